@@ -93,6 +93,12 @@ namespace pmon::util::cli
 		{
 			pOption_ = pParent->app_.add_option(std::move(names), data_, std::move(description));
 		}
+		Option(OptionsContainer* pParent, std::string names, const T& defaultValue, std::string description, CLI::Validator validator)
+			:
+			Option{ pParent, std::move(names), defaultValue, std::move(description) }
+		{
+			pOption_->check(std::move(validator));
+		}
 		Option(const Option&) = delete;
 		Option & operator=(const Option&) = delete;
 		Option(Option&&) = delete;
@@ -1,14 +1,51 @@
 // Copyright (C) 2022-2023 Intel Corporation
 // SPDX-License-Identifier: MIT
 #include "PresentMon.h"
+#include "CliOptions.h"
 
 #include <VersionHelpers.h>
 #include <shlwapi.h>
 #include <span>
+#include <glog/logging.h>
 
 static const std::wstring kEtlSessionName = L"ETLProcessing";
 static const std::wstring kRealTimeSessionName = L"PMService";
 
+// Logs the consumer's instrumentation counters, so that event rates, lost
+// presents, and memory use of a finished trace session can be checked in the
+// service log.
+static void LogConsumerStats(const PMTraceConsumer& pm_consumer) {
+  auto snapshot = std::make_unique<ConsumerStats::Snapshot>();
+  pm_consumer.mStats.GetSnapshot(snapshot.get());
+
+  for (uint32_t i = 0; i < ConsumerStats::Provider_Count; ++i) {
+    auto provider = (ConsumerStats::Provider)i;
+    if (auto event_count = snapshot->GetEventCount(provider); event_count > 0) {
+      LOG(INFO) << "Consumer stats: " << ConsumerStats::GetProviderName(provider)
+                << " events=" << event_count
+                << " ns/event=" << snapshot->GetHandlerAverageNs(provider);
+    }
+  }
+  LOG(INFO) << "Consumer stats: lost presents="
+            << snapshot->GetLostPresentCount();
+  for (uint32_t i = 0; i < ConsumerStats::LostPresent_Count; ++i) {
+    if (snapshot->mLostPresentCount[i] > 0) {
+      LOG(INFO) << "Consumer stats:   "
+                << ConsumerStats::GetLostPresentReasonName(
+                       (ConsumerStats::LostPresentReason)i)
+                << "=" << snapshot->mLostPresentCount[i];
+    }
+  }
+  for (uint32_t i = 0; i < ConsumerStats::Container_Count; ++i) {
+    LOG(INFO) << "Consumer stats: peak "
+              << ConsumerStats::GetContainerName((ConsumerStats::Container)i)
+              << "=" << snapshot->mPeakSize[i];
+  }
+  LOG(INFO) << "Consumer stats: memory budget="
+            << (snapshot->mMemoryBudget >> 10) << "KB peak footprint="
+            << (snapshot->mPeakMemoryFootprint >> 10) << "KB";
+}
+
 PresentMonSession::PresentMonSession()
     : target_process_count_(0),
       quit_output_thread_(false),
@@ -48,6 +85,13 @@ PM_STATUS PresentMonSession::StartTraceSession() {
   pm_consumer_->mTrackInput = true;
   pm_consumer_->mTrackFrameType = true;
 
+  if (auto& opt = clio::Options::Get(); opt.memoryBudget && *opt.memoryBudget > 0) {
+    // Budgets that don't fit in a size_t (on 32-bit builds) are clamped; the
+    // consumer's rings are capped well below that anyway.
+    auto memoryBudget = (uint64_t)*opt.memoryBudget << 20;
+    pm_consumer_->SetMemoryBudget(memoryBudget > SIZE_MAX ? SIZE_MAX : (size_t)memoryBudget);
+  }
+
   const wchar_t* etl_file_name = nullptr;
   if (etl_file_name_.size() > 0) {
     etl_file_name = etl_file_name_.c_str();
@@ -105,6 +149,7 @@ void PresentMonSession::StopTraceSession() {
   }
 
   if (pm_consumer_) {
+    LogConsumerStats(*pm_consumer_);
     pm_consumer_.reset();
   }
 }
@@ -503,8 +548,9 @@ void PresentMonSession::Output() {
     // Update tracking information.
     CheckForTerminatedRealtimeProcesses(&terminatedProcesses);
 
-    // Sleep to reduce overhead.
-    Sleep(100);
+    // Wait until more presents are ready, but no longer than 100ms so that
+    // process terminations and quit requests are still handled promptly.
+    pm_consumer_->WaitForPresentEvents(100);
   }
 
   // Process handles
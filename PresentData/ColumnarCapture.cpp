@@ -0,0 +1,674 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include "ColumnarCapture.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+namespace {
+
+enum : size_t {
+    ALIGNMENT = 8,
+};
+
+size_t Align(size_t size)
+{
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+ColumnarEncoding GetColumnEncoding(ColumnarColumn column)
+{
+    switch (column) {
+    case COLUMNAR_APPLICATION:
+    case COLUMNAR_PROCESS_ID:
+    case COLUMNAR_SWAP_CHAIN_ADDRESS:
+    case COLUMNAR_PRESENT_RUNTIME:
+    case COLUMNAR_SYNC_INTERVAL:
+    case COLUMNAR_PRESENT_FLAGS:
+    case COLUMNAR_ALLOWS_TEARING:
+    case COLUMNAR_PRESENT_MODE:
+    case COLUMNAR_FRAME_TYPE:       return COLUMNAR_ENCODING_RLE;
+    case COLUMNAR_CPU_START:        return COLUMNAR_ENCODING_DELTA;
+    default:                        return COLUMNAR_ENCODING_TICKS;
+    }
+}
+
+size_t GetColumnWidth(ColumnarColumn column)
+{
+    switch (column) {
+    case COLUMNAR_APPLICATION:
+    case COLUMNAR_PROCESS_ID:
+    case COLUMNAR_PRESENT_RUNTIME:
+    case COLUMNAR_SYNC_INTERVAL:
+    case COLUMNAR_PRESENT_FLAGS:
+    case COLUMNAR_ALLOWS_TEARING:
+    case COLUMNAR_PRESENT_MODE:
+    case COLUMNAR_FRAME_TYPE:       return 4;
+    default:                        return 8;
+    }
+}
+
+uint64_t DoubleToBits(double value)
+{
+    uint64_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+double BitsToDouble(uint64_t bits)
+{
+    double value = 0.0;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Metrics are computed like PMTraceSession::TimestampDeltaToMilliSeconds(), so the writer and
+// reader must convert ticks to milliseconds exactly the same way.
+double TicksToMilliSeconds(int64_t ticks, uint64_t timestampFrequency)
+{
+    return timestampFrequency == 0 ? 0.0 : 1000.0 * ticks / (double) timestampFrequency;
+}
+
+// Returns the nearest number of ticks to milliseconds, or 0 if it isn't representable (e.g., NaN).
+int64_t MilliSecondsToTicks(double milliseconds, uint64_t timestampFrequency)
+{
+    auto ticks = milliseconds * (double) timestampFrequency / 1000.0;
+    return fabs(ticks) < 9007199254740992.0 ? llround(ticks) : 0; // 2^53
+}
+
+uint64_t GetColumnValue(ColumnarFrame const& frame, ColumnarColumn column)
+{
+    switch (column) {
+    case COLUMNAR_APPLICATION:              return frame.mApplication;
+    case COLUMNAR_PROCESS_ID:               return frame.mProcessId;
+    case COLUMNAR_SWAP_CHAIN_ADDRESS:       return frame.mSwapChainAddress;
+    case COLUMNAR_PRESENT_RUNTIME:          return frame.mPresentRuntime;
+    case COLUMNAR_SYNC_INTERVAL:            return (uint32_t) frame.mSyncInterval;
+    case COLUMNAR_PRESENT_FLAGS:            return frame.mPresentFlags;
+    case COLUMNAR_ALLOWS_TEARING:           return frame.mAllowsTearing;
+    case COLUMNAR_PRESENT_MODE:             return frame.mPresentMode;
+    case COLUMNAR_FRAME_TYPE:               return frame.mFrameType;
+    case COLUMNAR_CPU_START:                return frame.mCPUStart;
+    case COLUMNAR_CPU_BUSY:                 return DoubleToBits(frame.mCPUBusy);
+    case COLUMNAR_CPU_WAIT:                 return DoubleToBits(frame.mCPUWait);
+    case COLUMNAR_GPU_LATENCY:              return DoubleToBits(frame.mGPULatency);
+    case COLUMNAR_GPU_BUSY:                 return DoubleToBits(frame.mGPUBusy);
+    case COLUMNAR_GPU_WAIT:                 return DoubleToBits(frame.mGPUWait);
+    case COLUMNAR_VIDEO_BUSY:               return DoubleToBits(frame.mVideoBusy);
+    case COLUMNAR_DISPLAY_LATENCY:          return DoubleToBits(frame.mDisplayLatency);
+    case COLUMNAR_DISPLAYED_TIME:           return DoubleToBits(frame.mDisplayedTime);
+    case COLUMNAR_CLICK_TO_PHOTON_LATENCY:  return DoubleToBits(frame.mClickToPhotonLatency);
+    }
+    return 0;
+}
+
+void SetColumnValue(ColumnarFrame* frame, ColumnarColumn column, uint64_t value)
+{
+    switch (column) {
+    case COLUMNAR_APPLICATION:              frame->mApplication          = (uint32_t) value; break;
+    case COLUMNAR_PROCESS_ID:               frame->mProcessId            = (uint32_t) value; break;
+    case COLUMNAR_SWAP_CHAIN_ADDRESS:       frame->mSwapChainAddress     = value; break;
+    case COLUMNAR_PRESENT_RUNTIME:          frame->mPresentRuntime       = (uint32_t) value; break;
+    case COLUMNAR_SYNC_INTERVAL:            frame->mSyncInterval         = (int32_t) (uint32_t) value; break;
+    case COLUMNAR_PRESENT_FLAGS:            frame->mPresentFlags         = (uint32_t) value; break;
+    case COLUMNAR_ALLOWS_TEARING:           frame->mAllowsTearing        = (uint32_t) value; break;
+    case COLUMNAR_PRESENT_MODE:             frame->mPresentMode          = (uint32_t) value; break;
+    case COLUMNAR_FRAME_TYPE:               frame->mFrameType            = (uint32_t) value; break;
+    case COLUMNAR_CPU_START:                frame->mCPUStart             = value; break;
+    case COLUMNAR_CPU_BUSY:                 frame->mCPUBusy              = BitsToDouble(value); break;
+    case COLUMNAR_CPU_WAIT:                 frame->mCPUWait              = BitsToDouble(value); break;
+    case COLUMNAR_GPU_LATENCY:              frame->mGPULatency           = BitsToDouble(value); break;
+    case COLUMNAR_GPU_BUSY:                 frame->mGPUBusy              = BitsToDouble(value); break;
+    case COLUMNAR_GPU_WAIT:                 frame->mGPUWait              = BitsToDouble(value); break;
+    case COLUMNAR_VIDEO_BUSY:               frame->mVideoBusy            = BitsToDouble(value); break;
+    case COLUMNAR_DISPLAY_LATENCY:          frame->mDisplayLatency       = BitsToDouble(value); break;
+    case COLUMNAR_DISPLAYED_TIME:           frame->mDisplayedTime        = BitsToDouble(value); break;
+    case COLUMNAR_CLICK_TO_PHOTON_LATENCY:  frame->mClickToPhotonLatency = BitsToDouble(value); break;
+    }
+}
+
+void Append(std::vector<char>* out, void const* data, size_t size)
+{
+    out->insert(out->end(), (char const*) data, (char const*) data + size);
+}
+
+// Values are stored little-endian using the column's width.
+void AppendValue(std::vector<char>* out, uint64_t value, size_t width)
+{
+    Append(out, &value, width);
+}
+
+void AppendVarint(std::vector<char>* out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out->push_back((char) (value | 0x80));
+        value >>= 7;
+    }
+    out->push_back((char) value);
+}
+
+uint64_t ZigZag(int64_t value)
+{
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+int64_t UnZigZag(uint64_t value)
+{
+    return (int64_t) ((value >> 1) ^ (0 - (value & 1)));
+}
+
+// Reads a LEB128 value at data[*offset], returning false if it is truncated or too long.
+bool ReadVarint(char const* data, size_t size, size_t* offset, uint64_t* value)
+{
+    *value = 0;
+    for (uint32_t shift = 0; ; shift += 7) {
+        if (*offset == size || shift > 63) {
+            return false;
+        }
+        auto b = (uint8_t) data[(*offset)++];
+        *value |= (uint64_t) (b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            return true;
+        }
+    }
+}
+
+// Pads out so that the file offset of its end is aligned.
+void Pad(std::vector<char>* out, uint64_t outOffset)
+{
+    auto size = (size_t) (outOffset + out->size());
+    out->resize(out->size() + Align(size) - size, 0);
+}
+
+void EncodeColumn(std::vector<char>* out, std::vector<ColumnarFrame> const& frames, ColumnarColumn column, uint64_t timestampFrequency)
+{
+    auto width = GetColumnWidth(column);
+    auto frameCount = frames.size();
+
+    switch (GetColumnEncoding(column)) {
+    case COLUMNAR_ENCODING_RAW:
+        for (auto const& frame : frames) {
+            AppendValue(out, GetColumnValue(frame, column), width);
+        }
+        break;
+
+    case COLUMNAR_ENCODING_RLE:
+        for (size_t i = 0; i < frameCount; ) {
+            auto value = GetColumnValue(frames[i], column);
+            uint32_t count = 1;
+            for (++i; i < frameCount && GetColumnValue(frames[i], column) == value; ++i) {
+                count += 1;
+            }
+            AppendVarint(out, value);
+            AppendVarint(out, count);
+        }
+        break;
+
+    case COLUMNAR_ENCODING_DELTA: {
+        uint64_t prev = GetColumnValue(frames[0], column);
+        AppendValue(out, prev, width);
+        for (size_t i = 1; i < frameCount; ++i) {
+            auto value = GetColumnValue(frames[i], column);
+            AppendVarint(out, ZigZag((int64_t) (value - prev)));
+            prev = value;
+        }
+    }   break;
+
+    case COLUMNAR_ENCODING_TICKS: {
+        // Ticks are within +/-2^53, so the zig-zag delta still fits after shifting in the flag.
+        int64_t prevTicks = 0;
+        for (auto const& frame : frames) {
+            auto bits = GetColumnValue(frame, column);
+            auto ticks = MilliSecondsToTicks(BitsToDouble(bits), timestampFrequency);
+            auto diff = bits ^ DoubleToBits(TicksToMilliSeconds(ticks, timestampFrequency));
+            AppendVarint(out, (ZigZag(ticks - prevTicks) << 1) | (diff == 0 ? 0 : 1));
+            if (diff != 0) {
+                AppendVarint(out, diff);
+            }
+            prevTicks = ticks;
+        }
+    }   break;
+    }
+}
+
+// Decodes one column of a chunk into frames, returning false if the data is malformed.
+bool DecodeColumn(char const* data, size_t size, uint8_t encoding, ColumnarColumn column, uint64_t timestampFrequency, std::vector<ColumnarFrame>* frames)
+{
+    auto width = GetColumnWidth(column);
+    auto frameCount = frames->size();
+
+    switch (encoding) {
+    case COLUMNAR_ENCODING_RAW:
+        if (size != frameCount * width) {
+            return false;
+        }
+        for (size_t i = 0; i < frameCount; ++i) {
+            uint64_t value = 0;
+            memcpy(&value, data + i * width, width);
+            SetColumnValue(&(*frames)[i], column, value);
+        }
+        return true;
+
+    case COLUMNAR_ENCODING_RLE: {
+        size_t i = 0;
+        for (size_t offset = 0; offset < size; ) {
+            uint64_t value = 0;
+            uint64_t count = 0;
+            if (!ReadVarint(data, size, &offset, &value) ||
+                !ReadVarint(data, size, &offset, &count) ||
+                count == 0 || count > frameCount - i) {
+                return false;
+            }
+            for (; count > 0; --count, ++i) {
+                SetColumnValue(&(*frames)[i], column, value);
+            }
+        }
+        return i == frameCount;
+    }
+
+    case COLUMNAR_ENCODING_DELTA: {
+        if (frameCount == 0 || size < width) {
+            return false;
+        }
+        uint64_t value = 0;
+        memcpy(&value, data, width);
+        SetColumnValue(&(*frames)[0], column, value);
+
+        size_t offset = width;
+        for (size_t i = 1; i < frameCount; ++i) {
+            uint64_t zigzag = 0;
+            if (!ReadVarint(data, size, &offset, &zigzag)) {
+                return false;
+            }
+            value += (uint64_t) UnZigZag(zigzag);
+            SetColumnValue(&(*frames)[i], column, value);
+        }
+        return offset == size;
+    }
+
+    case COLUMNAR_ENCODING_TICKS: {
+        if (width != sizeof(double)) {
+            return false;
+        }
+        size_t offset = 0;
+        uint64_t ticks = 0;
+        for (size_t i = 0; i < frameCount; ++i) {
+            uint64_t tag = 0;
+            uint64_t diff = 0;
+            if (!ReadVarint(data, size, &offset, &tag) ||
+                ((tag & 1) != 0 && !ReadVarint(data, size, &offset, &diff))) {
+                return false;
+            }
+            ticks += (uint64_t) UnZigZag(tag >> 1);
+            auto bits = DoubleToBits(TicksToMilliSeconds((int64_t) ticks, timestampFrequency)) ^ diff;
+            SetColumnValue(&(*frames)[i], column, bits);
+        }
+        return offset == size;
+    }
+    }
+
+    return false;
+}
+
+// Appends count NUL-terminated strings from data to strings, returning false if they don't fit in
+// size.
+bool ParseStrings(char const* data, size_t size, uint32_t count, std::vector<std::string>* strings)
+{
+    size_t offset = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        auto end = (char const*) memchr(data + offset, '\0', size - offset);
+        if (end == nullptr) {
+            return false;
+        }
+        strings->emplace_back(data + offset, end);
+        offset = (size_t) (end - data) + 1;
+    }
+    return true;
+}
+
+}
+
+void ColumnarCaptureWriter::Begin(ColumnarFileHeader const& header)
+{
+    mHeader = header;
+    mHeader.mMagic = COLUMNAR_MAGIC;
+    mHeader.mVersion = COLUMNAR_VERSION;
+
+    mOutput.clear();
+    mOutputOffset = 0;
+    mFrames.clear();
+    mFrames.reserve(COLUMNAR_CHUNK_FRAMES);
+    mStringIndex.clear();
+    mStrings.clear();
+    mFirstNewString = 0;
+    mChunks.clear();
+
+    Append(&mOutput, &mHeader, sizeof(mHeader));
+}
+
+uint32_t ColumnarCaptureWriter::GetStringIndex(std::string const& s)
+{
+    auto ii = mStringIndex.emplace(s, (uint32_t) mStrings.size());
+    if (ii.second) {
+        mStrings.emplace_back(s);
+    }
+    return ii.first->second;
+}
+
+void ColumnarCaptureWriter::AddFrame(ColumnarFrame const& frame)
+{
+    mFrames.emplace_back(frame);
+    if (mFrames.size() == COLUMNAR_CHUNK_FRAMES) {
+        EncodeChunk();
+    }
+}
+
+void ColumnarCaptureWriter::EncodeChunk()
+{
+    if (mFrames.empty()) {
+        return;
+    }
+
+    auto chunkStart = mOutput.size();
+
+    ColumnarChunkHeader header = {};
+    header.mMagic          = COLUMNAR_CHUNK_MAGIC;
+    header.mFrameCount     = (uint32_t) mFrames.size();
+    header.mNewStringCount = (uint32_t) mStrings.size() - mFirstNewString;
+    header.mMinCPUStart    = UINT64_MAX;
+    header.mMaxCPUStart    = 0;
+    for (auto const& frame : mFrames) {
+        header.mMinCPUStart = std::min(header.mMinCPUStart, frame.mCPUStart);
+        header.mMaxCPUStart = std::max(header.mMaxCPUStart, frame.mCPUStart);
+    }
+    for (uint32_t i = 0; i < COLUMNAR_COLUMN_COUNT; ++i) {
+        if (mHeader.mColumnMask & (1u << i)) {
+            header.mColumnCount += 1;
+        }
+    }
+    Append(&mOutput, &header, sizeof(header));
+
+    // Strings added to the dictionary since the last chunk.
+    auto stringsStart = mOutput.size();
+    for (size_t i = mFirstNewString, n = mStrings.size(); i < n; ++i) {
+        Append(&mOutput, mStrings[i].c_str(), mStrings[i].size() + 1);
+    }
+    header.mNewStringSize = (uint32_t) (mOutput.size() - stringsStart);
+    memcpy(mOutput.data() + chunkStart, &header, sizeof(header));
+    Pad(&mOutput, mOutputOffset);
+
+    for (uint32_t i = 0; i < COLUMNAR_COLUMN_COUNT; ++i) {
+        if (mHeader.mColumnMask & (1u << i)) {
+            auto column = (ColumnarColumn) i;
+
+            ColumnarColumnHeader columnHeader = {};
+            columnHeader.mColumn   = column;
+            columnHeader.mEncoding = GetColumnEncoding(column);
+
+            auto columnStart = mOutput.size();
+            Append(&mOutput, &columnHeader, sizeof(columnHeader));
+            EncodeColumn(&mOutput, mFrames, column, mHeader.mTimestampFrequency);
+
+            columnHeader.mSize = (uint32_t) (mOutput.size() - columnStart - sizeof(columnHeader));
+            memcpy(mOutput.data() + columnStart, &columnHeader, sizeof(columnHeader));
+            Pad(&mOutput, mOutputOffset);
+        }
+    }
+
+    ColumnarChunkIndexEntry entry = {};
+    entry.mOffset      = mOutputOffset + chunkStart;
+    entry.mMinCPUStart = header.mMinCPUStart;
+    entry.mMaxCPUStart = header.mMaxCPUStart;
+    entry.mFrameCount  = header.mFrameCount;
+    entry.mSize        = (uint32_t) (mOutput.size() - chunkStart);
+    mChunks.emplace_back(entry);
+
+    mFrames.clear();
+    mFirstNewString = (uint32_t) mStrings.size();
+}
+
+void ColumnarCaptureWriter::End()
+{
+    EncodeChunk();
+
+    ColumnarFileFooter footer = {};
+    footer.mMagic       = COLUMNAR_FOOTER_MAGIC;
+    footer.mStringCount = (uint32_t) mStrings.size();
+    footer.mChunkCount  = (uint32_t) mChunks.size();
+
+    footer.mDictionaryOffset = mOutputOffset + mOutput.size();
+    for (auto const& s : mStrings) {
+        Append(&mOutput, s.c_str(), s.size() + 1);
+    }
+    footer.mDictionarySize = (uint32_t) (mOutputOffset + mOutput.size() - footer.mDictionaryOffset);
+    Pad(&mOutput, mOutputOffset);
+
+    footer.mIndexOffset = mOutputOffset + mOutput.size();
+    if (!mChunks.empty()) {
+        Append(&mOutput, mChunks.data(), mChunks.size() * sizeof(ColumnarChunkIndexEntry));
+    }
+
+    Append(&mOutput, &footer, sizeof(footer));
+}
+
+ColumnarCaptureReader::~ColumnarCaptureReader()
+{
+    if (mFile != nullptr) {
+        fclose(mFile);
+    }
+}
+
+bool ColumnarCaptureReader::Open(wchar_t const* path)
+{
+    assert(mFile == nullptr);
+
+    if (_wfopen_s(&mFile, path, L"rb") != 0) {
+        mFile = nullptr;
+        return false;
+    }
+
+    _fseeki64(mFile, 0, SEEK_END);
+    mFileSize = (uint64_t) _ftelli64(mFile);
+    mData.clear();
+    return Load();
+}
+
+bool ColumnarCaptureReader::Open(std::vector<char>&& data)
+{
+    assert(mFile == nullptr);
+
+    mData = std::move(data);
+    mFileSize = mData.size();
+    return Load();
+}
+
+bool ColumnarCaptureReader::ReadAt(uint64_t offset, void* data, size_t size)
+{
+    if (offset > mFileSize || size > mFileSize - offset) {
+        return false;
+    }
+    if (size == 0) {
+        return true;
+    }
+
+    if (mFile == nullptr) {
+        memcpy(data, mData.data() + offset, size);
+        return true;
+    }
+
+    return _fseeki64(mFile, (int64_t) offset, SEEK_SET) == 0 &&
+           fread(data, 1, size, mFile) == size;
+}
+
+bool ColumnarCaptureReader::Load()
+{
+    mStrings.clear();
+    mChunks.clear();
+    mHasFooter = false;
+
+    if (!ReadAt(0, &mHeader, sizeof(mHeader)) ||
+        mHeader.mMagic != COLUMNAR_MAGIC ||
+        mHeader.mVersion != COLUMNAR_VERSION) {
+        return false;
+    }
+
+    if (LoadFooter()) {
+        mHasFooter = true;
+        return true;
+    }
+
+    mStrings.clear();
+    mChunks.clear();
+    return ScanChunks();
+}
+
+bool ColumnarCaptureReader::LoadFooter()
+{
+    if (mFileSize < sizeof(mHeader) + sizeof(ColumnarFileFooter)) {
+        return false;
+    }
+
+    ColumnarFileFooter footer = {};
+    auto footerOffset = mFileSize - sizeof(footer);
+    if (!ReadAt(footerOffset, &footer, sizeof(footer)) ||
+        footer.mMagic != COLUMNAR_FOOTER_MAGIC ||
+        footer.mDictionaryOffset > footerOffset ||
+        footer.mDictionarySize > footerOffset - footer.mDictionaryOffset ||
+        footer.mIndexOffset > footerOffset ||
+        (uint64_t) footer.mChunkCount * sizeof(ColumnarChunkIndexEntry) != footerOffset - footer.mIndexOffset) {
+        return false;
+    }
+
+    std::vector<char> dictionary(footer.mDictionarySize);
+    if (!ReadAt(footer.mDictionaryOffset, dictionary.data(), dictionary.size()) ||
+        !ParseStrings(dictionary.data(), dictionary.size(), footer.mStringCount, &mStrings)) {
+        return false;
+    }
+
+    mChunks.resize(footer.mChunkCount);
+    if (!ReadAt(footer.mIndexOffset, mChunks.data(), mChunks.size() * sizeof(ColumnarChunkIndexEntry))) {
+        return false;
+    }
+    for (auto const& chunk : mChunks) {
+        if (chunk.mOffset > mFileSize || chunk.mSize > mFileSize - chunk.mOffset) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool ColumnarCaptureReader::ScanChunks()
+{
+    // Add every complete chunk, stopping at the first one that is truncated or malformed.
+    std::vector<char> strings;
+    for (uint64_t offset = sizeof(mHeader); ; ) {
+        ColumnarChunkHeader header = {};
+        if (!ReadAt(offset, &header, sizeof(header)) ||
+            header.mMagic != COLUMNAR_CHUNK_MAGIC) {
+            break;
+        }
+
+        strings.resize(header.mNewStringSize);
+        if (!ReadAt(offset + sizeof(header), strings.data(), strings.size())) {
+            break;
+        }
+
+        auto end = offset + sizeof(header) + Align(header.mNewStringSize);
+        auto complete = true;
+        for (uint32_t i = 0; i < header.mColumnCount; ++i) {
+            ColumnarColumnHeader columnHeader = {};
+            if (!ReadAt(end, &columnHeader, sizeof(columnHeader))) {
+                complete = false;
+                break;
+            }
+            end += sizeof(columnHeader) + Align(columnHeader.mSize);
+        }
+        if (!complete || end > mFileSize ||
+            !ParseStrings(strings.data(), strings.size(), header.mNewStringCount, &mStrings)) {
+            break;
+        }
+
+        ColumnarChunkIndexEntry entry = {};
+        entry.mOffset      = offset;
+        entry.mMinCPUStart = header.mMinCPUStart;
+        entry.mMaxCPUStart = header.mMaxCPUStart;
+        entry.mFrameCount  = header.mFrameCount;
+        entry.mSize        = (uint32_t) (end - offset);
+        mChunks.emplace_back(entry);
+
+        offset = end;
+    }
+
+    return true;
+}
+
+char const* ColumnarCaptureReader::GetString(uint32_t index) const
+{
+    return index < mStrings.size() ? mStrings[index].c_str() : "";
+}
+
+bool ColumnarCaptureReader::ReadChunk(size_t chunkIndex, std::vector<ColumnarFrame>* frames)
+{
+    frames->clear();
+    if (chunkIndex >= mChunks.size()) {
+        return false;
+    }
+
+    auto const& entry = mChunks[chunkIndex];
+    std::vector<char> data(entry.mSize);
+    if (!ReadAt(entry.mOffset, data.data(), data.size())) {
+        return false;
+    }
+
+    ColumnarChunkHeader header = {};
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.mMagic != COLUMNAR_CHUNK_MAGIC ||
+        header.mFrameCount != entry.mFrameCount ||
+        header.mFrameCount > COLUMNAR_CHUNK_FRAMES) {
+        return false;
+    }
+
+    frames->resize(header.mFrameCount, ColumnarFrame{});
+
+    auto offset = sizeof(header) + Align(header.mNewStringSize);
+    for (uint32_t i = 0; i < header.mColumnCount; ++i) {
+        ColumnarColumnHeader columnHeader = {};
+        if (offset + sizeof(columnHeader) > data.size()) {
+            return false;
+        }
+        memcpy(&columnHeader, data.data() + offset, sizeof(columnHeader));
+        offset += sizeof(columnHeader);
+
+        // Skip columns that this version doesn't know about.
+        if (columnHeader.mSize > data.size() - offset) {
+            return false;
+        }
+        if (columnHeader.mColumn < COLUMNAR_COLUMN_COUNT &&
+            !DecodeColumn(data.data() + offset, columnHeader.mSize, columnHeader.mEncoding, (ColumnarColumn) columnHeader.mColumn,
+                          mHeader.mTimestampFrequency, frames)) {
+            return false;
+        }
+        offset += Align(columnHeader.mSize);
+    }
+
+    return true;
+}
+
+size_t ColumnarCaptureReader::FindChunk(uint64_t timestamp) const
+{
+    // Frames are added roughly in CPUStart order, so check each chunk's range rather than binary
+    // searching.
+    for (size_t i = 0, n = mChunks.size(); i < n; ++i) {
+        if (mChunks[i].mMaxCPUStart >= timestamp) {
+            return i;
+        }
+    }
+    return mChunks.size();
+}
@@ -0,0 +1,210 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A columnar capture is a compact binary alternative to the per-frame CSV output, containing the
+// same per-frame columns.  Frames are grouped into chunks, and each chunk stores each of its
+// columns contiguously:
+//
+//     - Strings (the application name and the runtime, present mode and frame type names) are
+//       stored as indices into a dictionary of strings.
+//     - Columns that rarely change from frame to frame (e.g., the process id or swap chain
+//       address) are run-length encoded, with LEB128-encoded values and counts.
+//     - CPUStart timestamps are stored as zig-zag, LEB128-encoded deltas from the previous frame.
+//     - Metrics (doubles, in milliseconds) are converted to the nearest number of timestamp ticks,
+//       which are stored like CPUStart.  PresentMon computes most metrics from a tick count, so
+//       they convert back exactly; the rest also store the bits that differ (see
+//       COLUMNAR_ENCODING_TICKS).
+//
+// All fields are little-endian.  The file starts with a ColumnarFileHeader, followed by the
+// chunks, and then the footer.  Each chunk starts with a ColumnarChunkHeader and the strings that
+// were added to the dictionary since the previous chunk, followed by its columns.  The footer
+// contains the full dictionary, an index of the chunks (for random access), and finally a
+// ColumnarFileFooter.  All structures are 8-byte aligned.
+//
+// Because each chunk contains the strings it adds to the dictionary, a file whose footer wasn't
+// written (e.g., because PresentMon was terminated) can still be read by scanning the chunks.
+
+enum : uint32_t {
+    COLUMNAR_MAGIC        = 0x43434d50, // "PMCC"
+    COLUMNAR_CHUNK_MAGIC  = 0x4b484350, // "PCHK"
+    COLUMNAR_FOOTER_MAGIC = 0x46434d50, // "PMCF"
+    COLUMNAR_VERSION      = 2,
+    COLUMNAR_CHUNK_FRAMES = 16384,      // Maximum number of frames per chunk
+};
+
+enum ColumnarColumn : uint16_t {
+    COLUMNAR_APPLICATION,               // Dictionary index
+    COLUMNAR_PROCESS_ID,
+    COLUMNAR_SWAP_CHAIN_ADDRESS,
+    COLUMNAR_PRESENT_RUNTIME,           // Dictionary index
+    COLUMNAR_SYNC_INTERVAL,
+    COLUMNAR_PRESENT_FLAGS,
+    COLUMNAR_ALLOWS_TEARING,
+    COLUMNAR_PRESENT_MODE,              // Dictionary index
+    COLUMNAR_FRAME_TYPE,                // Dictionary index
+    COLUMNAR_CPU_START,                 // Timestamp
+    COLUMNAR_CPU_BUSY,
+    COLUMNAR_CPU_WAIT,
+    COLUMNAR_GPU_LATENCY,
+    COLUMNAR_GPU_BUSY,
+    COLUMNAR_GPU_WAIT,
+    COLUMNAR_VIDEO_BUSY,
+    COLUMNAR_DISPLAY_LATENCY,
+    COLUMNAR_DISPLAYED_TIME,
+    COLUMNAR_CLICK_TO_PHOTON_LATENCY,
+    COLUMNAR_COLUMN_COUNT
+};
+
+enum ColumnarEncoding : uint8_t {
+    COLUMNAR_ENCODING_RAW         = 1,  // Each value, using the column's width
+    COLUMNAR_ENCODING_RLE         = 2,  // { LEB128 value, LEB128 count } pairs
+    COLUMNAR_ENCODING_DELTA       = 3,  // First value, then zig-zag LEB128 deltas from the previous value
+    COLUMNAR_ENCODING_TICKS       = 4,  // For each double, LEB128 (zig-zag tick delta << 1 | has XOR),
+                                        // and if has XOR, LEB128 (value bits ^ bits of the ticks' value)
+};
+
+struct ColumnarFileHeader {
+    uint32_t mMagic;
+    uint32_t mVersion;
+    uint64_t mTimestampFrequency;
+    uint64_t mStartTimestamp;
+    uint64_t mStartFileTime;
+    uint32_t mTimestampType;            // PMTraceSession::TimestampType
+    uint32_t mColumnMask;               // (1 << ColumnarColumn) for each column in the file
+    uint32_t mTimeUnit;                 // How the capturing application output CPUStart
+    uint32_t mReserved;
+};
+
+struct ColumnarChunkHeader {
+    uint32_t mMagic;
+    uint32_t mFrameCount;
+    uint32_t mColumnCount;
+    uint32_t mNewStringCount;           // Number of strings added to the dictionary
+    uint32_t mNewStringSize;            // Size of the NUL-terminated strings, excluding padding
+    uint32_t mReserved;
+    uint64_t mMinCPUStart;
+    uint64_t mMaxCPUStart;
+};
+
+struct ColumnarColumnHeader {
+    uint16_t mColumn;                   // ColumnarColumn
+    uint8_t mEncoding;                  // ColumnarEncoding
+    uint8_t mReserved;
+    uint32_t mSize;                     // Size of the encoded data, excluding padding
+};
+
+struct ColumnarChunkIndexEntry {
+    uint64_t mOffset;                   // File offset of the ColumnarChunkHeader
+    uint64_t mMinCPUStart;
+    uint64_t mMaxCPUStart;
+    uint32_t mFrameCount;
+    uint32_t mSize;                     // Size of the chunk, including all its columns
+};
+
+struct ColumnarFileFooter {
+    uint64_t mDictionaryOffset;         // File offset of the NUL-terminated dictionary strings
+    uint64_t mIndexOffset;              // File offset of the ColumnarChunkIndexEntry array
+    uint32_t mStringCount;
+    uint32_t mChunkCount;
+    uint32_t mDictionarySize;
+    uint32_t mMagic;
+};
+
+static_assert(sizeof(ColumnarFileHeader) == 48, "Unexpected ColumnarFileHeader layout");
+static_assert(sizeof(ColumnarChunkHeader) == 40, "Unexpected ColumnarChunkHeader layout");
+static_assert(sizeof(ColumnarColumnHeader) == 8, "Unexpected ColumnarColumnHeader layout");
+static_assert(sizeof(ColumnarChunkIndexEntry) == 32, "Unexpected ColumnarChunkIndexEntry layout");
+static_assert(sizeof(ColumnarFileFooter) == 32, "Unexpected ColumnarFileFooter layout");
+
+// The columns of one frame.  Dictionary indices are obtained from ColumnarCaptureWriter::GetStringIndex()
+// and looked up with ColumnarCaptureReader::GetString().
+struct ColumnarFrame {
+    uint32_t mApplication;
+    uint32_t mProcessId;
+    uint64_t mSwapChainAddress;
+    uint32_t mPresentRuntime;
+    int32_t mSyncInterval;
+    uint32_t mPresentFlags;
+    uint32_t mAllowsTearing;
+    uint32_t mPresentMode;
+    uint32_t mFrameType;
+    uint64_t mCPUStart;
+    double mCPUBusy;
+    double mCPUWait;
+    double mGPULatency;
+    double mGPUBusy;
+    double mGPUWait;
+    double mVideoBusy;
+    double mDisplayLatency;
+    double mDisplayedTime;
+    double mClickToPhotonLatency;
+};
+
+// ColumnarCaptureWriter encodes frames into a columnar capture.  It doesn't do any I/O itself: the
+// encoded file is appended to mOutput, which the caller should write out and clear whenever it is
+// convenient (e.g., when it exceeds some size).
+struct ColumnarCaptureWriter {
+    std::vector<char> mOutput;          // Encoded data that hasn't been written out yet
+    uint64_t mOutputOffset = 0;         // File offset of mOutput[0]
+    ColumnarFileHeader mHeader = {};
+    std::vector<ColumnarFrame> mFrames; // Frames in the current chunk
+    std::unordered_map<std::string, uint32_t> mStringIndex;
+    std::vector<std::string> mStrings;
+    uint32_t mFirstNewString = 0;       // Strings from here on haven't been written to a chunk yet
+    std::vector<ColumnarChunkIndexEntry> mChunks;
+
+    // Begin a new file.  header.mMagic and header.mVersion are set by the writer.
+    void Begin(ColumnarFileHeader const& header);
+
+    uint32_t GetStringIndex(std::string const& s);
+
+    // Add a frame, encoding the current chunk into mOutput when it is full.  Columns that are not
+    // in the header's mColumnMask are ignored.
+    void AddFrame(ColumnarFrame const& frame);
+
+    // Encode the last chunk and the footer into mOutput.
+    void End();
+
+    void EncodeChunk();
+};
+
+// ColumnarCaptureReader provides random access to the chunks of a columnar capture.
+struct ColumnarCaptureReader {
+    FILE* mFile = nullptr;
+    std::vector<char> mData;            // The whole file, if opened from memory
+    uint64_t mFileSize = 0;
+    ColumnarFileHeader mHeader = {};
+    std::vector<std::string> mStrings;
+    std::vector<ColumnarChunkIndexEntry> mChunks;
+    bool mHasFooter = false;            // False if the chunks had to be found by scanning the file
+
+    ColumnarCaptureReader() = default;
+    ColumnarCaptureReader(ColumnarCaptureReader const&) = delete;
+    ColumnarCaptureReader& operator=(ColumnarCaptureReader const&) = delete;
+    ~ColumnarCaptureReader();
+
+    // Reads the header, dictionary, and chunk index.  Returns false if the file isn't a valid
+    // columnar capture.
+    bool Open(wchar_t const* path);
+    bool Open(std::vector<char>&& data);
+
+    char const* GetString(uint32_t index) const;
+
+    // Decodes all the frames in the chunk.  Columns that are not in the file are set to 0.
+    bool ReadChunk(size_t chunkIndex, std::vector<ColumnarFrame>* frames);
+
+    // Returns the index of the first chunk that may contain frames with CPUStart >= timestamp.
+    size_t FindChunk(uint64_t timestamp) const;
+
+    bool Load();
+    bool LoadFooter();
+    bool ScanChunks();
+    bool ReadAt(uint64_t offset, void* data, size_t size);
+};
@@ -0,0 +1,152 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include "ConsumerStats.hpp"
+#include "Debug.hpp"
+
+#include <windows.h>
+
+namespace {
+
+void Reset(std::atomic<uint64_t>* counters, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        counters[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void Copy(uint64_t* dst, std::atomic<uint64_t> const* counters, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = counters[i].load(std::memory_order_relaxed);
+    }
+}
+
+}
+
+ConsumerStats::ConsumerStats()
+    : mSampleCountdown(HANDLER_SAMPLE_INTERVAL)
+{
+    Reset(&mEventCount[0][0], Provider_Count * EVENT_ID_COUNT);
+    Reset(mHandlerSampleCount, Provider_Count);
+    Reset(mHandlerSampleTicks, Provider_Count);
+    Reset(mLostPresentCount, LostPresent_Count);
+    Reset(mPeakSize, Container_Count);
+    Reset(&mMemoryBudget, 1);
+    Reset(&mMemoryFootprint, 1);
+    Reset(&mPeakMemoryFootprint, 1);
+
+    LARGE_INTEGER frequency = {};
+    QueryPerformanceFrequency(&frequency);
+    mQpcFrequency = frequency.QuadPart;
+}
+
+void ConsumerStats::GetSnapshot(Snapshot* snapshot) const
+{
+    Copy(&snapshot->mEventCount[0][0], &mEventCount[0][0], Provider_Count * EVENT_ID_COUNT);
+    Copy(snapshot->mHandlerSampleCount, mHandlerSampleCount, Provider_Count);
+    Copy(snapshot->mLostPresentCount, mLostPresentCount, LostPresent_Count);
+    Copy(snapshot->mPeakSize, mPeakSize, Container_Count);
+    Copy(&snapshot->mMemoryBudget, &mMemoryBudget, 1);
+    Copy(&snapshot->mMemoryFootprint, &mMemoryFootprint, 1);
+    Copy(&snapshot->mPeakMemoryFootprint, &mPeakMemoryFootprint, 1);
+
+    for (uint32_t i = 0; i < Provider_Count; ++i) {
+        auto ticks = mHandlerSampleTicks[i].load(std::memory_order_relaxed);
+        snapshot->mHandlerSampleNs[i] = mQpcFrequency == 0 ? 0 : (uint64_t) ((double) ticks * 1000000000.0 / (double) mQpcFrequency);
+    }
+}
+
+uint64_t ConsumerStats::Snapshot::GetEventCount(Provider provider) const
+{
+    uint64_t count = 0;
+    for (uint32_t i = 0; i < EVENT_ID_COUNT; ++i) {
+        count += mEventCount[provider][i];
+    }
+    return count;
+}
+
+uint64_t ConsumerStats::Snapshot::GetLostPresentCount() const
+{
+    uint64_t count = 0;
+    for (uint32_t i = 0; i < LostPresent_Count; ++i) {
+        count += mLostPresentCount[i];
+    }
+    return count;
+}
+
+uint64_t ConsumerStats::Snapshot::GetEvictionCount() const
+{
+    return mLostPresentCount[LostPresent_TrackingRingWrap] +
+           mLostPresentCount[LostPresent_CompletedRingOverflow];
+}
+
+double ConsumerStats::Snapshot::GetHandlerAverageNs(Provider provider) const
+{
+    return mHandlerSampleCount[provider] == 0 ? 0.0 : (double) mHandlerSampleNs[provider] / (double) mHandlerSampleCount[provider];
+}
+
+double ConsumerStats::Snapshot::GetHandlerTotalNs(Provider provider) const
+{
+    return GetHandlerAverageNs(provider) * (double) GetEventCount(provider);
+}
+
+char const* ConsumerStats::GetProviderName(Provider provider)
+{
+    switch (provider) {
+    case Provider_DxgKrnl:          return "Microsoft-Windows-DxgKrnl";
+    case Provider_DXGI:             return "Microsoft-Windows-DXGI";
+    case Provider_Win32k:           return "Microsoft-Windows-Win32k";
+    case Provider_Dwm:              return "Microsoft-Windows-Dwm-Core";
+    case Provider_D3D9:             return "Microsoft-Windows-D3D9";
+    case Provider_Process:          return "Process";
+    case Provider_EventMetadata:    return "EventMetadata";
+    case Provider_IntelPresentMon:  return "Intel-PresentMon";
+    case Provider_Win7:             return "Win7";
+    case Provider_Other:            return "Other";
+    }
+
+    DebugAssert(false);
+    return "Unknown";
+}
+
+char const* ConsumerStats::GetLostPresentReasonName(LostPresentReason reason)
+{
+    switch (reason) {
+    case LostPresent_TrackingRingWrap:      return "TrackingRingWrap";
+    case LostPresent_CompletedRingOverflow: return "CompletedRingOverflow";
+    case LostPresent_DeferralTimeout:       return "DeferralTimeout";
+    case LostPresent_UnexpectedEvent:       return "UnexpectedEvent";
+    case LostPresent_ThreadReused:          return "ThreadReused";
+    case LostPresent_DuplicateToken:        return "DuplicateToken";
+    case LostPresent_Unsupported:           return "Unsupported";
+    case LostPresent_StartupDiscard:        return "StartupDiscard";
+    }
+
+    DebugAssert(false);
+    return "Unknown";
+}
+
+char const* ConsumerStats::GetContainerName(Container container)
+{
+    switch (container) {
+    case Container_TrackedPresents:                     return "TrackedPresents";
+    case Container_CompletedPresents:                   return "CompletedPresents";
+    case Container_ReadyPresents:                       return "ReadyPresents";
+    case Container_PresentByThreadId:                   return "PresentByThreadId";
+    case Container_OrderedPresentsByProcessId:          return "OrderedPresentsByProcessId";
+    case Container_PresentBySubmitSequence:             return "PresentBySubmitSequence";
+    case Container_PresentByWin32KPresentHistoryToken:  return "PresentByWin32KPresentHistoryToken";
+    case Container_PresentByDxgkPresentHistoryToken:    return "PresentByDxgkPresentHistoryToken";
+    case Container_PresentByDxgkPresentHistoryTokenData:return "PresentByDxgkPresentHistoryTokenData";
+    case Container_PresentByDxgkContext:                return "PresentByDxgkContext";
+    case Container_PresentByVidPnLayerId:               return "PresentByVidPnLayerId";
+    case Container_LastPresentByWindow:                 return "LastPresentByWindow";
+    case Container_PresentsWaitingForDWM:               return "PresentsWaitingForDWM";
+    case Container_PendingPresentFrameTypeEvents:       return "PendingPresentFrameTypeEvents";
+    case Container_PendingFlipFrameTypeEvents:          return "PendingFlipFrameTypeEvents";
+    }
+
+    DebugAssert(false);
+    return "Unknown";
+}
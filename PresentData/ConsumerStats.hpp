@@ -0,0 +1,168 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// ConsumerStats are always-on counters that PMTraceConsumer maintains while it analyzes events:
+// the number of events handled from each provider, a sample of how long the handlers take, the
+// number of presents that were lost (by reason), the peak size of each of the consumer's
+// tracking structures, and an estimate of the memory they use.  They are intended to help explain
+// lost presents and to size the consumer's buffers.
+//
+// The counters are only written by the thread processing events, using relaxed loads and stores
+// rather than read-modify-write operations, so they cost about the same as plain integers.  Any
+// thread can call GetSnapshot() at any time; each value in the snapshot is consistent, but the
+// values may be from slightly different points in the analysis.
+struct ConsumerStats {
+    enum Provider {
+        Provider_DxgKrnl,
+        Provider_DXGI,
+        Provider_Win32k,
+        Provider_Dwm,
+        Provider_D3D9,
+        Provider_Process,           // Microsoft-Windows-Kernel-Process and NT Process
+        Provider_EventMetadata,
+        Provider_IntelPresentMon,
+        Provider_Win7,              // Win7 DxgKrnl and Dwm providers
+        Provider_Other,             // Events that weren't handled
+        Provider_Count
+    };
+
+    enum LostPresentReason {
+        LostPresent_TrackingRingWrap,       // Still in progress when the tracked present ring wrapped around
+        LostPresent_CompletedRingOverflow,  // Completed, but dropped because the completed present ring was full
+        LostPresent_DeferralTimeout,        // Deferred for longer than mDeferralTimeLimit
+        LostPresent_UnexpectedEvent,        // Received an event that doesn't fit its present path
+        LostPresent_ThreadReused,           // Its thread started another present before it was done
+        LostPresent_DuplicateToken,         // Another present was given the same present history token
+        LostPresent_Unsupported,            // Uses an unsupported present path
+        LostPresent_StartupDiscard,         // Still in progress when the first present was completed
+        LostPresent_Count
+    };
+
+    enum Container {
+        Container_TrackedPresents,                      // Number of in-progress presents
+        Container_CompletedPresents,                    // Number of completed presents not yet ready
+        Container_ReadyPresents,                        // Number of ready presents not yet dequeued
+        Container_PresentByThreadId,
+        Container_OrderedPresentsByProcessId,           // Number of processes
+        Container_PresentBySubmitSequence,
+        Container_PresentByWin32KPresentHistoryToken,
+        Container_PresentByDxgkPresentHistoryToken,
+        Container_PresentByDxgkPresentHistoryTokenData,
+        Container_PresentByDxgkContext,
+        Container_PresentByVidPnLayerId,
+        Container_LastPresentByWindow,
+        Container_PresentsWaitingForDWM,
+        Container_PendingPresentFrameTypeEvents,
+        Container_PendingFlipFrameTypeEvents,
+        Container_Count
+    };
+
+    enum : uint32_t {
+        EVENT_ID_COUNT = 512,           // Events with larger ids are counted as id EVENT_ID_COUNT - 1
+        HANDLER_SAMPLE_INTERVAL = 64,   // One in this many events is timed
+    };
+
+    struct Snapshot {
+        uint64_t mEventCount[Provider_Count][EVENT_ID_COUNT];   // Provider, EventDescriptor.Id -> number of events
+        uint64_t mHandlerSampleCount[Provider_Count];           // Number of events that were timed
+        uint64_t mHandlerSampleNs[Provider_Count];              // Time spent handling the timed events
+        uint64_t mLostPresentCount[LostPresent_Count];
+        uint64_t mPeakSize[Container_Count];
+        uint64_t mMemoryBudget;                                 // Bytes, or 0 if no budget was set
+        uint64_t mMemoryFootprint;                              // Estimated bytes currently used
+        uint64_t mPeakMemoryFootprint;
+
+        uint64_t GetEventCount(Provider provider) const;
+        uint64_t GetLostPresentCount() const;
+
+        // The number of presents that were dropped because there wasn't room for them in the
+        // consumer's rings (i.e., TrackingRingWrap and CompletedRingOverflow).  If this is
+        // non-zero, a larger memory budget may be needed.
+        uint64_t GetEvictionCount() const;
+
+        // The average time spent handling each of the provider's events, and the estimated total
+        // time spent handling all of them.
+        double GetHandlerAverageNs(Provider provider) const;
+        double GetHandlerTotalNs(Provider provider) const;
+    };
+
+    static char const* GetProviderName(Provider provider);
+    static char const* GetLostPresentReasonName(LostPresentReason reason);
+    static char const* GetContainerName(Container container);
+
+    ConsumerStats();
+    void GetSnapshot(Snapshot* snapshot) const;
+
+
+    // -------------------------------------------------------------------------------------------
+    // The following are only called by the thread processing events.
+
+    void CountEvent(Provider provider, uint16_t eventId)
+    {
+        Increment(&mEventCount[provider][eventId < EVENT_ID_COUNT ? eventId : EVENT_ID_COUNT - 1], 1);
+    }
+
+    // Returns true if the next event's handler should be timed, in which case its duration must
+    // be reported with AddHandlerSample().
+    bool SampleNextHandler()
+    {
+        if (--mSampleCountdown != 0) {
+            return false;
+        }
+        mSampleCountdown = HANDLER_SAMPLE_INTERVAL;
+        return true;
+    }
+
+    void AddHandlerSample(Provider provider, uint64_t qpcTicks)
+    {
+        Increment(&mHandlerSampleCount[provider], 1);
+        Increment(&mHandlerSampleTicks[provider], qpcTicks);
+    }
+
+    void CountLostPresent(LostPresentReason reason)
+    {
+        Increment(&mLostPresentCount[reason], 1);
+    }
+
+    void UpdatePeakSize(Container container, size_t size)
+    {
+        if (size > mPeakSize[container].load(std::memory_order_relaxed)) {
+            mPeakSize[container].store(size, std::memory_order_relaxed);
+        }
+    }
+
+    void SetMemoryBudget(size_t bytes)
+    {
+        mMemoryBudget.store(bytes, std::memory_order_relaxed);
+    }
+
+    void UpdateMemoryFootprint(size_t bytes)
+    {
+        mMemoryFootprint.store(bytes, std::memory_order_relaxed);
+        if (bytes > mPeakMemoryFootprint.load(std::memory_order_relaxed)) {
+            mPeakMemoryFootprint.store(bytes, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    static void Increment(std::atomic<uint64_t>* counter, uint64_t value)
+    {
+        counter->store(counter->load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> mEventCount[Provider_Count][EVENT_ID_COUNT];
+    std::atomic<uint64_t> mHandlerSampleCount[Provider_Count];
+    std::atomic<uint64_t> mHandlerSampleTicks[Provider_Count];
+    std::atomic<uint64_t> mLostPresentCount[LostPresent_Count];
+    std::atomic<uint64_t> mPeakSize[Container_Count];
+    std::atomic<uint64_t> mMemoryBudget;
+    std::atomic<uint64_t> mMemoryFootprint;
+    std::atomic<uint64_t> mPeakMemoryFootprint;
+    uint64_t mQpcFrequency;
+    uint32_t mSampleCountdown;
+};
@@ -0,0 +1,215 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include "CsvIndex.hpp"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+template<typename T>
+void Append(std::vector<char>* out, std::vector<T> const& v)
+{
+    if (!v.empty()) {
+        auto data = (char const*) v.data();
+        out->insert(out->end(), data, data + v.size() * sizeof(T));
+    }
+}
+
+template<typename T>
+bool Read(std::vector<char> const& data, size_t* offset, size_t count, std::vector<T>* v)
+{
+    if (count > (data.size() - *offset) / sizeof(T)) {
+        return false;
+    }
+    v->resize(count);
+    if (count > 0) {
+        memcpy(v->data(), data.data() + *offset, count * sizeof(T));
+    }
+    *offset += count * sizeof(T);
+    return true;
+}
+
+}
+
+void CsvIndexWriter::Begin(uint64_t timestampFrequency, uint64_t startTimestamp, uint32_t rowsPerBlock)
+{
+    mHeader = {};
+    mHeader.mMagic              = CSV_INDEX_MAGIC;
+    mHeader.mVersion            = CSV_INDEX_VERSION;
+    mHeader.mTimestampFrequency = timestampFrequency;
+    mHeader.mStartTimestamp     = startTimestamp;
+    mHeader.mRowsPerBlock       = std::max(rowsPerBlock, 1u);
+
+    mSwapChains.clear();
+    mBlocks.clear();
+    mBlockSwapChains.clear();
+    mSwapChainLastBlock.clear();
+    mSwapChainIndex.clear();
+}
+
+void CsvIndexWriter::AddRows(uint64_t offset, uint32_t rowCount, uint64_t minTimestamp, uint64_t maxTimestamp,
+                             uint32_t processId, uint64_t swapChainAddress)
+{
+    if (rowCount == 0) {
+        return;
+    }
+
+    if (mBlocks.empty() || mBlocks.back().mRowCount >= mHeader.mRowsPerBlock) {
+        CsvIndexBlock block = {};
+        block.mOffset              = offset;
+        block.mFirstRow            = mHeader.mRowCount;
+        block.mMinTimestamp        = minTimestamp;
+        block.mMaxTimestamp        = maxTimestamp;
+        block.mSwapChainListOffset = (uint32_t) mBlockSwapChains.size();
+        mBlocks.push_back(block);
+    }
+
+    auto block = &mBlocks.back();
+    block->mRowCount += rowCount;
+    block->mMinTimestamp = std::min(block->mMinTimestamp, minTimestamp);
+    block->mMaxTimestamp = std::max(block->mMaxTimestamp, maxTimestamp);
+    mHeader.mRowCount += rowCount;
+
+    auto ii = mSwapChainIndex[processId].emplace(swapChainAddress, (uint32_t) mSwapChains.size());
+    auto swapChainIndex = ii.first->second;
+    if (ii.second) {
+        CsvIndexSwapChain swapChain = {};
+        swapChain.mSwapChainAddress = swapChainAddress;
+        swapChain.mProcessId        = processId;
+        mSwapChains.push_back(swapChain);
+        mSwapChainLastBlock.push_back(0);
+    }
+
+    auto blockNumber = (uint32_t) mBlocks.size();
+    if (mSwapChainLastBlock[swapChainIndex] != blockNumber) {
+        mSwapChainLastBlock[swapChainIndex] = blockNumber;
+        mBlockSwapChains.push_back(swapChainIndex);
+        block->mSwapChainListCount += 1;
+    }
+}
+
+void CsvIndexWriter::End(uint64_t csvSize, std::vector<char>* output)
+{
+    mHeader.mCsvSize             = csvSize;
+    mHeader.mSwapChainCount      = (uint32_t) mSwapChains.size();
+    mHeader.mBlockCount          = (uint32_t) mBlocks.size();
+    mHeader.mBlockSwapChainCount = (uint32_t) mBlockSwapChains.size();
+
+    output->clear();
+    output->insert(output->end(), (char const*) &mHeader, (char const*) &mHeader + sizeof(mHeader));
+    Append(output, mSwapChains);
+    Append(output, mBlocks);
+    Append(output, mBlockSwapChains);
+}
+
+bool CsvIndexReader::Open(wchar_t const* path)
+{
+    FILE* fp = nullptr;
+    if (_wfopen_s(&fp, path, L"rb") != 0) {
+        return false;
+    }
+
+    std::vector<char> data;
+    char buffer[64 * 1024];
+    for (;;) {
+        auto n = fread(buffer, 1, sizeof(buffer), fp);
+        data.insert(data.end(), buffer, buffer + n);
+        if (n < sizeof(buffer)) {
+            break;
+        }
+    }
+    auto ok = ferror(fp) == 0;
+    fclose(fp);
+
+    return ok && Open(data);
+}
+
+bool CsvIndexReader::Open(std::vector<char> const& data)
+{
+    mSwapChains.clear();
+    mBlocks.clear();
+    mBlockSwapChains.clear();
+
+    if (data.size() < sizeof(mHeader)) {
+        return false;
+    }
+    memcpy(&mHeader, data.data(), sizeof(mHeader));
+    if (mHeader.mMagic != CSV_INDEX_MAGIC ||
+        mHeader.mVersion != CSV_INDEX_VERSION ||
+        mHeader.mTimestampFrequency == 0) {
+        return false;
+    }
+
+    size_t offset = sizeof(mHeader);
+    if (!Read(data, &offset, mHeader.mSwapChainCount, &mSwapChains) ||
+        !Read(data, &offset, mHeader.mBlockCount, &mBlocks) ||
+        !Read(data, &offset, mHeader.mBlockSwapChainCount, &mBlockSwapChains) ||
+        offset != data.size()) {
+        return false;
+    }
+
+    for (auto const& block : mBlocks) {
+        if (block.mSwapChainListOffset > mBlockSwapChains.size() ||
+            block.mSwapChainListCount > mBlockSwapChains.size() - block.mSwapChainListOffset) {
+            return false;
+        }
+    }
+    for (auto swapChainIndex : mBlockSwapChains) {
+        if (swapChainIndex >= mSwapChains.size()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void CsvIndexReader::FindBlocks(CsvIndexQuery const& query, std::vector<uint32_t>* blocks) const
+{
+    blocks->clear();
+
+    // Find the swap chains that match the query first, so each block only needs a lookup per swap
+    // chain in its list.
+    auto anySwapChain = query.mProcessId == CSV_INDEX_ANY_PROCESS && query.mSwapChainAddress == CSV_INDEX_ANY_SWAP_CHAIN;
+    std::vector<bool> swapChainMatches;
+    if (!anySwapChain) {
+        swapChainMatches.resize(mSwapChains.size(), false);
+        for (size_t i = 0, n = mSwapChains.size(); i < n; ++i) {
+            auto const& swapChain = mSwapChains[i];
+            swapChainMatches[i] = (query.mProcessId        == CSV_INDEX_ANY_PROCESS    || query.mProcessId        == swapChain.mProcessId) &&
+                                  (query.mSwapChainAddress == CSV_INDEX_ANY_SWAP_CHAIN || query.mSwapChainAddress == swapChain.mSwapChainAddress);
+        }
+    }
+
+    for (uint32_t i = 0, n = (uint32_t) mBlocks.size(); i < n; ++i) {
+        auto const& block = mBlocks[i];
+        if (block.mMaxTimestamp < query.mBeginTimestamp || block.mMinTimestamp > query.mEndTimestamp) {
+            continue;
+        }
+
+        auto matches = anySwapChain;
+        for (uint32_t j = 0; j < block.mSwapChainListCount && !matches; ++j) {
+            matches = swapChainMatches[mBlockSwapChains[block.mSwapChainListOffset + j]];
+        }
+        if (matches) {
+            blocks->push_back(i);
+        }
+    }
+}
+
+uint64_t CsvIndexReader::MilliSecondsToTimestamp(double milliSeconds) const
+{
+    auto timestamp = (double) mHeader.mStartTimestamp + milliSeconds * (double) mHeader.mTimestampFrequency / 1000.0;
+    return timestamp <= 0.0                   ? 0 :
+           timestamp >= 18446744073709551615. ? UINT64_MAX
+                                              : (uint64_t) timestamp;
+}
+
+double CsvIndexReader::TimestampToMilliSeconds(uint64_t timestamp) const
+{
+    return timestamp >= mHeader.mStartTimestamp
+        ?  1000.0 * (timestamp - mHeader.mStartTimestamp) / mHeader.mTimestampFrequency
+        : -1000.0 * (mHeader.mStartTimestamp - timestamp) / mHeader.mTimestampFrequency;
+}
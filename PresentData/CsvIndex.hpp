@@ -0,0 +1,114 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+// A CSV index is a small sidecar file that lets a reader find the rows of a large CSV that are in
+// a time range and/or belong to a particular swap chain, and seek straight to them instead of
+// reading the whole CSV.
+//
+// The CSV's rows are divided into blocks of (at least) mRowsPerBlock rows.  For each block the
+// index stores the file offset of its first row, the range of its rows' timestamps, and the list
+// of swap chains that its rows belong to.  The timestamps are those that the rows' time column was
+// computed from (CPUStart, or PresentStartTime with --v1_metrics).  Rows are not strictly in
+// timestamp order, so a reader has to check every block's range rather than binary searching.
+//
+// All fields are little-endian.  The file contains a CsvIndexHeader, the swap chain table
+// (mSwapChainCount CsvIndexSwapChains), the blocks (mBlockCount CsvIndexBlocks), and finally the
+// blocks' swap chain lists (mBlockSwapChainCount uint32_t indices into the swap chain table).
+
+enum : uint32_t {
+    CSV_INDEX_MAGIC       = 0x49434d50, // "PMCI"
+    CSV_INDEX_VERSION     = 1,
+    CSV_INDEX_ANY_PROCESS = UINT32_MAX,
+};
+
+enum : uint64_t {
+    CSV_INDEX_ANY_SWAP_CHAIN = UINT64_MAX,
+};
+
+struct CsvIndexHeader {
+    uint32_t mMagic;
+    uint32_t mVersion;
+    uint64_t mTimestampFrequency;
+    uint64_t mStartTimestamp;           // The timestamp that the CSV's time columns are relative to
+    uint64_t mCsvSize;                  // Size of the CSV that the index was written for
+    uint64_t mRowCount;                 // Number of rows, excluding the header
+    uint32_t mRowsPerBlock;
+    uint32_t mSwapChainCount;
+    uint32_t mBlockCount;
+    uint32_t mBlockSwapChainCount;
+};
+
+struct CsvIndexSwapChain {
+    uint64_t mSwapChainAddress;
+    uint32_t mProcessId;
+    uint32_t mReserved;
+};
+
+struct CsvIndexBlock {
+    uint64_t mOffset;                   // File offset of the block's first row
+    uint64_t mFirstRow;                 // Index of the block's first row (0 is the row after the header)
+    uint64_t mMinTimestamp;
+    uint64_t mMaxTimestamp;
+    uint32_t mRowCount;
+    uint32_t mSwapChainListOffset;      // Index of the block's swap chain list in the swap chain lists
+    uint32_t mSwapChainListCount;
+    uint32_t mReserved;
+};
+
+static_assert(sizeof(CsvIndexHeader) == 56, "Unexpected CsvIndexHeader layout");
+static_assert(sizeof(CsvIndexSwapChain) == 16, "Unexpected CsvIndexSwapChain layout");
+static_assert(sizeof(CsvIndexBlock) == 48, "Unexpected CsvIndexBlock layout");
+
+// CsvIndexWriter builds the index as rows are written to the CSV, and encodes it once the CSV is
+// complete.  Like ColumnarCaptureWriter, it doesn't do any I/O itself.
+struct CsvIndexWriter {
+    CsvIndexHeader mHeader = {};
+    std::vector<CsvIndexSwapChain> mSwapChains;
+    std::vector<CsvIndexBlock> mBlocks;
+    std::vector<uint32_t> mBlockSwapChains;
+    std::vector<uint32_t> mSwapChainLastBlock;  // Per swap chain, 1 + the last block it was added to
+    std::unordered_map<uint32_t, std::unordered_map<uint64_t, uint32_t> > mSwapChainIndex;
+
+    void Begin(uint64_t timestampFrequency, uint64_t startTimestamp, uint32_t rowsPerBlock);
+
+    // Add rowCount consecutive rows of one swap chain, the first of which starts at the specified
+    // CSV file offset.  A new block is started if the current block is full, so rows that are
+    // added together are always in the same block.
+    void AddRows(uint64_t offset, uint32_t rowCount, uint64_t minTimestamp, uint64_t maxTimestamp,
+                 uint32_t processId, uint64_t swapChainAddress);
+
+    // Encode the index of a CSV of csvSize bytes into output.
+    void End(uint64_t csvSize, std::vector<char>* output);
+};
+
+// The rows to find with CsvIndexReader::FindBlocks().  Timestamps are inclusive.
+struct CsvIndexQuery {
+    uint64_t mBeginTimestamp = 0;
+    uint64_t mEndTimestamp = UINT64_MAX;
+    uint32_t mProcessId = CSV_INDEX_ANY_PROCESS;
+    uint64_t mSwapChainAddress = CSV_INDEX_ANY_SWAP_CHAIN;
+};
+
+struct CsvIndexReader {
+    CsvIndexHeader mHeader = {};
+    std::vector<CsvIndexSwapChain> mSwapChains;
+    std::vector<CsvIndexBlock> mBlocks;
+    std::vector<uint32_t> mBlockSwapChains;
+
+    // Returns false if the file isn't a valid CSV index.
+    bool Open(wchar_t const* path);
+    bool Open(std::vector<char> const& data);
+
+    // Returns the indices of the blocks that may contain rows matching the query, in file order.
+    void FindBlocks(CsvIndexQuery const& query, std::vector<uint32_t>* blocks) const;
+
+    // Convert between timestamps and the milliseconds since mStartTimestamp used by the CSV's time
+    // columns (e.g., CPUStartTime).
+    uint64_t MilliSecondsToTimestamp(double milliSeconds) const;
+    double TimestampToMilliSeconds(uint64_t timestamp) const;
+};
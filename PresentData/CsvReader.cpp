@@ -0,0 +1,362 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include "CsvReader.hpp"
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+
+#include <algorithm>
+#include <assert.h>
+#include <charconv>
+#include <string.h>
+#include <system_error>
+
+#if defined(_M_IX86) || defined(_M_X64)
+#define CSV_READER_USE_SSE2 1
+#include <emmintrin.h>
+#include <intrin.h>
+#else
+#define CSV_READER_USE_SSE2 0
+#endif
+
+namespace {
+
+bool ParseDigits(char const* p, char const* end, uint64_t* value)
+{
+    if (p == end) {
+        return false;
+    }
+
+    uint64_t v = 0;
+    for (; p < end; ++p) {
+        uint32_t d = (uint32_t) (*p - '0');
+        if (d > 9 || v > (UINT64_MAX - d) / 10) {
+            return false;
+        }
+        v = v * 10 + d;
+    }
+
+    *value = v;
+    return true;
+}
+
+void AddLastField(std::vector<CsvField>* fields, char const* field, char const* end)
+{
+    if (end > field && end[-1] == '\r') {
+        end -= 1;
+    }
+    fields->push_back({ field, (size_t) (end - field) });
+}
+
+uint64_t GetAllocationGranularity()
+{
+    SYSTEM_INFO info = {};
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+}
+
+}
+
+bool CsvField::operator==(char const* s) const
+{
+    return strlen(s) == mSize && memcmp(s, mData, mSize) == 0;
+}
+
+bool CsvField::operator==(std::string const& s) const
+{
+    return s.size() == mSize && memcmp(s.data(), mData, mSize) == 0;
+}
+
+bool CsvField::ParseUInt64(uint64_t* value) const
+{
+    return ParseDigits(mData, mData + mSize, value);
+}
+
+bool CsvField::ParseUInt32(uint32_t* value) const
+{
+    uint64_t v = 0;
+    if (!ParseDigits(mData, mData + mSize, &v) || v > UINT32_MAX) {
+        return false;
+    }
+    *value = (uint32_t) v;
+    return true;
+}
+
+bool CsvField::ParseInt32(int32_t* value) const
+{
+    auto negative = mSize > 0 && mData[0] == '-';
+    uint64_t v = 0;
+    if (!ParseDigits(mData + (negative ? 1 : 0), mData + mSize, &v) || v > (negative ? 0x80000000ull : 0x7fffffffull)) {
+        return false;
+    }
+    *value = negative ? (int32_t) (0 - v) : (int32_t) v;
+    return true;
+}
+
+bool CsvField::ParseHex(uint64_t* value) const
+{
+    auto p = mData;
+    auto end = mData + mSize;
+    if (end - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        p += 2;
+    }
+    if (p == end || end - p > 16) {
+        return false;
+    }
+
+    uint64_t v = 0;
+    for (; p < end; ++p) {
+        uint32_t d;
+        auto ch = *p;
+        if (ch >= '0' && ch <= '9') {
+            d = (uint32_t) (ch - '0');
+        } else if (ch >= 'a' && ch <= 'f') {
+            d = (uint32_t) (ch - 'a' + 10);
+        } else if (ch >= 'A' && ch <= 'F') {
+            d = (uint32_t) (ch - 'A' + 10);
+        } else {
+            return false;
+        }
+        v = (v << 4) | d;
+    }
+
+    *value = v;
+    return true;
+}
+
+// std::from_chars() parses the field in place, without a NUL-terminated copy, and is correctly
+// rounded (so it gives the same result as strtod()).  Unlike strtod(), it doesn't accept a leading
+// '+', so that is skipped here.
+bool CsvField::ParseDouble(double* value) const
+{
+    auto p = mData;
+    auto end = mData + mSize;
+    if (p < end && *p == '+') {
+        p += 1;
+        if (p < end && *p == '-') {
+            return false;
+        }
+    }
+
+    auto result = std::from_chars(p, end, *value);
+    return result.ec == std::errc() && result.ptr == end;
+}
+
+CsvReader::~CsvReader()
+{
+    Close();
+}
+
+bool CsvReader::Open(wchar_t const* path)
+{
+    Close();
+
+    auto file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    mFile = file;
+
+    LARGE_INTEGER fileSize = {};
+    if (!GetFileSizeEx(file, &fileSize)) {
+        Close();
+        return false;
+    }
+    mFileSize = (uint64_t) fileSize.QuadPart;
+
+    // Empty files can't be mapped.
+    if (mFileSize > 0) {
+        mMapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mMapping == nullptr || !MapView(0)) {
+            Close();
+            return false;
+        }
+    }
+
+    if (mViewSize >= 3 && memcmp(mView, "\xef\xbb\xbf", 3) == 0) {
+        mPosition = 3;
+    }
+
+    return true;
+}
+
+bool CsvReader::Open(std::vector<char>&& data)
+{
+    Close();
+
+    mData = std::move(data);
+    mFileSize = mData.size();
+    mView = mData.data();
+    mViewSize = mData.size();
+
+    if (mViewSize >= 3 && memcmp(mView, "\xef\xbb\xbf", 3) == 0) {
+        mPosition = 3;
+    }
+
+    return true;
+}
+
+void CsvReader::Close()
+{
+    if (mFile != nullptr) {
+        if (mView != nullptr) {
+            UnmapViewOfFile(mView);
+        }
+        if (mMapping != nullptr) {
+            CloseHandle(mMapping);
+        }
+        CloseHandle(mFile);
+    }
+
+    mFields.clear();
+    mLine = 0;
+    mRowOffset = 0;
+    mFileSize = 0;
+    mError = false;
+    mFile = nullptr;
+    mMapping = nullptr;
+    mView = nullptr;
+    mViewOffset = 0;
+    mViewSize = 0;
+    mPosition = 0;
+    mData.clear();
+}
+
+// Map a view that includes at least mMaxViewSize bytes from the specified offset (or up to the end
+// of the file), and set mPosition to the offset.  Views have to start on an allocation granularity
+// boundary, so they may start a little before the offset.
+bool CsvReader::MapView(uint64_t offset)
+{
+    assert(mMapping != nullptr);
+
+    static uint64_t const granularity = GetAllocationGranularity();
+    auto viewOffset = offset & ~(granularity - 1);
+    auto viewSize = std::min(mFileSize - viewOffset, (mMaxViewSize + 2 * granularity - 1) & ~(granularity - 1));
+
+    if (mView != nullptr) {
+        UnmapViewOfFile(mView);
+        mView = nullptr;
+    }
+
+    mView = (char const*) MapViewOfFile(mMapping, FILE_MAP_READ, (DWORD) (viewOffset >> 32), (DWORD) viewOffset, (SIZE_T) viewSize);
+    if (mView == nullptr) {
+        mError = true;
+        return false;
+    }
+
+    mViewOffset = viewOffset;
+    mViewSize = (size_t) viewSize;
+    mPosition = (size_t) (offset - viewOffset);
+    return true;
+}
+
+// Split the row starting at p into mFields, and return the start of the next row.  If the row
+// isn't terminated before end, and end isn't the end of the file, nullptr is returned.
+char const* CsvReader::SplitRow(char const* p, char const* end, bool isFileEnd)
+{
+    mFields.clear();
+
+    auto field = p;
+
+#if CSV_READER_USE_SSE2
+    // Find the delimiters 16 characters at a time.
+    auto const commas   = _mm_set1_epi8(',');
+    auto const newLines = _mm_set1_epi8('\n');
+    for (; end - p >= 16; p += 16) {
+        auto block = _mm_loadu_si128((__m128i const*) p);
+        auto commaMask   = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(block, commas));
+        auto newLineMask = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(block, newLines));
+
+        // Ignore commas that belong to the next row.
+        if (newLineMask != 0) {
+            commaMask &= (newLineMask & (0u - newLineMask)) - 1;
+        }
+
+        while (commaMask != 0) {
+            unsigned long i = 0;
+            _BitScanForward(&i, commaMask);
+            commaMask &= commaMask - 1;
+
+            mFields.push_back({ field, (size_t) (p + i - field) });
+            field = p + i + 1;
+        }
+
+        if (newLineMask != 0) {
+            unsigned long i = 0;
+            _BitScanForward(&i, newLineMask);
+
+            AddLastField(&mFields, field, p + i);
+            return p + i + 1;
+        }
+    }
+#endif
+
+    for (; p < end; ++p) {
+        if (*p == ',') {
+            mFields.push_back({ field, (size_t) (p - field) });
+            field = p + 1;
+        } else if (*p == '\n') {
+            AddLastField(&mFields, field, p);
+            return p + 1;
+        }
+    }
+
+    // The last row doesn't need to end with a new line.
+    if (!isFileEnd) {
+        return nullptr;
+    }
+    AddLastField(&mFields, field, end);
+    return end;
+}
+
+bool CsvReader::ReadRow()
+{
+    for (;;) {
+        auto rowOffset = mViewOffset + mPosition;
+        if (mError || rowOffset >= mFileSize) {
+            mFields.clear();
+            return false;
+        }
+
+        auto viewEnd = mViewOffset + mViewSize;
+        auto next = SplitRow(mView + mPosition, mView + mViewSize, viewEnd == mFileSize);
+        if (next != nullptr) {
+            mRowOffset = rowOffset;
+            mPosition = (size_t) (next - mView);
+            mLine += 1;
+            return true;
+        }
+
+        // The row continues past the end of the view, so map a new view starting with the row.
+        if (!MapView(rowOffset)) {
+            mFields.clear();
+            return false;
+        }
+        if (mViewOffset + mViewSize <= viewEnd) {
+            mError = true;
+        }
+    }
+}
+
+bool CsvReader::Seek(uint64_t offset, uint64_t line)
+{
+    if (mError || offset > mFileSize) {
+        return false;
+    }
+
+    mFields.clear();
+    mLine = line - 1;
+
+    // Use the current view if it contains the offset (it always does if the data is in memory).
+    // ReadRow() doesn't use the view at the end of the file.
+    if (offset >= mViewOffset && (offset <= mViewOffset + mViewSize || offset == mFileSize)) {
+        mPosition = (size_t) (offset - mViewOffset);
+        return true;
+    }
+
+    return MapView(offset);
+}
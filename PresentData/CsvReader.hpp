@@ -0,0 +1,77 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// A field of the current row of a CsvReader.  Fields point directly into the file's data (they are
+// not NUL-terminated), and are only valid until the next call to CsvReader::ReadRow().
+struct CsvField {
+    char const* mData;
+    size_t mSize;
+
+    bool operator==(char const* s) const;
+    bool operator==(std::string const& s) const;
+    bool operator!=(char const* s) const { return !(*this == s); }
+
+    std::string ToString() const { return std::string(mData, mSize); }
+
+    // The Parse functions return false if the field is not entirely a valid value of the type
+    // (e.g., if it is empty, or "NA").  Hex values may have a 0x prefix.
+    bool ParseInt32(int32_t* value) const;
+    bool ParseUInt32(uint32_t* value) const;
+    bool ParseUInt64(uint64_t* value) const;
+    bool ParseHex(uint64_t* value) const;
+    bool ParseDouble(double* value) const;
+};
+
+// CsvReader reads the rows of a CSV file, such as those written by PresentMon, splitting each row
+// into fields without copying them.  Files are memory-mapped a view at a time, so files larger
+// than the address space can be read, and the rows are split using SSE2 where it is available.
+//
+// Fields are separated by ',' and rows by '\n' or "\r\n".  Quoted fields are not supported (they
+// are not used by PresentMon).  A UTF-8 BOM at the start of the file is skipped.
+struct CsvReader {
+    enum : uint64_t {
+        DEFAULT_VIEW_SIZE = 64 * 1024 * 1024,
+    };
+
+    std::vector<CsvField> mFields;      // Fields of the current row
+    uint64_t mLine = 0;                 // Line number of the current row (1 is the first row)
+    uint64_t mRowOffset = 0;            // File offset of the current row
+    uint64_t mFileSize = 0;
+    uint64_t mMaxViewSize = DEFAULT_VIEW_SIZE; // Rows must be shorter than this
+    bool mError = false;                // A read error occurred, or a row was too long
+
+    // Internal state
+    void* mFile = nullptr;              // HANDLE
+    void* mMapping = nullptr;           // HANDLE
+    char const* mView = nullptr;
+    uint64_t mViewOffset = 0;           // File offset of mView[0]
+    size_t mViewSize = 0;
+    size_t mPosition = 0;               // Offset into mView of the next row
+    std::vector<char> mData;            // The whole file, if opened from memory
+
+    CsvReader() = default;
+    CsvReader(CsvReader const&) = delete;
+    CsvReader& operator=(CsvReader const&) = delete;
+    ~CsvReader();
+
+    bool Open(wchar_t const* path);
+    bool Open(std::vector<char>&& data);
+    void Close();
+
+    // Reads the next row into mFields.  Returns false at the end of the file, or if an error
+    // occurred (see mError).
+    bool ReadRow();
+
+    // Continue reading from the row at the specified file offset (e.g., an earlier mRowOffset),
+    // which is on the specified line.  Returns false if the offset is past the end of the file, or
+    // if an error occurred.
+    bool Seek(uint64_t offset, uint64_t line);
+
+    bool MapView(uint64_t offset);
+    char const* SplitRow(char const* p, char const* end, bool isFileEnd);
+};
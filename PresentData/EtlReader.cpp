@@ -0,0 +1,668 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include "EtlReader.hpp"
+
+#include <algorithm>
+#include <string.h>
+
+namespace {
+
+// The on-disk layout of ETL buffers and event headers.  Each buffer starts with a
+// WMI_BUFFER_HEADER, followed by 8-byte aligned event records.  Every record starts with a
+// 32-bit marker whose top two bits are set, and whose third byte identifies the header format.
+enum : uint32_t {
+    BUFFER_HEADER_SIZE          = 0x48,
+    BUFFER_SAVED_OFFSET         = 0x04,
+    BUFFER_CLIENT_CONTEXT       = 0x28,
+    BUFFER_OFFSET               = 0x30,
+    BUFFER_FLAG                 = 0x34,
+
+    BUFFER_FLAG_PROC_INDEX      = 0x0020,
+    BUFFER_FLAG_COMPRESSED      = 0x0040,
+
+    RECORD_MARKER_FLAGS         = 0xC0000000,
+    RECORD_ALIGNMENT            = 8,
+};
+
+enum HeaderType : uint32_t {
+    HEADER_TYPE_SYSTEM32        = 1,
+    HEADER_TYPE_SYSTEM64        = 2,
+    HEADER_TYPE_COMPACT32       = 3,
+    HEADER_TYPE_COMPACT64       = 4,
+    HEADER_TYPE_FULL_HEADER32   = 10,
+    HEADER_TYPE_INSTANCE32      = 11,
+    HEADER_TYPE_PERFINFO32      = 16,
+    HEADER_TYPE_PERFINFO64      = 17,
+    HEADER_TYPE_EVENT_HEADER32  = 18,
+    HEADER_TYPE_EVENT_HEADER64  = 19,
+    HEADER_TYPE_FULL_HEADER64   = 20,
+    HEADER_TYPE_INSTANCE64      = 21,
+};
+
+enum : uint32_t {
+    SYSTEM_HEADER_SIZE          = 32,   // SYSTEM_TRACE_HEADER
+    COMPACT_HEADER_SIZE         = 24,   // SYSTEM_TRACE_HEADER without KernelTime/UserTime
+    PERFINFO_HEADER_SIZE        = 16,   // PERFINFO_TRACE_HEADER
+    FULL_HEADER_SIZE            = 48,   // EVENT_TRACE_HEADER
+    INSTANCE_HEADER_SIZE        = 56,   // EVENT_INSTANCE_HEADER
+    EVENT_HEADER_SIZE           = 80,   // EVENT_HEADER
+    EXTENDED_ITEM_HEADER_SIZE   = 8,
+};
+
+// Kernel events are identified by the group in the high byte of their hook id, with the
+// opcode in the low byte.
+enum : uint32_t {
+    KERNEL_GROUP_EVENT_TRACE    = 0x00,
+    KERNEL_GROUP_PROCESS        = 0x03,
+};
+
+// {68fdd900-4a3e-11d1-84f4-0000f80464e3}
+GUID const EventTraceGuid = { 0x68fdd900, 0x4a3e, 0x11d1, { 0x84, 0xf4, 0x00, 0x00, 0xf8, 0x04, 0x64, 0xe3 } };
+// {3d6fa8d0-fe05-11d0-9dda-00c04fd7ba7c}
+GUID const ProcessGuid    = { 0x3d6fa8d0, 0xfe05, 0x11d0, { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } };
+
+template<typename T>
+T Read(uint8_t const* p)
+{
+    T t;
+    memcpy(&t, p, sizeof(T));
+    return t;
+}
+
+uint32_t AlignRecordSize(uint32_t size)
+{
+    return (size + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1);
+}
+
+// Validate the record at p, returning its size (including the header) and timestamp.
+bool PeekRecord(uint8_t const* p, uint64_t available, uint32_t* size, uint64_t* timestamp)
+{
+    if (available < PERFINFO_HEADER_SIZE) {
+        return false;
+    }
+
+    auto marker = Read<uint32_t>(p);
+    if ((marker & RECORD_MARKER_FLAGS) != RECORD_MARKER_FLAGS) {
+        return false;
+    }
+
+    uint32_t headerSize = 0;
+    uint32_t timestampOffset = 16;
+    switch ((marker >> 16) & 0xff) {
+    case HEADER_TYPE_SYSTEM32:
+    case HEADER_TYPE_SYSTEM64:
+        headerSize = SYSTEM_HEADER_SIZE;
+        *size = Read<uint16_t>(p + 4);
+        break;
+    case HEADER_TYPE_COMPACT32:
+    case HEADER_TYPE_COMPACT64:
+        headerSize = COMPACT_HEADER_SIZE;
+        *size = Read<uint16_t>(p + 4);
+        break;
+    case HEADER_TYPE_PERFINFO32:
+    case HEADER_TYPE_PERFINFO64:
+        headerSize = PERFINFO_HEADER_SIZE;
+        timestampOffset = 8;
+        *size = Read<uint16_t>(p + 4);
+        break;
+    case HEADER_TYPE_FULL_HEADER32:
+    case HEADER_TYPE_FULL_HEADER64:
+        headerSize = FULL_HEADER_SIZE;
+        *size = marker & 0xffff;
+        break;
+    case HEADER_TYPE_INSTANCE32:
+    case HEADER_TYPE_INSTANCE64:
+        headerSize = INSTANCE_HEADER_SIZE;
+        *size = marker & 0xffff;
+        break;
+    case HEADER_TYPE_EVENT_HEADER32:
+    case HEADER_TYPE_EVENT_HEADER64:
+        headerSize = EVENT_HEADER_SIZE;
+        *size = marker & 0xffff;
+        break;
+    default:
+        return false;
+    }
+
+    if (*size < headerSize || *size > available) {
+        return false;
+    }
+
+    *timestamp = Read<uint64_t>(p + timestampOffset);
+    return true;
+}
+
+uint64_t GetAllocationGranularity()
+{
+    SYSTEM_INFO info = {};
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+}
+
+bool CursorGreater(EtlReader::Cursor const& lhs, uint32_t lhsIndex, EtlReader::Cursor const& rhs, uint32_t rhsIndex)
+{
+    return lhs.mTimestamp != rhs.mTimestamp ? lhs.mTimestamp > rhs.mTimestamp : lhsIndex > rhsIndex;
+}
+
+}
+
+EtlReader::~EtlReader()
+{
+    Close();
+}
+
+ULONG EtlReader::Open(wchar_t const* path)
+{
+    Close();
+
+    mFile = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (mFile == INVALID_HANDLE_VALUE) {
+        return GetLastError();
+    }
+
+    LARGE_INTEGER fileSize = {};
+    if (!GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart == 0) {
+        Close();
+        return ERROR_FILE_CORRUPT;
+    }
+
+    mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mMapping == NULL) {
+        auto error = GetLastError();
+        Close();
+        return error;
+    }
+    mSize = (uint64_t) fileSize.QuadPart;
+
+    auto status = ParseBuffers();
+    if (status != ERROR_SUCCESS) {
+        Close();
+    }
+    return status;
+}
+
+void EtlReader::Close()
+{
+    for (auto& cursor : mCursors) {
+        UnmapView(&cursor.mView);
+    }
+    UnmapView(&mScanView);
+    UnmapView(&mRetiredView);
+    if (mMapping != NULL) {
+        CloseHandle(mMapping);
+        mMapping = NULL;
+    }
+    if (mFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(mFile);
+        mFile = INVALID_HANDLE_VALUE;
+    }
+
+    mSize = 0;
+    mCursors.clear();
+    mHeap.clear();
+    mSkippedEventCount = 0;
+    mCorrupt = false;
+}
+
+// Returns a pointer to the size bytes at the given file offset, mapping a new window into view if
+// they aren't already in it.  The view's previous window is unmapped, unless retire is set in which
+// case it is kept in mRetiredView until the next call to ReleaseRetiredView().  Returns nullptr if
+// the window couldn't be mapped (e.g., if the address space is exhausted).
+uint8_t const* EtlReader::MapRange(View* view, uint64_t offset, uint64_t size, bool retire)
+{
+    if (view->mData == nullptr || offset < view->mOffset || offset + size > view->mOffset + view->mSize) {
+        static uint64_t const granularity = GetAllocationGranularity();
+        auto viewOffset = offset & ~(granularity - 1);
+        auto viewSize = std::min(mSize - viewOffset, std::max(offset + size - viewOffset, (uint64_t) VIEW_SIZE));
+
+        auto data = (uint8_t const*) MapViewOfFile(mMapping, FILE_MAP_READ, (DWORD) (viewOffset >> 32), (DWORD) viewOffset, (SIZE_T) viewSize);
+        if (data == nullptr) {
+            return nullptr;
+        }
+
+        if (retire) {
+            ReleaseRetiredView();
+            mRetiredView = *view;
+        } else {
+            UnmapView(view);
+        }
+
+        view->mData = data;
+        view->mOffset = viewOffset;
+        view->mSize = viewSize;
+    }
+
+    return view->mData + (offset - view->mOffset);
+}
+
+void EtlReader::UnmapView(View* view)
+{
+    if (view->mData != nullptr) {
+        UnmapViewOfFile(view->mData);
+    }
+    *view = {};
+}
+
+void EtlReader::ReleaseRetiredView()
+{
+    UnmapView(&mRetiredView);
+}
+
+ULONG EtlReader::ParseBuffers()
+{
+    // Assign each buffer to the cursor for the processor that wrote it.
+    std::vector<uint32_t> cursorIndexByProcessor;
+    for (uint64_t offset = 0; offset + BUFFER_HEADER_SIZE <= mSize; ) {
+        auto buffer = MapRange(&mScanView, offset, BUFFER_HEADER_SIZE, false);
+        if (buffer == nullptr) {
+            return ERROR_NOT_ENOUGH_MEMORY;
+        }
+
+        auto bufferSize = Read<uint32_t>(buffer);
+        if (bufferSize < BUFFER_HEADER_SIZE || bufferSize > mSize - offset) {
+            // A truncated final buffer is ignored, as ProcessTrace() does.
+            if (offset == 0) {
+                return ERROR_FILE_CORRUPT;
+            }
+            break;
+        }
+
+        auto flags = Read<uint16_t>(buffer + BUFFER_FLAG);
+        if (flags & BUFFER_FLAG_COMPRESSED) {
+            return ERROR_NOT_SUPPORTED;
+        }
+
+        // Offset is the end of the events written to the buffer; fall back to SavedOffset or the
+        // whole buffer if it isn't valid.  Any unused space is not a valid record, so it also
+        // terminates the buffer.
+        auto dataEnd = Read<uint32_t>(buffer + BUFFER_OFFSET);
+        if (dataEnd < BUFFER_HEADER_SIZE || dataEnd > bufferSize) {
+            dataEnd = Read<uint32_t>(buffer + BUFFER_SAVED_OFFSET);
+            if (dataEnd < BUFFER_HEADER_SIZE || dataEnd > bufferSize) {
+                dataEnd = bufferSize;
+            }
+        }
+
+        uint16_t processorIndex = (flags & BUFFER_FLAG_PROC_INDEX)
+            ? Read<uint16_t>(buffer + BUFFER_CLIENT_CONTEXT)
+            : Read<uint8_t>(buffer + BUFFER_CLIENT_CONTEXT);
+        if (processorIndex >= cursorIndexByProcessor.size()) {
+            cursorIndexByProcessor.resize(processorIndex + 1, UINT32_MAX);
+        }
+        if (cursorIndexByProcessor[processorIndex] == UINT32_MAX) {
+            cursorIndexByProcessor[processorIndex] = (uint32_t) mCursors.size();
+            mCursors.emplace_back();
+            mCursors.back().mProcessorIndex = processorIndex;
+        }
+
+        Buffer b;
+        b.mOffset = offset;
+        b.mDataEnd = dataEnd;
+        mCursors[cursorIndexByProcessor[processorIndex]].mBuffers.emplace_back(b);
+
+        offset += bufferSize;
+    }
+
+    if (mCursors.empty()) {
+        return ERROR_FILE_CORRUPT;
+    }
+
+    // The first event in the file is the logfile header.
+    auto firstBuffer = mCursors[0].mBuffers[0];
+    auto firstBufferData = MapRange(&mScanView, 0, firstBuffer.mDataEnd, false);
+    if (firstBufferData == nullptr) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    uint32_t headerRecordSize = 0;
+    uint64_t headerTimestamp = 0;
+    auto headerRecord = firstBufferData + BUFFER_HEADER_SIZE;
+    if (!PeekRecord(headerRecord, firstBuffer.mDataEnd - BUFFER_HEADER_SIZE, &headerRecordSize, &headerTimestamp)) {
+        return ERROR_FILE_CORRUPT;
+    }
+    auto headerType = (Read<uint32_t>(headerRecord) >> 16) & 0xff;
+    if ((headerType != HEADER_TYPE_SYSTEM32 && headerType != HEADER_TYPE_SYSTEM64) ||
+        !DecodeLogfileHeader(headerRecord + SYSTEM_HEADER_SIZE, headerRecordSize - SYSTEM_HEADER_SIZE)) {
+        return ERROR_FILE_CORRUPT;
+    }
+
+    for (auto& cursor : mCursors) {
+        SetCursorBuffer(&cursor, 0);
+        if (AdvanceCursor(&cursor)) {
+            // ProcessTrace() always delivers the logfile header first.
+            if (cursor.mOffset == BUFFER_HEADER_SIZE) {
+                cursor.mTimestamp = 0;
+            }
+            mHeap.emplace_back((uint32_t) (&cursor - mCursors.data()));
+        }
+    }
+
+    auto greater = [this](uint32_t a, uint32_t b) { return CursorGreater(mCursors[a], a, mCursors[b], b); };
+    std::make_heap(mHeap.begin(), mHeap.end(), greater);
+    return ERROR_SUCCESS;
+}
+
+bool EtlReader::DecodeLogfileHeader(uint8_t const* data, uint32_t size)
+{
+    // TRACE_LOGFILE_HEADER contains two pointers (LoggerName and LogFileName), so the offsets of
+    // the fields after them depend on the pointer size of the system that wrote the file.
+    enum : uint32_t {
+        POINTER_SIZE_OFFSET = 44,
+        POINTERS_OFFSET = 56,
+        TIME_ZONE_SIZE = 172,
+    };
+
+    if (size < POINTERS_OFFSET) {
+        return false;
+    }
+
+    auto pointerSize = Read<uint32_t>(data + POINTER_SIZE_OFFSET);
+    if (pointerSize != 4 && pointerSize != 8) {
+        return false;
+    }
+
+    auto timeZoneOffset = POINTERS_OFFSET + 2 * pointerSize;
+    auto bootTimeOffset = (timeZoneOffset + TIME_ZONE_SIZE + 7) & ~7u;
+    if (size < bootTimeOffset + 32) {
+        return false;
+    }
+
+    auto h = &mLogfileHeader;
+    memset(h, 0, sizeof(*h));
+    h->BufferSize            = Read<uint32_t>(data + 0);
+    h->Version               = Read<uint32_t>(data + 4);
+    h->ProviderVersion       = Read<uint32_t>(data + 8);
+    h->NumberOfProcessors    = Read<uint32_t>(data + 12);
+    h->EndTime.QuadPart      = Read<int64_t>(data + 16);
+    h->TimerResolution       = Read<uint32_t>(data + 24);
+    h->MaximumFileSize       = Read<uint32_t>(data + 28);
+    h->LogFileMode           = Read<uint32_t>(data + 32);
+    h->BuffersWritten        = Read<uint32_t>(data + 36);
+    h->StartBuffers          = Read<uint32_t>(data + 40);
+    h->PointerSize           = pointerSize;
+    h->EventsLost            = Read<uint32_t>(data + 48);
+    h->CpuSpeedInMHz         = Read<uint32_t>(data + 52);
+    memcpy(&h->TimeZone, data + timeZoneOffset, TIME_ZONE_SIZE);
+    h->BootTime.QuadPart     = Read<int64_t>(data + bootTimeOffset);
+    h->PerfFreq.QuadPart     = Read<int64_t>(data + bootTimeOffset + 8);
+    h->StartTime.QuadPart    = Read<int64_t>(data + bootTimeOffset + 16);
+    h->ReservedFlags         = Read<uint32_t>(data + bootTimeOffset + 24);
+    h->BuffersLost           = Read<uint32_t>(data + bootTimeOffset + 28);
+    return true;
+}
+
+bool EtlReader::AdvanceCursor(Cursor* cursor)
+{
+    for (;;) {
+        if (cursor->mOffset < cursor->mEnd &&
+            PeekRecord(GetCursorData(*cursor), cursor->mEnd - cursor->mOffset, &cursor->mRecordSize, &cursor->mTimestamp)) {
+            return true;
+        }
+
+        cursor->mBufferIndex += 1;
+        if (cursor->mBufferIndex == cursor->mBuffers.size()) {
+            return false;
+        }
+
+        SetCursorBuffer(cursor, cursor->mBufferIndex);
+    }
+}
+
+// Map the buffer into the cursor's view.  The cursor's previous view is retired rather than
+// unmapped, since the last event read may point into it.  If the buffer can't be mapped, it is
+// treated as empty.
+void EtlReader::SetCursorBuffer(Cursor* cursor, size_t bufferIndex)
+{
+    auto const& buffer = cursor->mBuffers[bufferIndex];
+    cursor->mBufferIndex = bufferIndex;
+    cursor->mOffset = buffer.mOffset + BUFFER_HEADER_SIZE;
+    cursor->mEnd = buffer.mOffset + buffer.mDataEnd;
+
+    if (MapRange(&cursor->mView, buffer.mOffset, buffer.mDataEnd, true) == nullptr) {
+        cursor->mEnd = cursor->mOffset;
+        mCorrupt = true;
+    }
+}
+
+uint8_t const* EtlReader::GetCursorData(Cursor const& cursor) const
+{
+    return cursor.mView.mData + (cursor.mOffset - cursor.mView.mOffset);
+}
+
+// The logfile header is ignored by the timestamp queries since its timestamp isn't ordered with the
+// events that follow it.
+bool EtlReader::GetFirstTimestamp(Buffer const& buffer, uint64_t* timestamp)
+{
+    auto data = MapRange(&mScanView, buffer.mOffset, buffer.mDataEnd, false);
+    if (data == nullptr) {
+        return false;
+    }
+
+    uint64_t offset = BUFFER_HEADER_SIZE;
+    uint64_t end = buffer.mDataEnd;
+    uint32_t recordSize = 0;
+    while (offset < end && PeekRecord(data + offset, end - offset, &recordSize, timestamp)) {
+        if (buffer.mOffset + offset != BUFFER_HEADER_SIZE) {
+            return true;
+        }
+        offset += AlignRecordSize(recordSize);
+    }
+    return false;
+}
+
+bool EtlReader::GetLastTimestamp(Buffer const& buffer, uint64_t* timestamp)
+{
+    auto data = MapRange(&mScanView, buffer.mOffset, buffer.mDataEnd, false);
+    if (data == nullptr) {
+        return false;
+    }
+
+    // Records are variable-sized, so the buffer has to be walked from the start.
+    bool found = false;
+    uint64_t offset = BUFFER_HEADER_SIZE;
+    uint64_t end = buffer.mDataEnd;
+    uint32_t recordSize = 0;
+    uint64_t recordTimestamp = 0;
+    while (offset < end && PeekRecord(data + offset, end - offset, &recordSize, &recordTimestamp)) {
+        if (buffer.mOffset + offset != BUFFER_HEADER_SIZE) {
+            *timestamp = recordTimestamp;
+            found = true;
+        }
+        offset += AlignRecordSize(recordSize);
+    }
+    return found;
+}
+
+bool EtlReader::DecodeRecord(uint8_t const* record, uint32_t size, uint16_t processorIndex, EVENT_RECORD* eventRecord)
+{
+    auto userContext = eventRecord->UserContext;
+    memset(eventRecord, 0, sizeof(EVENT_RECORD));
+    eventRecord->UserContext = userContext;
+    eventRecord->BufferContext.ProcessorIndex = processorIndex;
+
+    auto hdr = &eventRecord->EventHeader;
+    hdr->Size = sizeof(EVENT_HEADER);
+
+    auto headerType = (Read<uint32_t>(record) >> 16) & 0xff;
+    uint32_t headerSize = 0;
+    switch (headerType) {
+    case HEADER_TYPE_SYSTEM32:
+    case HEADER_TYPE_SYSTEM64: {
+        auto hookId = Read<uint16_t>(record + 6);
+        switch (hookId >> 8) {
+        case KERNEL_GROUP_EVENT_TRACE: hdr->ProviderId = EventTraceGuid; break;
+        case KERNEL_GROUP_PROCESS:     hdr->ProviderId = ProcessGuid; break;
+        default: return false;
+        }
+
+        headerSize = SYSTEM_HEADER_SIZE;
+        hdr->Flags = EVENT_HEADER_FLAG_CLASSIC_HEADER |
+                     (headerType == HEADER_TYPE_SYSTEM64 ? EVENT_HEADER_FLAG_64_BIT_HEADER : EVENT_HEADER_FLAG_32_BIT_HEADER);
+        hdr->ThreadId               = Read<uint32_t>(record + 8);
+        hdr->ProcessId              = Read<uint32_t>(record + 12);
+        hdr->TimeStamp.QuadPart     = Read<int64_t>(record + 16);
+        hdr->KernelTime             = Read<uint32_t>(record + 24);
+        hdr->UserTime               = Read<uint32_t>(record + 28);
+        hdr->EventDescriptor.Version = (UCHAR) Read<uint16_t>(record);
+        hdr->EventDescriptor.Opcode  = (UCHAR) hookId;
+        break;
+    }
+
+    case HEADER_TYPE_FULL_HEADER32:
+    case HEADER_TYPE_FULL_HEADER64:
+        headerSize = FULL_HEADER_SIZE;
+        hdr->Flags = EVENT_HEADER_FLAG_CLASSIC_HEADER |
+                     (headerType == HEADER_TYPE_FULL_HEADER64 ? EVENT_HEADER_FLAG_64_BIT_HEADER : EVENT_HEADER_FLAG_32_BIT_HEADER);
+        hdr->EventDescriptor.Opcode  = Read<uint8_t>(record + 4);
+        hdr->EventDescriptor.Level   = Read<uint8_t>(record + 5);
+        hdr->EventDescriptor.Version = (UCHAR) Read<uint16_t>(record + 6);
+        hdr->ThreadId               = Read<uint32_t>(record + 8);
+        hdr->ProcessId              = Read<uint32_t>(record + 12);
+        hdr->TimeStamp.QuadPart     = Read<int64_t>(record + 16);
+        memcpy(&hdr->ProviderId, record + 24, sizeof(GUID));
+        hdr->KernelTime             = Read<uint32_t>(record + 40);
+        hdr->UserTime               = Read<uint32_t>(record + 44);
+        break;
+
+    case HEADER_TYPE_EVENT_HEADER32:
+    case HEADER_TYPE_EVENT_HEADER64: {
+        headerSize = EVENT_HEADER_SIZE;
+        hdr->Flags                  = Read<uint16_t>(record + 4);
+        hdr->EventProperty          = Read<uint16_t>(record + 6);
+        hdr->ThreadId               = Read<uint32_t>(record + 8);
+        hdr->ProcessId              = Read<uint32_t>(record + 12);
+        hdr->TimeStamp.QuadPart     = Read<int64_t>(record + 16);
+        memcpy(&hdr->ProviderId, record + 24, sizeof(GUID));
+        hdr->EventDescriptor.Id      = Read<uint16_t>(record + 40);
+        hdr->EventDescriptor.Version = Read<uint8_t>(record + 42);
+        hdr->EventDescriptor.Channel = Read<uint8_t>(record + 43);
+        hdr->EventDescriptor.Level   = Read<uint8_t>(record + 44);
+        hdr->EventDescriptor.Opcode  = Read<uint8_t>(record + 45);
+        hdr->EventDescriptor.Task    = Read<uint16_t>(record + 46);
+        hdr->EventDescriptor.Keyword = Read<uint64_t>(record + 48);
+        hdr->ProcessorTime           = Read<uint64_t>(record + 56);
+        memcpy(&hdr->ActivityId, record + 64, sizeof(GUID));
+
+        if ((hdr->Flags & (EVENT_HEADER_FLAG_32_BIT_HEADER | EVENT_HEADER_FLAG_64_BIT_HEADER)) == 0) {
+            hdr->Flags |= headerType == HEADER_TYPE_EVENT_HEADER64 ? EVENT_HEADER_FLAG_64_BIT_HEADER : EVENT_HEADER_FLAG_32_BIT_HEADER;
+        }
+
+        // Skip any extended data items; PMTraceConsumer doesn't use them.
+        if (hdr->Flags & EVENT_HEADER_FLAG_EXTENDED_INFO) {
+            for (;;) {
+                if (headerSize + EXTENDED_ITEM_HEADER_SIZE > size) {
+                    mCorrupt = true;
+                    return false;
+                }
+                auto linkage  = Read<uint16_t>(record + headerSize + 4) & 1;
+                auto dataSize = Read<uint16_t>(record + headerSize + 6);
+                headerSize += AlignRecordSize(EXTENDED_ITEM_HEADER_SIZE + dataSize);
+                if (!linkage) {
+                    break;
+                }
+            }
+            if (headerSize > size) {
+                mCorrupt = true;
+                return false;
+            }
+        }
+        break;
+    }
+
+    default:
+        return false;
+    }
+
+    eventRecord->UserData = (void*) (record + headerSize);
+    eventRecord->UserDataLength = (USHORT) (size - headerSize);
+    return true;
+}
+
+bool EtlReader::ReadEvent(EVENT_RECORD* eventRecord)
+{
+    auto greater = [this](uint32_t a, uint32_t b) { return CursorGreater(mCursors[a], a, mCursors[b], b); };
+
+    while (!mHeap.empty()) {
+        std::pop_heap(mHeap.begin(), mHeap.end(), greater);
+        auto cursor = &mCursors[mHeap.back()];
+
+        // The previous event is no longer needed, so its view can be released before this cursor
+        // moves on (and possibly retires the view that this event is in).
+        ReleaseRetiredView();
+
+        auto record = GetCursorData(*cursor);
+        auto recordSize = cursor->mRecordSize;
+        cursor->mOffset += AlignRecordSize(recordSize);
+        if (AdvanceCursor(cursor)) {
+            std::push_heap(mHeap.begin(), mHeap.end(), greater);
+        } else {
+            mHeap.pop_back();
+        }
+
+        if (DecodeRecord(record, recordSize, cursor->mProcessorIndex, eventRecord)) {
+            return true;
+        }
+        mSkippedEventCount += 1;
+    }
+
+    return false;
+}
+
+void EtlReader::Seek(uint64_t timestamp)
+{
+    mHeap.clear();
+    for (auto& cursor : mCursors) {
+        // Find the last buffer that starts before timestamp; the first event at or after timestamp
+        // is either in that buffer or at the start of the next one.  Buffers without any events
+        // are treated as starting before timestamp.
+        size_t lo = 0;
+        size_t hi = cursor.mBuffers.size();
+        while (hi - lo > 1) {
+            auto mid = lo + (hi - lo) / 2;
+            uint64_t firstTimestamp = 0;
+            if (GetFirstTimestamp(cursor.mBuffers[mid], &firstTimestamp) && firstTimestamp >= timestamp) {
+                hi = mid;
+            } else {
+                lo = mid;
+            }
+        }
+
+        SetCursorBuffer(&cursor, lo);
+        while (AdvanceCursor(&cursor)) {
+            if (cursor.mTimestamp >= timestamp && cursor.mOffset != BUFFER_HEADER_SIZE) {
+                mHeap.emplace_back((uint32_t) (&cursor - mCursors.data()));
+                break;
+            }
+            cursor.mOffset += AlignRecordSize(cursor.mRecordSize);
+        }
+    }
+
+    auto greater = [this](uint32_t a, uint32_t b) { return CursorGreater(mCursors[a], a, mCursors[b], b); };
+    std::make_heap(mHeap.begin(), mHeap.end(), greater);
+}
+
+bool EtlReader::GetTimestampRange(uint64_t* firstTimestamp, uint64_t* lastTimestamp)
+{
+    bool found = false;
+    *firstTimestamp = UINT64_MAX;
+    *lastTimestamp = 0;
+    for (auto const& cursor : mCursors) {
+        for (auto const& buffer : cursor.mBuffers) {
+            uint64_t timestamp = 0;
+            if (GetFirstTimestamp(buffer, &timestamp)) {
+                *firstTimestamp = std::min(*firstTimestamp, timestamp);
+                found = true;
+                break;
+            }
+        }
+        for (auto ii = cursor.mBuffers.rbegin(), ie = cursor.mBuffers.rend(); ii != ie; ++ii) {
+            uint64_t timestamp = 0;
+            if (GetLastTimestamp(*ii, &timestamp)) {
+                *lastTimestamp = std::max(*lastTimestamp, timestamp);
+                break;
+            }
+        }
+    }
+    return found;
+}
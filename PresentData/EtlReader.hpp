@@ -0,0 +1,99 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <windows.h>
+#include <evntcons.h> // must include after windows.h
+#include <evntrace.h>
+
+// EtlReader reads events directly out of a memory-mapped ETL file, as an alternative to
+// OpenTrace()/ProcessTrace().  Events are returned in timestamp order, merged across the
+// per-processor buffers, and each EVENT_RECORD points at the event's data inside the mapped file
+// so no event data is copied.  The file is mapped a window at a time, with a separate view for
+// each processor's buffers, so files larger than the address space can be read.
+//
+// Only the event formats that PMTraceConsumer handles are decoded: manifest/TraceLogging events
+// (EVENT_HEADER), classic events (EVENT_TRACE_HEADER), and kernel process events
+// (SYSTEM_TRACE_HEADER).  Other kernel events are skipped.  Timestamps are returned raw, as with
+// PROCESS_TRACE_MODE_RAW_TIMESTAMP.
+//
+// Compressed ETLs are not supported; Open() returns ERROR_NOT_SUPPORTED for them so the caller
+// can fall back to ProcessTrace().
+struct EtlReader {
+    enum : uint64_t {
+        VIEW_SIZE = 1024 * 1024,        // Minimum size of each mapped window
+    };
+
+    struct View {
+        uint8_t const* mData;
+        uint64_t mOffset;               // File offset of mData[0]
+        uint64_t mSize;
+    };
+
+    struct Buffer {
+        uint64_t mOffset;               // File offset of the buffer
+        uint32_t mDataEnd;              // Offset of the end of the buffer's events, relative to mOffset
+    };
+
+    // Each processor's buffers are read in file order, which is also timestamp order.
+    struct Cursor {
+        std::vector<Buffer> mBuffers;
+        size_t mBufferIndex;
+        uint64_t mOffset;               // File offset of the next record
+        uint64_t mEnd;                  // File offset of the end of the current buffer's events
+        uint64_t mTimestamp;            // Timestamp of the next record
+        uint32_t mRecordSize;           // Size of the next record
+        uint16_t mProcessorIndex;
+        View mView;                     // Maps the current buffer
+    };
+
+    uint64_t mSize = 0;                 // Size of the file
+    TRACE_LOGFILE_HEADER mLogfileHeader = {};   // Decoded from the first event in the file
+    std::vector<Cursor> mCursors;
+    std::vector<uint32_t> mHeap;        // Min-heap of mCursors indices, ordered by next timestamp
+    uint64_t mSkippedEventCount = 0;    // Events with unsupported headers or providers
+    bool mCorrupt = false;              // A malformed record was found, or a buffer couldn't be mapped
+
+    HANDLE mFile = INVALID_HANDLE_VALUE;
+    HANDLE mMapping = NULL;
+    View mScanView = {};                // Used to read buffers outside of the cursors
+    View mRetiredView = {};             // A cursor's previous view, which the last event read may point into
+
+    EtlReader() = default;
+    EtlReader(EtlReader const&) = delete;
+    EtlReader& operator=(EtlReader const&) = delete;
+    ~EtlReader();
+
+    // Returns ERROR_SUCCESS, or an error code if the file couldn't be opened or isn't supported.
+    ULONG Open(wchar_t const* path);
+    void Close();
+
+    // Reads the next event, returning false at the end of the file.  eventRecord->UserData points
+    // into the mapped file, and remains valid until the next call to ReadEvent(), Seek(), or
+    // Close().
+    bool ReadEvent(EVENT_RECORD* eventRecord);
+
+    // Position the reader so that the next event read is the first one with a timestamp at or
+    // after the given timestamp.  Each processor's buffers are located with a binary search, so
+    // this is much faster than reading up to the timestamp.  The logfile header event is not
+    // returned after a Seek().
+    void Seek(uint64_t timestamp);
+
+    // Get the timestamps of the first and last events in the file, excluding the logfile header.
+    // Returns false if the file has no other events.
+    bool GetTimestampRange(uint64_t* firstTimestamp, uint64_t* lastTimestamp);
+
+    ULONG ParseBuffers();
+    bool DecodeLogfileHeader(uint8_t const* data, uint32_t size);
+    bool DecodeRecord(uint8_t const* record, uint32_t size, uint16_t processorIndex, EVENT_RECORD* eventRecord);
+    bool AdvanceCursor(Cursor* cursor);
+    void SetCursorBuffer(Cursor* cursor, size_t bufferIndex);
+    uint8_t const* GetCursorData(Cursor const& cursor) const;
+    bool GetFirstTimestamp(Buffer const& buffer, uint64_t* timestamp);
+    bool GetLastTimestamp(Buffer const& buffer, uint64_t* timestamp);
+    uint8_t const* MapRange(View* view, uint64_t offset, uint64_t size, bool retire);
+    void UnmapView(View* view);
+    void ReleaseRetiredView();
+};
@@ -0,0 +1,272 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include "EventStream.hpp"
+#include "PresentMonTraceConsumer.hpp"
+#include "PresentMonTraceSession.hpp"
+
+#include <assert.h>
+#include <string.h>
+
+namespace {
+
+enum : size_t {
+    RECORD_ALIGNMENT = 8,
+    WRITE_BUFFER_SIZE = 1024 * 1024,
+};
+
+size_t AlignRecordSize(size_t size)
+{
+    return (size + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1);
+}
+
+}
+
+void ToEventStreamDescriptor(GUID const& providerId, EVENT_DESCRIPTOR const& desc, EventStreamDescriptor* out)
+{
+    static_assert(sizeof(GUID) == sizeof(out->mProviderId), "Unexpected GUID size");
+    memcpy(out->mProviderId, &providerId, sizeof(GUID));
+    out->mId      = desc.Id;
+    out->mVersion = desc.Version;
+    out->mChannel = desc.Channel;
+    out->mLevel   = desc.Level;
+    out->mOpcode  = desc.Opcode;
+    out->mTask    = desc.Task;
+    out->mKeyword = desc.Keyword;
+}
+
+void FromEventStreamDescriptor(EventStreamDescriptor const& in, GUID* providerId, EVENT_DESCRIPTOR* desc)
+{
+    memcpy(providerId, in.mProviderId, sizeof(GUID));
+    desc->Id      = in.mId;
+    desc->Version = in.mVersion;
+    desc->Channel = in.mChannel;
+    desc->Level   = in.mLevel;
+    desc->Opcode  = in.mOpcode;
+    desc->Task    = in.mTask;
+    desc->Keyword = in.mKeyword;
+}
+
+EventStreamWriter::~EventStreamWriter()
+{
+    if (mFile != nullptr) {
+        fclose(mFile);
+    }
+}
+
+bool EventStreamWriter::Open(wchar_t const* path)
+{
+    assert(mFile == nullptr);
+
+    if (_wfopen_s(&mFile, path, L"wb") != 0) {
+        mFile = nullptr;
+        return false;
+    }
+
+    // Reserve space for the header, which is written by Close().
+    EventStreamFileHeader header = {};
+    mBuffer.reserve(WRITE_BUFFER_SIZE);
+    mBuffer.assign((uint8_t const*) &header, (uint8_t const*) &header + sizeof(header));
+    mEventCount = 0;
+    mWriteError = false;
+    return true;
+}
+
+void EventStreamWriter::WriteRecord(uint32_t type, void const* data1, uint32_t size1, void const* data2, uint32_t size2)
+{
+    EventStreamRecordHeader header = {};
+    header.mType = type;
+    header.mSize = size1 + size2;
+
+    auto offset = mBuffer.size();
+    mBuffer.resize(offset + sizeof(header) + AlignRecordSize(header.mSize), 0);
+
+    auto p = mBuffer.data() + offset;
+    memcpy(p, &header, sizeof(header));
+    memcpy(p + sizeof(header), data1, size1);
+    if (size2 > 0) {
+        memcpy(p + sizeof(header) + size1, data2, size2);
+    }
+
+    if (mBuffer.size() >= WRITE_BUFFER_SIZE) {
+        Flush();
+    }
+}
+
+void EventStreamWriter::Flush()
+{
+    if (mFile != nullptr && !mBuffer.empty()) {
+        if (fwrite(mBuffer.data(), 1, mBuffer.size(), mFile) != mBuffer.size()) {
+            mWriteError = true;
+        }
+    }
+    mBuffer.clear();
+}
+
+void EventStreamWriter::WriteEvent(EVENT_RECORD const* eventRecord)
+{
+    auto const& hdr = eventRecord->EventHeader;
+
+    EventStreamEvent event = {};
+    ToEventStreamDescriptor(hdr.ProviderId, hdr.EventDescriptor, &event.mDescriptor);
+    event.mTimestamp      = hdr.TimeStamp.QuadPart;
+    event.mProcessId      = hdr.ProcessId;
+    event.mThreadId       = hdr.ThreadId;
+    event.mFlags          = hdr.Flags;
+    event.mEventProperty  = hdr.EventProperty;
+    event.mUserDataLength = eventRecord->UserDataLength;
+
+    WriteRecord(EVENT_STREAM_RECORD_EVENT, &event, sizeof(event), eventRecord->UserData, eventRecord->UserDataLength);
+    mEventCount += 1;
+}
+
+bool EventStreamWriter::Close(PMTraceSession const& session)
+{
+    if (mFile == nullptr) {
+        return false;
+    }
+
+    // Write the metadata for every event the consumer decoded, whether it came from TDH or from
+    // metadata embedded in an ETL.
+    for (auto const& pr : session.mPMConsumer->mMetadata.metadata_) {
+        EventStreamDescriptor desc = {};
+        ToEventStreamDescriptor(pr.first.guid_, pr.first.desc_, &desc);
+        WriteRecord(EVENT_STREAM_RECORD_METADATA, &desc, sizeof(desc), pr.second.data(), (uint32_t) pr.second.size());
+    }
+    Flush();
+
+    EventStreamFileHeader header = {};
+    header.mMagic              = EVENT_STREAM_MAGIC;
+    header.mVersion            = EVENT_STREAM_VERSION;
+    header.mTimestampFrequency = session.mTimestampFrequency.QuadPart;
+    header.mStartTimestamp     = session.mStartTimestamp.QuadPart;
+    header.mStartFileTime      = session.mStartFileTime;
+    header.mTimestampType      = session.mTimestampType;
+    if (fseek(mFile, 0, SEEK_SET) != 0 ||
+        fwrite(&header, sizeof(header), 1, mFile) != 1) {
+        mWriteError = true;
+    }
+
+    if (fclose(mFile) != 0) {
+        mWriteError = true;
+    }
+    mFile = nullptr;
+
+    return !mWriteError;
+}
+
+bool EventStreamReader::Open(wchar_t const* path)
+{
+    FILE* fp = nullptr;
+    if (_wfopen_s(&fp, path, L"rb") != 0) {
+        return false;
+    }
+
+    std::vector<uint8_t> data;
+    if (_fseeki64(fp, 0, SEEK_END) == 0) {
+        auto size = _ftelli64(fp);
+        if (size > 0 && _fseeki64(fp, 0, SEEK_SET) == 0) {
+            data.resize((size_t) size);
+            if (fread(data.data(), 1, data.size(), fp) != data.size()) {
+                data.clear();
+            }
+        }
+    }
+    fclose(fp);
+
+    return Open(std::move(data));
+}
+
+bool EventStreamReader::Open(std::vector<uint8_t>&& data)
+{
+    mData = std::move(data);
+    mCorrupt = false;
+
+    if (mData.size() < sizeof(EventStreamFileHeader) ||
+        Header().mMagic != EVENT_STREAM_MAGIC ||
+        Header().mVersion != EVENT_STREAM_VERSION) {
+        mData.clear();
+        mOffset = 0;
+        return false;
+    }
+
+    Rewind();
+    return true;
+}
+
+bool EventStreamReader::ReadRecord(EventStreamRecordHeader const** header, uint8_t const** data)
+{
+    if (mOffset + sizeof(EventStreamRecordHeader) > mData.size()) {
+        mCorrupt = mOffset != mData.size();
+        return false;
+    }
+
+    auto h = (EventStreamRecordHeader const*) (mData.data() + mOffset);
+    auto recordSize = sizeof(EventStreamRecordHeader) + AlignRecordSize(h->mSize);
+    if (recordSize > mData.size() - mOffset) {
+        mCorrupt = true;
+        return false;
+    }
+
+    *header = h;
+    *data = mData.data() + mOffset + sizeof(EventStreamRecordHeader);
+    mOffset += recordSize;
+    return true;
+}
+
+void EventStreamReader::LoadMetadata(EventMetadata* metadata) const
+{
+    auto reader = const_cast<EventStreamReader*>(this);
+    auto offset = reader->mOffset;
+    reader->Rewind();
+
+    EventStreamRecordHeader const* header = nullptr;
+    uint8_t const* data = nullptr;
+    while (reader->ReadRecord(&header, &data)) {
+        if (header->mType == EVENT_STREAM_RECORD_METADATA && header->mSize >= sizeof(EventStreamDescriptor)) {
+            EventMetadataKey key;
+            FromEventStreamDescriptor(*(EventStreamDescriptor const*) data, &key.guid_, &key.desc_);
+
+            auto metadataData = data + sizeof(EventStreamDescriptor);
+            auto metadataSize = header->mSize - sizeof(EventStreamDescriptor);
+            metadata->metadata_[key].assign(metadataData, metadataData + metadataSize);
+            metadata->plans_.erase(key);
+        }
+    }
+
+    reader->mOffset = offset;
+}
+
+bool EventStreamReader::ReadEvent(EVENT_RECORD* eventRecord)
+{
+    EventStreamRecordHeader const* header = nullptr;
+    uint8_t const* data = nullptr;
+    while (ReadRecord(&header, &data)) {
+        if (header->mType != EVENT_STREAM_RECORD_EVENT) {
+            continue;
+        }
+
+        auto event = (EventStreamEvent const*) data;
+        if (header->mSize < sizeof(EventStreamEvent) ||
+            header->mSize - sizeof(EventStreamEvent) != event->mUserDataLength) {
+            mCorrupt = true;
+            return false;
+        }
+
+        auto userContext = eventRecord->UserContext;
+        memset(eventRecord, 0, sizeof(EVENT_RECORD));
+        eventRecord->EventHeader.Size          = sizeof(EVENT_HEADER);
+        eventRecord->EventHeader.Flags         = event->mFlags;
+        eventRecord->EventHeader.EventProperty = event->mEventProperty;
+        eventRecord->EventHeader.ThreadId      = event->mThreadId;
+        eventRecord->EventHeader.ProcessId     = event->mProcessId;
+        eventRecord->EventHeader.TimeStamp.QuadPart = event->mTimestamp;
+        FromEventStreamDescriptor(event->mDescriptor, &eventRecord->EventHeader.ProviderId, &eventRecord->EventHeader.EventDescriptor);
+        eventRecord->UserDataLength = event->mUserDataLength;
+        eventRecord->UserData       = (void*) (data + sizeof(EventStreamEvent));
+        eventRecord->UserContext    = userContext;
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,132 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include <windows.h>
+#include <evntcons.h> // must include after windows.h
+
+struct EventMetadata;
+struct PMTraceSession;
+
+// An event stream is a compact binary recording of the events delivered to a PMTraceConsumer,
+// along with the metadata needed to decode them.  Unlike an ETL, it can be read without any ETW
+// APIs, and replaying it (see PMTraceSession::StartReplay() and PresentMon's hidden
+// --replay_event_stream option) feeds the consumer as fast as it can process the events.
+//
+// The file format is platform-neutral, but EventStreamWriter and EventStreamReader are only
+// built for Windows: they use the Win32 EVENT_RECORD/GUID types and the MSVC CRT's _wfopen_s()
+// and _fseeki64(), the same as the rest of PresentData.
+//
+// All fields are little-endian.  The file starts with an EventStreamFileHeader, followed by a
+// sequence of records.  Each record starts with an EventStreamRecordHeader, and is padded to a
+// multiple of 8 bytes so that all records are 8-byte aligned.
+//
+// Event records are an EventStreamEvent followed by the event's user data.  Metadata records are
+// an EventStreamDescriptor followed by the event's TRACE_EVENT_INFO.  Metadata records may appear
+// anywhere in the stream, and apply to all events with the same descriptor.
+
+enum : uint32_t {
+    EVENT_STREAM_MAGIC   = 0x53454d50, // "PMES"
+    EVENT_STREAM_VERSION = 1,
+};
+
+enum EventStreamRecordType : uint32_t {
+    EVENT_STREAM_RECORD_EVENT    = 1,
+    EVENT_STREAM_RECORD_METADATA = 2,
+};
+
+struct EventStreamFileHeader {
+    uint32_t mMagic;
+    uint32_t mVersion;
+    uint64_t mTimestampFrequency;
+    uint64_t mStartTimestamp;
+    uint64_t mStartFileTime;
+    uint32_t mTimestampType;            // PMTraceSession::TimestampType
+    uint32_t mReserved;
+};
+
+struct EventStreamRecordHeader {
+    uint32_t mType;                     // EventStreamRecordType
+    uint32_t mSize;                     // Size of the record following this header, excluding padding
+};
+
+// Platform-neutral equivalent of EVENT_HEADER::ProviderId and EVENT_HEADER::EventDescriptor.
+struct EventStreamDescriptor {
+    uint8_t mProviderId[16];
+    uint16_t mId;
+    uint8_t mVersion;
+    uint8_t mChannel;
+    uint8_t mLevel;
+    uint8_t mOpcode;
+    uint16_t mTask;
+    uint64_t mKeyword;
+};
+
+// Platform-neutral equivalent of the EVENT_RECORD fields used by PMTraceConsumer.
+struct EventStreamEvent {
+    EventStreamDescriptor mDescriptor;
+    uint64_t mTimestamp;
+    uint32_t mProcessId;
+    uint32_t mThreadId;
+    uint16_t mFlags;                    // EVENT_HEADER_FLAG_*
+    uint16_t mEventProperty;            // EVENT_HEADER_PROPERTY_*
+    uint16_t mUserDataLength;
+    uint16_t mReserved;
+};
+
+static_assert(sizeof(EventStreamFileHeader) == 40, "Unexpected EventStreamFileHeader layout");
+static_assert(sizeof(EventStreamRecordHeader) == 8, "Unexpected EventStreamRecordHeader layout");
+static_assert(sizeof(EventStreamDescriptor) == 32, "Unexpected EventStreamDescriptor layout");
+static_assert(sizeof(EventStreamEvent) == 56, "Unexpected EventStreamEvent layout");
+
+// EventStreamWriter records events into an event stream file.  Set PMTraceSession::mEventStreamWriter
+// to record all the events delivered to the session's consumer.
+struct EventStreamWriter {
+    FILE* mFile = nullptr;
+    std::vector<uint8_t> mBuffer;       // Records that haven't been written to mFile yet
+    uint64_t mEventCount = 0;
+    bool mWriteError = false;
+
+    EventStreamWriter() = default;
+    EventStreamWriter(EventStreamWriter const&) = delete;
+    EventStreamWriter& operator=(EventStreamWriter const&) = delete;
+    ~EventStreamWriter();
+
+    bool Open(wchar_t const* path);
+    void WriteEvent(EVENT_RECORD const* eventRecord);
+
+    // Writes the metadata that the session's consumer used and the file header, then closes the
+    // file.  Returns false if any write failed.
+    bool Close(PMTraceSession const& session);
+
+    void WriteRecord(uint32_t type, void const* data1, uint32_t size1, void const* data2, uint32_t size2);
+    void Flush();
+};
+
+// EventStreamReader reads an event stream file into memory.
+struct EventStreamReader {
+    std::vector<uint8_t> mData;
+    size_t mOffset = 0;                 // Offset of the next record to read
+    bool mCorrupt = false;              // A malformed record was found
+
+    bool Open(wchar_t const* path);
+    bool Open(std::vector<uint8_t>&& data);
+
+    EventStreamFileHeader const& Header() const { return *(EventStreamFileHeader const*) mData.data(); }
+
+    // Adds all the metadata records in the stream to metadata.
+    void LoadMetadata(EventMetadata* metadata) const;
+
+    // Reads the next event, returning false at the end of the stream.  eventRecord->UserData points
+    // into mData, and remains valid until the reader is destroyed or re-opened.
+    bool ReadEvent(EVENT_RECORD* eventRecord);
+
+    void Rewind() { mOffset = sizeof(EventStreamFileHeader); }
+    bool ReadRecord(EventStreamRecordHeader const** header, uint8_t const** data);
+};
+
+void ToEventStreamDescriptor(GUID const& providerId, EVENT_DESCRIPTOR const& desc, EventStreamDescriptor* out);
+void FromEventStreamDescriptor(EventStreamDescriptor const& in, GUID* providerId, EVENT_DESCRIPTOR* desc);
@@ -0,0 +1,243 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+// FlatHashMapHash is the default hash used by FlatHashMap.  Integer keys are
+// used directly, since FlatHashMap mixes the hash before using it.
+template<typename Key> struct FlatHashMapHash : std::hash<Key> {};
+template<> struct FlatHashMapHash<uint32_t> { uint64_t operator()(uint32_t k) const { return k; } };
+template<> struct FlatHashMapHash<uint64_t> { uint64_t operator()(uint64_t k) const { return k; } };
+
+// FlatHashMap is an open-addressing hash table using linear probing, with
+// elements stored inline in a single power-of-two sized array.  Deletion uses
+// backward-shifting, so there are no tombstones and lookups never have to
+// probe past erased elements.
+//
+// The interface is a subset of std::unordered_map, except:
+//     - Elements are stored in Slots, which have first/second members like
+//       std::pair.
+//     - Any insertion may invalidate all iterators and element references.
+//     - erase() may move other elements, so it invalidates all iterators
+//       except end().  Use erase(key) if the table may have been modified
+//       since the iterator was obtained.
+//     - probe() can be used to visit all elements that share a hash value.
+template<typename Key, typename Value, typename Hash = FlatHashMapHash<Key>, typename KeyEqual = std::equal_to<Key>>
+class FlatHashMap {
+public:
+    struct Slot {
+        Key first;
+        Value second;
+        bool mOccupied;
+    };
+
+    template<typename SlotT>
+    struct Iterator {
+        SlotT* mSlot;
+        SlotT* mEnd;
+
+        Iterator(SlotT* slot, SlotT* end) : mSlot(slot), mEnd(end) {}
+        SlotT& operator*() const { return *mSlot; }
+        SlotT* operator->() const { return mSlot; }
+        Iterator& operator++() { ++mSlot; SkipEmpty(); return *this; }
+        bool operator==(Iterator const& rhs) const { return mSlot == rhs.mSlot; }
+        bool operator!=(Iterator const& rhs) const { return mSlot != rhs.mSlot; }
+        void SkipEmpty() { while (mSlot != mEnd && !mSlot->mOccupied) ++mSlot; }
+    };
+
+    using iterator       = Iterator<Slot>;
+    using const_iterator = Iterator<Slot const>;
+
+    iterator begin() { iterator it(mSlots.data(), mSlots.data() + mSlots.size()); it.SkipEmpty(); return it; }
+    iterator end()   { return iterator(mSlots.data() + mSlots.size(), mSlots.data() + mSlots.size()); }
+    const_iterator begin() const { const_iterator it(mSlots.data(), mSlots.data() + mSlots.size()); it.SkipEmpty(); return it; }
+    const_iterator end() const   { return const_iterator(mSlots.data() + mSlots.size(), mSlots.data() + mSlots.size()); }
+
+    bool empty() const { return mSize == 0; }
+    size_t size() const { return mSize; }
+    size_t bucket_count() const { return mSlots.size(); }
+
+    // Ensure that count elements can be stored without growing the table.
+    void reserve(size_t count)
+    {
+        size_t capacity = MIN_CAPACITY;
+        while (capacity * MAX_LOAD_NUMERATOR < count * MAX_LOAD_DENOMINATOR) {
+            capacity *= 2;
+        }
+        if (capacity > mSlots.size()) {
+            Rehash(capacity);
+        }
+    }
+
+    iterator find(Key const& key)
+    {
+        if (mSize == 0) {
+            return end();
+        }
+        for (auto i = HomeIndex(Hash()(key));; i = (i + 1) & mMask) {
+            auto slot = &mSlots[i];
+            if (!slot->mOccupied) {
+                return end();
+            }
+            if (KeyEqual()(slot->first, key)) {
+                return iterator(slot, mSlots.data() + mSlots.size());
+            }
+        }
+    }
+
+    const_iterator find(Key const& key) const
+    {
+        auto ii = const_cast<FlatHashMap*>(this)->find(key);
+        return const_iterator(ii.mSlot, ii.mEnd);
+    }
+
+    // Inserts (key, value) if key isn't already in the table.  Returns the
+    // element with key, and whether it was inserted.
+    template<typename V>
+    std::pair<iterator, bool> emplace(Key const& key, V&& value)
+    {
+        auto ii = find(key);
+        if (ii != end()) {
+            return std::make_pair(ii, false);
+        }
+
+        if ((mSize + 1) * MAX_LOAD_DENOMINATOR > mSlots.size() * MAX_LOAD_NUMERATOR) {
+            Rehash(mSlots.empty() ? MIN_CAPACITY : mSlots.size() * 2);
+        }
+
+        auto slot = Insert(key);
+        slot->second = std::forward<V>(value);
+        return std::make_pair(iterator(slot, mSlots.data() + mSlots.size()), true);
+    }
+
+    Value& operator[](Key const& key)
+    {
+        return emplace(key, Value()).first->second;
+    }
+
+    void erase(iterator pos)
+    {
+        // Shift subsequent elements in the probe run back into the hole, as
+        // long as doing so doesn't move them before their home slot.
+        auto hole = (size_t) (pos.mSlot - mSlots.data());
+        for (auto i = (hole + 1) & mMask;; i = (i + 1) & mMask) {
+            auto slot = &mSlots[i];
+            if (!slot->mOccupied) {
+                break;
+            }
+            auto home = HomeIndex(Hash()(slot->first));
+            if (((i - home) & mMask) >= ((i - hole) & mMask)) {
+                mSlots[hole].first  = std::move(slot->first);
+                mSlots[hole].second = std::move(slot->second);
+                hole = i;
+            }
+        }
+
+        mSlots[hole].first = Key();
+        mSlots[hole].second = Value();
+        mSlots[hole].mOccupied = false;
+        mSize -= 1;
+    }
+
+    size_t erase(Key const& key)
+    {
+        auto ii = find(key);
+        if (ii == end()) {
+            return 0;
+        }
+        erase(ii);
+        return 1;
+    }
+
+    void clear()
+    {
+        for (auto& slot : mSlots) {
+            if (slot.mOccupied) {
+                slot.first = Key();
+                slot.second = Value();
+                slot.mOccupied = false;
+            }
+        }
+        mSize = 0;
+    }
+
+    // Calls func(slot) for each element in the probe run that elements with
+    // the specified hash value are stored in, until func returns true.
+    // Returns the element that func returned true for, or end().  Elements
+    // with other hash values may also be visited.
+    template<typename Func>
+    iterator probe(uint64_t hash, Func func)
+    {
+        if (mSize == 0) {
+            return end();
+        }
+        for (auto i = HomeIndex(hash);; i = (i + 1) & mMask) {
+            auto slot = &mSlots[i];
+            if (!slot->mOccupied) {
+                return end();
+            }
+            if (func(*slot)) {
+                return iterator(slot, mSlots.data() + mSlots.size());
+            }
+        }
+    }
+
+private:
+    enum : size_t {
+        MIN_CAPACITY = 16,
+        MAX_LOAD_NUMERATOR = 3,    // Grow when more than 3/4 full
+        MAX_LOAD_DENOMINATOR = 4,
+    };
+
+    std::vector<Slot> mSlots;
+    size_t mSize = 0;
+    size_t mMask = 0;
+    uint32_t mShift = 64;
+
+    // Fibonacci hashing: multiply by 2^64/phi and use the top bits, so that
+    // keys that only differ in their low (or high) bits are spread out.
+    size_t HomeIndex(uint64_t hash) const
+    {
+        return (size_t) ((hash * 0x9E3779B97F4A7C15ull) >> mShift);
+    }
+
+    Slot* Insert(Key const& key)
+    {
+        for (auto i = HomeIndex(Hash()(key));; i = (i + 1) & mMask) {
+            auto slot = &mSlots[i];
+            if (!slot->mOccupied) {
+                slot->first = key;
+                slot->mOccupied = true;
+                mSize += 1;
+                return slot;
+            }
+        }
+    }
+
+    void Rehash(size_t capacity)
+    {
+        std::vector<Slot> slots(capacity);
+        for (auto& slot : slots) {
+            slot.mOccupied = false;
+        }
+        slots.swap(mSlots);
+
+        mSize = 0;
+        mMask = capacity - 1;
+        mShift = 64;
+        for (size_t c = capacity; c > 1; c >>= 1) {
+            mShift -= 1;
+        }
+
+        for (auto& slot : slots) {
+            if (slot.mOccupied) {
+                Insert(slot.first)->second = std::move(slot.second);
+            }
+        }
+    }
+};
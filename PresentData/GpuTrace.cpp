@@ -5,6 +5,11 @@
 
 namespace {
 
+// Node queues are never smaller than MIN_QUEUE_SIZE entries, and NodeOrdinals at or above
+// MAX_NODE_COUNT are assumed to be invalid and are not tracked.
+uint32_t const MIN_QUEUE_SIZE = 16;
+uint32_t const MAX_NODE_COUNT = 1024;
+
 void DebugPrintAccumulatedGpuTime(uint32_t processId, uint64_t accumulatedTime, uint64_t startTime, uint64_t endTime)
 {
     auto addedTime = endTime - startTime;
@@ -46,7 +51,7 @@ void GpuTrace::PrintRunningContexts() const
             wprintf(L"                             hContext=0x%llx [", hContext);
 
             for (uint32_t i = 0; i < node.mQueueCount; ++i) {
-                auto queueIdx = (node.mQueueIndex + i) % (uint32_t) node.mQueue.size();
+                auto queueIdx = (node.mQueueIndex + i) & ((uint32_t) node.mQueue.size() - 1);
                 auto const& entry = node.mQueue[queueIdx];
 
                 if (i > 0) {
@@ -75,6 +80,20 @@ GpuTrace::GpuTrace(PMTraceConsumer* pmConsumer)
 {
 }
 
+GpuTrace::Node* GpuTrace::GetNode(uint64_t pDxgAdapter, uint32_t nodeOrdinal)
+{
+    DebugAssert(nodeOrdinal < MAX_NODE_COUNT);
+    if (nodeOrdinal >= MAX_NODE_COUNT) {
+        return nullptr;
+    }
+
+    auto nodes = &mNodes[pDxgAdapter];
+    if (nodeOrdinal >= nodes->size()) {
+        nodes->resize(nodeOrdinal + 1);
+    }
+    return &(*nodes)[nodeOrdinal];
+}
+
 void GpuTrace::RegisterDevice(uint64_t hDevice, uint64_t pDxgAdapter)
 {
     // Sometimes there are duplicate start events
@@ -95,8 +114,10 @@ void GpuTrace::RegisterContext(uint64_t hContext, uint64_t hDevice, uint32_t nod
     if (deviceIter == mDevices.end()) {
         return;
     }
-    auto pDxgAdapter = deviceIter->second;
-    auto node = &mNodes[pDxgAdapter].emplace(nodeOrdinal, Node{}).first->second;
+    auto node = GetNode(deviceIter->second, nodeOrdinal);
+    if (node == nullptr) {
+        return;
+    }
 
     // Sometimes there are duplicate start events, make sure that they say the same thing
     DebugAssert(mContexts.find(hContext) == mContexts.end() || mContexts.find(hContext)->second.mNode == node);
@@ -159,8 +180,11 @@ void GpuTrace::RegisterHwQueueContext(uint64_t hContext, uint64_t parentDxgHwQue
     node->mQueueCount = 0;
     node->mIsVideo = parentContext->mNode->mIsVideo;
 
+    // Inserting into mContexts may move parentContext.
+    auto packetTrace = parentContext->mPacketTrace;
+
     auto hwQueueContext = &mContexts.emplace(parentDxgHwQueue, Context()).first->second;
-    hwQueueContext->mPacketTrace = parentContext->mPacketTrace;
+    hwQueueContext->mPacketTrace = packetTrace;
     hwQueueContext->mNode = node;
     hwQueueContext->mParentContext = hContext;
     hwQueueContext->mIsParentContext = false;
@@ -172,23 +196,29 @@ void GpuTrace::UnregisterContext(uint64_t hContext)
     // Sometimes there are duplicate stop events so it's ok if it's already
     // removed
     auto ii = mContexts.find(hContext);
-    auto ie = mContexts.end();
-    if (ii != ie) {
-        auto isParentContext = ii->second.mIsParentContext;
-        mContexts.erase(ii);
-
-        if (isParentContext) {
-            for (ii = mContexts.begin(); ii != ie; ) {
-                auto const& context = ii->second;
-                if (context.mParentContext == hContext) {
-                    DebugAssert(context.mIsHwQueue);
-                    delete context.mNode;
-                    ii = mContexts.erase(ii);
-                } else {
-                    ++ii;
-                }
+    if (ii == mContexts.end()) {
+        return;
+    }
+
+    auto isParentContext = ii->second.mIsParentContext;
+    mContexts.erase(ii);
+
+    // Erasing from mContexts moves other elements, so find all of the
+    // parent's HwQueue contexts before removing them.
+    if (isParentContext) {
+        std::vector<uint64_t> hwQueueContexts;
+        for (auto const& pr : mContexts) {
+            if (pr.second.mParentContext == hContext) {
+                DebugAssert(pr.second.mIsHwQueue);
+                hwQueueContexts.push_back(pr.first);
             }
         }
+
+        for (auto hHwQueueContext : hwQueueContexts) {
+            auto jj = mContexts.find(hHwQueueContext);
+            delete jj->second.mNode;
+            mContexts.erase(jj);
+        }
     }
 }
 
@@ -196,7 +226,10 @@ void GpuTrace::SetEngineType(uint64_t pDxgAdapter, uint32_t nodeOrdinal, Microso
 {
     // Node should already be created (DxgKrnl::Context_Start comes
     // first) but just to be sure...
-    auto node = &mNodes[pDxgAdapter].emplace(nodeOrdinal, Node{}).first->second;
+    auto node = GetNode(pDxgAdapter, nodeOrdinal);
+    if (node == nullptr) {
+        return;
+    }
 
     if (engineType == Microsoft_Windows_DxgKrnl::DXGK_ENGINE::VIDEO_DECODE ||
         engineType == Microsoft_Windows_DxgKrnl::DXGK_ENGINE::VIDEO_ENCODE ||
@@ -216,6 +249,22 @@ void GpuTrace::SetContextProcessId(Context* context, uint32_t processId)
     }
 }
 
+// Reallocate the node's queue with queueSize entries (a power of two), moving
+// the enqueued packets to the start of it.
+void GpuTrace::ResizeQueue(Node* node, uint32_t queueSize) const
+{
+    DebugAssert((queueSize & (queueSize - 1)) == 0 && queueSize >= node->mQueueCount);
+
+    std::vector<Node::EnqueuedPacket> queue(queueSize);
+    auto mask = (uint32_t) node->mQueue.size() - 1;
+    for (uint32_t i = 0; i < node->mQueueCount; ++i) {
+        queue[i] = node->mQueue[(node->mQueueIndex + i) & mask];
+    }
+
+    node->mQueue.swap(queue);
+    node->mQueueIndex = 0;
+}
+
 void GpuTrace::StartPacket(PacketTrace* packetTrace, uint64_t timestamp) const
 {
     packetTrace->mRunningPacketCount += 1;
@@ -262,16 +311,14 @@ void GpuTrace::EnqueueWork(Context* context, uint32_t sequenceId, uint64_t times
         return;
     }
 
-    // If the queue is too small, enlarge it by 16 entries at a time.  Typically, this will only be
-    // needed for the first packet observed on this node, which will result in sizing the queue from
-    // 0 to 16.  However, there are other cases where the queue entries can grow beyond that.  e.g.,
-    // this seems to always happen when an application closes.
+    // If the queue is full, double its size.  Typically, this will only be needed for the first
+    // packet observed on this node, which will result in sizing the queue from 0 to 16.  However,
+    // there are other cases where the queue entries can grow beyond that.  e.g., this seems to
+    // always happen when an application closes.
     uint32_t queueSize = (uint32_t) node->mQueue.size();
     if (node->mQueueCount == queueSize) {
-        Node::EnqueuedPacket empty{};
-        node->mQueue.insert(node->mQueue.begin() + node->mQueueIndex, 16, empty);
-        queueSize += 16;
-        node->mQueueIndex = (node->mQueueIndex + 16) % queueSize;
+        queueSize = queueSize == 0 ? MIN_QUEUE_SIZE : queueSize * 2;
+        ResizeQueue(node, queueSize);
     }
 
     // Enqueue the packet.
@@ -284,7 +331,7 @@ void GpuTrace::EnqueueWork(Context* context, uint32_t sequenceId, uint64_t times
         packetTrace = nullptr;
     }
 
-    auto queueIndex = (node->mQueueIndex + node->mQueueCount) % queueSize;
+    auto queueIndex = (node->mQueueIndex + node->mQueueCount) & (queueSize - 1);
     auto entry = &node->mQueue[queueIndex];
     entry->mPacketTrace = packetTrace;
     entry->mSequenceId = sequenceId;
@@ -358,7 +405,7 @@ bool GpuTrace::CompleteWork(Context* context, uint32_t sequenceId, uint64_t time
                 return false;
             }
 
-            uint32_t queueIndex = (node->mQueueIndex + missingCount) % (uint32_t) node->mQueue.size();
+            uint32_t queueIndex = (node->mQueueIndex + missingCount) & ((uint32_t) node->mQueue.size() - 1);
             auto entry = &node->mQueue[queueIndex];
             if (entry->mSequenceId == sequenceId) {
 
@@ -394,7 +441,7 @@ bool GpuTrace::CompleteWork(Context* context, uint32_t sequenceId, uint64_t time
     // Pop the completed packet from the queue, and start the next one.
     uint32_t queueSize = (uint32_t) node->mQueue.size();
     for (;;) {
-        node->mQueueIndex = (node->mQueueIndex + 1) % queueSize;
+        node->mQueueIndex = (node->mQueueIndex + 1) & (queueSize - 1);
         node->mQueueCount -= 1;
         if (node->mQueueCount == 0) {
             break;
@@ -411,19 +458,10 @@ bool GpuTrace::CompleteWork(Context* context, uint32_t sequenceId, uint64_t time
         }
     }
 
-    // Decrease queue storage in multiples of 16.
-    uint32_t N = (queueSize - node->mQueueCount) / 16;
-    if (N >= 2) {
-        N = (N - 1) * 16;
-        if (node->mQueueIndex >= N) {
-            node->mQueue.erase(node->mQueue.begin() + node->mQueueIndex - N, node->mQueue.begin() + node->mQueueIndex);
-            node->mQueueIndex -= N;
-        } else {
-            node->mQueue.erase(node->mQueue.begin() + queueSize - (N - node->mQueueIndex), node->mQueue.end());
-            node->mQueue.erase(node->mQueue.begin(), node->mQueue.begin() + node->mQueueIndex);
-            node->mQueueIndex = 0;
-        }
-        node->mQueue.shrink_to_fit();
+    // Halve the queue storage once it is no more than a quarter full, so that a queue that only
+    // grew briefly (e.g., while an application was closing) doesn't stay large.
+    if (queueSize > MIN_QUEUE_SIZE && node->mQueueCount <= queueSize / 4) {
+        ResizeQueue(node, queueSize / 2);
     }
 
     return true;
@@ -2,9 +2,12 @@
 // SPDX-License-Identifier: MIT
 #pragma once
 
+#include <deque>
 #include <stdint.h>
 #include <unordered_map>
+#include <vector>
 
+#include "FlatHashMap.hpp"
 #include "etw/Microsoft_Windows_DxgKrnl.h"
 
 struct PresentEvent;
@@ -30,7 +33,7 @@ class GpuTrace {
             uint32_t mSequenceId;           // Sequence ID for this packet
             bool mCompleted;                // Flag to signal that the packet completed out-of-order
         };
-        std::vector<EnqueuedPacket> mQueue; // Ring buffer of current enqueued packets
+        std::vector<EnqueuedPacket> mQueue; // Ring buffer of current enqueued packets, sized to a power of two
         uint32_t mQueueIndex;               // Index into mQueue for currently-running packet
         uint32_t mQueueCount;               // Number of enqueued packets
         bool mIsVideo;
@@ -53,16 +56,20 @@ class GpuTrace {
         PacketTrace mOtherEngines;
     };
 
-    std::unordered_map<uint64_t, std::unordered_map<uint32_t, Node> > mNodes;   // pDxgAdapter -> NodeOrdinal -> Node
+    // Each adapter's nodes are stored in a dense table indexed by NodeOrdinal.  The table is a
+    // std::deque so that growing it doesn't move the existing Nodes, which Contexts point to.
+    std::unordered_map<uint64_t, std::deque<Node> > mNodes;                     // pDxgAdapter -> NodeOrdinal -> Node
     std::unordered_map<uint64_t, uint64_t> mDevices;                            // hDevice -> pDxgAdapter
-    std::unordered_map<uint64_t, Context> mContexts;                            // hContext -> Context
+    FlatHashMap<uint64_t, Context> mContexts;                                   // hContext -> Context
     std::unordered_map<uint32_t, ProcessFrameInfo> mProcessFrameInfo;           // ProcessID -> ProcessFrameInfo
     std::unordered_map<uint64_t, uint32_t> mPagingSequenceIds;                  // SequenceID -> ProcessID
 
     // The parent trace consumer
     PMTraceConsumer* mPMConsumer;
 
+    Node* GetNode(uint64_t pDxgAdapter, uint32_t nodeOrdinal);
     void SetContextProcessId(Context* context, uint32_t processId);
+    void ResizeQueue(Node* node, uint32_t queueSize) const;
 
     void StartPacket(PacketTrace* packetTrace, uint64_t timestamp) const;
     void CompletePacket(PacketTrace* packetTrace, uint64_t timestamp) const;
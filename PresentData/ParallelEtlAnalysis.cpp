@@ -0,0 +1,215 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include "ParallelEtlAnalysis.hpp"
+#include "EtlReader.hpp"
+#include "PresentMonTraceConsumer.hpp"
+#include "PresentMonTraceSession.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <iterator>
+#include <thread>
+
+namespace {
+
+struct Chunk {
+    uint64_t mWarmupStart;  // Timestamp to start analyzing at
+    uint64_t mStart;        // Timestamp of the first event that belongs to the chunk
+    uint64_t mEnd;          // Timestamp after the last event that belongs to the chunk
+    uint64_t mStop;         // Timestamp to stop analyzing at
+
+    std::vector<ProcessEvent> mProcessEvents;
+
+    // Presents that started in the chunk, with the timestamp of the event that completed them.
+    std::vector<std::pair<uint64_t, std::shared_ptr<PresentEvent>>> mPresents;
+
+    ULONG mStatus = ERROR_SUCCESS;
+};
+
+void AnalyzeChunk(PMTraceSession const* session, wchar_t const* etlPath, Chunk* chunk)
+{
+    auto const& config = *session->mPMConsumer;
+
+    PMTraceConsumer consumer;
+    consumer.mFilteredEvents     = config.mFilteredEvents;
+    consumer.mFilteredProcessIds = config.mFilteredProcessIds;
+    consumer.mTrackDisplay       = config.mTrackDisplay;
+    consumer.mTrackGPU           = config.mTrackGPU;
+    consumer.mTrackGPUVideo      = config.mTrackGPUVideo;
+    consumer.mTrackInput         = config.mTrackInput;
+    consumer.mTrackFrameType     = config.mTrackFrameType;
+    consumer.mDeferralTimeLimit  = config.mDeferralTimeLimit;
+    consumer.SetMemoryBudget(config.mMemoryBudget);
+    {
+        auto mainConsumer = session->mPMConsumer;
+        std::lock_guard<std::mutex> lock(mainConsumer->mTrackedProcessFilterMutex);
+        for (auto processId : mainConsumer->mTrackedProcessFilter) {
+            consumer.AddTrackedProcessForFiltering(processId);
+        }
+    }
+
+    PMTraceSession chunkSession;
+    chunkSession.mPMConsumer         = &consumer;
+    chunkSession.mStartTimestamp     = session->mStartTimestamp;
+    chunkSession.mTimestampFrequency = session->mTimestampFrequency;
+    chunkSession.mStartFileTime      = session->mStartFileTime;
+    chunkSession.mTimestampType      = session->mTimestampType;
+
+    EtlReader reader;
+    chunk->mStatus = reader.Open(etlPath);
+    if (chunk->mStatus != ERROR_SUCCESS) {
+        return;
+    }
+
+    // The first chunk starts at the beginning of the file, so that it also sees the logfile
+    // header.
+    if (chunk->mWarmupStart != 0) {
+        reader.Seek(chunk->mWarmupStart);
+    }
+
+    auto eventRecordCallback = chunkSession.GetOfflineEventRecordCallback();
+    EVENT_RECORD eventRecord = {};
+    eventRecord.UserContext = &chunkSession;
+
+    // Presents are published synchronously with the event that completes them, so dequeue them
+    // whenever the ready count changes to record which event that was.
+    auto readyWriteCount = consumer.mReadyWriteCount.load(std::memory_order_relaxed);
+    std::vector<std::shared_ptr<PresentEvent>> presents;
+    while (session->mContinueProcessingBuffers && reader.ReadEvent(&eventRecord)) {
+        uint64_t timestamp = eventRecord.EventHeader.TimeStamp.QuadPart;
+        if (timestamp >= chunk->mStop) {
+            break;
+        }
+
+        (*eventRecordCallback)(&eventRecord);
+
+        auto writeCount = consumer.mReadyWriteCount.load(std::memory_order_relaxed);
+        if (writeCount != readyWriteCount) {
+            readyWriteCount = writeCount;
+            consumer.DequeuePresentEvents(presents);
+            for (auto const& present : presents) {
+                if (present->PresentStartTime >= chunk->mStart && present->PresentStartTime < chunk->mEnd) {
+                    chunk->mPresents.emplace_back(timestamp, present);
+                }
+            }
+        }
+    }
+
+    std::vector<ProcessEvent> processEvents;
+    consumer.DequeueProcessEvents(processEvents);
+    for (auto const& processEvent : processEvents) {
+        if (processEvent.QpcTime >= chunk->mStart && processEvent.QpcTime < chunk->mEnd) {
+            chunk->mProcessEvents.emplace_back(processEvent);
+        }
+    }
+
+    if (reader.mCorrupt) {
+        chunk->mStatus = ERROR_FILE_CORRUPT;
+    }
+}
+
+// Enqueue presents into the session's consumer, waiting for the application to dequeue them if
+// its ring is full.
+void EnqueuePresents(PMTraceSession* session, std::vector<std::shared_ptr<PresentEvent>> const& presents)
+{
+    size_t count = 0;
+    while (count < presents.size() && session->mContinueProcessingBuffers) {
+        count += session->mPMConsumer->EnqueuePresentEvents(presents.data() + count, presents.size() - count);
+        if (count < presents.size()) {
+            Sleep(1);
+        }
+    }
+}
+
+}
+
+ULONG ParallelEtlAnalysis::Run(PMTraceSession* session, wchar_t const* etlPath)
+{
+    assert(session->mEtlReader != nullptr);
+
+    auto reader = session->mEtlReader;
+    auto frequency = (double) session->mTimestampFrequency.QuadPart;
+    auto minChunkTicks = (uint64_t) (mMinChunkSeconds * frequency);
+    auto warmupTicks = (uint64_t) (mWarmupSeconds * frequency);
+    auto tailTicks = std::max((uint64_t) (mTailSeconds * frequency), session->mPMConsumer->mDeferralTimeLimit);
+
+    uint32_t chunkCount = mThreadCount != 0 ? mThreadCount : std::max(std::thread::hardware_concurrency(), 1u);
+    uint64_t firstTimestamp = 0;
+    uint64_t lastTimestamp = 0;
+    if (reader->GetTimestampRange(&firstTimestamp, &lastTimestamp) && minChunkTicks > 0) {
+        chunkCount = (uint32_t) std::min<uint64_t>(chunkCount, std::max<uint64_t>((lastTimestamp - firstTimestamp) / minChunkTicks, 1));
+    } else {
+        chunkCount = 1;
+    }
+
+    // Events can't be recorded out of order, so recording sessions are always analyzed serially.
+    if (chunkCount == 1 || session->mEventStreamWriter != nullptr) {
+        return session->ProcessEtlReader();
+    }
+
+    // The session's start time is the time of the first event, which is the logfile header.
+    EVENT_RECORD eventRecord = {};
+    if (session->mStartTimestamp.QuadPart == 0 && reader->ReadEvent(&eventRecord)) {
+        session->mStartTimestamp = eventRecord.EventHeader.TimeStamp;
+    }
+
+    std::vector<Chunk> chunks(chunkCount);
+    auto chunkTicks = (lastTimestamp - firstTimestamp) / chunkCount;
+    for (uint32_t i = 0; i < chunkCount; ++i) {
+        auto chunk = &chunks[i];
+        chunk->mStart = i == 0 ? 0 : firstTimestamp + i * chunkTicks;
+        chunk->mEnd = i + 1 == chunkCount ? UINT64_MAX : firstTimestamp + (i + 1) * chunkTicks;
+        chunk->mWarmupStart = chunk->mStart > warmupTicks ? chunk->mStart - warmupTicks : 0;
+        chunk->mStop = chunk->mEnd < UINT64_MAX - tailTicks ? chunk->mEnd + tailTicks : UINT64_MAX;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(chunkCount);
+    for (auto& chunk : chunks) {
+        threads.emplace_back(AnalyzeChunk, session, etlPath, &chunk);
+    }
+
+    // Stitch the chunks back together in completion order.  Every present in a later chunk
+    // started, and so completed, at or after that chunk's start; so once chunk i has been merged,
+    // everything completed before chunk i+1's start is final.  Ties are broken in favour of the
+    // earlier chunk.
+    ULONG status = ERROR_SUCCESS;
+    std::vector<std::pair<uint64_t, std::shared_ptr<PresentEvent>>> pending;
+    std::vector<std::pair<uint64_t, std::shared_ptr<PresentEvent>>> merged;
+    std::vector<std::shared_ptr<PresentEvent>> presents;
+    auto compare = [](std::pair<uint64_t, std::shared_ptr<PresentEvent>> const& a,
+                      std::pair<uint64_t, std::shared_ptr<PresentEvent>> const& b) { return a.first < b.first; };
+    for (uint32_t i = 0; i < chunkCount; ++i) {
+        threads[i].join();
+
+        auto chunk = &chunks[i];
+        if (status == ERROR_SUCCESS) {
+            status = chunk->mStatus;
+        }
+
+        merged.clear();
+        merged.reserve(pending.size() + chunk->mPresents.size());
+        std::merge(pending.begin(), pending.end(), chunk->mPresents.begin(), chunk->mPresents.end(),
+                   std::back_inserter(merged), compare);
+        chunk->mPresents.clear();
+        chunk->mPresents.shrink_to_fit();
+
+        auto nextStart = i + 1 == chunkCount ? UINT64_MAX : chunks[i + 1].mStart;
+        auto split = std::find_if(merged.begin(), merged.end(), [=](std::pair<uint64_t, std::shared_ptr<PresentEvent>> const& p) {
+            return p.first >= nextStart;
+        });
+
+        presents.clear();
+        for (auto ii = merged.begin(); ii != split; ++ii) {
+            presents.emplace_back(std::move(ii->second));
+        }
+        pending.assign(std::make_move_iterator(split), std::make_move_iterator(merged.end()));
+
+        session->mPMConsumer->EnqueueProcessEvents(chunk->mProcessEvents);
+        chunk->mProcessEvents.clear();
+        EnqueuePresents(session, presents);
+    }
+
+    return status;
+}
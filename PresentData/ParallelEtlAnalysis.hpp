@@ -0,0 +1,33 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#include <stdint.h>
+#include <windows.h>
+
+struct PMTraceSession;
+
+// ParallelEtlAnalysis analyzes an ETL on several threads by splitting its timeline into chunks.
+// Each chunk is analyzed by its own PMTraceConsumer, which starts reading a warm-up window before
+// the chunk so that presents already in flight are tracked correctly, and keeps reading a tail
+// window after the chunk so that presents started inside the chunk can complete.  Each chunk only
+// keeps the process events that occurred, and presents that started, within the chunk; so the
+// chunk results don't overlap and are stitched back together in the order the serial analysis
+// would have completed them.
+//
+// The results match the serial analysis as long as no present is in flight for longer than the
+// warm-up or tail windows.  Chunk results are held in memory until they are stitched, so memory
+// use grows with the number of presents in each chunk.
+struct ParallelEtlAnalysis {
+    uint32_t mThreadCount = 0;          // Number of chunks to analyze concurrently; 0 uses one per logical processor
+    double mWarmupSeconds = 5.0;        // Time analyzed before each chunk to establish in-flight state
+    double mTailSeconds = 5.0;          // Time analyzed after each chunk to complete its presents
+    double mMinChunkSeconds = 30.0;     // Shorter ETLs use fewer chunks
+
+    // Analyze the ETL that session is reading with EtlReader (i.e., Start() set
+    // session->mEtlReader), queueing the results into session->mPMConsumer.  etlPath is the path
+    // the session was started with; each chunk opens its own EtlReader on it.  Run() is used in
+    // place of PMTraceSession::ProcessEtlReader(), and returns once all events have been analyzed
+    // or the session is stopped.
+    ULONG Run(PMTraceSession* session, wchar_t const* etlPath);
+};
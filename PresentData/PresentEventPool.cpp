@@ -0,0 +1,59 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include "PresentEventPool.hpp"
+#include "Debug.hpp"
+
+PresentEventPool::~PresentEventPool()
+{
+    for (auto slab : mSlabs) {
+        ::operator delete(slab);
+    }
+}
+
+// The block size is determined by the first allocation, which is the combined
+// size of the PresentEvent and its shared_ptr control block.
+bool PresentEventPool::IsPoolSize(size_t size)
+{
+    if (mBlockSize == 0) {
+        mBlockSize = (size + BLOCK_ALIGNMENT - 1) & ~((size_t) BLOCK_ALIGNMENT - 1);
+    }
+    return size <= mBlockSize;
+}
+
+void* PresentEventPool::Allocate()
+{
+    // If our free list is empty, take all the blocks that have been returned
+    // from other threads.  If there are none, create a new slab.
+    if (mFreeBlocks == nullptr) {
+        mFreeBlocks = mReturnedBlocks.exchange(nullptr, std::memory_order_acquire);
+
+        if (mFreeBlocks == nullptr) {
+            auto slab = (uint8_t*) ::operator new(mBlockSize * BLOCKS_PER_SLAB);
+            mSlabs.push_back(slab);
+
+            for (size_t i = BLOCKS_PER_SLAB; i-- > 0; ) {
+                auto block = (FreeBlock*) (slab + i * mBlockSize);
+                block->mNext = mFreeBlocks;
+                mFreeBlocks = block;
+            }
+        }
+    }
+
+    auto block = mFreeBlocks;
+    mFreeBlocks = block->mNext;
+    return block;
+}
+
+// Free() can be called from any thread, so the block is pushed onto
+// mReturnedBlocks.  Since the allocating thread only ever takes the whole
+// list, there is no ABA hazard.
+void PresentEventPool::Free(void* p)
+{
+    DebugAssert(p != nullptr);
+
+    auto block = (FreeBlock*) p;
+    block->mNext = mReturnedBlocks.load(std::memory_order_relaxed);
+    while (!mReturnedBlocks.compare_exchange_weak(block->mNext, block, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+}
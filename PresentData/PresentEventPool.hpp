@@ -0,0 +1,161 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <cstddef>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+// InlineVector stores up to N elements inside the object itself, and only
+// allocates heap storage once more than N elements are added.  When the heap
+// storage is used, all the elements are stored there.
+template<typename T, uint32_t N>
+struct InlineVector {
+    T mInline[N];
+    std::vector<T> mHeap;
+    uint32_t mSize;
+
+    using iterator               = T*;
+    using const_iterator         = T const*;
+    using reverse_iterator       = std::reverse_iterator<T*>;
+    using const_reverse_iterator = std::reverse_iterator<T const*>;
+
+    InlineVector() : mSize(0) {}
+
+    bool empty() const { return mSize == 0; }
+    size_t size() const { return mSize; }
+
+    T*       begin()       { return mSize > N ? mHeap.data() : mInline; }
+    T const* begin() const { return mSize > N ? mHeap.data() : mInline; }
+    T*       end()         { return begin() + mSize; }
+    T const* end() const   { return begin() + mSize; }
+
+    reverse_iterator       rbegin()       { return reverse_iterator(end()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    reverse_iterator       rend()         { return reverse_iterator(begin()); }
+    const_reverse_iterator rend() const   { return const_reverse_iterator(begin()); }
+
+    template<typename... Args>
+    void emplace_back(Args&&... args)
+    {
+        if (mSize < N) {
+            mInline[mSize] = T(std::forward<Args>(args)...);
+        } else {
+            if (mSize == N) {
+                mHeap.reserve(2 * N);
+                for (uint32_t i = 0; i < N; ++i) {
+                    mHeap.emplace_back(std::move(mInline[i]));
+                    mInline[i] = T();
+                }
+            }
+            mHeap.emplace_back(std::forward<Args>(args)...);
+        }
+        mSize += 1;
+    }
+
+    // Heap capacity is retained (unless shrink_to_fit() is called).
+    void clear()
+    {
+        for (uint32_t i = 0; i < N && i < mSize; ++i) {
+            mInline[i] = T();
+        }
+        mHeap.clear();
+        mSize = 0;
+    }
+
+    void shrink_to_fit()
+    {
+        if (mSize <= N) {
+            mHeap.clear();
+        }
+        mHeap.shrink_to_fit();
+    }
+
+    bool operator==(InlineVector const& rhs) const
+    {
+        return mSize == rhs.mSize && std::equal(begin(), end(), rhs.begin());
+    }
+
+    bool operator!=(InlineVector const& rhs) const
+    {
+        return !(*this == rhs);
+    }
+};
+
+// PresentEventPool provides fixed-size blocks, allocated in slabs, which are
+// used to store each PresentEvent along with its shared_ptr control block.
+// Freed blocks are recycled for subsequent PresentEvents instead of being
+// returned to the heap.
+//
+// Blocks must only be allocated by a single thread (the consumer thread), but
+// they can be freed from any thread since the last reference to a PresentEvent
+// is often released by the thread that dequeued it.  Blocks freed by other
+// threads are pushed onto mReturnedBlocks, which the allocating thread takes
+// in bulk when its own free list is empty.
+struct PresentEventPool {
+    struct FreeBlock {
+        FreeBlock* mNext;
+    };
+
+    // Slabs are allocated with operator new(), which is aligned for any
+    // fundamental type, and blocks are a multiple of that alignment.
+    enum : size_t { BLOCK_ALIGNMENT = alignof(std::max_align_t), BLOCKS_PER_SLAB = 256 };
+
+    std::vector<void*> mSlabs;
+    FreeBlock* mFreeBlocks = nullptr;               // Only accessed by the allocating thread
+    std::atomic<FreeBlock*> mReturnedBlocks { nullptr };
+    size_t mBlockSize = 0;                          // Set by the first allocation
+
+    PresentEventPool() = default;
+    PresentEventPool(PresentEventPool const&) = delete;
+    PresentEventPool& operator=(PresentEventPool const&) = delete;
+    ~PresentEventPool();
+
+    bool IsPoolSize(size_t size);
+    void* Allocate();
+    void Free(void* p);
+
+    // The total size of the slabs allocated so far (only valid on the allocating thread).
+    size_t GetAllocatedSize() const { return mSlabs.size() * BLOCKS_PER_SLAB * mBlockSize; }
+};
+
+// PresentEventAllocator is used with std::allocate_shared() to allocate
+// PresentEvents from a PresentEventPool.  Each allocator holds a reference to
+// the pool, so the pool remains valid until all PresentEvents allocated from
+// it have been released (including any held by the application after the
+// PMTraceConsumer has been destroyed).
+template<typename T>
+struct PresentEventAllocator {
+    using value_type = T;
+
+    std::shared_ptr<PresentEventPool> mPool;
+
+    explicit PresentEventAllocator(std::shared_ptr<PresentEventPool> const& pool) : mPool(pool) {}
+    template<typename U> PresentEventAllocator(PresentEventAllocator<U> const& other) : mPool(other.mPool) {}
+
+    T* allocate(size_t n)
+    {
+        static_assert(alignof(T) <= PresentEventPool::BLOCK_ALIGNMENT, "PresentEventPool blocks are not sufficiently aligned");
+        if (n == 1 && mPool->IsPoolSize(sizeof(T))) {
+            return (T*) mPool->Allocate();
+        }
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        if (n == 1 && mPool->IsPoolSize(sizeof(T))) {
+            mPool->Free(p);
+        } else {
+            std::allocator<T>().deallocate(p, n);
+        }
+    }
+
+    template<typename U> bool operator==(PresentEventAllocator<U> const& rhs) const { return mPool == rhs.mPool; }
+    template<typename U> bool operator!=(PresentEventAllocator<U> const& rhs) const { return mPool != rhs.mPool; }
+};
@@ -16,14 +16,33 @@
 #include <assert.h>
 #include <d3d9.h>
 #include <dxgi.h>
+#include <iterator>
 #include <stdlib.h>
 #include <unordered_set>
 
+// Default size of the present rings, if no memory budget is set.  When a
+// budget is set, the ring size is the largest power of two that fits within it
+// (clamped to [MIN_RING_SIZE, MAX_RING_SIZE]).
 #ifdef DEBUG
-static constexpr int PRESENTEVENT_CIRCULAR_BUFFER_SIZE = 32768;
+static constexpr uint32_t PRESENTEVENT_CIRCULAR_BUFFER_SIZE = 32768;
 #else
-static constexpr int PRESENTEVENT_CIRCULAR_BUFFER_SIZE = 8192;
+static constexpr uint32_t PRESENTEVENT_CIRCULAR_BUFFER_SIZE = 8192;
 #endif
+static constexpr uint32_t MIN_RING_SIZE = 64;
+static constexpr uint32_t MAX_RING_SIZE = 1u << 20;
+
+// Estimated memory used by each present, including its shared_ptr control
+// block and its entries in the tracking maps.
+static constexpr size_t PRESENT_MEMORY_SIZE = sizeof(PresentEvent) + 64;
+
+// The tracking maps are initially sized to hold one present for each of this
+// many ring entries (256 for the default ring size), which is enough for the
+// presents typically in flight without needing to grow the maps.
+static constexpr uint32_t RING_ENTRIES_PER_TRACKING_MAP_ENTRY = 32;
+
+// EstimateMemoryFootprint() walks every tracking container, so the footprint
+// is only re-estimated once for this many completed presents (a power of two).
+static constexpr uint32_t MEMORY_FOOTPRINT_SAMPLE_INTERVAL = 256;
 
 // These macros, when enabled, record what PresentMon analysis below was done
 // for each present.  The primary use case is to compute usage statistics and
@@ -53,11 +72,6 @@ static constexpr int PRESENTEVENT_CIRCULAR_BUFFER_SIZE = 8192;
 
 static uint32_t gNextFrameId = 1;
 
-static inline uint32_t GetRingIndex(uint32_t index)
-{
-    return index % PRESENTEVENT_CIRCULAR_BUFFER_SIZE;
-}
-
 static inline uint64_t GenerateVidPnLayerId(uint32_t vidPnSourceId, uint32_t layerIndex)
 {
     return (((uint64_t) vidPnSourceId) << 32) | (uint64_t) layerIndex;
@@ -134,19 +148,109 @@ PresentEvent::PresentEvent()
 {
 }
 
+OrderedPresents::Iterator::Iterator(std::vector<Entry> const* entries, size_t index)
+    : mEntries(entries)
+    , mIndex(index)
+{
+    while (mIndex < mEntries->size() && (*mEntries)[mIndex].mPresent == nullptr) {
+        mIndex += 1;
+    }
+}
+
+OrderedPresents::Iterator& OrderedPresents::Iterator::operator++()
+{
+    do {
+        mIndex += 1;
+    } while (mIndex < mEntries->size() && (*mEntries)[mIndex].mPresent == nullptr);
+    return *this;
+}
+
+void OrderedPresents::emplace(std::shared_ptr<PresentEvent> const& present)
+{
+    auto presentStartTime = present->PresentStartTime;
+
+    // Remove any holes once they make up more than half of mEntries.
+    if (mCount == 0) {
+        mEntries.clear();
+        mFirst = 0;
+    } else if (mEntries.size() - mCount > mCount) {
+        mEntries.erase(std::remove_if(mEntries.begin(), mEntries.end(), [](Entry const& e) {
+            return e.mPresent == nullptr;
+        }), mEntries.end());
+        mFirst = 0;
+    }
+
+    // Common case: the present is newer than all the others.
+    if (mEntries.empty() || mEntries.back().mPresentStartTime < presentStartTime) {
+        mEntries.push_back({ presentStartTime, present });
+        mCount += 1;
+        return;
+    }
+
+    auto ii = std::lower_bound(mEntries.begin(), mEntries.end(), presentStartTime, [](Entry const& e, uint64_t t) {
+        return e.mPresentStartTime < t;
+    });
+    auto index = (size_t) (ii - mEntries.begin());
+    if (ii->mPresentStartTime == presentStartTime) {
+        if (ii->mPresent != nullptr) {
+            return;
+        }
+        ii->mPresent = present;
+    } else {
+        mEntries.insert(ii, { presentStartTime, present });
+    }
+
+    mCount += 1;
+    if (mFirst > index) {
+        mFirst = index;
+    }
+}
+
+void OrderedPresents::erase(uint64_t presentStartTime)
+{
+    // Common case: the oldest present is being removed.
+    auto index = mFirst;
+    if (index == mEntries.size() || mEntries[index].mPresentStartTime != presentStartTime) {
+        auto ii = std::lower_bound(mEntries.begin(), mEntries.end(), presentStartTime, [](Entry const& e, uint64_t t) {
+            return e.mPresentStartTime < t;
+        });
+        if (ii == mEntries.end() || ii->mPresentStartTime != presentStartTime || ii->mPresent == nullptr) {
+            return;
+        }
+        index = (size_t) (ii - mEntries.begin());
+    }
+
+    mEntries[index].mPresent.reset();
+    mCount -= 1;
+    if (index == mFirst) {
+        mFirst = Iterator(&mEntries, mFirst).mIndex;
+    }
+}
+
 PMTraceConsumer::PMTraceConsumer()
-    : mTrackedPresents(PRESENTEVENT_CIRCULAR_BUFFER_SIZE)
-    , mCompletedPresents(PRESENTEVENT_CIRCULAR_BUFFER_SIZE)
+    : mReadyEvent(CreateEventW(nullptr, FALSE, FALSE, nullptr))
+    , mPresentEventPool(std::make_shared<PresentEventPool>())
     , mGpuTrace(this)
 {
+    AllocateRings(PRESENTEVENT_CIRCULAR_BUFFER_SIZE);
+}
+
+PMTraceConsumer::~PMTraceConsumer()
+{
+    if (mReadyEvent != NULL) {
+        CloseHandle(mReadyEvent);
+    }
+
+    delete mPendingProcessFilter.load();
 }
 
+template<bool TRACK_DISPLAY, bool FILTERED_PROCESS_IDS>
 void PMTraceConsumer::HandleD3D9Event(EVENT_RECORD* pEventRecord)
 {
     auto const& hdr = pEventRecord->EventHeader;
     switch (hdr.EventDescriptor.Id) {
     case Microsoft_Windows_D3D9::Present_Start::Id:
-        if (IsProcessTrackedForFiltering(hdr.ProcessId)) {
+        if (!FILTERED_PROCESS_IDS || IsProcessTrackedForFiltering(hdr.ProcessId)) {
             EventDataDesc desc[] = {
                 { L"pSwapchain" },
                 { L"Flags" },
@@ -171,8 +275,8 @@ void PMTraceConsumer::HandleD3D9Event(EVENT_RECORD* pEventRecord)
         }
         break;
     case Microsoft_Windows_D3D9::Present_Stop::Id:
-        if (IsProcessTrackedForFiltering(hdr.ProcessId)) {
-            RuntimePresentStop(Runtime::D3D9, hdr, mMetadata.GetEventData<uint32_t>(pEventRecord, L"Result"));
+        if (!FILTERED_PROCESS_IDS || IsProcessTrackedForFiltering(hdr.ProcessId)) {
+            RuntimePresentStop<TRACK_DISPLAY>(Runtime::D3D9, hdr, mMetadata.GetEventData<uint32_t>(pEventRecord, L"Result"));
         }
         break;
     default:
@@ -181,13 +285,14 @@ void PMTraceConsumer::HandleD3D9Event(EVENT_RECORD* pEventRecord)
     }
 }
 
+template<bool TRACK_DISPLAY, bool FILTERED_PROCESS_IDS>
 void PMTraceConsumer::HandleDXGIEvent(EVENT_RECORD* pEventRecord)
 {
     auto const& hdr = pEventRecord->EventHeader;
     switch (hdr.EventDescriptor.Id) {
     case Microsoft_Windows_DXGI::Present_Start::Id:
     case Microsoft_Windows_DXGI::PresentMultiplaneOverlay_Start::Id:
-        if (IsProcessTrackedForFiltering(hdr.ProcessId)) {
+        if (!FILTERED_PROCESS_IDS || IsProcessTrackedForFiltering(hdr.ProcessId)) {
             EventDataDesc desc[] = {
                 { L"pIDXGISwapChain" },
                 { L"Flags" },
@@ -205,8 +310,8 @@ void PMTraceConsumer::HandleDXGIEvent(EVENT_RECORD* pEventRecord)
         break;
     case Microsoft_Windows_DXGI::Present_Stop::Id:
     case Microsoft_Windows_DXGI::PresentMultiplaneOverlay_Stop::Id:
-        if (IsProcessTrackedForFiltering(hdr.ProcessId)) {
-            RuntimePresentStop(Runtime::DXGI, hdr, mMetadata.GetEventData<uint32_t>(pEventRecord, L"Result"));
+        if (!FILTERED_PROCESS_IDS || IsProcessTrackedForFiltering(hdr.ProcessId)) {
+            RuntimePresentStop<TRACK_DISPLAY>(Runtime::DXGI, hdr, mMetadata.GetEventData<uint32_t>(pEventRecord, L"Result"));
         }
         break;
     default:
@@ -231,7 +336,7 @@ void PMTraceConsumer::HandleDxgkBlt(EVENT_HEADER const& hdr, uint64_t hwnd, bool
             break;
         }
 
-        RemoveLostPresent(presentEvent);
+        RemoveLostPresent(presentEvent, ConsumerStats::LostPresent_UnexpectedEvent);
     }
 
     TRACK_PRESENT_PATH_SAVE_GENERATED_ID(presentEvent);
@@ -270,7 +375,7 @@ void PMTraceConsumer::HandleDxgkFlip(EVENT_HEADER const& hdr, int32_t flipInterv
             break;
         }
 
-        RemoveLostPresent(presentEvent);
+        RemoveLostPresent(presentEvent, ConsumerStats::LostPresent_UnexpectedEvent);
     }
 
     TRACK_PRESENT_PATH_SAVE_GENERATED_ID(presentEvent);
@@ -301,12 +406,14 @@ void PMTraceConsumer::HandleDxgkFlip(EVENT_HEADER const& hdr, int32_t flipInterv
 
             for (auto& p : mPresentsWaitingForDWM) {
                 p->PresentInDwmWaitingStruct = false;
+                presentEvent->DependentPresents.emplace_back(std::move(p));
             }
-            std::swap(presentEvent->DependentPresents, mPresentsWaitingForDWM);
+            mPresentsWaitingForDWM.clear();
         }
     }
 }
 
+template<bool TRACK_GPU>
 void PMTraceConsumer::HandleDxgkQueueSubmit(
     EVENT_HEADER const& hdr,
     uint64_t hContext,
@@ -316,7 +423,8 @@ void PMTraceConsumer::HandleDxgkQueueSubmit(
     bool isWin7)
 {
     // Track GPU execution
-    if (mTrackGPU) {
+    #pragma warning(suppress: 4984) // C++17 extension
+    if constexpr (TRACK_GPU) {
         bool isWaitPacket = packetType == (uint32_t) Microsoft_Windows_DxgKrnl::QueuePacketType::DXGKETW_WAIT_COMMAND_BUFFER;
         mGpuTrace.EnqueueQueuePacket(hContext, submitSequence, hdr.ProcessId, hdr.TimeStamp.QuadPart, isWaitPacket);
     }
@@ -346,8 +454,11 @@ void PMTraceConsumer::HandleDxgkQueueSubmit(
 
             // We're done with DxgkContext tracking, if the present hasn't
             // completed remove it from the tracking now.
+            //
+            // CompletePresent() may have already removed it, invalidating
+            // eventIter, so erase by key.
             if (present->DxgkContext != 0) {
-                mPresentByDxgkContext.erase(eventIter);
+                mPresentByDxgkContext.erase(hContext);
                 present->DxgkContext = 0;
             }
         }
@@ -366,70 +477,70 @@ void PMTraceConsumer::HandleDxgkQueueSubmit(
             VerboseTraceBeforeModifyingPresent(present.get());
             present->QueueSubmitSequence = submitSequence;
 
-            auto presentsBySubmitSequence = &mPresentBySubmitSequence[submitSequence];
-            DebugAssert(presentsBySubmitSequence->find(hContext) == presentsBySubmitSequence->end());
-            (*presentsBySubmitSequence)[hContext] = present;
+            DebugAssert(mPresentBySubmitSequence.find(std::make_pair(submitSequence, hContext)) == mPresentBySubmitSequence.end());
+            mPresentBySubmitSequence[std::make_pair(submitSequence, hContext)] = present;
+            mStats.UpdatePeakSize(ConsumerStats::Container_PresentBySubmitSequence, mPresentBySubmitSequence.size());
 
             if (isWin7 && present->PresentMode == PresentMode::Hardware_Legacy_Copy_To_Front_Buffer) {
                 mPresentByDxgkContext[hContext] = present;
+                mStats.UpdatePeakSize(ConsumerStats::Container_PresentByDxgkContext, mPresentByDxgkContext.size());
                 present->DxgkContext = hContext;
             }
         }
     }
 }
 
+template<bool TRACK_GPU>
 void PMTraceConsumer::HandleDxgkQueueComplete(uint64_t timestamp, uint64_t hContext, uint32_t submitSequence)
 {
     // Track GPU execution of the packet
-    if (mTrackGPU) {
+    #pragma warning(suppress: 4984) // C++17 extension
+    if constexpr (TRACK_GPU) {
         mGpuTrace.CompleteQueuePacket(hContext, submitSequence, timestamp);
     }
 
     // If this packet was a present packet being tracked...
-    auto ii = mPresentBySubmitSequence.find(submitSequence);
+    auto ii = mPresentBySubmitSequence.find(std::make_pair(submitSequence, hContext));
     if (ii != mPresentBySubmitSequence.end()) {
-        auto presentsBySubmitSequence = &ii->second;
-        auto jj = presentsBySubmitSequence->find(hContext);
-        if (jj != presentsBySubmitSequence->end()) {
-            auto pEvent = jj->second;
-
-            TRACK_PRESENT_PATH_SAVE_GENERATED_ID(pEvent);
+        auto pEvent = ii->second;
 
-            // Stop tracking GPU work for this present.
-            //
-            // Note: there is a potential race here because QueuePacket_Stop
-            // occurs sometime after DmaPacket_Info it's possible that some
-            // small portion of the next frame's GPU work has started before
-            // QueuePacket_Stop and will be attributed to this frame.  However,
-            // this is necessarily a small amount of work, and we can't use DMA
-            // packets as not all present types create them.
-            if (mTrackGPU) {
-                mGpuTrace.CompleteFrame(pEvent.get(), timestamp);
-            }
+        TRACK_PRESENT_PATH_SAVE_GENERATED_ID(pEvent);
 
-            // We use present packet completion as the screen time for
-            // Hardware_Legacy_Copy_To_Front_Buffer and Hardware_Legacy_Flip
-            // present modes, unless we are expecting a subsequent flip/*sync
-            // event from DXGK.
-            if (pEvent->PresentMode == PresentMode::Hardware_Legacy_Copy_To_Front_Buffer ||
-                (pEvent->PresentMode == PresentMode::Hardware_Legacy_Flip && !pEvent->WaitForFlipEvent)) {
-                VerboseTraceBeforeModifyingPresent(pEvent.get());
+        // Stop tracking GPU work for this present.
+        //
+        // Note: there is a potential race here because QueuePacket_Stop
+        // occurs sometime after DmaPacket_Info it's possible that some
+        // small portion of the next frame's GPU work has started before
+        // QueuePacket_Stop and will be attributed to this frame.  However,
+        // this is necessarily a small amount of work, and we can't use DMA
+        // packets as not all present types create them.
+        #pragma warning(suppress: 4984) // C++17 extension
+        if constexpr (TRACK_GPU) {
+            mGpuTrace.CompleteFrame(pEvent.get(), timestamp);
+        }
+
+        // We use present packet completion as the screen time for
+        // Hardware_Legacy_Copy_To_Front_Buffer and Hardware_Legacy_Flip
+        // present modes, unless we are expecting a subsequent flip/*sync
+        // event from DXGK.
+        if (pEvent->PresentMode == PresentMode::Hardware_Legacy_Copy_To_Front_Buffer ||
+            (pEvent->PresentMode == PresentMode::Hardware_Legacy_Flip && !pEvent->WaitForFlipEvent)) {
+            VerboseTraceBeforeModifyingPresent(pEvent.get());
 
-                if (pEvent->ReadyTime == 0) {
-                    pEvent->ReadyTime = timestamp;
-                }
+            if (pEvent->ReadyTime == 0) {
+                pEvent->ReadyTime = timestamp;
+            }
 
-                pEvent->ScreenTime = timestamp;
-                pEvent->FinalState = PresentResult::Presented;
+            pEvent->ScreenTime = timestamp;
+            pEvent->FinalState = PresentResult::Presented;
 
-                // Sometimes, the queue packets associated with a present will complete
-                // before the DxgKrnl PresentInfo event is fired.  For blit presents in
-                // this case, we have no way to differentiate between fullscreen and
-                // windowed blits, so we defer the completion of this present until
-                // we've also seen the Dxgk Present_Info event.
-                if (pEvent->SeenDxgkPresent || pEvent->PresentMode != PresentMode::Hardware_Legacy_Copy_To_Front_Buffer) {
-                    CompletePresent(pEvent);
-                }
+            // Sometimes, the queue packets associated with a present will complete
+            // before the DxgKrnl PresentInfo event is fired.  For blit presents in
+            // this case, we have no way to differentiate between fullscreen and
+            // windowed blits, so we defer the completion of this present until
+            // we've also seen the Dxgk Present_Info event.
+            if (pEvent->SeenDxgkPresent || pEvent->PresentMode != PresentMode::Hardware_Legacy_Copy_To_Front_Buffer) {
+                CompletePresent(pEvent);
             }
         }
     }
@@ -439,27 +550,20 @@ void PMTraceConsumer::HandleDxgkQueueComplete(uint64_t timestamp, uint64_t hCont
 // events that reference submit sequence id don't include the queue context,
 // it's possible (though rare) that there are multiple presents in flight with
 // the same submit sequence id.  If that is the case, we pick the oldest one.
+//
+// All presents with the same submit sequence are in the same probe run of
+// mPresentBySubmitSequence, so we visit that run without needing the context.
 std::shared_ptr<PresentEvent> PMTraceConsumer::FindPresentBySubmitSequence(uint32_t submitSequence)
 {
-    auto ii = mPresentBySubmitSequence.find(submitSequence);
-    if (ii != mPresentBySubmitSequence.end()) {
-        auto presentsBySubmitSequence = &ii->second;
-
-        auto jj = presentsBySubmitSequence->begin();
-        auto je = presentsBySubmitSequence->end();
-        DebugAssert(jj != je);
-        if (jj != je) {
-            auto present = jj->second;
-            for (++jj; jj != je; ++jj) {
-                if (present->PresentStartTime > jj->second->PresentStartTime) {
-                    present = jj->second;
-                }
-            }
-            return present;
-        }
-    }
-
-    return std::shared_ptr<PresentEvent>();
+    std::shared_ptr<PresentEvent> present;
+    mPresentBySubmitSequence.probe(submitSequence, [&](auto const& slot) {
+        if (slot.first.first == submitSequence &&
+            (present == nullptr || present->PresentStartTime > slot.second->PresentStartTime)) {
+            present = slot.second;
+        }
+        return false;
+    });
+    return present;
 }
 
 // An MMIOFlip event is emitted when an MMIOFlip packet is dequeued.  All GPU
@@ -542,7 +646,7 @@ void PMTraceConsumer::HandleDxgkPresentHistory(
             break;
         }
 
-        RemoveLostPresent(presentEvent);
+        RemoveLostPresent(presentEvent, ConsumerStats::LostPresent_UnexpectedEvent);
     }
 
     TRACK_PRESENT_PATH_SAVE_GENERATED_ID(presentEvent);
@@ -556,10 +660,11 @@ void PMTraceConsumer::HandleDxgkPresentHistory(
 
     auto iter = mPresentByDxgkPresentHistoryToken.find(token);
     if (iter != mPresentByDxgkPresentHistoryToken.end()) {
-        RemoveLostPresent(iter->second);
+        RemoveLostPresent(iter->second, ConsumerStats::LostPresent_DuplicateToken);
     }
     DebugAssert(mPresentByDxgkPresentHistoryToken.find(token) == mPresentByDxgkPresentHistoryToken.end());
     mPresentByDxgkPresentHistoryToken[token] = presentEvent;
+    mStats.UpdatePeakSize(ConsumerStats::Container_PresentByDxgkPresentHistoryToken, mPresentByDxgkPresentHistoryToken.size());
 
     switch (presentEvent->PresentMode) {
     case PresentMode::Hardware_Legacy_Copy_To_Front_Buffer:
@@ -576,7 +681,7 @@ void PMTraceConsumer::HandleDxgkPresentHistory(
              * could not be diagnosed, so we removed support for this present mode for now...
             presentEvent->PresentMode = PresentMode::Composed_Composition_Atlas;
             */
-            RemoveLostPresent(presentEvent);
+            RemoveLostPresent(presentEvent, ConsumerStats::LostPresent_Unsupported);
             return;
             /* END WORKAROUND */
         } else {
@@ -591,11 +696,11 @@ void PMTraceConsumer::HandleDxgkPresentHistory(
     case PresentMode::Composed_Copy_CPU_GDI:
         if (tokenData == 0) {
             // This is the best we can do, we won't be able to tell how many frames are actually displayed.
-            mPresentsWaitingForDWM.emplace_back(presentEvent);
-            presentEvent->PresentInDwmWaitingStruct = true;
+            AddPresentWaitingForDWM(presentEvent);
         } else {
             DebugAssert(mPresentByDxgkPresentHistoryTokenData.find(tokenData) == mPresentByDxgkPresentHistoryTokenData.end());
             mPresentByDxgkPresentHistoryTokenData[tokenData] = presentEvent;
+            mStats.UpdatePeakSize(ConsumerStats::Container_PresentByDxgkPresentHistoryTokenData, mPresentByDxgkPresentHistoryTokenData.size());
             presentEvent->DxgkPresentHistoryTokenData = tokenData;
         }
         break;
@@ -630,8 +735,7 @@ void PMTraceConsumer::HandleDxgkPresentHistoryInfo(EVENT_HEADER const& hdr, uint
     // Composed presents are currently ignored.
     if (//eventIter->second->PresentMode == PresentMode::Composed_Composition_Atlas ||
         (eventIter->second->PresentMode == PresentMode::Composed_Flip && !eventIter->second->SeenWin32KEvents)) {
-        mPresentsWaitingForDWM.emplace_back(eventIter->second);
-        eventIter->second->PresentInDwmWaitingStruct = true;
+        AddPresentWaitingForDWM(eventIter->second);
     }
 
     if (eventIter->second->PresentMode == PresentMode::Composed_Copy_GPU_GDI) {
@@ -639,11 +743,13 @@ void PMTraceConsumer::HandleDxgkPresentHistoryInfo(EVENT_HEADER const& hdr, uint
         // present, we'll query for the most recent blt targeting this window
         // and take it out of the map.
         mLastPresentByWindow[eventIter->second->Hwnd] = eventIter->second;
+        mStats.UpdatePeakSize(ConsumerStats::Container_LastPresentByWindow, mLastPresentByWindow.size());
     }
 
     mPresentByDxgkPresentHistoryToken.erase(eventIter);
 }
 
+template<bool TRACK_GPU, bool TRACK_FRAME_TYPE>
 void PMTraceConsumer::HandleDXGKEvent(EVENT_RECORD* pEventRecord)
 {
     auto const& hdr = pEventRecord->EventHeader;
@@ -705,7 +811,7 @@ void PMTraceConsumer::HandleDXGKEvent(EVENT_RECORD* pEventRecord)
         auto hContext       = desc[2].GetData<uint64_t>();
         auto bPresent       = desc[3].GetData<BOOL>() != 0;
 
-        HandleDxgkQueueSubmit(hdr, hContext, SubmitSequence, PacketType, bPresent, false);
+        HandleDxgkQueueSubmit<TRACK_GPU>(hdr, hContext, SubmitSequence, PacketType, bPresent, false);
         return;
     }
     case Microsoft_Windows_DxgKrnl::QueuePacket_Start_2::Id:
@@ -720,7 +826,7 @@ void PMTraceConsumer::HandleDXGKEvent(EVENT_RECORD* pEventRecord)
 
         uint32_t PacketType = (uint32_t) Microsoft_Windows_DxgKrnl::QueuePacketType::DXGKETW_WAIT_COMMAND_BUFFER;
         bool bPresent = false;
-        HandleDxgkQueueSubmit(hdr, hContext, SubmitSequence, PacketType, bPresent, false);
+        HandleDxgkQueueSubmit<TRACK_GPU>(hdr, hContext, SubmitSequence, PacketType, bPresent, false);
         return;
     }
     case Microsoft_Windows_DxgKrnl::QueuePacket_Stop::Id:
@@ -734,7 +840,7 @@ void PMTraceConsumer::HandleDXGKEvent(EVENT_RECORD* pEventRecord)
         auto SubmitSequence = desc[1].GetData<uint32_t>();
 
         TRACK_PRESENT_PATH_GENERATE_ID();
-        HandleDxgkQueueComplete(hdr.TimeStamp.QuadPart, hContext, SubmitSequence);
+        HandleDxgkQueueComplete<TRACK_GPU>(hdr.TimeStamp.QuadPart, hContext, SubmitSequence);
         return;
     }
     case Microsoft_Windows_DxgKrnl::MMIOFlip_Info::Id:
@@ -987,9 +1093,33 @@ void PMTraceConsumer::HandleDXGKEvent(EVENT_RECORD* pEventRecord)
         }
         return;
     }
+
+    // Events handled below, depending on the tracking options.  Any other event is rejected
+    // here so that unhandled events (e.g., from an unfiltered ETL) only go through one switch.
+    case Microsoft_Windows_DxgKrnl::Device_DCStart::Id:
+    case Microsoft_Windows_DxgKrnl::Device_Start::Id:
+    case Microsoft_Windows_DxgKrnl::Device_Stop::Id:
+    case Microsoft_Windows_DxgKrnl::AdapterAllocation_Start::Id:
+    case Microsoft_Windows_DxgKrnl::AdapterAllocation_DCStart::Id:
+    case Microsoft_Windows_DxgKrnl::AdapterAllocation_Stop::Id:
+    case Microsoft_Windows_DxgKrnl::Context_DCStart::Id:
+    case Microsoft_Windows_DxgKrnl::Context_Start::Id:
+    case Microsoft_Windows_DxgKrnl::Context_Stop::Id:
+    case Microsoft_Windows_DxgKrnl::HwQueue_DCStart::Id:
+    case Microsoft_Windows_DxgKrnl::HwQueue_Start::Id:
+    case Microsoft_Windows_DxgKrnl::NodeMetadata_Info::Id:
+    case Microsoft_Windows_DxgKrnl::DmaPacket_Start::Id:
+    case Microsoft_Windows_DxgKrnl::DmaPacket_Info::Id:
+    case Microsoft_Windows_DxgKrnl::MMIOFlipMultiPlaneOverlay3_Info::Id:
+        break;
+
+    default:
+        assert(!mFilteredEvents); // Assert that filtering is working if expected
+        return;
     }
 
-    if (mTrackGPU) {
+    #pragma warning(suppress: 4984) // C++17 extension
+    if constexpr (TRACK_GPU) {
         switch (hdr.EventDescriptor.Id) {
 
         // We need a mapping from hContext to GPU node.
@@ -1143,7 +1273,8 @@ void PMTraceConsumer::HandleDXGKEvent(EVENT_RECORD* pEventRecord)
         }
     }
 
-    if (mTrackFrameType) {
+    #pragma warning(suppress: 4984) // C++17 extension
+    if constexpr (TRACK_FRAME_TYPE) {
         // MMIOFlipMultiPlaneOverlay3_Info is emitted immediately before MMIOFlipMultiPlaneOverlay_Info,
         // on the same thread, with the same SubmitSequence, and includes the PresentId(s) that the
         // driver uses to report flip completion.
@@ -1196,9 +1327,10 @@ void PMTraceConsumer::HandleDXGKEvent(EVENT_RECORD* pEventRecord)
                         // the present ids to it.
                         if (present != nullptr) {
                             VerboseTraceBeforeModifyingPresent(present.get());
-                            present->PresentIds.emplace(vidPnLayerId, PresentId[i]);
+                            present->PresentIds.emplace_back(vidPnLayerId, PresentId[i]);
 
                             mPresentByVidPnLayerId.emplace(vidPnLayerId, present);
+                            mStats.UpdatePeakSize(ConsumerStats::Container_PresentByVidPnLayerId, mPresentByVidPnLayerId.size());
                         }
 
                         // Apply any pending FlipFrameType events
@@ -1270,7 +1402,9 @@ void PMTraceConsumer::HandleWin7DxgkQueuePacket(EVENT_RECORD* pEventRecord)
 
     if (pEventRecord->EventHeader.EventDescriptor.Opcode == EVENT_TRACE_TYPE_START) {
         auto pSubmitEvent = reinterpret_cast<DXGKETW_QUEUESUBMITEVENT*>(pEventRecord->UserData);
-        HandleDxgkQueueSubmit(
+        auto handleQueueSubmit = mTrackGPU ? &PMTraceConsumer::HandleDxgkQueueSubmit<true>
+                                           : &PMTraceConsumer::HandleDxgkQueueSubmit<false>;
+        (this->*handleQueueSubmit)(
             pEventRecord->EventHeader,
             pSubmitEvent->hContext,
             pSubmitEvent->SubmitSequence,
@@ -1280,7 +1414,9 @@ void PMTraceConsumer::HandleWin7DxgkQueuePacket(EVENT_RECORD* pEventRecord)
     } else if (pEventRecord->EventHeader.EventDescriptor.Opcode == EVENT_TRACE_TYPE_STOP) {
         auto pCompleteEvent = reinterpret_cast<DXGKETW_QUEUECOMPLETEEVENT*>(pEventRecord->UserData);
         TRACK_PRESENT_PATH_GENERATE_ID();
-        HandleDxgkQueueComplete(
+        auto handleQueueComplete = mTrackGPU ? &PMTraceConsumer::HandleDxgkQueueComplete<true>
+                                             : &PMTraceConsumer::HandleDxgkQueueComplete<false>;
+        (this->*handleQueueComplete)(
             pEventRecord->EventHeader.TimeStamp.QuadPart,
             pCompleteEvent->hContext,
             pCompleteEvent->SubmitSequence);
@@ -1331,6 +1467,7 @@ std::size_t PMTraceConsumer::Win32KPresentHistoryTokenHash::operator()(PMTraceCo
     return std::hash<uint64_t>::operator()(h64);
 }
 
+template<bool TRACK_INPUT>
 void PMTraceConsumer::HandleWin32kEvent(EVENT_RECORD* pEventRecord)
 {
     auto const& hdr = pEventRecord->EventHeader;
@@ -1363,7 +1500,7 @@ void PMTraceConsumer::HandleWin32kEvent(EVENT_RECORD* pEventRecord)
                 break;
             }
 
-            RemoveLostPresent(present);
+            RemoveLostPresent(present, ConsumerStats::LostPresent_UnexpectedEvent);
         }
 
         TRACK_PRESENT_PATH(present);
@@ -1379,6 +1516,7 @@ void PMTraceConsumer::HandleWin32kEvent(EVENT_RECORD* pEventRecord)
         Win32KPresentHistoryToken key(CompositionSurfaceLuid, PresentCount, BindId);
         DebugAssert(mPresentByWin32KPresentHistoryToken.find(key) == mPresentByWin32KPresentHistoryToken.end());
         mPresentByWin32KPresentHistoryToken[key] = present;
+        mStats.UpdatePeakSize(ConsumerStats::Container_PresentByWin32KPresentHistoryToken, mPresentByWin32KPresentHistoryToken.size());
         present->CompositionSurfaceLuid = CompositionSurfaceLuid;
         present->Win32KPresentCount = PresentCount;
         present->Win32KBindId = BindId;
@@ -1427,6 +1565,7 @@ void PMTraceConsumer::HandleWin32kEvent(EVENT_RECORD* pEventRecord)
                 auto hWndIter = mLastPresentByWindow.find(presentEvent->Hwnd);
                 if (hWndIter == mLastPresentByWindow.end()) {
                     mLastPresentByWindow.emplace(presentEvent->Hwnd, presentEvent);
+                    mStats.UpdatePeakSize(ConsumerStats::Container_LastPresentByWindow, mLastPresentByWindow.size());
                 } else if (hWndIter->second != presentEvent) {
                     auto prevPresent = hWndIter->second;
                     hWndIter->second = presentEvent;
@@ -1494,38 +1633,40 @@ void PMTraceConsumer::HandleWin32kEvent(EVENT_RECORD* pEventRecord)
     }
 
     case Microsoft_Windows_Win32k::InputDeviceRead_Stop::Id:
-    {
-        EventDataDesc desc[] = {
-            { L"DeviceType" },
-        };
-        mMetadata.GetEventData(pEventRecord, desc, _countof(desc));
-        auto DeviceType = desc[0].GetData<uint32_t>();
+        #pragma warning(suppress: 4984) // C++17 extension
+        if constexpr (TRACK_INPUT) {
+            EventDataDesc desc[] = {
+                { L"DeviceType" },
+            };
+            mMetadata.GetEventData(pEventRecord, desc, _countof(desc));
+            auto DeviceType = desc[0].GetData<uint32_t>();
 
-        switch (DeviceType) {
-        case 0: mLastInputDeviceType = InputDeviceType::Mouse; break;
-        case 1: mLastInputDeviceType = InputDeviceType::Keyboard; break;
-        default: mLastInputDeviceType = InputDeviceType::Unknown; break;
-        }
+            switch (DeviceType) {
+            case 0: mLastInputDeviceType = InputDeviceType::Mouse; break;
+            case 1: mLastInputDeviceType = InputDeviceType::Keyboard; break;
+            default: mLastInputDeviceType = InputDeviceType::Unknown; break;
+            }
 
-        mLastInputDeviceReadTime = hdr.TimeStamp.QuadPart;
+            mLastInputDeviceReadTime = hdr.TimeStamp.QuadPart;
+        }
         break;
-    }
 
     case Microsoft_Windows_Win32k::RetrieveInputMessage_Info::Id:
-    {
-        auto ii = mRetrievedInput.find(hdr.ProcessId);
-        if (ii == mRetrievedInput.end()) {
-            mRetrievedInput.emplace(hdr.ProcessId, std::make_pair(
-                mLastInputDeviceReadTime,
-                mLastInputDeviceType));
-        } else {
-            if (ii->second.first < mLastInputDeviceReadTime) {
-                ii->second.first = mLastInputDeviceReadTime;
-                ii->second.second = mLastInputDeviceType;
+        #pragma warning(suppress: 4984) // C++17 extension
+        if constexpr (TRACK_INPUT) {
+            auto ii = mRetrievedInput.find(hdr.ProcessId);
+            if (ii == mRetrievedInput.end()) {
+                mRetrievedInput.emplace(hdr.ProcessId, std::make_pair(
+                    mLastInputDeviceReadTime,
+                    mLastInputDeviceType));
+            } else {
+                if (ii->second.first < mLastInputDeviceReadTime) {
+                    ii->second.first = mLastInputDeviceReadTime;
+                    ii->second.second = mLastInputDeviceType;
+                }
             }
         }
         break;
-    }
 
     default:
         assert(!mFilteredEvents); // Assert that filtering is working if expected
@@ -1547,8 +1688,7 @@ void PMTraceConsumer::HandleDWMEvent(EVENT_RECORD* pEventRecord)
                 present->PresentMode == PresentMode::Composed_Copy_CPU_GDI) {
                 TRACK_PRESENT_PATH(present);
                 VerboseTraceBeforeModifyingPresent(present.get());
-                mPresentsWaitingForDWM.emplace_back(present);
-                present->PresentInDwmWaitingStruct = true;
+                AddPresentWaitingForDWM(present);
             }
         }
         mLastPresentByWindow.clear();
@@ -1605,6 +1745,7 @@ void PMTraceConsumer::HandleDWMEvent(EVENT_RECORD* pEventRecord)
             present->DxgkPresentHistoryTokenData = 0;
 
             mLastPresentByWindow[hwnd] = present;
+            mStats.UpdatePeakSize(ConsumerStats::Container_LastPresentByWindow, mLastPresentByWindow.size());
 
             mPresentByDxgkPresentHistoryTokenData.erase(flipIter);
         }
@@ -1632,8 +1773,7 @@ void PMTraceConsumer::HandleDWMEvent(EVENT_RECORD* pEventRecord)
         if (eventIter != mPresentByWin32KPresentHistoryToken.end() && eventIter->second->SeenInFrameEvent) {
             TRACK_PRESENT_PATH(eventIter->second);
             VerboseTraceBeforeModifyingPresent(eventIter->second.get());
-            mPresentsWaitingForDWM.emplace_back(eventIter->second);
-            eventIter->second->PresentInDwmWaitingStruct = true;
+            AddPresentWaitingForDWM(eventIter->second);
         }
         break;
     }
@@ -1647,25 +1787,15 @@ void PMTraceConsumer::HandleDWMEvent(EVENT_RECORD* pEventRecord)
 void PMTraceConsumer::RemovePresentFromSubmitSequenceIdTracking(std::shared_ptr<PresentEvent> const& present)
 {
     if (present->QueueSubmitSequence != 0) {
-        auto ii = mPresentBySubmitSequence.find(present->QueueSubmitSequence);
+        // Search the submit sequence's probe run for present here.  We could do
+        // a find() but that would require storing the queue context in
+        // PresentEvent and since the run is expected to be small (typically
+        // one element) this should be as fast.
+        auto ii = mPresentBySubmitSequence.probe(present->QueueSubmitSequence, [&](auto const& slot) {
+            return slot.second == present;
+        });
         if (ii != mPresentBySubmitSequence.end()) {
-            auto presentsBySubmitSequence = &ii->second;
-
-            // Do a linear search for present here.  We could do a find() but that
-            // would require storing the queue context in PresentEvent and since
-            // presentsBySubmitSequence is expected to be small (typically one element)
-            // this should be faster.
-            if (presentsBySubmitSequence->size() == 1) {
-                DebugAssert(presentsBySubmitSequence->begin()->second == present);
-                mPresentBySubmitSequence.erase(ii);
-            } else {
-                for (auto jj = presentsBySubmitSequence->begin(), je = presentsBySubmitSequence->end(); jj != je; ++jj) {
-                    if (jj->second == present) {
-                        presentsBySubmitSequence->erase(jj);
-                        break;
-                    }
-                }
-            }
+            mPresentBySubmitSequence.erase(ii);
         }
 
         // Don't report clearing of key in verbose trace
@@ -1684,6 +1814,7 @@ void PMTraceConsumer::StopTrackingPresent(std::shared_ptr<PresentEvent> const& p
     if (p->RingIndex != UINT32_MAX) {
         mTrackedPresents[p->RingIndex] = nullptr;
         p->RingIndex = UINT32_MAX;
+        mTrackedCount--;
     }
 
     // mPresentByThreadId
@@ -1789,13 +1920,24 @@ void PMTraceConsumer::StopTrackingPresent(std::shared_ptr<PresentEvent> const& p
     }
 }
 
-void PMTraceConsumer::RemoveLostPresent(std::shared_ptr<PresentEvent> p)
+void PMTraceConsumer::RemoveLostPresent(std::shared_ptr<PresentEvent> p, ConsumerStats::LostPresentReason reason)
 {
+    mStats.CountLostPresent(reason);
+
     VerboseTraceBeforeModifyingPresent(p.get());
     p->IsLost = true;
     CompletePresent(p);
 }
 
+void PMTraceConsumer::AddPresentWaitingForDWM(std::shared_ptr<PresentEvent> const& p)
+{
+    mPresentsWaitingForDWM.emplace_back(p);
+    mStats.UpdatePeakSize(ConsumerStats::Container_PresentsWaitingForDWM, mPresentsWaitingForDWM.size());
+
+    VerboseTraceBeforeModifyingPresent(p.get());
+    p->PresentInDwmWaitingStruct = true;
+}
+
 void PMTraceConsumer::CompletePresent(std::shared_ptr<PresentEvent> const& p)
 {
     // We use the first completed present to indicate that all necessary
@@ -1813,7 +1955,7 @@ void PMTraceConsumer::CompletePresent(std::shared_ptr<PresentEvent> const& p)
     if (!mHasCompletedAPresent && !p->IsLost) {
         for (auto const& pr : mOrderedPresentsByProcessId) {
             for (auto orderedPresents = &pr.second; !orderedPresents->empty(); ) {
-                RemoveLostPresent(orderedPresents->begin()->second);
+                RemoveLostPresent(orderedPresents->front(), ConsumerStats::LostPresent_StartupDiscard);
             }
         }
 
@@ -1874,11 +2016,9 @@ void PMTraceConsumer::CompletePresent(std::shared_ptr<PresentEvent> const& p)
     // If presented, remove any earlier presents made on the same swap chain.
     if (p->FinalState == PresentResult::Presented) {
         auto presentsByThisProcess = &mOrderedPresentsByProcessId[p->ProcessId];
-        for (auto ii = presentsByThisProcess->begin(), ie = presentsByThisProcess->end(); ii != ie; ) {
-            auto p2 = ii->second;
+        for (auto ii = presentsByThisProcess->begin(); ii != presentsByThisProcess->end(); ++ii) {
+            auto p2 = *ii; // Copy since below calls may remove it from presentsByThisProcess.
             if (p2->PresentStartTime >= p->PresentStartTime) break;
-            ++ii; // Increment the iterator first since below calls may remove it from
-                  // presentsByThisProcess.
 
             if (p2->SwapChainAddress == p->SwapChainAddress) {
                 if (p->IsLost) {
@@ -1934,32 +2074,36 @@ void PMTraceConsumer::CompletePresent(std::shared_ptr<PresentEvent> const& p)
 
 void PMTraceConsumer::AddPresentToCompletedList(std::shared_ptr<PresentEvent> const& present)
 {
-    {
-        std::lock_guard<std::mutex> lock(mPresentEventMutex);
-
-        // If the completed list is full, throw away the oldest completed present, if it IsLost; or this
-        // present, if it IsLost; or the oldest completed present.
-        uint32_t index;
-        if (mCompletedCount == PRESENTEVENT_CIRCULAR_BUFFER_SIZE) {
-            if (!mCompletedPresents[mCompletedIndex]->IsLost && present->IsLost) {
+    // If the completed list is full, throw away the oldest completed present, if it IsLost; or this
+    // present, if it IsLost; or the oldest completed present.
+    uint32_t index;
+    if (mCompletedCount == mRingSize) {
+        if (!mCompletedPresents[mCompletedIndex]->IsLost) {
+            if (present->IsLost) {
                 return;
             }
+            mStats.CountLostPresent(ConsumerStats::LostPresent_CompletedRingOverflow);
+        }
 
-            index = mCompletedIndex;
-            mCompletedIndex = GetRingIndex(mCompletedIndex + 1);
-            if (mReadyCount > 0) {
-                mReadyCount--;
-            }
-        } else {
-            index = GetRingIndex(mCompletedIndex + mCompletedCount);
-            mCompletedCount++;
+        index = mCompletedIndex;
+        mCompletedIndex = GetRingIndex(mCompletedIndex + 1);
+        if (mReadyCount > 0) {
+            mReadyCount--;
         }
+    } else {
+        index = GetRingIndex(mCompletedIndex + mCompletedCount);
+        mCompletedCount++;
+        mStats.UpdatePeakSize(ConsumerStats::Container_CompletedPresents, mCompletedCount);
+    }
 
-        mCompletedPresents[index] = present;
+    mCompletedPresents[index] = present;
 
-        if (present->DeferredReason == DeferredReason_None && index == GetRingIndex(mCompletedIndex + mReadyCount)) {
-            mReadyCount++;
-        }
+    if (present->DeferredReason == DeferredReason_None && index == GetRingIndex(mCompletedIndex + mReadyCount)) {
+        mReadyCount++;
+    }
+
+    if (mReadyCount > 0) {
+        PublishReadyPresents();
     }
 
     // It's possible for a deferred condition to never be cleared.  e.g., a process' last present
@@ -1967,15 +2111,22 @@ void PMTraceConsumer::AddPresentToCompletedList(std::shared_ptr<PresentEvent> co
     // subsequent presents from other processes from being dequeued until the ring buffer wraps and
     // forces it out, which is likely longer than we want to wait.  So we check here if there is 
     // a stuck deferred present and clear the deferral if it gets too old.
-    if (mReadyCount == 0) {
+    if (mReadyCount == 0 && mCompletedCount > 0) {
         auto const& deferredPresent = mCompletedPresents[mCompletedIndex];
         if (present->PresentStartTime >= deferredPresent->PresentStartTime &&
             present->PresentStartTime - deferredPresent->PresentStartTime > mDeferralTimeLimit) {
+            mStats.CountLostPresent(ConsumerStats::LostPresent_DeferralTimeout);
             VerboseTraceBeforeModifyingPresent(deferredPresent.get());
             deferredPresent->IsLost = true;
             ClearDeferredReason(deferredPresent, deferredPresent->DeferredReason);
         }
     }
+
+    mCompletedSinceFootprintSample += 1;
+    if (mCompletedSinceFootprintSample == MEMORY_FOOTPRINT_SAMPLE_INTERVAL) {
+        mCompletedSinceFootprintSample = 0;
+        mStats.UpdateMemoryFootprint(EstimateMemoryFootprint());
+    }
 }
 
 void PMTraceConsumer::ClearDeferredReason(std::shared_ptr<PresentEvent> const& present, uint32_t deferredReason)
@@ -1988,27 +2139,37 @@ void PMTraceConsumer::ClearDeferredReason(std::shared_ptr<PresentEvent> const& p
         StopTrackingPresent(present);
 
         if (present->DeferredReason == DeferredReason_None) {
-            std::lock_guard<std::mutex> lock(mPresentEventMutex);
-
             uint32_t nextIndex = GetRingIndex(mCompletedIndex + mReadyCount);
             while (mReadyCount < mCompletedCount && mCompletedPresents[nextIndex]->DeferredReason == DeferredReason_None) {
                 mReadyCount++;
                 nextIndex = GetRingIndex(mCompletedIndex + mReadyCount);
             }
+
+            PublishReadyPresents();
         }
     }
 }
 
+// PresentEvents and their shared_ptr control blocks are allocated together from
+// mPresentEventPool.  The storage is returned to the pool once the last
+// reference is released, typically after the present has been dequeued and
+// processed by the application.
+std::shared_ptr<PresentEvent> PMTraceConsumer::CreatePresent()
+{
+    return std::allocate_shared<PresentEvent>(PresentEventAllocator<PresentEvent>(mPresentEventPool));
+}
+
 void PMTraceConsumer::SetThreadPresent(uint32_t threadId, std::shared_ptr<PresentEvent> const& present)
 {
     // If there is an in-flight present on this thread already, then something
     // has gone wrong with it's tracking so consider it lost.
     auto ii = mPresentByThreadId.find(threadId);
     if (ii != mPresentByThreadId.end()) {
-        RemoveLostPresent(ii->second);
+        RemoveLostPresent(ii->second, ConsumerStats::LostPresent_ThreadReused);
     }
 
     mPresentByThreadId.emplace(threadId, present);
+    mStats.UpdatePeakSize(ConsumerStats::Container_PresentByThreadId, mPresentByThreadId.size());
 }
 
 std::shared_ptr<PresentEvent> PMTraceConsumer::FindThreadPresent(uint32_t threadId)
@@ -2031,8 +2192,8 @@ std::shared_ptr<PresentEvent> PMTraceConsumer::FindOrCreatePresent(EVENT_HEADER
     // presents should have only seen present start/stop events so should not
     // have a known PresentMode, etc. yet.
     auto presentsByThisProcess = &mOrderedPresentsByProcessId[hdr.ProcessId];
-    for (auto const& pr : *presentsByThisProcess) {
-        present = pr.second;
+    for (auto const& p : *presentsByThisProcess) {
+        present = p;
         if (present->DriverThreadId == 0 &&
             present->SeenDxgkPresent == false &&
             present->SeenWin32KEvents == false &&
@@ -2059,7 +2220,7 @@ std::shared_ptr<PresentEvent> PMTraceConsumer::FindOrCreatePresent(EVENT_HEADER
     // D3D9) in which case a DxgKrnl event will be the first present-related
     // event we ever see.
     if (IsProcessTrackedForFiltering(hdr.ProcessId)) {
-        present = std::make_shared<PresentEvent>();
+        present = CreatePresent();
 
         VerboseTraceBeforeModifyingPresent(present.get());
         present->PresentStartTime = *(uint64_t*) &hdr.TimeStamp;
@@ -2083,7 +2244,7 @@ void PMTraceConsumer::TrackPresent(
     // If there is an existing present that hasn't completed by the time the
     // circular buffer has come around, consider it lost.
     if (mTrackedPresents[mNextFreeRingIndex] != nullptr) {
-        RemoveLostPresent(mTrackedPresents[mNextFreeRingIndex]);
+        RemoveLostPresent(mTrackedPresents[mNextFreeRingIndex], ConsumerStats::LostPresent_TrackingRingWrap);
     }
 
     // Add the present into the initial tracking data structures
@@ -2091,8 +2252,11 @@ void PMTraceConsumer::TrackPresent(
     present->RingIndex = mNextFreeRingIndex;
     mTrackedPresents[mNextFreeRingIndex] = present;
     mNextFreeRingIndex = GetRingIndex(mNextFreeRingIndex + 1);
+    mTrackedCount++;
+    mStats.UpdatePeakSize(ConsumerStats::Container_TrackedPresents, mTrackedCount);
 
-    presentsByThisProcess->emplace(present->PresentStartTime, present);
+    presentsByThisProcess->emplace(present);
+    mStats.UpdatePeakSize(ConsumerStats::Container_OrderedPresentsByProcessId, mOrderedPresentsByProcessId.size());
 
     SetThreadPresent(present->ThreadId, present);
 
@@ -2116,7 +2280,7 @@ void PMTraceConsumer::RuntimePresentStart(Runtime runtime, EVENT_HEADER const& h
         return;
     }
 
-    auto present = std::make_shared<PresentEvent>();
+    auto present = CreatePresent();
 
     VerboseTraceBeforeModifyingPresent(present.get());
     present->PresentStartTime = *(uint64_t*) &hdr.TimeStamp;
@@ -2137,6 +2301,7 @@ void PMTraceConsumer::RuntimePresentStart(Runtime runtime, EVENT_HEADER const& h
 // No TRACK_PRESENT instrumentation here because each runtime Present::Start
 // event is instrumented and we assume we'll see the corresponding Stop event
 // for any completed present.
+template<bool TRACK_DISPLAY>
 void PMTraceConsumer::RuntimePresentStop(Runtime runtime, EVENT_HEADER const& hdr, uint32_t result)
 {
     // Present_Start and Present_Stop happen on the same thread, so Lookup the PresentEvent
@@ -2198,7 +2363,8 @@ void PMTraceConsumer::RuntimePresentStop(Runtime runtime, EVENT_HEADER const& hd
     }
 
     // If we are not tracking presents to display, then no more analysis is needed.
-    if (!mTrackDisplay) {
+    #pragma warning(suppress: 4984) // C++17 extension
+    if constexpr (!TRACK_DISPLAY) {
         present->FinalState = PresentResult::Presented;
         CompletePresent(present);
         return;
@@ -2274,8 +2440,13 @@ void PMTraceConsumer::HandleProcessEvent(EVENT_RECORD* pEventRecord)
         }
     }
 
-    std::lock_guard<std::mutex> lock(mProcessEventMutex);
-    mProcessEvents.emplace_back(event);
+    {
+        std::lock_guard<std::mutex> lock(mProcessEventMutex);
+        mProcessEvents.emplace_back(event);
+    }
+
+    // Process events are rare, so wake the dequeuing thread for each one.
+    InterruptWaitForPresentEvents();
 }
 
 void PMTraceConsumer::HandleIntelPresentMonEvent(EVENT_RECORD* pEventRecord)
@@ -2287,6 +2458,7 @@ void PMTraceConsumer::HandleIntelPresentMonEvent(EVENT_RECORD* pEventRecord)
 
         auto props = (Intel_PresentMon::PresentFrameType_Info_Props*) pEventRecord->UserData;
         auto event = &mPendingPresentFrameTypeEvents[pEventRecord->EventHeader.ThreadId];
+        mStats.UpdatePeakSize(ConsumerStats::Container_PendingPresentFrameTypeEvents, mPendingPresentFrameTypeEvents.size());
         event->FrameId   = props->FrameId;
         event->FrameType = ConvertPMPFrameTypeToFrameType(props->FrameType);
     }   break;
@@ -2312,7 +2484,8 @@ void PMTraceConsumer::HandleIntelPresentMonEvent(EVENT_RECORD* pEventRecord)
             }
 
             auto present = ii->second;
-            auto jj = present->PresentIds.find(vidPnLayerId);
+            auto jj = std::find_if(present->PresentIds.begin(), present->PresentIds.end(),
+                                   [=](std::pair<uint64_t, uint64_t> const& pr) { return pr.first == vidPnLayerId; });
             if (jj == present->PresentIds.end() || jj->second != props->PresentId) {
                 DeferFlipFrameType(vidPnLayerId, props->PresentId, timestamp, frameType);
                 return;
@@ -2342,6 +2515,7 @@ void PMTraceConsumer::DeferFlipFrameType(
     e.Timestamp = timestamp;
     e.FrameType = frameType;
     mPendingFlipFrameTypeEvents.emplace(vidPnLayerId, e);
+    mStats.UpdatePeakSize(ConsumerStats::Container_PendingFlipFrameTypeEvents, mPendingFlipFrameTypeEvents.size());
 }
 
 void PMTraceConsumer::ApplyFlipFrameType(
@@ -2351,7 +2525,7 @@ void PMTraceConsumer::ApplyFlipFrameType(
 {
     // Create a copy of the present for this flip to add to the complete list, and mark the base
     // present as lost.
-    auto copy = std::make_shared<PresentEvent>();
+    auto copy = CreatePresent();
     *copy = *present;
     copy->IsLost = false;
     copy->DeferredReason &= ~DeferredReason_WaitingForFlipFrameType;
@@ -2385,31 +2559,48 @@ void PMTraceConsumer::HandleMetadataEvent(EVENT_RECORD* pEventRecord)
 
 void PMTraceConsumer::AddTrackedProcessForFiltering(uint32_t processID)
 {
-    std::unique_lock<std::shared_mutex> lock(mTrackedProcessFilterMutex);
-    mTrackedProcessFilter.insert(processID);
+    std::lock_guard<std::mutex> lock(mTrackedProcessFilterMutex);
+    if (mTrackedProcessFilter.insert(processID).second) {
+        PublishTrackedProcessFilter();
+    }
 }
 
 void PMTraceConsumer::RemoveTrackedProcessForFiltering(uint32_t processID)
 {
-    std::unique_lock<std::shared_mutex> lock(mTrackedProcessFilterMutex);
+    std::lock_guard<std::mutex> lock(mTrackedProcessFilterMutex);
     auto iterator = mTrackedProcessFilter.find(processID);
     if (iterator != mTrackedProcessFilter.end()) {
         mTrackedProcessFilter.erase(iterator);
+        PublishTrackedProcessFilter();
     }
 
     // Completion events will remove any currently tracked events for this process
     // from data structures, so we don't need to proactively remove them now.
 }
 
+// Publish a copy of mTrackedProcessFilter for the thread processing events.  If the previously-
+// published copy hasn't been taken yet, it is replaced (the thread processing events never saw
+// it, so it can be freed here).  mTrackedProcessFilterMutex must be held.
+void PMTraceConsumer::PublishTrackedProcessFilter()
+{
+    auto filter = new std::vector<uint32_t>(mTrackedProcessFilter.begin(), mTrackedProcessFilter.end());
+    delete mPendingProcessFilter.exchange(filter, std::memory_order_acq_rel);
+}
+
 bool PMTraceConsumer::IsProcessTrackedForFiltering(uint32_t processID)
 {
     if (!mFilteredProcessIds || processID == DwmProcessId) {
         return true;
     }
 
-    std::shared_lock<std::shared_mutex> lock(mTrackedProcessFilterMutex);
-    auto iterator = mTrackedProcessFilter.find(processID);
-    return (iterator != mTrackedProcessFilter.end());
+    if (mPendingProcessFilter.load(std::memory_order_relaxed) != nullptr) {
+        std::unique_ptr<std::vector<uint32_t>> filter(mPendingProcessFilter.exchange(nullptr, std::memory_order_acquire));
+        if (filter != nullptr) {
+            mProcessFilter.swap(*filter);
+        }
+    }
+
+    return std::binary_search(mProcessFilter.begin(), mProcessFilter.end(), processID);
 }
 
 void PMTraceConsumer::DequeueProcessEvents(std::vector<ProcessEvent>& outProcessEvents)
@@ -2420,19 +2611,248 @@ void PMTraceConsumer::DequeueProcessEvents(std::vector<ProcessEvent>& outProcess
 
 void PMTraceConsumer::DequeuePresentEvents(std::vector<std::shared_ptr<PresentEvent>>& outPresentEvents)
 {
+    // If any presents overflowed, hold the lock while emptying the ring as well so that the
+    // consumer thread can't add to the ring until the overflow has been dequeued after it.
+    std::unique_lock<std::mutex> overflowLock(mReadyOverflowMutex, std::defer_lock);
+    if (mReadyOverflowCount.load(std::memory_order_acquire) != 0) {
+        overflowLock.lock();
+    }
+
+    auto readCount = mReadyReadCount.load(std::memory_order_relaxed);
+    auto writeCount = mReadyWriteCount.load(std::memory_order_acquire);
+    auto count = writeCount - readCount;
+
     outPresentEvents.clear();
-    if (mReadyCount > 0) {
-        std::lock_guard<std::mutex> lock(mPresentEventMutex);
+    outPresentEvents.resize(count, nullptr);
+    for (uint32_t i = 0; i < count; ++i) {
+        std::swap(outPresentEvents[i], mReadyPresents[GetRingIndex(readCount + i)]);
+    }
+
+    mReadyReadCount.store(writeCount, std::memory_order_release);
+
+    if (overflowLock.owns_lock()) {
+        outPresentEvents.insert(outPresentEvents.end(), std::make_move_iterator(mReadyOverflow.begin()),
+                                                        std::make_move_iterator(mReadyOverflow.end()));
+        mReadyOverflow.clear();
+        mReadyOverflowCount.store(0);
+    }
+}
+
+bool PMTraceConsumer::WaitForPresentEvents(uint32_t timeoutMilliseconds, uint32_t minPresentCount)
+{
+    minPresentCount = std::max(minPresentCount, 1u);
+
+    auto GetReadyCount = [this]() {
+        return mReadyWriteCount.load() - mReadyReadCount.load(std::memory_order_relaxed) + mReadyOverflowCount.load();
+    };
+
+    if (GetReadyCount() >= minPresentCount) {
+        return true;
+    }
+
+    // Publish minPresentCount before checking the count again, so that either the check sees
+    // presents published after the first check or the consumer thread sees mReadyWaitCount and
+    // signals mReadyEvent.  The event is auto-reset, so it may already be signaled by a previous
+    // wait that timed out; in that case we return early and the caller simply waits again.
+    mReadyWaitCount.store(minPresentCount);
+    if (GetReadyCount() < minPresentCount) {
+        WaitForSingleObject(mReadyEvent, timeoutMilliseconds);
+    }
+    mReadyWaitCount.store(0);
+
+    return GetReadyCount() > 0;
+}
+
+void PMTraceConsumer::InterruptWaitForPresentEvents()
+{
+    SetEvent(mReadyEvent);
+}
+
+void PMTraceConsumer::EnqueueProcessEvents(std::vector<ProcessEvent> const& processEvents)
+{
+    if (processEvents.empty()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mProcessEventMutex);
+        mProcessEvents.insert(mProcessEvents.end(), processEvents.begin(), processEvents.end());
+    }
+
+    InterruptWaitForPresentEvents();
+}
+
+size_t PMTraceConsumer::EnqueuePresentEvents(std::shared_ptr<PresentEvent> const* presents, size_t presentCount)
+{
+    // The presents are already complete, so they are ready as soon as they are added.  Publish any
+    // that are still waiting for space in the ready ring first, then only add presents while the
+    // ready overflow has space so that PublishReadyPresents() never drops one.
+    PublishReadyPresents();
+
+    size_t count = 0;
+    for (; count < presentCount && mCompletedCount < mRingSize && mReadyOverflowCount.load(std::memory_order_relaxed) < mRingSize; ++count) {
+        DebugAssert(presents[count]->DeferredReason == DeferredReason_None);
+        AddPresentToCompletedList(presents[count]);
+    }
+    return count;
+}
 
-        outPresentEvents.resize(mReadyCount, nullptr);
-        for (uint32_t i = 0; i < mReadyCount; ++i) {
-            std::swap(outPresentEvents[i], mCompletedPresents[mCompletedIndex]);
+// Move all ready presents out of mCompletedPresents: into mReadyPresents as space allows, and
+// into mReadyOverflow if the dequeuing thread has fallen far enough behind that mReadyPresents is
+// full.  Ready presents never wait in mCompletedPresents, so they can all be dequeued even if the
+// consumer thread never completes another present (e.g., at the end of a trace).
+void PMTraceConsumer::PublishReadyPresents()
+{
+    if (mReadyCount == 0) {
+        return;
+    }
+
+    // Only this thread makes mReadyOverflowCount non-zero, so if it is zero the dequeuing thread
+    // won't touch mReadyOverflow until more presents are added to it.
+    auto writeCount = mReadyWriteCount.load(std::memory_order_relaxed);
+    auto readCount = mReadyReadCount.load(std::memory_order_acquire);
+    if (mReadyOverflowCount.load(std::memory_order_relaxed) == 0) {
+        auto count = std::min(mReadyCount, mRingSize - (writeCount - readCount));
+        for (uint32_t i = 0; i < count; ++i) {
+            std::swap(mReadyPresents[GetRingIndex(writeCount + i)], mCompletedPresents[mCompletedIndex]);
             mCompletedIndex = GetRingIndex(mCompletedIndex + 1);
         }
+        mCompletedCount -= count;
+        mReadyCount -= count;
+
+        writeCount += count;
+        mReadyWriteCount.store(writeCount);
+    }
 
-        mCompletedCount -= mReadyCount;
-        mReadyCount = 0;
+    uint32_t overflowCount = 0;
+    if (mReadyCount > 0) {
+        std::lock_guard<std::mutex> lock(mReadyOverflowMutex);
+        for (; mReadyCount > 0; --mReadyCount) {
+            if (mReadyOverflow.size() == mRingSize) {
+                mReadyOverflow.pop_front();
+                mStats.CountLostPresent(ConsumerStats::LostPresent_CompletedRingOverflow);
+            }
+            mReadyOverflow.emplace_back(std::move(mCompletedPresents[mCompletedIndex]));
+            mCompletedIndex = GetRingIndex(mCompletedIndex + 1);
+            mCompletedCount -= 1;
+        }
+        overflowCount = (uint32_t) mReadyOverflow.size();
+        mReadyOverflowCount.store(overflowCount);
     }
+
+    auto readyCount = writeCount - readCount + overflowCount;
+    mStats.UpdatePeakSize(ConsumerStats::Container_ReadyPresents, readyCount);
+
+    auto waitCount = mReadyWaitCount.load();
+    if (waitCount != 0 && readyCount >= waitCount) {
+        SetEvent(mReadyEvent);
+    }
+}
+
+// Instantiate the handler specializations that PMTraceSession dispatches events to.
+template void PMTraceConsumer::HandleD3D9Event<false, false>(EVENT_RECORD*);
+template void PMTraceConsumer::HandleD3D9Event<false, true>(EVENT_RECORD*);
+template void PMTraceConsumer::HandleD3D9Event<true, false>(EVENT_RECORD*);
+template void PMTraceConsumer::HandleD3D9Event<true, true>(EVENT_RECORD*);
+template void PMTraceConsumer::HandleDXGIEvent<false, false>(EVENT_RECORD*);
+template void PMTraceConsumer::HandleDXGIEvent<false, true>(EVENT_RECORD*);
+template void PMTraceConsumer::HandleDXGIEvent<true, false>(EVENT_RECORD*);
+template void PMTraceConsumer::HandleDXGIEvent<true, true>(EVENT_RECORD*);
+template void PMTraceConsumer::HandleDXGKEvent<false, false>(EVENT_RECORD*);
+template void PMTraceConsumer::HandleDXGKEvent<false, true>(EVENT_RECORD*);
+template void PMTraceConsumer::HandleDXGKEvent<true, false>(EVENT_RECORD*);
+template void PMTraceConsumer::HandleDXGKEvent<true, true>(EVENT_RECORD*);
+template void PMTraceConsumer::HandleWin32kEvent<false>(EVENT_RECORD*);
+template void PMTraceConsumer::HandleWin32kEvent<true>(EVENT_RECORD*);
+
+void PMTraceConsumer::SetMemoryBudget(size_t bytes)
+{
+    DebugAssert(mTrackedCount == 0 && mCompletedCount == 0 && mReadyWriteCount.load() == 0);
+
+    // Each ring entry can end up holding a present in each of the tracked, completed, and ready
+    // rings.
+    uint32_t ringSize = PRESENTEVENT_CIRCULAR_BUFFER_SIZE;
+    if (bytes != 0) {
+        size_t ringEntrySize = 3 * (sizeof(std::shared_ptr<PresentEvent>) + PRESENT_MEMORY_SIZE);
+        ringSize = MIN_RING_SIZE;
+        while (ringSize < MAX_RING_SIZE && 2 * ringSize * ringEntrySize <= bytes) {
+            ringSize *= 2;
+        }
+    }
+
+    mMemoryBudget = bytes;
+    mStats.SetMemoryBudget(bytes);
+    AllocateRings(ringSize);
+}
+
+void PMTraceConsumer::AllocateRings(uint32_t ringSize)
+{
+    DebugAssert((ringSize & (ringSize - 1)) == 0);
+    mRingSize = ringSize;
+    std::vector<std::shared_ptr<PresentEvent>>(ringSize).swap(mTrackedPresents);
+    std::vector<std::shared_ptr<PresentEvent>>(ringSize).swap(mCompletedPresents);
+    std::vector<std::shared_ptr<PresentEvent>>(ringSize).swap(mReadyPresents);
+
+    // Replace the (empty) maps so that a smaller budget also shrinks them.
+    auto mapCapacity = ringSize / RING_ENTRIES_PER_TRACKING_MAP_ENTRY;
+    mPresentByThreadId = {};
+    mPresentBySubmitSequence = {};
+    mPresentByWin32KPresentHistoryToken = {};
+    mPresentByDxgkPresentHistoryToken = {};
+    mPresentByDxgkPresentHistoryTokenData = {};
+    mPresentByDxgkContext = {};
+    mPresentByVidPnLayerId = {};
+    mLastPresentByWindow = {};
+    mPresentByThreadId.reserve(mapCapacity);
+    mPresentBySubmitSequence.reserve(mapCapacity);
+    mPresentByWin32KPresentHistoryToken.reserve(mapCapacity);
+    mPresentByDxgkPresentHistoryToken.reserve(mapCapacity);
+    mPresentByDxgkPresentHistoryTokenData.reserve(mapCapacity);
+    mPresentByDxgkContext.reserve(mapCapacity);
+    mPresentByVidPnLayerId.reserve(mapCapacity);
+    mLastPresentByWindow.reserve(mapCapacity);
+
+    mStats.UpdateMemoryFootprint(EstimateMemoryFootprint());
+}
+
+namespace {
+
+template<typename Map>
+size_t GetFlatHashMapMemorySize(Map const& map)
+{
+    return map.bucket_count() * sizeof(typename Map::Slot);
+}
+
+template<typename Map>
+size_t GetUnorderedMapMemorySize(Map const& map)
+{
+    // Each element is a separately-allocated node in a bucket list.
+    return map.bucket_count() * sizeof(void*) + map.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void*));
+}
+
+}
+
+// Estimate the memory used to track presents: the rings, the PresentEvents (including those the
+// application hasn't released yet), and the tracking maps.  GPU tracking is not included.
+size_t PMTraceConsumer::EstimateMemoryFootprint() const
+{
+    size_t bytes = 3 * (size_t) mRingSize * sizeof(std::shared_ptr<PresentEvent>);
+    bytes += mReadyOverflowCount.load(std::memory_order_relaxed) * sizeof(std::shared_ptr<PresentEvent>);
+    bytes += mPresentEventPool->GetAllocatedSize();
+    bytes += GetFlatHashMapMemorySize(mPresentByThreadId);
+    bytes += GetFlatHashMapMemorySize(mPresentBySubmitSequence);
+    bytes += GetFlatHashMapMemorySize(mPresentByWin32KPresentHistoryToken);
+    bytes += GetFlatHashMapMemorySize(mPresentByDxgkPresentHistoryToken);
+    bytes += GetFlatHashMapMemorySize(mPresentByDxgkPresentHistoryTokenData);
+    bytes += GetFlatHashMapMemorySize(mPresentByDxgkContext);
+    bytes += GetFlatHashMapMemorySize(mPresentByVidPnLayerId);
+    bytes += GetFlatHashMapMemorySize(mLastPresentByWindow);
+    bytes += GetUnorderedMapMemorySize(mOrderedPresentsByProcessId) + mTrackedCount * sizeof(OrderedPresents::Entry);
+    bytes += GetUnorderedMapMemorySize(mPendingPresentFrameTypeEvents);
+    bytes += GetUnorderedMapMemorySize(mPendingFlipFrameTypeEvents);
+    bytes += GetUnorderedMapMemorySize(mRetrievedInput);
+    bytes += mPresentsWaitingForDWM.size() * sizeof(std::shared_ptr<PresentEvent>);
+    return bytes;
 }
 
 #ifdef TRACK_PRESENT_PATHS
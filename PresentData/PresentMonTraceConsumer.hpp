@@ -6,11 +6,11 @@
 #define NOMINMAX
 #endif
 
+#include <atomic>
 #include <deque>
 #include <map>
 #include <memory>
 #include <mutex>
-#include <shared_mutex>
 #include <stdint.h>
 #include <string>
 #include <tuple>
@@ -20,8 +20,11 @@
 #include <windows.h>
 #include <evntcons.h> // must include after windows.h
 
+#include "ConsumerStats.hpp"
 #include "Debug.hpp"
+#include "FlatHashMap.hpp"
 #include "GpuTrace.hpp"
+#include "PresentEventPool.hpp"
 #include "TraceConsumer.hpp"
 
 // PresentMode represents the different paths a present can take on windows.
@@ -183,7 +186,7 @@ struct PresentEvent {
     uint64_t Hwnd;                        // mLastPresentByWindow
     uint32_t QueueSubmitSequence;         // mPresentBySubmitSequence
     uint32_t RingIndex;                   // mTrackedPresents and mCompletedPresents
-    std::unordered_map<uint64_t, uint64_t> PresentIds; // mPresentByVidPnLayerId
+    InlineVector<std::pair<uint64_t, uint64_t>, 4> PresentIds; // mPresentByVidPnLayerId (VidPnLayerId, PresentId) pairs
     // Note: the following index tracking structures as well but are defined elsewhere:
     //       ProcessId                 -> mOrderedPresentsByProcessId
     //       ThreadId, DriverThreadId  -> mPresentByThreadId
@@ -218,7 +221,7 @@ struct PresentEvent {
                                     // PMTraceConsumer::mPresentsWaitingForDWM
 
     // Additional transient tracking state
-    std::deque<std::shared_ptr<PresentEvent>> DependentPresents;
+    InlineVector<std::shared_ptr<PresentEvent>, 4> DependentPresents;
 
     uint32_t DeferredReason;    // The reason(s) this present is being deferred (see DeferredReason enum).
 
@@ -233,6 +236,45 @@ private:
     PresentEvent(PresentEvent const& copy); // dne
 };
 
+// OrderedPresents stores a process' in-progress presents ordered by PresentStartTime, with at
+// most one present per PresentStartTime.
+//
+// Presents nearly always arrive in PresentStartTime order and are usually removed oldest-first,
+// so they are stored contiguously with an append fast path.  Removing a present leaves a hole
+// that iteration skips; holes at the front are skipped by advancing mFirst, and the rest are
+// compacted away during insertion.  Since removal never moves other presents, it's safe to
+// remove presents (including the current one) while iterating.
+struct OrderedPresents {
+    struct Entry {
+        uint64_t mPresentStartTime;
+        std::shared_ptr<PresentEvent> mPresent; // nullptr if this is a hole
+    };
+
+    struct Iterator {
+        std::vector<Entry> const* mEntries;
+        size_t mIndex;
+
+        Iterator(std::vector<Entry> const* entries, size_t index);
+        std::shared_ptr<PresentEvent> const& operator*() const { return (*mEntries)[mIndex].mPresent; }
+        Iterator& operator++();
+        bool operator==(Iterator const& rhs) const { return mIndex == rhs.mIndex; }
+        bool operator!=(Iterator const& rhs) const { return mIndex != rhs.mIndex; }
+    };
+
+    std::vector<Entry> mEntries;
+    size_t mFirst = 0;  // Index of the first present in mEntries
+    size_t mCount = 0;  // Number of presents (i.e., not holes) in mEntries
+
+    bool empty() const { return mCount == 0; }
+    size_t size() const { return mCount; }
+    Iterator begin() const { return Iterator(&mEntries, mFirst); }
+    Iterator end() const { return Iterator(&mEntries, mEntries.size()); }
+    std::shared_ptr<PresentEvent> const& front() const { return *begin(); }
+
+    void emplace(std::shared_ptr<PresentEvent> const& present);
+    void erase(uint64_t presentStartTime);
+};
+
 struct PMTraceConsumer
 {
     // -------------------------------------------------------------------------------------------
@@ -255,9 +297,18 @@ struct PMTraceConsumer
     // deferred, potentially leading to dequeued events that are missing data.
     uint64_t mDeferralTimeLimit = 0; // QPC duration
 
+    // Limit the memory used to track presents to approximately the specified number of bytes, by
+    // sizing the present rings (and the tracking maps' initial capacity) to fit within it.  If more
+    // presents are in flight than fit, the oldest are evicted and counted in mStats (see
+    // ConsumerStats::Snapshot::GetEvictionCount()).  A budget of 0 uses the default sizes.  This
+    // must be called before the trace session is started.
+    void SetMemoryBudget(size_t bytes);
+
 
     // -------------------------------------------------------------------------------------------
     // These functions can be used to filter PresentEvents by process from within the consumer.
+    // Add/RemoveTrackedProcessForFiltering() can be called from any thread, while
+    // IsProcessTrackedForFiltering() is only called by the thread processing events.
 
     void AddTrackedProcessForFiltering(uint32_t processID);
     void RemoveTrackedProcessForFiltering(uint32_t processID);
@@ -276,6 +327,30 @@ struct PMTraceConsumer
     void DequeueProcessEvents(std::vector<ProcessEvent>& outProcessEvents);
     void DequeuePresentEvents(std::vector<std::shared_ptr<PresentEvent>>& outPresentEvents);
 
+    // WaitForPresentEvents() can be used instead of polling DequeuePresentEvents().  It blocks
+    // until at least minPresentCount PresentEvents are ready to be dequeued, or until the timeout
+    // elapses, and returns whether any PresentEvents are ready.  Only one thread may wait at a time,
+    // and it should be the thread that calls DequeuePresentEvents().
+    //
+    // The wait also ends early when a ProcessEvent is ready to be dequeued, or when another thread
+    // calls InterruptWaitForPresentEvents() (e.g., because the waiting thread has other work to
+    // do).  If no thread is waiting, the next wait returns immediately instead.
+    bool WaitForPresentEvents(uint32_t timeoutMilliseconds, uint32_t minPresentCount = 1);
+    void InterruptWaitForPresentEvents();
+
+    // EnqueueProcessEvents() and EnqueuePresentEvents() add completed events that were analyzed
+    // by other consumers (see ParallelEtlAnalysis) so that they can be dequeued from this one.
+    // They must only be called from the thread that would otherwise be processing events.
+    // EnqueuePresentEvents() returns how many of the presents were enqueued, which is less than
+    // presentCount if the presents already waiting to be dequeued fill the ready ring and its
+    // overflow.
+    void EnqueueProcessEvents(std::vector<ProcessEvent> const& processEvents);
+    size_t EnqueuePresentEvents(std::shared_ptr<PresentEvent> const* presents, size_t presentCount);
+
+    // mStats counts the events handled, lost presents, and the peak size of the tracking data
+    // structures (see ConsumerStats.hpp).  Call mStats.GetSnapshot() from any thread to read them.
+    ConsumerStats mStats;
+
 
     // -------------------------------------------------------------------------------------------
     // The rest of this structure are internal data and functions for analysing the collected ETW
@@ -289,18 +364,56 @@ struct PMTraceConsumer
     uint32_t mCompletedIndex = 0;       // The index of mCompletedPresents of the oldest completed present.
     uint32_t mCompletedCount = 0;       // The total number of presents in mCompletedPresents.
     uint32_t mReadyCount = 0;           // The number of presents in mCompletedPresents, starting at mCompletedIndex, that are ready to be dequeued.
+    uint32_t mTrackedCount = 0;         // The number of in-progress presents in mTrackedPresents.
+    uint32_t mRingSize = 0;             // The number of elements in each present ring (a power of two).
+    size_t mMemoryBudget = 0;           // The budget passed to SetMemoryBudget().
+    uint32_t mCompletedSinceFootprintSample = 0; // Presents completed since mStats' memory footprint was last estimated.
+
+    uint32_t GetRingIndex(uint32_t index) const { return index & (mRingSize - 1); }
 
-    // Mutexs to protect consumer/dequeue access from different threads:
+    // Ready presents are moved from mCompletedPresents into mReadyPresents, which is a
+    // single-producer/single-consumer ring shared with the dequeuing thread.  Only the consumer
+    // thread writes mReadyWriteCount, and only the dequeuing thread writes mReadyReadCount; both
+    // are running counts, and the ring index is the count modulo the ring size.
+    //
+    // If the dequeuing thread falls a full ring behind, ready presents are instead appended to
+    // mReadyOverflow under mReadyOverflowMutex, and mReadyOverflowCount is its size.  While it is
+    // non-zero, the consumer thread keeps appending to mReadyOverflow (rather than the ring) so
+    // that presents stay in order, and DequeuePresentEvents() takes the lock to empty both.  It
+    // holds at most mRingSize presents, after which the oldest are dropped.
+    //
+    // mReadyWaitCount is the minPresentCount of a thread blocked in WaitForPresentEvents() (or 0
+    // if no thread is waiting), and mReadyEvent is signaled when that many presents are ready.
+    std::vector<std::shared_ptr<PresentEvent>> mReadyPresents;
+    std::atomic<uint32_t> mReadyWriteCount { 0 };
+    std::atomic<uint32_t> mReadyReadCount { 0 };
+    std::deque<std::shared_ptr<PresentEvent>> mReadyOverflow;
+    std::mutex mReadyOverflowMutex;
+    std::atomic<uint32_t> mReadyOverflowCount { 0 };
+    std::atomic<uint32_t> mReadyWaitCount { 0 };
+    HANDLE mReadyEvent = NULL;
+
+    // PresentEvents are allocated from mPresentEventPool (see CreatePresent()).
+    std::shared_ptr<PresentEventPool> mPresentEventPool;
+
+    // Mutex to protect consumer/dequeue access of mProcessEvents from different threads:
     std::mutex mProcessEventMutex;
-    std::mutex mPresentEventMutex;
 
 
     // EventMetadata stores the structure of ETW events to optimize subsequent property retrieval.
     EventMetadata mMetadata;
 
-    // Limit tracking to specified processes
+    // Limit tracking to specified processes.
+    //
+    // mTrackedProcessFilter is the set of processes, which is modified under
+    // mTrackedProcessFilterMutex.  Each modification publishes an immutable, sorted copy of it to
+    // mPendingProcessFilter, which the thread processing events takes ownership of the next time
+    // it filters a process (moving it into mProcessFilter).  This way, filtering doesn't need to
+    // lock anything or walk the set, and a copy is never freed while it is being used.
     std::set<uint32_t> mTrackedProcessFilter;
-    std::shared_mutex mTrackedProcessFilterMutex;
+    std::mutex mTrackedProcessFilterMutex;
+    std::atomic<std::vector<uint32_t>*> mPendingProcessFilter { nullptr };
+    std::vector<uint32_t> mProcessFilter;
 
     // Whether we've completed any presents yet.  This is used to indicate that all the necessary
     // providers have started and it's safe to start tracking presents.
@@ -328,8 +441,8 @@ struct PMTraceConsumer
     // is the index of the element to use when creating the next present.
     //
     // Once presents are completed, they are moved into the mCompletedPresents ring buffer.
-    // mCompletedIndex and mCompletedCount specify a list of presents are ready to be dequeued by
-    // the user.
+    // mCompletedIndex and mCompletedCount specify a list of presents that are waiting to become
+    // ready, after which they are moved into mReadyPresents to be dequeued by the user.
     //
     // mPresentByThreadId stores the in-progress present that was last operated on by each thread.
     // This is used to look up the right present for event sequences that are known to execute on
@@ -365,25 +478,34 @@ struct PMTraceConsumer
     // window.  It's needed to discard some legacy blts, which don't always get a Win32K token
     // Discarded transition.  The present is either overwritten, or removed when DWM confirms the
     // present.
-
-    using OrderedPresents = std::map<uint64_t, std::shared_ptr<PresentEvent>>;
+    //
+    // Other than mOrderedPresentsByProcessId, these are FlatHashMaps which are looked up on nearly
+    // every event.  Note that FlatHashMap iterators are invalidated by any insertion or erase into
+    // the same map, so erase by key if the map may have been modified since the lookup.
 
     using Win32KPresentHistoryToken = std::tuple<uint64_t, uint64_t, uint64_t>; // (composition surface pointer, present count, bind id)
     struct Win32KPresentHistoryTokenHash : private std::hash<uint64_t> {
         std::size_t operator()(Win32KPresentHistoryToken const& v) const noexcept;
     };
 
-    std::unordered_map<uint32_t, std::shared_ptr<PresentEvent>> mPresentByThreadId;                     // ThreadId -> PresentEvent
+    // mPresentBySubmitSequence is hashed on the submit sequence only, so that all the contexts
+    // that share a submit sequence are in the same probe run (see FindPresentBySubmitSequence()).
+    using SubmitSequenceKey = std::pair<uint32_t, uint64_t>; // (submit sequence, hContext)
+    struct SubmitSequenceKeyHash {
+        uint64_t operator()(SubmitSequenceKey const& v) const { return v.first; }
+    };
+
+    FlatHashMap<uint32_t, std::shared_ptr<PresentEvent>>        mPresentByThreadId;                     // ThreadId -> PresentEvent
     std::unordered_map<uint32_t, OrderedPresents>               mOrderedPresentsByProcessId;            // ProcessId -> ordered PresentStartTime -> PresentEvent
-    std::unordered_map<uint32_t, std::unordered_map<uint64_t, std::shared_ptr<PresentEvent>>>
-                                                                mPresentBySubmitSequence;               // SubmitSequenceId -> hContext -> PresentEvent
-    std::unordered_map<Win32KPresentHistoryToken, std::shared_ptr<PresentEvent>,
-                       Win32KPresentHistoryTokenHash>           mPresentByWin32KPresentHistoryToken;    // Win32KPresentHistoryToken -> PresentEvent
-    std::unordered_map<uint64_t, std::shared_ptr<PresentEvent>> mPresentByDxgkPresentHistoryToken;      // DxgkPresentHistoryToken -> PresentEvent
-    std::unordered_map<uint64_t, std::shared_ptr<PresentEvent>> mPresentByDxgkPresentHistoryTokenData;  // DxgkPresentHistoryTokenData -> PresentEvent
-    std::unordered_map<uint64_t, std::shared_ptr<PresentEvent>> mPresentByDxgkContext;                  // DxgkContex -> PresentEvent
-    std::unordered_map<uint64_t, std::shared_ptr<PresentEvent>> mPresentByVidPnLayerId;                 // VidPnLayerId -> PresentEvent
-    std::unordered_map<uint64_t, std::shared_ptr<PresentEvent>> mLastPresentByWindow;                   // HWND -> PresentEvent
+    FlatHashMap<SubmitSequenceKey, std::shared_ptr<PresentEvent>,
+                SubmitSequenceKeyHash>                          mPresentBySubmitSequence;               // (SubmitSequenceId, hContext) -> PresentEvent
+    FlatHashMap<Win32KPresentHistoryToken, std::shared_ptr<PresentEvent>,
+                Win32KPresentHistoryTokenHash>                  mPresentByWin32KPresentHistoryToken;    // Win32KPresentHistoryToken -> PresentEvent
+    FlatHashMap<uint64_t, std::shared_ptr<PresentEvent>>        mPresentByDxgkPresentHistoryToken;      // DxgkPresentHistoryToken -> PresentEvent
+    FlatHashMap<uint64_t, std::shared_ptr<PresentEvent>>        mPresentByDxgkPresentHistoryTokenData;  // DxgkPresentHistoryTokenData -> PresentEvent
+    FlatHashMap<uint64_t, std::shared_ptr<PresentEvent>>        mPresentByDxgkContext;                  // DxgkContex -> PresentEvent
+    FlatHashMap<uint64_t, std::shared_ptr<PresentEvent>>        mPresentByVidPnLayerId;                 // VidPnLayerId -> PresentEvent
+    FlatHashMap<uint64_t, std::shared_ptr<PresentEvent>>        mLastPresentByWindow;                   // HWND -> PresentEvent
 
     // mGpuTrace tracks work executed on the GPU.
     GpuTrace mGpuTrace;
@@ -419,21 +541,27 @@ struct PMTraceConsumer
     // Functions for decoding ETW and analysing process and present events.
 
     PMTraceConsumer();
+    ~PMTraceConsumer();
 
     void HandleDxgkBlt(EVENT_HEADER const& hdr, uint64_t hwnd, bool redirectedPresent);
     void HandleDxgkFlip(EVENT_HEADER const& hdr, int32_t flipInterval, bool isMMIOFlip, bool isMPOFlip);
-    void HandleDxgkQueueSubmit(EVENT_HEADER const& hdr, uint64_t hContext, uint32_t submitSequence, uint32_t packetType, bool isPresentPacket, bool isWin7);
-    void HandleDxgkQueueComplete(uint64_t timestamp, uint64_t hContext, uint32_t submitSequence);
+    template<bool TRACK_GPU> void HandleDxgkQueueSubmit(EVENT_HEADER const& hdr, uint64_t hContext, uint32_t submitSequence, uint32_t packetType, bool isPresentPacket, bool isWin7);
+    template<bool TRACK_GPU> void HandleDxgkQueueComplete(uint64_t timestamp, uint64_t hContext, uint32_t submitSequence);
     void HandleDxgkMMIOFlip(uint64_t timestamp, uint32_t submitSequence, uint32_t flags);
     void HandleDxgkSyncDPC(uint64_t timestamp, uint32_t submitSequence);
     void HandleDxgkPresentHistory(EVENT_HEADER const& hdr, uint64_t token, uint64_t tokenData, Microsoft_Windows_DxgKrnl::PresentModel presentModel);
     void HandleDxgkPresentHistoryInfo(EVENT_HEADER const& hdr, uint64_t token);
 
+    // The handlers that test tracking options while handling frequent events are specialized on
+    // those options, so that the work for disabled features is compiled out.  The template
+    // arguments must match the corresponding mTrack*/mFilteredProcessIds values;
+    // PMTraceSession's event callback selects the matching specializations.
+    template<bool TRACK_DISPLAY, bool FILTERED_PROCESS_IDS> void HandleDXGIEvent(EVENT_RECORD* pEventRecord);
+    template<bool TRACK_DISPLAY, bool FILTERED_PROCESS_IDS> void HandleD3D9Event(EVENT_RECORD* pEventRecord);
+    template<bool TRACK_GPU, bool TRACK_FRAME_TYPE> void HandleDXGKEvent(EVENT_RECORD* pEventRecord);
+    template<bool TRACK_INPUT> void HandleWin32kEvent(EVENT_RECORD* pEventRecord);
+
     void HandleProcessEvent(EVENT_RECORD* pEventRecord);
-    void HandleDXGIEvent(EVENT_RECORD* pEventRecord);
-    void HandleD3D9Event(EVENT_RECORD* pEventRecord);
-    void HandleDXGKEvent(EVENT_RECORD* pEventRecord);
-    void HandleWin32kEvent(EVENT_RECORD* pEventRecord);
     void HandleDWMEvent(EVENT_RECORD* pEventRecord);
     void HandleMetadataEvent(EVENT_RECORD* pEventRecord);
     void HandleIntelPresentMonEvent(EVENT_RECORD* pEventRecord);
@@ -446,6 +574,7 @@ struct PMTraceConsumer
     void HandleWin7DxgkMMIOFlip(EVENT_RECORD* pEventRecord);
 
 
+    std::shared_ptr<PresentEvent> CreatePresent();
     void SetThreadPresent(uint32_t threadId, std::shared_ptr<PresentEvent> const& present);
     std::shared_ptr<PresentEvent> FindThreadPresent(uint32_t threadId);
     std::shared_ptr<PresentEvent> FindOrCreatePresent(EVENT_HEADER const& hdr);
@@ -456,11 +585,16 @@ struct PMTraceConsumer
     void RemovePresentFromSubmitSequenceIdTracking(std::shared_ptr<PresentEvent> const& present);
 
     void RuntimePresentStart(Runtime runtime, EVENT_HEADER const& hdr, uint64_t swapchainAddr, uint32_t dxgiPresentFlags, int32_t syncInterval);
-    void RuntimePresentStop(Runtime runtime, EVENT_HEADER const& hdr, uint32_t result);
+    template<bool TRACK_DISPLAY> void RuntimePresentStop(Runtime runtime, EVENT_HEADER const& hdr, uint32_t result);
     void CompletePresent(std::shared_ptr<PresentEvent> const& p);
-    void RemoveLostPresent(std::shared_ptr<PresentEvent> present);
+    void RemoveLostPresent(std::shared_ptr<PresentEvent> present, ConsumerStats::LostPresentReason reason);
+    void PublishTrackedProcessFilter();
+    void AllocateRings(uint32_t ringSize);
+    size_t EstimateMemoryFootprint() const;
+    void AddPresentWaitingForDWM(std::shared_ptr<PresentEvent> const& present);
 
     void AddPresentToCompletedList(std::shared_ptr<PresentEvent> const& present);
+    void PublishReadyPresents();
     void ClearDeferredReason(std::shared_ptr<PresentEvent> const& present, uint32_t deferredReason);
 
     void DeferFlipFrameType(uint64_t vidPnLayerId, uint64_t presentId, uint64_t timestamp, FrameType frameType);
@@ -2,6 +2,8 @@
 // SPDX-License-Identifier: MIT
 
 #include "Debug.hpp"
+#include "EtlReader.hpp"
+#include "EventStream.hpp"
 #include "PresentMonTraceConsumer.hpp"
 #include "PresentMonTraceSession.hpp"
 
@@ -341,11 +343,155 @@ void DisableProviders(TRACEHANDLE sessionHandle)
     status = EnableTraceEx2(sessionHandle, &Microsoft_Windows_Win32k::GUID,         EVENT_CONTROL_CODE_DISABLE_PROVIDER, 0, 0, 0, 0, nullptr);
 }
 
+// ProviderDispatchTable maps an event's ProviderId to the PMTraceConsumer handler for that
+// provider using a small, collision-free hash table: each provider's GUID hashes to a different
+// slot, so looking up an event's handler costs one hash and one GUID comparison regardless of
+// how many providers there are (and an unhandled provider is usually rejected by an empty slot).
+// The table is built once for each combination of tracking options, and only contains the
+// providers, and handler specializations, for that combination.
+struct ProviderHandler {
+    GUID mProviderId;
+    void (PMTraceConsumer::*mHandler)(EVENT_RECORD*);
+    ConsumerStats::Provider mProvider;
+};
+
+class ProviderDispatchTable {
+    enum { MIN_TABLE_BITS = 4, MAX_TABLE_BITS = 12 };
+
+    std::vector<ProviderHandler> mSlots;
+    uint32_t mShift;
+    uint32_t mMask;
+
+    static uint32_t Hash(GUID const& guid)
+    {
+        uint32_t words[4] = {};
+        static_assert(sizeof(words) == sizeof(GUID), "unexpected GUID size");
+        memcpy(words, &guid, sizeof(GUID));
+        return (words[0] ^ words[1] ^ words[2] ^ words[3]) * 0x9E3779B1u;
+    }
+
+public:
+    explicit ProviderDispatchTable(std::vector<ProviderHandler> const& handlers)
+    {
+        // Use the smallest table, at least twice as large as the number of providers, that none
+        // of the providers collide in.  Collisions are resolved with linear probing, so if
+        // there is no such table up to MAX_TABLE_BITS the largest one is still correct.
+        uint32_t bits = MIN_TABLE_BITS;
+        while ((2u * handlers.size()) > (1u << bits)) {
+            bits += 1;
+        }
+        for (;; ++bits) {
+            mShift = 32 - bits;
+            mMask = (1u << bits) - 1;
+            mSlots.assign(1u << bits, ProviderHandler{});
+
+            bool collision = false;
+            for (auto const& handler : handlers) {
+                auto index = Hash(handler.mProviderId) >> mShift;
+                while (mSlots[index].mHandler != nullptr) {
+                    index = (index + 1) & mMask;
+                    collision = true;
+                }
+                mSlots[index] = handler;
+            }
+
+            if (!collision || bits == MAX_TABLE_BITS) {
+                break;
+            }
+        }
+    }
+
+    // Returns nullptr if providerId isn't handled.
+    ProviderHandler const* Find(GUID const& providerId) const
+    {
+        for (auto index = Hash(providerId) >> mShift; ; index = (index + 1) & mMask) {
+            auto slot = &mSlots[index];
+            if (slot->mHandler == nullptr) {
+                return nullptr;
+            }
+            if (slot->mProviderId == providerId) {
+                return slot;
+            }
+        }
+    }
+};
+
+template<
+    bool TRACK_DISPLAY,
+    bool TRACK_GPU,
+    bool TRACK_INPUT,
+    bool TRACK_PRESENTMON,
+    bool FILTERED_PROCESS_IDS>
+std::vector<ProviderHandler> GetProviderHandlers()
+{
+    #pragma warning(push)
+    #pragma warning(disable: 4984) // c++17 extension
+
+    std::vector<ProviderHandler> handlers;
+    handlers.reserve(20);
+    handlers.push_back({ Microsoft_Windows_DxgKrnl::GUID,                       &PMTraceConsumer::HandleDXGKEvent<TRACK_GPU, TRACK_PRESENTMON>,              ConsumerStats::Provider_DxgKrnl });
+    handlers.push_back({ Microsoft_Windows_DXGI::GUID,                          &PMTraceConsumer::HandleDXGIEvent<TRACK_DISPLAY, FILTERED_PROCESS_IDS>,      ConsumerStats::Provider_DXGI });
+    handlers.push_back({ Microsoft_Windows_D3D9::GUID,                          &PMTraceConsumer::HandleD3D9Event<TRACK_DISPLAY, FILTERED_PROCESS_IDS>,      ConsumerStats::Provider_D3D9 });
+    handlers.push_back({ Microsoft_Windows_Kernel_Process::GUID,                &PMTraceConsumer::HandleProcessEvent,                                        ConsumerStats::Provider_Process });
+    handlers.push_back({ NT_Process::GUID,                                      &PMTraceConsumer::HandleProcessEvent,                                        ConsumerStats::Provider_Process });
+    handlers.push_back({ Microsoft_Windows_DxgKrnl::Win7::PRESENTHISTORY_GUID,  &PMTraceConsumer::HandleWin7DxgkPresentHistory,                              ConsumerStats::Provider_Win7 });
+    handlers.push_back({ Microsoft_Windows_EventMetadata::GUID,                 &PMTraceConsumer::HandleMetadataEvent,                                       ConsumerStats::Provider_EventMetadata });
+    if constexpr (TRACK_DISPLAY || TRACK_INPUT) {
+        handlers.push_back({ Microsoft_Windows_Win32k::GUID,                    &PMTraceConsumer::HandleWin32kEvent<TRACK_INPUT>,                            ConsumerStats::Provider_Win32k });
+    }
+    if constexpr (TRACK_DISPLAY) {
+        handlers.push_back({ Microsoft_Windows_Dwm_Core::GUID,                  &PMTraceConsumer::HandleDWMEvent,                                            ConsumerStats::Provider_Dwm });
+        handlers.push_back({ Microsoft_Windows_Dwm_Core::Win7::GUID,            &PMTraceConsumer::HandleDWMEvent,                                            ConsumerStats::Provider_Win7 });
+        handlers.push_back({ Microsoft_Windows_DxgKrnl::Win7::BLT_GUID,         &PMTraceConsumer::HandleWin7DxgkBlt,                                         ConsumerStats::Provider_Win7 });
+        handlers.push_back({ Microsoft_Windows_DxgKrnl::Win7::FLIP_GUID,        &PMTraceConsumer::HandleWin7DxgkFlip,                                        ConsumerStats::Provider_Win7 });
+        handlers.push_back({ Microsoft_Windows_DxgKrnl::Win7::QUEUEPACKET_GUID, &PMTraceConsumer::HandleWin7DxgkQueuePacket,                                 ConsumerStats::Provider_Win7 });
+        handlers.push_back({ Microsoft_Windows_DxgKrnl::Win7::VSYNCDPC_GUID,    &PMTraceConsumer::HandleWin7DxgkVSyncDPC,                                    ConsumerStats::Provider_Win7 });
+        handlers.push_back({ Microsoft_Windows_DxgKrnl::Win7::MMIOFLIP_GUID,    &PMTraceConsumer::HandleWin7DxgkMMIOFlip,                                    ConsumerStats::Provider_Win7 });
+    }
+    if constexpr (TRACK_PRESENTMON) {
+        handlers.push_back({ Intel_PresentMon::GUID,                            &PMTraceConsumer::HandleIntelPresentMonEvent,                                ConsumerStats::Provider_IntelPresentMon });
+    }
+    return handlers;
+
+    #pragma warning(pop)
+}
+
+template<
+    bool TRACK_DISPLAY,
+    bool TRACK_GPU,
+    bool TRACK_INPUT,
+    bool TRACK_PRESENTMON,
+    bool FILTERED_PROCESS_IDS>
+ProviderDispatchTable const& GetProviderDispatchTable()
+{
+    static ProviderDispatchTable const table(GetProviderHandlers<TRACK_DISPLAY, TRACK_GPU, TRACK_INPUT, TRACK_PRESENTMON, FILTERED_PROCESS_IDS>());
+    return table;
+}
+
+// Count the event and, for a sample of events, how long it takes to handle.
+void HandleEvent(PMTraceConsumer* pmConsumer, ProviderHandler const& handler, EVENT_RECORD* pEventRecord)
+{
+    pmConsumer->mStats.CountEvent(handler.mProvider, pEventRecord->EventHeader.EventDescriptor.Id);
+
+    if (pmConsumer->mStats.SampleNextHandler()) {
+        LARGE_INTEGER start = {};
+        LARGE_INTEGER end = {};
+        QueryPerformanceCounter(&start);
+        (pmConsumer->*handler.mHandler)(pEventRecord);
+        QueryPerformanceCounter(&end);
+        pmConsumer->mStats.AddHandlerSample(handler.mProvider, end.QuadPart - start.QuadPart);
+    } else {
+        (pmConsumer->*handler.mHandler)(pEventRecord);
+    }
+}
+
 template<
     bool IS_REALTIME_SESSION,
     bool TRACK_DISPLAY,
+    bool TRACK_GPU,
     bool TRACK_INPUT,
-    bool TRACK_PRESENTMON>
+    bool TRACK_PRESENTMON,
+    bool FILTERED_PROCESS_IDS>
 void CALLBACK EventRecordCallback(EVENT_RECORD* pEventRecord)
 {
     auto session = (PMTraceSession*) pEventRecord->UserContext;
@@ -360,78 +506,17 @@ void CALLBACK EventRecordCallback(EVENT_RECORD* pEventRecord)
         }
     }
 
-    VerboseTraceEvent(session->mPMConsumer, pEventRecord, &session->mPMConsumer->mMetadata);
-
-    if (hdr.ProviderId == Microsoft_Windows_DxgKrnl::GUID) {
-        session->mPMConsumer->HandleDXGKEvent(pEventRecord);
-        return;
-    }
-    if (hdr.ProviderId == Microsoft_Windows_DXGI::GUID) {
-        session->mPMConsumer->HandleDXGIEvent(pEventRecord);
-        return;
-    }
-    if constexpr (TRACK_DISPLAY || TRACK_INPUT) {
-        if (hdr.ProviderId == Microsoft_Windows_Win32k::GUID) {
-            session->mPMConsumer->HandleWin32kEvent(pEventRecord);
-            return;
-        }
-    }
-    if constexpr (TRACK_DISPLAY) {
-        if (hdr.ProviderId == Microsoft_Windows_Dwm_Core::GUID) {
-            session->mPMConsumer->HandleDWMEvent(pEventRecord);
-            return;
-        }
-    }
-    if (hdr.ProviderId == Microsoft_Windows_D3D9::GUID) {
-        session->mPMConsumer->HandleD3D9Event(pEventRecord);
-        return;
-    }
-    if (hdr.ProviderId == Microsoft_Windows_Kernel_Process::GUID ||
-        hdr.ProviderId == NT_Process::GUID) {
-        session->mPMConsumer->HandleProcessEvent(pEventRecord);
-        return;
-    }
-    if (hdr.ProviderId == Microsoft_Windows_DxgKrnl::Win7::PRESENTHISTORY_GUID) {
-        session->mPMConsumer->HandleWin7DxgkPresentHistory(pEventRecord);
-        return;
-    }
-    if (hdr.ProviderId == Microsoft_Windows_EventMetadata::GUID) {
-        session->mPMConsumer->HandleMetadataEvent(pEventRecord);
-        return;
+    if (session->mEventStreamWriter != nullptr) {
+        session->mEventStreamWriter->WriteEvent(pEventRecord);
     }
 
-    if constexpr (TRACK_DISPLAY) {
-        if (hdr.ProviderId == Microsoft_Windows_Dwm_Core::Win7::GUID) {
-            session->mPMConsumer->HandleDWMEvent(pEventRecord);
-            return;
-        }
-        if (hdr.ProviderId == Microsoft_Windows_DxgKrnl::Win7::BLT_GUID) {
-            session->mPMConsumer->HandleWin7DxgkBlt(pEventRecord);
-            return;
-        }
-        if (hdr.ProviderId == Microsoft_Windows_DxgKrnl::Win7::FLIP_GUID) {
-            session->mPMConsumer->HandleWin7DxgkFlip(pEventRecord);
-            return;
-        }
-        if (hdr.ProviderId == Microsoft_Windows_DxgKrnl::Win7::QUEUEPACKET_GUID) {
-            session->mPMConsumer->HandleWin7DxgkQueuePacket(pEventRecord);
-            return;
-        }
-        if (hdr.ProviderId == Microsoft_Windows_DxgKrnl::Win7::VSYNCDPC_GUID) {
-            session->mPMConsumer->HandleWin7DxgkVSyncDPC(pEventRecord);
-            return;
-        }
-        if (hdr.ProviderId == Microsoft_Windows_DxgKrnl::Win7::MMIOFLIP_GUID) {
-            session->mPMConsumer->HandleWin7DxgkMMIOFlip(pEventRecord);
-            return;
-        }
-    }
+    VerboseTraceEvent(session->mPMConsumer, pEventRecord, &session->mPMConsumer->mMetadata);
 
-    if constexpr (TRACK_PRESENTMON) {
-        if (hdr.ProviderId == Intel_PresentMon::GUID) {
-            session->mPMConsumer->HandleIntelPresentMonEvent(pEventRecord);
-            return;
-        }
+    auto handler = GetProviderDispatchTable<TRACK_DISPLAY, TRACK_GPU, TRACK_INPUT, TRACK_PRESENTMON, FILTERED_PROCESS_IDS>().Find(hdr.ProviderId);
+    if (handler != nullptr) {
+        HandleEvent(session->mPMConsumer, *handler, pEventRecord);
+    } else {
+        session->mPMConsumer->mStats.CountEvent(ConsumerStats::Provider_Other, hdr.EventDescriptor.Id);
     }
 
     #pragma warning(pop)
@@ -465,12 +550,76 @@ PEVENT_RECORD_CALLBACK GetEventRecordCallback(bool t1, bool t2, bool t3, bool t4
               : GetEventRecordCallback<Ts..., false>(t2, t3, t4);
 }
 
+template<bool... Ts>
+PEVENT_RECORD_CALLBACK GetEventRecordCallback(bool t1, bool t2, bool t3, bool t4, bool t5)
+{
+    return t1 ? GetEventRecordCallback<Ts..., true>(t2, t3, t4, t5)
+              : GetEventRecordCallback<Ts..., false>(t2, t3, t4, t5);
+}
+
+template<bool... Ts>
+PEVENT_RECORD_CALLBACK GetEventRecordCallback(bool t1, bool t2, bool t3, bool t4, bool t5, bool t6)
+{
+    return t1 ? GetEventRecordCallback<Ts..., true>(t2, t3, t4, t5, t6)
+              : GetEventRecordCallback<Ts..., false>(t2, t3, t4, t5, t6);
+}
+
 ULONG CALLBACK BufferCallback(EVENT_TRACE_LOGFILE* pLogFile)
 {
     auto session = (PMTraceSession*) pLogFile->Context;
     return session->mContinueProcessingBuffers; // TRUE = continue processing events, FALSE = return out of ProcessTrace()
 }
 
+// Dispatch all of reader's events to the session's consumer, until the end of
+// the events or until the session is stopped.
+template<typename Reader>
+void DispatchEvents(PMTraceSession* session, Reader* reader)
+{
+    auto eventRecordCallback = session->GetOfflineEventRecordCallback();
+
+    EVENT_RECORD eventRecord = {};
+    eventRecord.UserContext = session;
+
+    while (session->mContinueProcessingBuffers && reader->ReadEvent(&eventRecord)) {
+        (*eventRecordCallback)(&eventRecord);
+    }
+}
+
+// Set the session's timestamp type and frequency from an ETL's logfile
+// header, and (for ETLs) the local FILETIME that the trace started at.
+void InitializeTimestamps(PMTraceSession* session, TRACE_LOGFILE_HEADER const& logfileHeader)
+{
+    session->mTimestampType = (PMTraceSession::TimestampType) logfileHeader.ReservedFlags;
+    switch (session->mTimestampType) {
+    case PMTraceSession::TIMESTAMP_TYPE_SYSTEM_TIME:
+        session->mTimestampFrequency.QuadPart = 10000000ull;
+        break;
+    case PMTraceSession::TIMESTAMP_TYPE_CPU_CYCLE_COUNTER:
+        session->mTimestampFrequency.QuadPart = 1000000ull * logfileHeader.CpuSpeedInMHz;
+        break;
+    case PMTraceSession::TIMESTAMP_TYPE_QPC:
+    default:
+        session->mTimestampFrequency = logfileHeader.PerfFreq;
+        break;
+    }
+
+    // Default to systemtime frequency if the frequency didn't load correctly.
+    if (session->mTimestampFrequency.QuadPart == 0) {
+        session->mTimestampFrequency.QuadPart = 10000000ull;
+    }
+
+    if (!session->mIsRealtimeSession) {
+        // Convert start FILETIME to local start FILETIME
+        SYSTEMTIME ust{};
+        SYSTEMTIME lst{};
+        FileTimeToSystemTime((FILETIME const*) &logfileHeader.StartTime, &ust);
+        SystemTimeToTzSpecificLocalTime(&logfileHeader.TimeZone, &ust, &lst);
+        SystemTimeToFileTime(&lst, (FILETIME*) &session->mStartFileTime);
+        // The above conversion stops at milliseconds, so copy the rest over too
+        session->mStartFileTime += logfileHeader.StartTime.QuadPart % 10000;
+    }
+}
+
 }
 
 ULONG PMTraceSession::Start(
@@ -484,6 +633,23 @@ ULONG PMTraceSession::Start(
     mContinueProcessingBuffers = TRUE;
     mIsRealtimeSession = etlPath == nullptr;
 
+    delete mEtlReader;
+    mEtlReader = nullptr;
+
+    // If requested, read the ETL directly instead of through OpenTrace() and
+    // ProcessTrace().  If EtlReader doesn't support the ETL, fall back to
+    // ProcessTrace().
+    if (!mIsRealtimeSession && mUseNativeEtlReader) {
+        auto etlReader = new EtlReader;
+        if (etlReader->Open(etlPath) == ERROR_SUCCESS) {
+            mEtlReader = etlReader;
+            InitializeTimestamps(this, mEtlReader->mLogfileHeader);
+            InitializeTimestampInfo(&mStartTimestamp, mTimestampFrequency);
+            return ERROR_SUCCESS;
+        }
+        delete etlReader;
+    }
+
     // If we're not reading an ETL, start a realtime trace session with the
     // required providers enabled.
     if (mIsRealtimeSession) {
@@ -525,10 +691,12 @@ ULONG PMTraceSession::Start(
     }
 
     traceProps.EventRecordCallback = GetEventRecordCallback(
-        mIsRealtimeSession,            // IS_REALTIME_SESSION
-        mPMConsumer->mTrackDisplay,    // TRACK_DISPLAY
-        mPMConsumer->mTrackInput,      // TRACK_INPUT
-        mPMConsumer->mTrackFrameType); // TRACK_PRESENTMON
+        mIsRealtimeSession,                // IS_REALTIME_SESSION
+        mPMConsumer->mTrackDisplay,        // TRACK_DISPLAY
+        mPMConsumer->mTrackGPU,            // TRACK_GPU
+        mPMConsumer->mTrackInput,          // TRACK_INPUT
+        mPMConsumer->mTrackFrameType,      // TRACK_PRESENTMON
+        mPMConsumer->mFilteredProcessIds); // FILTERED_PROCESS_IDS
 
     mTraceHandle = OpenTraceW(&traceProps);
     if (mTraceHandle == INVALID_PROCESSTRACE_HANDLE) {
@@ -540,24 +708,7 @@ ULONG PMTraceSession::Start(
     // Save the initial time to base capture off of.  ETL captures use the
     // time of the first event, which matches GPUVIEW usage, and realtime
     // captures are based off the timestamp here.
-    mTimestampType = (TimestampType) traceProps.LogfileHeader.ReservedFlags;
-    switch (mTimestampType) {
-    case TIMESTAMP_TYPE_SYSTEM_TIME:
-        mTimestampFrequency.QuadPart = 10000000ull;
-        break;
-    case TIMESTAMP_TYPE_CPU_CYCLE_COUNTER:
-        mTimestampFrequency.QuadPart = 1000000ull * traceProps.LogfileHeader.CpuSpeedInMHz;
-        break;
-    case TIMESTAMP_TYPE_QPC:
-    default:
-        mTimestampFrequency = traceProps.LogfileHeader.PerfFreq;
-        break;
-    }
-
-    // Default to systemtime frequency if the frequency didn't load correctly.
-    if (mTimestampFrequency.QuadPart == 0) {
-        mTimestampFrequency.QuadPart = 10000000ull;
-    }
+    InitializeTimestamps(this, traceProps.LogfileHeader);
 
     if (mIsRealtimeSession) {
         LARGE_INTEGER qpc1 = {};
@@ -568,15 +719,6 @@ ULONG PMTraceSession::Start(
         QueryPerformanceCounter(&qpc2);
         FileTimeToLocalFileTime(&ft, (FILETIME*) &mStartFileTime);
         mStartTimestamp.QuadPart = (qpc1.QuadPart + qpc2.QuadPart) / 2;
-    } else {
-        // Convert start FILETIME to local start FILETIME
-        SYSTEMTIME ust{};
-        SYSTEMTIME lst{};
-        FileTimeToSystemTime((FILETIME const*) &traceProps.LogfileHeader.StartTime, &ust);
-        SystemTimeToTzSpecificLocalTime(&traceProps.LogfileHeader.TimeZone, &ust, &lst);
-        SystemTimeToFileTime(&lst, (FILETIME*) &mStartFileTime);
-        // The above conversion stops at milliseconds, so copy the rest over too
-        mStartFileTime += traceProps.LogfileHeader.StartTime.QuadPart % 10000;
     }
 
     InitializeTimestampInfo(&mStartTimestamp, mTimestampFrequency);
@@ -584,6 +726,68 @@ ULONG PMTraceSession::Start(
     return ERROR_SUCCESS;
 }
 
+PMTraceSession::~PMTraceSession()
+{
+    delete mEtlReader;
+}
+
+ULONG PMTraceSession::StartReplay(EventStreamReader* reader)
+{
+    assert(mPMConsumer != nullptr);
+    assert(mSessionHandle == 0);
+    assert(mTraceHandle == INVALID_PROCESSTRACE_HANDLE);
+    mContinueProcessingBuffers = TRUE;
+    mIsRealtimeSession = false;
+
+    // Use the timing information of the session that the stream was recorded from.
+    auto const& header = reader->Header();
+    mTimestampType = (TimestampType) header.mTimestampType;
+    mTimestampFrequency.QuadPart = header.mTimestampFrequency;
+    mStartTimestamp.QuadPart = header.mStartTimestamp;
+    mStartFileTime = header.mStartFileTime;
+    if (mTimestampFrequency.QuadPart == 0) {
+        mTimestampFrequency.QuadPart = 10000000ull;
+    }
+
+    InitializeTimestampInfo(&mStartTimestamp, mTimestampFrequency);
+
+    // The stream contains the metadata for every event it contains, so TDH is never needed to
+    // decode them.
+    reader->LoadMetadata(&mPMConsumer->mMetadata);
+
+    reader->Rewind();
+    mEventStreamReader = reader;
+
+    return ERROR_SUCCESS;
+}
+
+ULONG PMTraceSession::ProcessEventStream()
+{
+    assert(mEventStreamReader != nullptr);
+    DispatchEvents(this, mEventStreamReader);
+
+    return mEventStreamReader->mCorrupt ? ERROR_FILE_CORRUPT : ERROR_SUCCESS;
+}
+
+PEVENT_RECORD_CALLBACK PMTraceSession::GetOfflineEventRecordCallback() const
+{
+    return GetEventRecordCallback(
+        false,                             // IS_REALTIME_SESSION
+        mPMConsumer->mTrackDisplay,        // TRACK_DISPLAY
+        mPMConsumer->mTrackGPU,            // TRACK_GPU
+        mPMConsumer->mTrackInput,          // TRACK_INPUT
+        mPMConsumer->mTrackFrameType,      // TRACK_PRESENTMON
+        mPMConsumer->mFilteredProcessIds); // FILTERED_PROCESS_IDS
+}
+
+ULONG PMTraceSession::ProcessEtlReader()
+{
+    assert(mEtlReader != nullptr);
+    DispatchEvents(this, mEtlReader);
+
+    return mEtlReader->mCorrupt ? ERROR_FILE_CORRUPT : ERROR_SUCCESS;
+}
+
 void PMTraceSession::Stop()
 {
     ULONG status = 0;
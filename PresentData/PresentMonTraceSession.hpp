@@ -2,6 +2,9 @@
 // SPDX-License-Identifier: MIT
 
 struct PMTraceConsumer;
+struct EtlReader;
+struct EventStreamReader;
+struct EventStreamWriter;
 
 struct PMTraceSession {
     enum TimestampType {
@@ -27,10 +30,37 @@ struct PMTraceSession {
 
     bool mIsRealtimeSession = false;
 
+    EventStreamWriter* mEventStreamWriter = nullptr;        // If set, all events are also recorded into this stream
+
+    bool mUseNativeEtlReader = false;                       // If true, Start() reads ETLs with EtlReader when possible
+    EtlReader* mEtlReader = nullptr;                        // Set by Start() if the ETL is being read with EtlReader
+    EventStreamReader* mEventStreamReader = nullptr;        // Set by StartReplay() to the stream being replayed
+
+    PMTraceSession() = default;
+    PMTraceSession(PMTraceSession const&) = delete;
+    PMTraceSession& operator=(PMTraceSession const&) = delete;
+    ~PMTraceSession();
+
     ULONG Start(wchar_t const* etlPath,      // If nullptr, start a live/realtime tracing session
                 wchar_t const* sessionName); // Required session name
     void Stop();
 
+    // When Start() sets mEtlReader, this must be used instead of ProcessTrace() to process the
+    // ETL's events.  It returns once all events have been processed or Stop() is called.
+    ULONG ProcessEtlReader();
+
+    // Replay a recorded event stream instead of starting a trace session.  StartReplay() sets up
+    // the session's timing information from the stream, and ProcessEventStream() then feeds all
+    // of its events through mPMConsumer as fast as they can be processed.  ProcessEventStream()
+    // returns once all events have been processed or Stop() is called.  The reader is not owned
+    // by the session and must remain valid until ProcessEventStream() returns.
+    ULONG StartReplay(EventStreamReader* reader);
+    ULONG ProcessEventStream();
+
+    // The callback used to feed offline (ETL or event stream) events to mPMConsumer, for callers
+    // that read events themselves.  Each EVENT_RECORD's UserContext must point to this session.
+    PEVENT_RECORD_CALLBACK GetOfflineEventRecordCallback() const;
+
     double TimestampDeltaToMilliSeconds(uint64_t timestampDelta) const;
     double TimestampDeltaToMilliSeconds(uint64_t timestampFrom, uint64_t timestampTo) const;
     double TimestampDeltaToUnsignedMilliSeconds(uint64_t timestampFrom, uint64_t timestampTo) const;
@@ -0,0 +1,116 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include "QuantileSketch.hpp"
+
+#include <math.h>
+#include <string.h>
+
+double const QuantileSketch::RELATIVE_ACCURACY = 0.01;
+double const QuantileSketch::MIN_VALUE = 0.0001;
+
+namespace {
+
+double const GAMMA = (1.0 + QuantileSketch::RELATIVE_ACCURACY) / (1.0 - QuantileSketch::RELATIVE_ACCURACY);
+double const INV_LOG_GAMMA = 1.0 / log(GAMMA);
+
+}
+
+QuantileSketch::QuantileSketch()
+{
+    Reset();
+}
+
+void QuantileSketch::Reset()
+{
+    mCount = 0;
+    mZeroCount = 0;
+    mSum = 0.0;
+    mMin = 0.0;
+    mMax = 0.0;
+    memset(mBins, 0, sizeof(mBins));
+}
+
+void QuantileSketch::Add(double value)
+{
+    if (mCount == 0) {
+        mMin = value;
+        mMax = value;
+    } else {
+        if (value < mMin) mMin = value;
+        if (value > mMax) mMax = value;
+    }
+    mCount += 1;
+    mSum += value;
+
+    if (value <= 0.0) {
+        mZeroCount += 1;
+        return;
+    }
+
+    uint32_t binIndex = 0;
+    auto i = ceil(log(value / MIN_VALUE) * INV_LOG_GAMMA);
+    if (i >= (double) (BIN_COUNT - 1)) {
+        binIndex = BIN_COUNT - 1;
+    } else if (i > 0.0) {
+        binIndex = (uint32_t) i;
+    }
+    mBins[binIndex] += 1;
+}
+
+void QuantileSketch::Merge(QuantileSketch const& other)
+{
+    if (other.mCount == 0) {
+        return;
+    }
+    if (mCount == 0) {
+        mMin = other.mMin;
+        mMax = other.mMax;
+    } else {
+        if (other.mMin < mMin) mMin = other.mMin;
+        if (other.mMax > mMax) mMax = other.mMax;
+    }
+    mCount += other.mCount;
+    mZeroCount += other.mZeroCount;
+    mSum += other.mSum;
+    for (uint32_t i = 0; i < BIN_COUNT; ++i) {
+        mBins[i] += other.mBins[i];
+    }
+}
+
+double QuantileSketch::GetQuantile(double q) const
+{
+    if (mCount == 0) {
+        return 0.0;
+    }
+    if (q <= 0.0) {
+        return mMin;
+    }
+    if (q >= 1.0) {
+        return mMax;
+    }
+
+    // Find the bin containing the value with the requested rank, and return the value in the
+    // middle of the bin's range (in terms of relative error), clamped to the values seen.
+    auto rank = (uint64_t) (q * (double) (mCount - 1));
+    auto count = mZeroCount;
+    if (rank < count) {
+        return mMin < 0.0 ? mMin : 0.0;
+    }
+
+    double value = mMax;
+    for (uint32_t i = 0; i < BIN_COUNT; ++i) {
+        count += mBins[i];
+        if (rank < count) {
+            value = MIN_VALUE * 2.0 * pow(GAMMA, (double) i) / (GAMMA + 1.0);
+            break;
+        }
+    }
+
+    return value < mMin ? mMin : value > mMax ? mMax : value;
+}
+
+double QuantileSketch::GetMean() const
+{
+    return mCount == 0 ? 0.0 : mSum / (double) mCount;
+}
@@ -0,0 +1,42 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#include <stdint.h>
+
+// QuantileSketch estimates the quantiles of a stream of values using a fixed amount of memory, and
+// with a bounded relative error (i.e., it is a DDSketch).  Positive values are counted in bins
+// whose sizes grow logarithmically: bin i counts the values in (MIN_VALUE * GAMMA^(i-1),
+// MIN_VALUE * GAMMA^i], where GAMMA = (1 + RELATIVE_ACCURACY) / (1 - RELATIVE_ACCURACY).  Any
+// quantile of the values in a bin's range is then estimated to within RELATIVE_ACCURACY.
+//
+// With the constants below, values between 0.0001 and ~77000 (e.g., 0.1us to 77s in milliseconds)
+// are estimated to within 1%.  Smaller and larger values are counted in the first and last bins,
+// and values <= 0 are counted separately as zero.  The exact minimum, maximum, and mean are also
+// tracked.
+//
+// Sketches are mergeable: the sketch of two streams is the sum of their sketches.
+struct QuantileSketch {
+    enum : uint32_t {
+        BIN_COUNT = 1024,
+    };
+
+    static double const RELATIVE_ACCURACY;  // 0.01
+    static double const MIN_VALUE;          // 0.0001
+
+    uint64_t mCount;
+    uint64_t mZeroCount;
+    double mSum;
+    double mMin;
+    double mMax;
+    uint32_t mBins[BIN_COUNT];
+
+    QuantileSketch();
+    void Reset();
+    void Add(double value);
+    void Merge(QuantileSketch const& other);
+
+    // Returns 0 if the sketch is empty.  q is clamped to [0, 1].
+    double GetQuantile(double q) const;
+    double GetMean() const;
+};
@@ -145,6 +145,90 @@ uint32_t GetPropertyDataOffset(TRACE_EVENT_INFO const& tei, EVENT_RECORD const&
     return offset;
 }
 
+// Returns true if the size and count of the property only depend on the
+// metadata (and the event's pointer size), and not on the event's data.
+bool IsFixedSizeProperty(TRACE_EVENT_INFO const& tei, uint32_t index)
+{
+    auto const& epi = tei.EventPropertyInfoArray[index];
+    if (epi.Flags & PropertyParamCount) {
+        return false;
+    }
+
+    if (epi.Flags & PropertyStruct) {
+        for (USHORT i = 0; i < epi.structType.NumOfStructMembers; ++i) {
+            if (!IsFixedSizeProperty(tei, epi.structType.StructStartIndex + i)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    switch (epi.nonStructType.InType) {
+    case TDH_INTYPE_UNICODESTRING:
+    case TDH_INTYPE_ANSISTRING:
+        return (epi.Flags & PropertyParamLength) == 0 && epi.length != 0;
+    case TDH_INTYPE_SID:
+    case TDH_INTYPE_WBEMSID:
+        return false;
+    }
+
+    return true;
+}
+
+// Build a decode plan for the properties at the start of the event that have
+// a fixed offset and size.  Once a variable-size property is encountered, the
+// offsets of all subsequent properties depend on the event data and they must
+// be found by walking the metadata.
+void BuildDecodePlan(TRACE_EVENT_INFO const* tei, EVENT_RECORD const& eventRecord, EventDecodePlan* plan)
+{
+    plan->tei_ = tei;
+    plan->is64BitHeader_ = (eventRecord.EventHeader.Flags & EVENT_HEADER_FLAG_64_BIT_HEADER) != 0;
+    plan->complete_ = true;
+    plan->properties_.reserve(tei->TopLevelPropertyCount);
+
+    for (uint32_t i = 0, offset = 0; i < tei->TopLevelPropertyCount; ++i) {
+        if (!IsFixedSizeProperty(*tei, i)) {
+            plan->complete_ = false;
+            break;
+        }
+
+        auto info = GetPropertyInfo(*tei, eventRecord, i, offset);
+
+        EventDecodePlan::Property property;
+        property.name_   = TEI_PROPERTY_NAME(tei, &tei->EventPropertyInfoArray[i]);
+        property.offset_ = offset;
+        property.size_   = info.size_;
+        property.count_  = info.count_;
+        property.status_ = info.status_ | PROP_STATUS_FOUND;
+        plan->properties_.emplace_back(property);
+
+        offset += info.size_ * info.count_;
+    }
+}
+
+}
+
+uint32_t EventDecodePlan::ResolveName(wchar_t const* name)
+{
+    for (auto const& resolved : names_) {
+        if (resolved.name_ == name) {
+            return resolved.index_;
+        }
+    }
+
+    // First time this name has been requested; compare it against the
+    // planned properties and remember the result.
+    ResolvedName resolved;
+    resolved.name_ = name;
+    resolved.index_ = complete_ ? PROPERTY_NOT_PRESENT : PROPERTY_NOT_PLANNED;
+    for (uint32_t i = 0, n = (uint32_t) properties_.size(); i < n; ++i) {
+        if (properties_[i].name_ != nullptr && wcscmp(properties_[i].name_, name) == 0) {
+            resolved.index_ = i;
+            break;
+        }
+    }
+    names_.emplace_back(resolved);
+    return resolved.index_;
 }
 
 size_t EventMetadataKeyHash::operator()(EventMetadataKey const& key) const
@@ -178,19 +262,16 @@ void EventMetadata::AddMetadata(EVENT_RECORD* eventRecord)
         key.guid_ = tei->ProviderGuid;
         key.desc_ = tei->EventDescriptor;
         metadata_[key].assign(userData, userData + eventRecord->UserDataLength);
+
+        // Any plan built from the previous metadata is no longer valid
+        plans_.erase(key);
     }
 }
 
-// Look up metadata for this provider/event and use it to look up the property.
-// If the metadata isn't found look it up using TDH.  Then, look up each
-// property in the metadata to obtain it's data pointer and size.
-void EventMetadata::GetEventData(EVENT_RECORD* eventRecord, EventDataDesc* desc, uint32_t descCount, uint32_t optionalCount /*=0*/)
+// Look up stored metadata.  If not found, look up metadata using TDH and cache
+// it for future events.
+TRACE_EVENT_INFO const* EventMetadata::GetEventInfo(EventMetadataKey const& key, EVENT_RECORD* eventRecord)
 {
-    // Look up stored metadata.  If not found, look up metadata using TDH and
-    // cache it for future events.
-    EventMetadataKey key;
-    key.guid_ = eventRecord->EventHeader.ProviderId;
-    key.desc_ = eventRecord->EventHeader.EventDescriptor;
     auto ii = metadata_.find(key);
     if (ii == metadata_.end()) {
         ULONG bufferSize = 0;
@@ -207,7 +288,67 @@ void EventMetadata::GetEventData(EVENT_RECORD* eventRecord, EventDataDesc* desc,
         }
     }
 
-    auto tei = (TRACE_EVENT_INFO*) ii->second.data();
+    return (TRACE_EVENT_INFO const*) ii->second.data();
+}
+
+// Look up metadata for this provider/event and use it to look up the property.
+// If the metadata isn't found look it up using TDH.  Then, look up each
+// property in the metadata to obtain it's data pointer and size.
+//
+// The first time an event is seen, a decode plan is built for it.  If all the
+// requested properties are in the plan, they are decoded directly from their
+// planned offsets.  Otherwise, we fall back to walking the metadata.
+void EventMetadata::GetEventData(EVENT_RECORD* eventRecord, EventDataDesc* desc, uint32_t descCount, uint32_t optionalCount /*=0*/)
+{
+    EventMetadataKey key;
+    key.guid_ = eventRecord->EventHeader.ProviderId;
+    key.desc_ = eventRecord->EventHeader.EventDescriptor;
+
+    TRACE_EVENT_INFO const* tei = nullptr;
+    if (decodePlansEnabled_) {
+        auto ii = plans_.find(key);
+        if (ii == plans_.end()) {
+            ii = plans_.emplace(key, EventDecodePlan()).first;
+            BuildDecodePlan(GetEventInfo(key, eventRecord), *eventRecord, &ii->second);
+        }
+
+        auto plan = &ii->second;
+        tei = plan->tei_;
+
+        // The plan is only valid for the pointer size it was built with.
+        if (plan->is64BitHeader_ == ((eventRecord->EventHeader.Flags & EVENT_HEADER_FLAG_64_BIT_HEADER) != 0)) {
+            uint32_t j = 0;
+            for (; j < descCount; ++j) {
+                if (desc[j].status_ == PROP_STATUS_NOT_FOUND &&
+                    plan->ResolveName(desc[j].name_) == EventDecodePlan::PROPERTY_NOT_PLANNED) {
+                    break;
+                }
+            }
+
+            if (j == descCount) {
+                uint32_t foundCount = 0;
+                for (j = 0; j < descCount; ++j) {
+                    if (desc[j].status_ == PROP_STATUS_NOT_FOUND) {
+                        auto index = plan->ResolveName(desc[j].name_);
+                        if (index != EventDecodePlan::PROPERTY_NOT_PRESENT) {
+                            auto const& property = plan->properties_[index];
+                            desc[j].data_   = (void*) ((uintptr_t) eventRecord->UserData + property.offset_);
+                            desc[j].size_   = property.size_;
+                            desc[j].count_  = property.count_;
+                            desc[j].status_ = property.status_;
+                            foundCount += 1;
+                        }
+                    }
+                }
+
+                assert(foundCount >= descCount - optionalCount);
+                (void) optionalCount;
+                return;
+            }
+        }
+    } else {
+        tei = GetEventInfo(key, eventRecord);
+    }
 
     // Lookup properties in metadata
     uint32_t foundCount = 0;
@@ -29,7 +29,7 @@ enum PropertyStatus {
 };
 
 struct EventDataDesc {
-    wchar_t const* name_;   // Property name
+    wchar_t const* name_;   // Property name (expected to be a string literal, see EventDecodePlan)
     void* data_;            // OUT pointer to property data
     uint32_t size_;         // OUT size of a property data element
     uint32_t count_;        // OUT number of elements (if it's an array property)
@@ -64,11 +64,48 @@ struct EventDataDesc {
 template<> std::string EventDataDesc::GetData<std::string>() const;
 template<> std::wstring EventDataDesc::GetData<std::wstring>() const;
 
+// A decode plan caches the layout of an event's leading top-level properties
+// that have a fixed offset and size, so that requests for those properties can
+// be satisfied with a direct load instead of walking the TRACE_EVENT_INFO and
+// comparing property names for every event.
+struct EventDecodePlan {
+    struct Property {
+        wchar_t const* name_;   // Property name (points into the metadata)
+        uint32_t offset_;       // Offset of the property data in UserData
+        uint32_t size_;
+        uint32_t count_;
+        uint32_t status_;
+    };
+
+    // Requested property name (compared by address, since callers pass string
+    // literals) to index into properties_, or one of the special values below.
+    struct ResolvedName {
+        wchar_t const* name_;
+        uint32_t index_;
+    };
+
+    enum : uint32_t {
+        PROPERTY_NOT_PLANNED = UINT32_MAX,      // Property may be in the variable-layout tail
+        PROPERTY_NOT_PRESENT = UINT32_MAX - 1,  // Property does not exist in this event
+    };
+
+    TRACE_EVENT_INFO const* tei_;           // Metadata the plan was built from
+    std::vector<Property> properties_;      // Leading fixed-layout properties
+    std::vector<ResolvedName> names_;
+    bool is64BitHeader_;                    // Pointer size the plan was built with
+    bool complete_;                         // All top-level properties are in properties_
+
+    uint32_t ResolveName(wchar_t const* name);
+};
+
 struct EventMetadata {
     std::unordered_map<EventMetadataKey, std::vector<uint8_t>, EventMetadataKeyHash, EventMetadataKeyEqual> metadata_;
+    std::unordered_map<EventMetadataKey, EventDecodePlan, EventMetadataKeyHash, EventMetadataKeyEqual> plans_;
+    bool decodePlansEnabled_ = true;        // Disable to always walk the metadata (e.g., for comparison)
 
     void AddMetadata(EVENT_RECORD* eventRecord);
     void GetEventData(EVENT_RECORD* eventRecord, EventDataDesc* desc, uint32_t descCount, uint32_t optionalCount=0);
+    TRACE_EVENT_INFO const* GetEventInfo(EventMetadataKey const& key, EVENT_RECORD* eventRecord);
 
     template<typename T> T GetEventData(EVENT_RECORD* eventRecord, wchar_t const* name)
     {
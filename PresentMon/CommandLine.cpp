@@ -166,6 +166,20 @@ bool ParseKeyName(KeyNameCode const* valid, size_t validCount, wchar_t* name, wc
     return false;
 }
 
+bool AssignOutputFormat(wchar_t const* format, CommandLineArgs* args)
+{
+    if (_wcsicmp(format, L"csv") == 0) {
+        args->mColumnarOutput = false;
+        return true;
+    }
+    if (_wcsicmp(format, L"columnar") == 0) {
+        args->mColumnarOutput = true;
+        return true;
+    }
+    PrintError(L"error: unrecognized --output_format '%s'; expecting 'csv' or 'columnar'.\n", format);
+    return false;
+}
+
 bool AssignHotkey(wchar_t* key, CommandLineArgs* args)
 {
     #pragma warning(suppress: 4996)
@@ -274,6 +288,9 @@ void PrintUsage()
         LR"(--date_time)",        LR"(Output the CPU start time as a date and time with nanosecond precision.)",
         LR"(--exclude_dropped)",  LR"(Exclude frames that were not displayed to the screen from the CSV output.)",
         LR"(--v1_metrics)",       LR"(Output a CSV using PresentMon 1.x metrics.)",
+        LR"(--output_format fmt)", LR"(Write the output as 'csv' (the default) or 'columnar'. A columnar capture is a compact binary file with the same columns as the CSV, which can be converted to CSV using pm_convert_csv.)",
+        LR"(--summary_file path)", LR"(Write the count, mean, min, max, and 1st/5th/50th/95th/99th percentiles of key metrics for each swap chain to the specified CSV path each time recording stops.)",
+        LR"(--csv_index rows)",   LR"(Write an index next to each CSV (with an additional ".idx" extension) that records the time range, processes, and swap chains of every block of the specified number of rows. pm_convert_csv uses it to read only the rows it needs.)",
 
         LR"(--Recording Options)", nullptr,
         LR"(--hotkey key)",       LR"(Use the specified key press to start and stop recording. 'key' is of the form MODIFIER+KEY, e.g., "ALT+SHIFT+F11".)",
@@ -292,6 +309,11 @@ void PrintUsage()
         LR"(--restart_as_admin)",           LR"(If not running with elevated privilege, restart and request to be run as administrator.)",
         LR"(--terminate_on_proc_exit)",     LR"(Terminate PresentMon when all the target processes have exited.)",
         LR"(--terminate_after_timed)",      LR"(When using --timed, terminate PresentMon after the timed capture completes.)",
+        LR"(--memory_budget MB)",           LR"(Limit the memory used to track in-progress presents to approximately the specified number of megabytes. If more presents are in flight than fit, the oldest are dropped and a warning is reported.)",
+        LR"(--max_output_latency ms)",      LR"(Output each frame at most the specified number of milliseconds after its metrics are available (default 100).)",
+        LR"(--min_output_batch count)",     LR"(Wait until at least the specified number of frames are available, or --max_output_latency elapses, before outputting them (default 1). Larger batches reduce the output overhead under heavy load.)",
+        LR"(--output_threads count)",       LR"(Compute the metrics of different processes on the specified number of threads (default 1). This can help when capturing many processes at once; the CSV output is the same.)",
+        LR"(--console_update_period ms)",   LR"(Update the statistics displayed in the console at most once every specified number of milliseconds (default 100).)",
 
         LR"(--Beta Options)", nullptr,
         LR"(--track_frame_type)", LR"(Track the type of each displayed frame; requires application and/or driver instrumentation using Intel-PresentMon provider.)",
@@ -373,11 +395,22 @@ bool ParseCommandLine(int argc, wchar_t** argv)
     args->mTargetProcessNames.clear();
     args->mExcludeProcessNames.clear();
     args->mOutputCsvFileName = nullptr;
+    args->mSummaryFileName = nullptr;
     args->mEtlFileName = nullptr;
+    args->mEventStreamFileName = nullptr;
+    args->mReplayEventStreamFileName = nullptr;
     args->mSessionName = L"PresentMon";
     args->mTargetPid = 0;
     args->mDelay = 0;
     args->mTimer = 0;
+    args->mEtlAnalysisThreads = 0;
+    args->mEtlAnalysisChunkMs = 0;
+    args->mMemoryBudgetMB = 0;
+    args->mMaxOutputLatency = 100;
+    args->mMinOutputBatch = 1;
+    args->mOutputThreads = 1;
+    args->mCsvIndexRows = 0;
+    args->mConsoleUpdatePeriod = 100;
     args->mHotkeyModifiers = MOD_NOREPEAT;
     args->mHotkeyVirtualKeyCode = 0;
     args->mConsoleOutput = ConsoleOutput::Statistics;
@@ -395,8 +428,11 @@ bool ParseCommandLine(int argc, wchar_t** argv)
     args->mHotkeySupport = false;
     args->mTryToElevate = false;
     args->mMultiCsv = false;
+    args->mColumnarOutput = false;
     args->mUseV1Metrics = false;
     args->mStopExistingSession = false;
+    args->mNativeEtlReader = false;
+    args->mPrintConsumerStats = false;
 
     bool sessionNameSet  = false;
     bool csvOutputStdout = false;
@@ -430,6 +466,9 @@ bool ParseCommandLine(int argc, wchar_t** argv)
         else if (ParseArg(argv[i], L"date_time"))        { dtTime                = true;                              continue; }
         else if (ParseArg(argv[i], L"exclude_dropped"))  { args->mExcludeDropped = true;                              continue; }
         else if (ParseArg(argv[i], L"v1_metrics"))       { args->mUseV1Metrics   = true;                              continue; }
+        else if (ParseArg(argv[i], L"output_format"))    { if (ParseValue(argv, argc, &i) && AssignOutputFormat(argv[i], args)) continue; }
+        else if (ParseArg(argv[i], L"summary_file"))     { if (ParseValue(argv, argc, &i, &args->mSummaryFileName)) continue; }
+        else if (ParseArg(argv[i], L"csv_index"))        { if (ParseValue(argv, argc, &i, &args->mCsvIndexRows)) continue; }
 
         // Recording options:
         else if (ParseArg(argv[i], L"hotkey"))           { if (ParseValue(argv, argc, &i) && AssignHotkey(argv[i], args)) continue; }
@@ -448,11 +487,22 @@ bool ParseCommandLine(int argc, wchar_t** argv)
         else if (ParseArg(argv[i], L"restart_as_admin"))           { args->mTryToElevate             = true; continue; }
         else if (ParseArg(argv[i], L"terminate_on_proc_exit"))     { args->mTerminateOnProcExit      = true; continue; }
         else if (ParseArg(argv[i], L"terminate_after_timed"))      { args->mTerminateAfterTimer      = true; continue; }
+        else if (ParseArg(argv[i], L"memory_budget"))              { if (ParseValue(argv, argc, &i, &args->mMemoryBudgetMB)) continue; }
+        else if (ParseArg(argv[i], L"max_output_latency"))         { if (ParseValue(argv, argc, &i, &args->mMaxOutputLatency)) continue; }
+        else if (ParseArg(argv[i], L"min_output_batch"))           { if (ParseValue(argv, argc, &i, &args->mMinOutputBatch)) continue; }
+        else if (ParseArg(argv[i], L"output_threads"))             { if (ParseValue(argv, argc, &i, &args->mOutputThreads)) continue; }
+        else if (ParseArg(argv[i], L"console_update_period"))      { if (ParseValue(argv, argc, &i, &args->mConsoleUpdatePeriod)) continue; }
 
         // Beta options:
         else if (ParseArg(argv[i], L"track_frame_type")) { args->mTrackFrameType = true; continue; }
 
         // Hidden options:
+        else if (ParseArg(argv[i], L"write_event_stream"))  { if (ParseValue(argv, argc, &i, &args->mEventStreamFileName)) continue; }
+        else if (ParseArg(argv[i], L"replay_event_stream")) { if (ParseValue(argv, argc, &i, &args->mReplayEventStreamFileName)) continue; }
+        else if (ParseArg(argv[i], L"native_etl_reader"))   { args->mNativeEtlReader = true; continue; }
+        else if (ParseArg(argv[i], L"etl_analysis_threads")) { if (ParseValue(argv, argc, &i, &args->mEtlAnalysisThreads)) { args->mNativeEtlReader = true; continue; } }
+        else if (ParseArg(argv[i], L"etl_analysis_chunk_ms")) { if (ParseValue(argv, argc, &i, &args->mEtlAnalysisChunkMs)) continue; }
+        else if (ParseArg(argv[i], L"print_consumer_stats")) { args->mPrintConsumerStats = true; continue; }
         #if PRESENTMON_ENABLE_DEBUG_TRACE
         else if (ParseArg(argv[i], L"debug_verbose_trace")) { verboseTrace = true; continue; }
         #endif
@@ -477,6 +527,13 @@ bool ParseCommandLine(int argc, wchar_t** argv)
         return false;
     }
 
+    // An event stream replaces the trace session, so it can't be combined with --etl_file.
+    if (args->mReplayEventStreamFileName != nullptr && args->mEtlFileName != nullptr) {
+        PrintError(L"error: --replay_event_stream cannot be used with --etl_file.\n");
+        PrintUsage();
+        return false;
+    }
+
     // Disallow --hotkey that are known to be already in use:
     // - CTRL+C, CTRL+PAUSE, and CTRL+SCROLLLOCK already used to exit PresentMon
     // - F12 is reserved for debugger use at all times
@@ -513,6 +570,24 @@ bool ParseCommandLine(int argc, wchar_t** argv)
         PrintWarning(L"\n");
     }
 
+    // Columnar output is binary, so it can only be written to a file, and it only contains the
+    // current metrics.
+    if (args->mColumnarOutput && (csvOutputStdout || args->mUseV1Metrics)) {
+        PrintError(L"error: --output_format columnar cannot be used with %s.\n", csvOutputStdout ? L"--output_stdout" : L"--v1_metrics");
+        PrintUsage();
+        return false;
+    }
+
+    // The CSV index records file offsets, so it needs a CSV file.  Columnar captures have their own
+    // chunk index.
+    if (args->mCsvIndexRows > 0 && (csvOutputStdout || csvOutputNone || args->mColumnarOutput)) {
+        PrintError(L"error: --csv_index cannot be used with %s.\n",
+            csvOutputStdout ? L"--output_stdout" :
+            csvOutputNone   ? L"--no_csv" : L"--output_format columnar");
+        PrintUsage();
+        return false;
+    }
+
     // If we're outputting CSV to stdout, we can't use it for console output.
     //
     // Also ignore --multi_csv since it only applies to file output.
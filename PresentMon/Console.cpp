@@ -89,75 +89,33 @@ static uint32_t VPrint(wchar_t* buffer, uint32_t bufferCount, wchar_t const* for
     return numChars;
 }
 
+// Statistics are drawn as a block of rows starting at the cursor, without moving the cursor.
+// Rather than writing to the console as each line is printed, an update is formatted into gFrame
+// (info.dwSize.X cells per row, starting at row gWritePosition.Y) and EndConsoleUpdate() only
+// writes the cells that differ from the previous update, which are still on the console.  If the
+// cursor moves (e.g., something else was printed) or the console is resized, the whole block is
+// redrawn.
+static CONSOLE_SCREEN_BUFFER_INFO gConsoleInfo{};
+static std::vector<wchar_t> gFrame;
+static std::vector<wchar_t> gPrevFrame;
+static COORD gPrevWritePosition{};
+static SHORT gPrevWidth = 0;
+static bool gPrevFrameValid = false;
+
 static void VConsolePrint(wchar_t const* format, va_list val, bool newLine)
 {
     wchar_t buffer[256];
     uint32_t numChars = VPrint(buffer, _countof(buffer), format, val);
 
-    HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
-
-    CONSOLE_SCREEN_BUFFER_INFO info = {};
-    GetConsoleScreenBufferInfo(console, &info);
-    if (info.dwSize.X == 0) {
+    auto width = (size_t) gConsoleInfo.dwSize.X;
+    if (width == 0) {
         return;
     }
 
-    COORD endPosition;
-    endPosition.Y = gWritePosition.Y + (SHORT) ((numChars + gWritePosition.X) / info.dwSize.X);
-    endPosition.X = (numChars + gWritePosition.X) % info.dwSize.X;
-
-    SHORT finalY = endPosition.Y + (newLine ? 1 : 0);
-    if (finalY >= info.dwSize.Y) {
-        SHORT deltaY = finalY - info.dwSize.Y + 1;
-
-        SMALL_RECT rect;
-        rect.Left   = 0;
-        rect.Top    = deltaY;
-        rect.Right  = info.dwSize.X - 1;
-        rect.Bottom = info.dwSize.Y - deltaY - 1;
-
-        COORD dstPos;
-        dstPos.X = 0;
-        dstPos.Y = 0;
-
-        CHAR_INFO fill;
-        fill.Char.UnicodeChar = L' ';
-        fill.Attributes = info.wAttributes;
-
-        ScrollConsoleScreenBufferW(console, &rect, nullptr, dstPos, &fill);
-
-        info.dwCursorPosition.Y -= deltaY;
-        gWritePosition.Y        -= deltaY;
-        endPosition.Y           -= deltaY;
-
-        SetConsoleCursorPosition(console, info.dwCursorPosition);
-    }
-
-    if (info.dwCursorPosition.Y >= info.srWindow.Top &&
-        info.dwCursorPosition.Y <= info.srWindow.Bottom &&
-        finalY > info.srWindow.Bottom) {
-        SHORT deltaY = finalY - info.srWindow.Bottom;
-
-        SMALL_RECT rect;
-        rect.Left   = 0;
-        rect.Top    = deltaY;
-        rect.Right  = 0;
-        rect.Bottom = deltaY;
-
-        SetConsoleWindowInfo(console, FALSE, &rect);
-    }
-
-    DWORD numCharsWritten = 0;
-    WriteConsoleOutputCharacterW(console, buffer, numChars, gWritePosition, &numCharsWritten);
+    gFrame.insert(gFrame.end(), buffer, buffer + numChars);
 
     if (newLine) {
-        numChars = info.dwSize.X - endPosition.X;
-        FillConsoleOutputCharacterW(console, L' ', numChars, endPosition, &numCharsWritten);
-
-        gWritePosition.X = 0;
-        gWritePosition.Y = endPosition.Y + 1;
-    } else {
-        gWritePosition = endPosition;
+        gFrame.resize(gFrame.size() + width - gFrame.size() % width, L' ');
     }
 }
 
@@ -174,6 +132,7 @@ void ConsolePrintLn(wchar_t const* format, ...)
     va_list val;
     va_start(val, format);
     VConsolePrint(format, val, true);
+    va_end(val);
 }
 
 bool BeginConsoleUpdate()
@@ -184,21 +143,20 @@ bool BeginConsoleUpdate()
 
     HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
 
-    CONSOLE_SCREEN_BUFFER_INFO info = {};
-    GetConsoleScreenBufferInfo(console, &info);
+    gConsoleInfo = {};
+    GetConsoleScreenBufferInfo(console, &gConsoleInfo);
 
-    gWritePosition = info.dwCursorPosition;
+    gWritePosition = gConsoleInfo.dwCursorPosition;
+
+    // The cells before the cursor on the first row are not part of the block.
+    gFrame.assign(gWritePosition.X, L' ');
 
     return true;
 }
 
-void EndConsoleUpdate()
+// Clear any rows from y down until a blank section is found.
+static void ClearConsoleRows(HANDLE console, CONSOLE_SCREEN_BUFFER_INFO const& info, SHORT y)
 {
-    HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
-
-    CONSOLE_SCREEN_BUFFER_INFO info = {};
-    GetConsoleScreenBufferInfo(console, &info);
-
     COORD dstPos;
     dstPos.X = 0;
     dstPos.Y = 0;
@@ -212,7 +170,7 @@ void EndConsoleUpdate()
 
     COORD srcPos;
     srcPos.X = 0;
-    srcPos.Y = gWritePosition.Y;
+    srcPos.Y = y;
 
     SMALL_RECT rect;
     for ( ; srcPos.Y < info.dwSize.Y; srcPos.Y += dstSize.Y) {
@@ -244,6 +202,119 @@ void EndConsoleUpdate()
     delete[] buffer;
 }
 
+void EndConsoleUpdate()
+{
+    HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+
+    auto info = gConsoleInfo;
+    auto width = (size_t) info.dwSize.X;
+    if (width == 0) {
+        gPrevFrameValid = false;
+        return;
+    }
+
+    // Pad the last row, if it wasn't ended with a new line.
+    if (gFrame.size() % width != 0) {
+        gFrame.resize(gFrame.size() + width - gFrame.size() % width, L' ');
+    }
+    auto rowCount = (SHORT) (gFrame.size() / width);
+
+    // The previous update is still on the console if nothing else moved the cursor.
+    auto prevFrameValid = gPrevFrameValid &&
+                          gPrevWidth == info.dwSize.X &&
+                          gPrevWritePosition.X == gWritePosition.X &&
+                          gPrevWritePosition.Y == gWritePosition.Y;
+
+    // If the block doesn't fit in the screen buffer, scroll the buffer up (including the cursor
+    // and the previous update).
+    SHORT finalY = gWritePosition.Y + rowCount;
+    if (finalY >= info.dwSize.Y) {
+        SHORT deltaY = finalY - info.dwSize.Y + 1;
+
+        SMALL_RECT rect;
+        rect.Left   = 0;
+        rect.Top    = deltaY;
+        rect.Right  = info.dwSize.X - 1;
+        rect.Bottom = info.dwSize.Y - 1;
+
+        COORD dstPos;
+        dstPos.X = 0;
+        dstPos.Y = 0;
+
+        CHAR_INFO fill;
+        fill.Char.UnicodeChar = L' ';
+        fill.Attributes = info.wAttributes;
+
+        ScrollConsoleScreenBufferW(console, &rect, nullptr, dstPos, &fill);
+
+        info.dwCursorPosition.Y -= deltaY;
+        gWritePosition.Y        -= deltaY;
+        finalY                  -= deltaY;
+
+        SetConsoleCursorPosition(console, info.dwCursorPosition);
+    }
+
+    // If the cursor is visible, scroll the window down to show the block, but no further than
+    // just past the cursor.
+    if (info.dwCursorPosition.Y >= info.srWindow.Top &&
+        info.dwCursorPosition.Y <= info.srWindow.Bottom &&
+        finalY > info.srWindow.Bottom) {
+        SHORT deltaY = std::min<SHORT>(finalY - info.srWindow.Bottom, info.dwCursorPosition.Y - info.srWindow.Top + 1);
+
+        SMALL_RECT rect;
+        rect.Left   = 0;
+        rect.Top    = deltaY;
+        rect.Right  = 0;
+        rect.Bottom = deltaY;
+
+        SetConsoleWindowInfo(console, FALSE, &rect);
+    }
+
+    // Write the cells in each row that changed, and clear any rows left over from the previous
+    // update.
+    auto cellCount = std::max(gFrame.size(), prevFrameValid ? gPrevFrame.size() : 0);
+    for (size_t i = gWritePosition.X; i < cellCount; ) {
+        auto rowEnd = (i / width + 1) * width;
+        wchar_t const* frame = i < gFrame.size() ? gFrame.data() : nullptr;
+
+        // Find the first and last cell in this row that changed.
+        size_t first = rowEnd;
+        size_t last = i;
+        for (size_t j = i; j < rowEnd; ++j) {
+            auto c = frame != nullptr ? frame[j] : L' ';
+            if (!prevFrameValid || j >= gPrevFrame.size() || gPrevFrame[j] != c) {
+                first = std::min(first, j);
+                last = j + 1;
+            }
+        }
+
+        if (first < last) {
+            COORD pos;
+            pos.X = (SHORT) (first % width);
+            pos.Y = gWritePosition.Y + (SHORT) (first / width);
+
+            DWORD numCharsWritten = 0;
+            if (frame != nullptr) {
+                WriteConsoleOutputCharacterW(console, frame + first, (DWORD) (last - first), pos, &numCharsWritten);
+            } else {
+                FillConsoleOutputCharacterW(console, L' ', (DWORD) (last - first), pos, &numCharsWritten);
+            }
+        }
+
+        i = rowEnd;
+    }
+
+    // If the whole block was redrawn, clear anything below it as well.
+    if (!prevFrameValid) {
+        ClearConsoleRows(console, info, finalY);
+    }
+
+    gPrevFrame.swap(gFrame);
+    gPrevWritePosition = gWritePosition;
+    gPrevWidth = info.dwSize.X;
+    gPrevFrameValid = true;
+}
+
 static float CalculateFPSForPrintf(float duration)
 {
     return duration == 0.f ? 0.f : ((1000.f / duration) + 0.05f);
@@ -299,6 +370,34 @@ void UpdateConsole(uint32_t processId, ProcessInfo const& processInfo)
         }
 
         ConsolePrintLn(L"");
+
+        // Percentiles since recording started (p50/p99), and the 1% low displayed fps.
+        auto const& summary = chain.mSummary;
+        if (summary.mCPUBusy.mCount > 0) {
+            ConsolePrint(L"        p50/p99: %s=%.3f/%.3fms",
+                args.mUseV1Metrics ? L"CPU" : L"CPUBusy",
+                summary.mCPUBusy.GetQuantile(0.5),
+                summary.mCPUBusy.GetQuantile(0.99));
+
+            if (args.mTrackGPU) {
+                ConsolePrint(L" %s=%.3f/%.3fms",
+                    args.mUseV1Metrics ? L"GPU" : L"GPUBusy",
+                    summary.mGPUBusy.GetQuantile(0.5),
+                    summary.mGPUBusy.GetQuantile(0.99));
+            }
+
+            if (args.mTrackDisplay) {
+                auto displayedP99 = summary.mDisplayedTime.GetQuantile(0.99);
+                ConsolePrint(L" Display=%.3f/%.3fms (1%% low %.1f fps) Latency=%.3f/%.3fms",
+                    summary.mDisplayedTime.GetQuantile(0.5),
+                    displayedP99,
+                    CalculateFPSForPrintf((float) displayedP99),
+                    summary.mDisplayLatency.GetQuantile(0.5),
+                    summary.mDisplayLatency.GetQuantile(0.99));
+            }
+
+            ConsolePrintLn(L"");
+        }
     }
 
     if (!empty) {
@@ -5,7 +5,7 @@
 
 static std::thread gThread;
 
-static void Consume(TRACEHANDLE traceHandle)
+static void Consume(PMTraceSession* pmSession, TRACEHANDLE traceHandle)
 {
     SetThreadDescription(GetCurrentThread(), L"PresentMon Consumer Thread");
     SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
@@ -26,8 +26,31 @@ static void Consume(TRACEHANDLE traceHandle)
     // explicitly closed).
     //
     // However, it seems to always return ERROR_SUCCESS.
+    //
+    // If the session is reading the ETL with EtlReader, ProcessEtlReader() is
+    // used instead and returns once all the events are processed or the
+    // session is stopped.  If --etl_analysis_threads was used, the ETL is
+    // instead split into chunks that are analyzed in parallel.  Similarly,
+    // ProcessEventStream() is used when replaying an event stream.
 
-    auto status = ProcessTrace(&traceHandle, 1, NULL, NULL);
+    ULONG status = ERROR_SUCCESS;
+    if (pmSession->mEventStreamReader != nullptr) {
+        status = pmSession->ProcessEventStream();
+    } else if (pmSession->mEtlReader == nullptr) {
+        status = ProcessTrace(&traceHandle, 1, NULL, NULL);
+    } else {
+        auto const& args = GetCommandLineArgs();
+        if (args.mEtlAnalysisThreads > 1) {
+            ParallelEtlAnalysis analysis;
+            analysis.mThreadCount = args.mEtlAnalysisThreads;
+            if (args.mEtlAnalysisChunkMs != 0) {
+                analysis.mMinChunkSeconds = 0.001 * args.mEtlAnalysisChunkMs;
+            }
+            status = analysis.Run(pmSession, args.mEtlFileName);
+        } else {
+            status = pmSession->ProcessEtlReader();
+        }
+    }
     (void) status;
 
     // Signal MainThread to exit.  This is only needed if we are processing an
@@ -38,9 +61,9 @@ static void Consume(TRACEHANDLE traceHandle)
     ExitMainThread();
 }
 
-void StartConsumerThread(TRACEHANDLE traceHandle)
+void StartConsumerThread(PMTraceSession* pmSession)
 {
-    gThread = std::thread(Consume, traceHandle);
+    gThread = std::thread(Consume, pmSession, pmSession->mTraceHandle);
 }
 
 void WaitForConsumerThreadToExit()
@@ -2,8 +2,17 @@
 // SPDX-License-Identifier: MIT
 
 #include "PresentMon.hpp"
+#include "../PresentData/ColumnarCapture.hpp"
+#include "../PresentData/CsvIndex.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
 
-static FILE* gGlobalOutputCsv = nullptr;
 static uint32_t gRecordingCount = 1;
 
 void IncrementRecordingCount()
@@ -104,7 +113,7 @@ static void GenerateFilename(wchar_t* path, std::wstring const& processName, uin
         time_t time_now = time(NULL);
         localtime_s(&tm, &time_now);
         ADD_TO_PATH(L"PresentMon-%4d-%02d-%02dT%02d%02d%02d", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
-        wcscpy_s(ext, L".csv");
+        wcscpy_s(ext, args.mColumnarOutput ? L".pmcc" : L".csv");
     }
 
     // Append -PROCESSNAME if applicable.
@@ -126,234 +135,864 @@ static void GenerateFilename(wchar_t* path, std::wstring const& processName, uin
     #undef ADD_TO_PATH
 }
 
-template<typename FrameMetricsT>
-void WriteCsvHeader(FILE* fp);
+// The CSV columns, in the order they are output.  Some columns have several formats, depending on
+// the command line arguments, in which case each format has its own CsvColumn with the same
+// header.
+enum CsvColumn {
+    Column_Application,
+    Column_ProcessID,
+    Column_SwapChainAddress,
+    Column_SwapChainAddress1,           // v1 format (zero-padded)
+    Column_Runtime1,
+    Column_PresentRuntime,
+    Column_SyncInterval,
+    Column_PresentFlags,
+    Column_Dropped1,
+    Column_TimeInSeconds1,
+    Column_TimeInSecondsDateTime1,
+    Column_msInPresentAPI1,
+    Column_msBetweenPresents1,
+    Column_AllowsTearing,
+    Column_PresentMode,
+    Column_msUntilRenderComplete1,
+    Column_msUntilDisplayed1,
+    Column_msBetweenDisplayChange1,
+    Column_msUntilRenderStart1,
+    Column_msGPUActive1,
+    Column_msGPUVideoActive1,
+    Column_msSinceInput1,
+    Column_QPCTime1,
+    Column_QPCTimeMilliSeconds1,
+    Column_FrameType,
+    Column_CPUStartTime,
+    Column_CPUStartQPC,
+    Column_CPUStartQPCTime,
+    Column_CPUStartDateTime,
+    Column_FrameTime,
+    Column_CPUBusy,
+    Column_CPUWait,
+    Column_GPULatency,
+    Column_GPUTime,
+    Column_GPUBusy,
+    Column_GPUWait,
+    Column_VideoBusy,
+    Column_DisplayLatency,
+    Column_DisplayedTime,
+    Column_ClickToPhotonLatency,
+};
 
+static char const* GetCsvColumnHeader(CsvColumn column)
+{
+    switch (column) {
+    case Column_Application:            return "Application";
+    case Column_ProcessID:              return "ProcessID";
+    case Column_SwapChainAddress:
+    case Column_SwapChainAddress1:      return "SwapChainAddress";
+    case Column_Runtime1:               return "Runtime";
+    case Column_PresentRuntime:         return "PresentRuntime";
+    case Column_SyncInterval:           return "SyncInterval";
+    case Column_PresentFlags:           return "PresentFlags";
+    case Column_Dropped1:               return "Dropped";
+    case Column_TimeInSeconds1:
+    case Column_TimeInSecondsDateTime1: return "TimeInSeconds";
+    case Column_msInPresentAPI1:        return "msInPresentAPI";
+    case Column_msBetweenPresents1:     return "msBetweenPresents";
+    case Column_AllowsTearing:          return "AllowsTearing";
+    case Column_PresentMode:            return "PresentMode";
+    case Column_msUntilRenderComplete1: return "msUntilRenderComplete";
+    case Column_msUntilDisplayed1:      return "msUntilDisplayed";
+    case Column_msBetweenDisplayChange1:return "msBetweenDisplayChange";
+    case Column_msUntilRenderStart1:    return "msUntilRenderStart";
+    case Column_msGPUActive1:           return "msGPUActive";
+    case Column_msGPUVideoActive1:      return "msGPUVideoActive";
+    case Column_msSinceInput1:          return "msSinceInput";
+    case Column_QPCTime1:
+    case Column_QPCTimeMilliSeconds1:   return "QPCTime";
+    case Column_FrameType:              return "FrameType";
+    case Column_CPUStartTime:           return "CPUStartTime";
+    case Column_CPUStartQPC:            return "CPUStartQPC";
+    case Column_CPUStartQPCTime:        return "CPUStartQPCTime";
+    case Column_CPUStartDateTime:       return "CPUStartDateTime";
+    case Column_FrameTime:              return "FrameTime";
+    case Column_CPUBusy:                return "CPUBusy";
+    case Column_CPUWait:                return "CPUWait";
+    case Column_GPULatency:             return "GPULatency";
+    case Column_GPUTime:                return "GPUTime";
+    case Column_GPUBusy:                return "GPUBusy";
+    case Column_GPUWait:                return "GPUWait";
+    case Column_VideoBusy:              return "VideoBusy";
+    case Column_DisplayLatency:         return "DisplayLatency";
+    case Column_DisplayedTime:          return "DisplayedTime";
+    case Column_ClickToPhotonLatency:   return "ClickToPhotonLatency";
+    }
+    return "Unknown";
+}
+
+// The column layout is determined by the command line arguments, so it is computed once and then
+// used for the header and every row.
 template<typename FrameMetricsT>
-void WriteCsvRow(FILE* fp, PMTraceSession const& pmSession, ProcessInfo const& processInfo, PresentEvent const& p, FrameMetricsT const& metrics);
+std::vector<CsvColumn> const& GetCsvColumns();
 
 template<>
-void WriteCsvHeader<FrameMetrics1>(FILE* fp)
+std::vector<CsvColumn> const& GetCsvColumns<FrameMetrics1>()
 {
-    auto const& args = GetCommandLineArgs();
+    static std::vector<CsvColumn> const columns = []() {
+        auto const& args = GetCommandLineArgs();
 
-    fwprintf(fp, L"Application"
-                 L",ProcessID"
-                 L",SwapChainAddress"
-                 L",Runtime"
-                 L",SyncInterval"
-                 L",PresentFlags"
-                 L",Dropped");
-    fwprintf(fp, L",TimeInSeconds"
-                 L",msInPresentAPI"
-                 L",msBetweenPresents");
-    if (args.mTrackDisplay) {
-        fwprintf(fp, L",AllowsTearing"
-                     L",PresentMode"
-                     L",msUntilRenderComplete"
-                     L",msUntilDisplayed"
-                     L",msBetweenDisplayChange");
+        std::vector<CsvColumn> c = {
+            Column_Application,
+            Column_ProcessID,
+            Column_SwapChainAddress1,
+            Column_Runtime1,
+            Column_SyncInterval,
+            Column_PresentFlags,
+            Column_Dropped1,
+            args.mTimeUnit == TimeUnit::DateTime ? Column_TimeInSecondsDateTime1 : Column_TimeInSeconds1,
+            Column_msInPresentAPI1,
+            Column_msBetweenPresents1,
+        };
+        if (args.mTrackDisplay) {
+            c.insert(c.end(), { Column_AllowsTearing,
+                                Column_PresentMode,
+                                Column_msUntilRenderComplete1,
+                                Column_msUntilDisplayed1,
+                                Column_msBetweenDisplayChange1 });
+        }
+        if (args.mTrackGPU) {
+            c.insert(c.end(), { Column_msUntilRenderStart1,
+                                Column_msGPUActive1 });
+        }
+        if (args.mTrackGPUVideo) {
+            c.push_back(Column_msGPUVideoActive1);
+        }
+        if (args.mTrackInput) {
+            c.push_back(Column_msSinceInput1);
+        }
+        switch (args.mTimeUnit) {
+        case TimeUnit::QPC:             c.push_back(Column_QPCTime1); break;
+        case TimeUnit::QPCMilliSeconds: c.push_back(Column_QPCTimeMilliSeconds1); break;
+        }
+        return c;
+    }();
+    return columns;
+}
+
+template<>
+std::vector<CsvColumn> const& GetCsvColumns<FrameMetrics>()
+{
+    static std::vector<CsvColumn> const columns = []() {
+        auto const& args = GetCommandLineArgs();
+
+        std::vector<CsvColumn> c = {
+            Column_Application,
+            Column_ProcessID,
+            Column_SwapChainAddress,
+            Column_PresentRuntime,
+            Column_SyncInterval,
+            Column_PresentFlags,
+        };
+        if (args.mTrackDisplay) {
+            c.insert(c.end(), { Column_AllowsTearing,
+                                Column_PresentMode });
+        }
+        if (args.mTrackFrameType) {
+            c.push_back(Column_FrameType);
+        }
+        switch (args.mTimeUnit) {
+        case TimeUnit::MilliSeconds:    c.push_back(Column_CPUStartTime); break;
+        case TimeUnit::QPC:             c.push_back(Column_CPUStartQPC); break;
+        case TimeUnit::QPCMilliSeconds: c.push_back(Column_CPUStartQPCTime); break;
+        case TimeUnit::DateTime:        c.push_back(Column_CPUStartDateTime); break;
+        }
+        c.insert(c.end(), { Column_FrameTime,
+                            Column_CPUBusy,
+                            Column_CPUWait });
+        if (args.mTrackGPU) {
+            c.insert(c.end(), { Column_GPULatency,
+                                Column_GPUTime,
+                                Column_GPUBusy,
+                                Column_GPUWait });
+        }
+        if (args.mTrackGPUVideo) {
+            c.push_back(Column_VideoBusy);
+        }
+        if (args.mTrackDisplay) {
+            c.insert(c.end(), { Column_DisplayLatency,
+                                Column_DisplayedTime });
+        }
+        if (args.mTrackInput) {
+            c.push_back(Column_ClickToPhotonLatency);
+        }
+        return c;
+    }();
+    return columns;
+}
+
+// CSV files are written by a separate writer thread, so that a slow disk or network share doesn't
+// stall the output thread.  When a CsvFile's buffer fills up, or at the end of each batch of
+// presents, the buffer is queued for the writer thread and replaced with a free one.  If the
+// writer falls more than MAX_QUEUED_CSV_WRITES buffers behind, the output thread waits for it
+// (back-pressure).
+enum {
+    CSV_BUFFER_SIZE = 256 * 1024,
+    MAX_QUEUED_CSV_WRITES = 32,
+};
+
+struct CsvWrite {
+    FILE* mFile;
+    bool mIsStdout;
+    bool mClose;            // Close the file after writing the buffer
+    uint64_t mRowCount;
+    size_t mSize;
+    std::vector<char> mBuffer;
+};
+
+static std::thread gCsvWriterThread;
+static std::mutex gCsvWriterMutex;
+static std::condition_variable gCsvWriteQueued;
+static std::condition_variable gCsvWriteDone;
+static std::deque<CsvWrite> gCsvWriteQueue;
+static std::vector<std::vector<char>> gFreeCsvBuffers;
+static size_t gQueuedCsvBytes = 0;
+static bool gCsvWriterQuit = false;
+static CsvWriterStats gCsvWriterStats = {};
+
+static bool WriteCsvBuffer(CsvWrite const& write, std::vector<wchar_t>* wideBuffer)
+{
+    if (write.mSize == 0) {
+        return true;
     }
-    if (args.mTrackGPU) {
-        fwprintf(fp, L",msUntilRenderStart"
-                     L",msGPUActive");
+
+    // stdout may have been set to UTF-16 mode (see InitConsole()), so it has to be written as wide
+    // text.
+    if (write.mIsStdout) {
+        auto wideLength = MultiByteToWideChar(CP_UTF8, 0, write.mBuffer.data(), (int) write.mSize, nullptr, 0);
+        wideBuffer->resize((size_t) wideLength + 1);
+        MultiByteToWideChar(CP_UTF8, 0, write.mBuffer.data(), (int) write.mSize, wideBuffer->data(), wideLength);
+        (*wideBuffer)[wideLength] = L'\0';
+        return fputws(wideBuffer->data(), write.mFile) >= 0 && fflush(write.mFile) == 0;
     }
-    if (args.mTrackGPUVideo) {
-        fwprintf(fp, L",msGPUVideoActive");
+
+    return fwrite(write.mBuffer.data(), 1, write.mSize, write.mFile) == write.mSize;
+}
+
+static void CsvWriter()
+{
+    SetThreadDescription(GetCurrentThread(), L"PresentMon CSV Writer Thread");
+
+    std::vector<wchar_t> wideBuffer;
+
+    std::unique_lock<std::mutex> lock(gCsvWriterMutex);
+    for (;;) {
+        gCsvWriteQueued.wait(lock, [] { return gCsvWriterQuit || !gCsvWriteQueue.empty(); });
+
+        // Only quit once everything that was queued has been written.
+        if (gCsvWriteQueue.empty()) {
+            break;
+        }
+
+        auto write = std::move(gCsvWriteQueue.front());
+        gCsvWriteQueue.pop_front();
+        gQueuedCsvBytes -= write.mSize;
+        lock.unlock();
+
+        auto written = WriteCsvBuffer(write, &wideBuffer);
+        if (write.mClose && !write.mIsStdout) {
+            if (fclose(write.mFile) != 0) {
+                written = false;
+            }
+        }
+
+        lock.lock();
+        if (written) {
+            gCsvWriterStats.mRowsWritten += write.mRowCount;
+        } else {
+            gCsvWriterStats.mRowsDropped += write.mRowCount;
+        }
+        if (write.mBuffer.size() == CSV_BUFFER_SIZE) {
+            gFreeCsvBuffers.emplace_back(std::move(write.mBuffer));
+        }
+        gCsvWriteDone.notify_one();
     }
-    if (args.mTrackInput) {
-        fwprintf(fp, L",msSinceInput");
+}
+
+// Queue size bytes of *buffer to be written to fp, and replace *buffer with a free buffer (unless
+// the file is being closed).
+static void QueueCsvWrite(FILE* fp, bool isStdout, bool close, std::vector<char>* buffer, size_t size, uint64_t rowCount)
+{
+    std::unique_lock<std::mutex> lock(gCsvWriterMutex);
+
+    if (gCsvWriteQueue.size() >= MAX_QUEUED_CSV_WRITES) {
+        auto waitStart = GetTickCount64();
+        gCsvWriteDone.wait(lock, [] { return gCsvWriteQueue.size() < MAX_QUEUED_CSV_WRITES; });
+        gCsvWriterStats.mBackPressureWaits += 1;
+        gCsvWriterStats.mBackPressureMs += GetTickCount64() - waitStart;
     }
-    if (args.mTimeUnit == TimeUnit::QPC || args.mTimeUnit == TimeUnit::QPCMilliSeconds) {
-        fwprintf(fp, L",QPCTime");
+
+    CsvWrite write;
+    write.mFile = fp;
+    write.mIsStdout = isStdout;
+    write.mClose = close;
+    write.mRowCount = rowCount;
+    write.mSize = size;
+    write.mBuffer.swap(*buffer);
+    gCsvWriteQueue.emplace_back(std::move(write));
+
+    gQueuedCsvBytes += size;
+    gCsvWriterStats.mPeakQueuedBytes = std::max<uint64_t>(gCsvWriterStats.mPeakQueuedBytes, gQueuedCsvBytes);
+
+    if (!close) {
+        if (gFreeCsvBuffers.empty()) {
+            buffer->resize(CSV_BUFFER_SIZE);
+        } else {
+            buffer->swap(gFreeCsvBuffers.back());
+            gFreeCsvBuffers.pop_back();
+        }
     }
-    fwprintf(fp, L"\n");
+
+    lock.unlock();
+    gCsvWriteQueued.notify_one();
 }
 
-template<>
-void WriteCsvRow<FrameMetrics1>(
-    FILE* fp,
-    PMTraceSession const& pmSession,
-    ProcessInfo const& processInfo,
-    PresentEvent const& p,
-    FrameMetrics1 const& metrics)
+void StartCsvWriterThread()
 {
-    auto const& args = GetCommandLineArgs();
+    gCsvWriterQuit = false;
+    gCsvWriterStats = {};
+    gCsvWriterThread = std::thread(CsvWriter);
+}
 
-    fwprintf(fp, L"%s,%d,0x%016llX,%hs,%d,%d,%hs", processInfo.mModuleName.c_str(),
-                                                   p.ProcessId,
-                                                   p.SwapChainAddress,
-                                                   RuntimeToString(p.Runtime),
-                                                   p.SyncInterval,
-                                                   p.PresentFlags,
-                                                   FinalStateToDroppedString(p.FinalState));
-    switch (args.mTimeUnit) {
-    case TimeUnit::DateTime: {
-        SYSTEMTIME st = {};
-        uint64_t ns = 0;
-        pmSession.TimestampToLocalSystemTime(p.PresentStartTime, &st, &ns);
-        fwprintf(fp, L",%u-%u-%u %u:%02u:%02u.%09llu", st.wYear,
-                                                       st.wMonth,
-                                                       st.wDay,
-                                                       st.wHour,
-                                                       st.wMinute,
-                                                       st.wSecond,
-                                                       ns);
-    }   break;
-    default:
-        fwprintf(fp, L",%.*lf", DBL_DIG - 1, 0.001 * pmSession.TimestampToMilliSeconds(p.PresentStartTime));
-        break;
-    }
-    fwprintf(fp, L",%.*lf,%.*lf", DBL_DIG - 1, metrics.msInPresentApi,
-                                  DBL_DIG - 1, metrics.msBetweenPresents);
-    if (args.mTrackDisplay) {
-        fwprintf(fp, L",%d,%hs,%.*lf,%.*lf,%.*lf", p.SupportsTearing,
-                                                   PresentModeToString(p.PresentMode),
-                                                   DBL_DIG - 1, metrics.msUntilRenderComplete,
-                                                   DBL_DIG - 1, metrics.msUntilDisplayed,
-                                                   DBL_DIG - 1, metrics.msBetweenDisplayChange);
+// Wait for all queued writes to complete, and then stop the writer thread.
+void StopCsvWriterThread()
+{
+    if (gCsvWriterThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(gCsvWriterMutex);
+            gCsvWriterQuit = true;
+        }
+        gCsvWriteQueued.notify_one();
+        gCsvWriterThread.join();
+
+        gFreeCsvBuffers.clear();
+        gFreeCsvBuffers.shrink_to_fit();
     }
-    if (args.mTrackGPU) {
-        fwprintf(fp, L",%.*lf,%.*lf", DBL_DIG - 1, metrics.msUntilRenderStart,
-                                      DBL_DIG - 1, metrics.msGPUDuration);
+}
+
+void GetCsvWriterStats(CsvWriterStats* stats)
+{
+    std::lock_guard<std::mutex> lock(gCsvWriterMutex);
+    *stats = gCsvWriterStats;
+}
+
+// CsvFile formats the CSV text into a UTF-8 buffer, which is queued for the writer thread when it
+// fills up and at the end of each batch of presents (see FlushCsv()).
+//
+// The output is identical to what the file would contain had it been opened with "w,ccs=UTF-8"
+// and written to with fwprintf(): a UTF-8 BOM and CRLF line endings.
+//
+// With --output_format columnar, frames are instead encoded by mColumnar, and its output is queued
+// for the writer thread the same way.
+//
+// With --csv_index, each row is also added to mIndex, which is written to mIndexFile when the CSV
+// is closed.
+struct CsvFile {
+    enum {
+        MAX_DOUBLE_LENGTH = 350,    // Enough for any double in fixed notation with precision <= 14
+    };
+
+    FILE* mFile;
+    bool mIsStdout;
+    std::vector<char> mBuffer;
+    size_t mSize;
+    uint64_t mRowCount;         // Number of rows in mBuffer, excluding the header
+    uint64_t mFileOffset;       // Number of bytes queued before mBuffer
+    uint64_t mMinTimestamp;     // Range of the row timestamps in mBuffer since ResetTimestampRange()
+    uint64_t mMaxTimestamp;
+
+    std::unique_ptr<CsvIndexWriter> mIndex;
+    FILE* mIndexFile;
+
+    std::unique_ptr<ColumnarCaptureWriter> mColumnar;
+    std::unordered_map<std::wstring, uint32_t> mColumnarApplications;  // Module name -> string index
+    std::unordered_map<char const*, uint32_t> mColumnarNames;          // Static name -> string index
+
+    CsvFile(FILE* fp, bool isStdout)
+        : mFile(fp)
+        , mIsStdout(isStdout)
+        , mBuffer(CSV_BUFFER_SIZE)
+        , mSize(0)
+        , mRowCount(0)
+        , mFileOffset(0)
+        , mMinTimestamp(UINT64_MAX)
+        , mMaxTimestamp(0)
+        , mIndexFile(nullptr)
+    {
     }
-    if (args.mTrackGPUVideo) {
-        fwprintf(fp, L",%.*lf", DBL_DIG - 1, metrics.msVideoDuration);
+
+    // Called before each row is formatted, with the timestamp that the row's time column is
+    // computed from.
+    void BeginRow(uint64_t timestamp, uint32_t processId, uint64_t swapChainAddress)
+    {
+        mMinTimestamp = std::min(mMinTimestamp, timestamp);
+        mMaxTimestamp = std::max(mMaxTimestamp, timestamp);
+        if (mIndex != nullptr) {
+            mIndex->AddRows(mFileOffset + mSize, 1, timestamp, timestamp, processId, swapChainAddress);
+        }
     }
-    if (args.mTrackInput) {
-        fwprintf(fp, L",%.*lf", DBL_DIG - 1, metrics.msSinceInput);
+
+    void ResetTimestampRange()
+    {
+        mMinTimestamp = UINT64_MAX;
+        mMaxTimestamp = 0;
     }
-    switch (args.mTimeUnit) {
-    case TimeUnit::QPC:
-        fwprintf(fp, L",%llu", p.PresentStartTime);
-        break;
-    case TimeUnit::QPCMilliSeconds:
-        fwprintf(fp, L",%.*lf", DBL_DIG - 1, 0.001 * pmSession.TimestampDeltaToMilliSeconds(p.PresentStartTime));
-        break;
+
+    char* Reserve(size_t size)
+    {
+        if (mSize + size > mBuffer.size()) {
+            mBuffer.resize(std::max(mBuffer.size() * 2, mSize + size));
+        }
+        return mBuffer.data() + mSize;
     }
-    fwprintf(fp, L"\n");
-}
 
-template<>
-void WriteCsvHeader<FrameMetrics>(FILE* fp)
-{
-    auto const& args = GetCommandLineArgs();
+    void Append(char const* s, size_t length)
+    {
+        memcpy(Reserve(length), s, length);
+        mSize += length;
+    }
 
-    fwprintf(fp, L"Application"
-                 L",ProcessID"
-                 L",SwapChainAddress"
-                 L",PresentRuntime"
-                 L",SyncInterval"
-                 L",PresentFlags");
-    if (args.mTrackDisplay) {
-        fwprintf(fp, L",AllowsTearing"
-                     L",PresentMode");
+    void Append(char const* s)
+    {
+        Append(s, strlen(s));
     }
-    if (args.mTrackFrameType) {
-        fwprintf(fp, L",FrameType");
+
+    void AppendChar(char c)
+    {
+        *Reserve(1) = c;
+        mSize += 1;
     }
-    switch (args.mTimeUnit) {
-    case TimeUnit::MilliSeconds:    fwprintf(fp, L",CPUStartTime"); break;
-    case TimeUnit::QPC:             fwprintf(fp, L",CPUStartQPC"); break;
-    case TimeUnit::QPCMilliSeconds: fwprintf(fp, L",CPUStartQPCTime"); break;
-    case TimeUnit::DateTime:        fwprintf(fp, L",CPUStartDateTime"); break;
+
+    // Equivalent to %d
+    void AppendInt(int32_t value)
+    {
+        auto p = Reserve(16);
+        mSize += (size_t) (std::to_chars(p, p + 16, value).ptr - p);
     }
-    fwprintf(fp, L",FrameTime"
-                 L",CPUBusy"
-                 L",CPUWait");
-    if (args.mTrackGPU) {
-        fwprintf(fp, L",GPULatency"
-                     L",GPUTime"
-                     L",GPUBusy"
-                     L",GPUWait");
+
+    // Equivalent to %0*llu
+    void AppendUInt(uint64_t value, uint32_t minDigits = 1)
+    {
+        char digits[24];
+        auto n = (size_t) (std::to_chars(digits, digits + sizeof(digits), value).ptr - digits);
+        auto p = Reserve(std::max<size_t>(minDigits, n));
+        for (; n < minDigits; --minDigits) {
+            *p++ = '0';
+            mSize += 1;
+        }
+        memcpy(p, digits, n);
+        mSize += n;
     }
-    if (args.mTrackGPUVideo) {
-        fwprintf(fp, L",VideoBusy");
+
+    // Equivalent to %0*llX
+    void AppendHex(uint64_t value, uint32_t minDigits = 1)
+    {
+        char digits[16];
+        auto n = 0u;
+        do {
+            digits[15 - n] = "0123456789ABCDEF"[value & 0xf];
+            value >>= 4;
+            n += 1;
+        } while (value != 0);
+        auto p = Reserve(std::max(minDigits, n));
+        for (; n < minDigits; --minDigits) {
+            *p++ = '0';
+            mSize += 1;
+        }
+        memcpy(p, digits + 16 - n, n);
+        mSize += n;
     }
-    if (args.mTrackDisplay) {
-        fwprintf(fp, L",DisplayLatency"
-                     L",DisplayedTime");
+
+    // Equivalent to %.*lf
+    void AppendDouble(double value, int precision)
+    {
+        auto p = Reserve(MAX_DOUBLE_LENGTH);
+        auto r = std::to_chars(p, p + MAX_DOUBLE_LENGTH, value, std::chars_format::fixed, precision);
+        if (r.ec == std::errc()) {
+            mSize += (size_t) (r.ptr - p);
+        }
     }
-    if (args.mTrackInput) {
-        fwprintf(fp, L",ClickToPhotonLatency");
+
+    void AppendUtf8(std::wstring const& s)
+    {
+        auto length = s.size();
+        auto p = Reserve(3 * length);
+
+        size_t i = 0;
+        for ( ; i < length && s[i] < 0x80; ++i) {
+            p[i] = (char) s[i];
+        }
+        if (i < length) {
+            i = (size_t) WideCharToMultiByte(CP_UTF8, 0, s.c_str(), (int) length, p, (int) (3 * length), nullptr, nullptr);
+        }
+        mSize += i;
+    }
+
+    // Equivalent to %u-%u-%u %u:%02u:%02u.%09llu
+    void AppendDateTime(PMTraceSession const& pmSession, uint64_t timestamp)
+    {
+        SYSTEMTIME st = {};
+        uint64_t ns = 0;
+        pmSession.TimestampToLocalSystemTime(timestamp, &st, &ns);
+        AppendUInt(st.wYear);
+        AppendChar('-');
+        AppendUInt(st.wMonth);
+        AppendChar('-');
+        AppendUInt(st.wDay);
+        AppendChar(' ');
+        AppendUInt(st.wHour);
+        AppendChar(':');
+        AppendUInt(st.wMinute, 2);
+        AppendChar(':');
+        AppendUInt(st.wSecond, 2);
+        AppendChar('.');
+        AppendUInt(ns, 9);
     }
-    fwprintf(fp, L"\n");
+
+    void EndRow()
+    {
+        if (mIsStdout) {
+            AppendChar('\n');
+        } else {
+            Append("\r\n", 2);
+        }
+        if (mSize >= CSV_BUFFER_SIZE - 4096 && mFile != nullptr) {
+            Flush();
+        }
+    }
+
+    void Flush()
+    {
+        if (mColumnar != nullptr) {
+            QueueColumnarOutput(false);
+            return;
+        }
+
+        if (mSize > 0) {
+            QueueCsvWrite(mFile, mIsStdout, false, &mBuffer, mSize, mRowCount);
+            mFileOffset += mSize;
+            mSize = 0;
+            mRowCount = 0;
+        }
+    }
+
+    // Queue the rest of the buffer, and have the writer thread close the file once it is written.
+    void Close()
+    {
+        if (mColumnar != nullptr) {
+            mColumnar->End();
+            QueueColumnarOutput(true);
+            return;
+        }
+
+        QueueCsvWrite(mFile, mIsStdout, true, &mBuffer, mSize, mRowCount);
+        mFileOffset += mSize;
+        mSize = 0;
+        mRowCount = 0;
+
+        if (mIndex != nullptr) {
+            std::vector<char> index;
+            mIndex->End(mFileOffset, &index);
+            QueueCsvWrite(mIndexFile, false, true, &index, index.size(), 0);
+        }
+    }
+
+    // Queue the columnar data that has been encoded so far.  Frames that are still waiting to be
+    // encoded into a chunk are counted in the next write.
+    void QueueColumnarOutput(bool close)
+    {
+        auto size = mColumnar->mOutput.size();
+        if (size > 0 || close) {
+            auto pendingRowCount = (uint64_t) mColumnar->mFrames.size();
+            QueueCsvWrite(mFile, false, close, &mColumnar->mOutput, size, mRowCount - pendingRowCount);
+            mColumnar->mOutput.clear();
+            mColumnar->mOutputOffset += size;
+            mRowCount = pendingRowCount;
+        }
+    }
+};
+
+static CsvFile* gGlobalOutputCsv = nullptr;
+static std::vector<CsvFile*> gOpenCsvFiles;
+static std::mutex gOpenCsvFilesMutex;     // Guards gOpenCsvFiles, as per-process CSVs may be opened by output worker threads
+
+template<typename FrameMetricsT>
+static void WriteCsvHeader(CsvFile* csv)
+{
+    auto const& columns = GetCsvColumns<FrameMetricsT>();
+    for (size_t i = 0, n = columns.size(); i < n; ++i) {
+        if (i > 0) {
+            csv->AppendChar(',');
+        }
+        csv->Append(GetCsvColumnHeader(columns[i]));
+    }
+    csv->EndRow();
 }
 
-template<>
-void WriteCsvRow<FrameMetrics>(
-    FILE* fp,
+static void WriteCsvRow(
+    CsvFile* csv,
+    PMTraceSession const& pmSession,
+    ProcessInfo const& processInfo,
+    PresentEvent const& p,
+    FrameMetrics1 const& metrics)
+{
+    csv->BeginRow(p.PresentStartTime, p.ProcessId, p.SwapChainAddress);
+
+    auto const& columns = GetCsvColumns<FrameMetrics1>();
+    for (size_t i = 0, n = columns.size(); i < n; ++i) {
+        if (i > 0) {
+            csv->AppendChar(',');
+        }
+        switch (columns[i]) {
+        case Column_Application:            csv->AppendUtf8(processInfo.mModuleName); break;
+        case Column_ProcessID:              csv->AppendInt((int32_t) p.ProcessId); break;
+        case Column_SwapChainAddress1:      csv->Append("0x", 2); csv->AppendHex(p.SwapChainAddress, 16); break;
+        case Column_Runtime1:               csv->Append(RuntimeToString(p.Runtime)); break;
+        case Column_SyncInterval:           csv->AppendInt(p.SyncInterval); break;
+        case Column_PresentFlags:           csv->AppendInt((int32_t) p.PresentFlags); break;
+        case Column_Dropped1:               csv->Append(FinalStateToDroppedString(p.FinalState)); break;
+        case Column_TimeInSeconds1:         csv->AppendDouble(0.001 * pmSession.TimestampToMilliSeconds(p.PresentStartTime), DBL_DIG - 1); break;
+        case Column_TimeInSecondsDateTime1: csv->AppendDateTime(pmSession, p.PresentStartTime); break;
+        case Column_msInPresentAPI1:        csv->AppendDouble(metrics.msInPresentApi, DBL_DIG - 1); break;
+        case Column_msBetweenPresents1:     csv->AppendDouble(metrics.msBetweenPresents, DBL_DIG - 1); break;
+        case Column_AllowsTearing:          csv->AppendInt(p.SupportsTearing); break;
+        case Column_PresentMode:            csv->Append(PresentModeToString(p.PresentMode)); break;
+        case Column_msUntilRenderComplete1: csv->AppendDouble(metrics.msUntilRenderComplete, DBL_DIG - 1); break;
+        case Column_msUntilDisplayed1:      csv->AppendDouble(metrics.msUntilDisplayed, DBL_DIG - 1); break;
+        case Column_msBetweenDisplayChange1:csv->AppendDouble(metrics.msBetweenDisplayChange, DBL_DIG - 1); break;
+        case Column_msUntilRenderStart1:    csv->AppendDouble(metrics.msUntilRenderStart, DBL_DIG - 1); break;
+        case Column_msGPUActive1:           csv->AppendDouble(metrics.msGPUDuration, DBL_DIG - 1); break;
+        case Column_msGPUVideoActive1:      csv->AppendDouble(metrics.msVideoDuration, DBL_DIG - 1); break;
+        case Column_msSinceInput1:          csv->AppendDouble(metrics.msSinceInput, DBL_DIG - 1); break;
+        case Column_QPCTime1:               csv->AppendUInt(p.PresentStartTime); break;
+        case Column_QPCTimeMilliSeconds1:   csv->AppendDouble(0.001 * pmSession.TimestampDeltaToMilliSeconds(p.PresentStartTime), DBL_DIG - 1); break;
+        }
+    }
+    csv->mRowCount += 1;
+    csv->EndRow();
+}
+
+static void WriteCsvRow(
+    CsvFile* csv,
     PMTraceSession const& pmSession,
     ProcessInfo const& processInfo,
     PresentEvent const& p,
     FrameMetrics const& metrics)
+{
+    csv->BeginRow(metrics.mCPUStart, p.ProcessId, p.SwapChainAddress);
+
+    auto const& columns = GetCsvColumns<FrameMetrics>();
+    for (size_t i = 0, n = columns.size(); i < n; ++i) {
+        if (i > 0) {
+            csv->AppendChar(',');
+        }
+        switch (columns[i]) {
+        case Column_Application:            csv->AppendUtf8(processInfo.mModuleName); break;
+        case Column_ProcessID:              csv->AppendInt((int32_t) p.ProcessId); break;
+        case Column_SwapChainAddress:       csv->Append("0x", 2); csv->AppendHex(p.SwapChainAddress); break;
+        case Column_PresentRuntime:         csv->Append(RuntimeToString(p.Runtime)); break;
+        case Column_SyncInterval:           csv->AppendInt(p.SyncInterval); break;
+        case Column_PresentFlags:           csv->AppendInt((int32_t) p.PresentFlags); break;
+        case Column_AllowsTearing:          csv->AppendInt(p.SupportsTearing); break;
+        case Column_PresentMode:            csv->Append(PresentModeToString(p.PresentMode)); break;
+        case Column_FrameType:              csv->Append(FrameTypeToString(p.FrameType)); break;
+        case Column_CPUStartTime:           csv->AppendDouble(pmSession.TimestampToMilliSeconds(metrics.mCPUStart), 4); break;
+        case Column_CPUStartQPC:            csv->AppendUInt(metrics.mCPUStart); break;
+        case Column_CPUStartQPCTime:        csv->AppendDouble(pmSession.TimestampDeltaToMilliSeconds(metrics.mCPUStart), 4); break;
+        case Column_CPUStartDateTime:       csv->AppendDateTime(pmSession, metrics.mCPUStart); break;
+        case Column_FrameTime:              csv->AppendDouble(metrics.mCPUBusy + metrics.mCPUWait, 4); break;
+        case Column_CPUBusy:                csv->AppendDouble(metrics.mCPUBusy, 4); break;
+        case Column_CPUWait:                csv->AppendDouble(metrics.mCPUWait, 4); break;
+        case Column_GPULatency:             csv->AppendDouble(metrics.mGPULatency, 4); break;
+        case Column_GPUTime:                csv->AppendDouble(metrics.mGPUBusy + metrics.mGPUWait, 4); break;
+        case Column_GPUBusy:                csv->AppendDouble(metrics.mGPUBusy, 4); break;
+        case Column_GPUWait:                csv->AppendDouble(metrics.mGPUWait, 4); break;
+        case Column_VideoBusy:              csv->AppendDouble(metrics.mVideoBusy, 4); break;
+        case Column_DisplayLatency:
+            if (metrics.mDisplayedTime == 0.0) {
+                csv->Append("NA", 2);
+            } else {
+                csv->AppendDouble(metrics.mDisplayLatency, 4);
+            }
+            break;
+        case Column_DisplayedTime:
+            if (metrics.mDisplayedTime == 0.0) {
+                csv->Append("NA", 2);
+            } else {
+                csv->AppendDouble(metrics.mDisplayedTime, 4);
+            }
+            break;
+        case Column_ClickToPhotonLatency:
+            if (metrics.mClickToPhotonLatency == 0.0) {
+                csv->Append("NA", 2);
+            } else {
+                csv->AppendDouble(metrics.mClickToPhotonLatency, 4);
+            }
+            break;
+        }
+    }
+    csv->mRowCount += 1;
+    csv->EndRow();
+}
+
+static void WriteColumnarHeader(CsvFile* csv, PMTraceSession const& pmSession)
 {
     auto const& args = GetCommandLineArgs();
 
-    fwprintf(fp, L"%s,%d,0x%llX,%hs,%d,%d", processInfo.mModuleName.c_str(),
-                                            p.ProcessId,
-                                            p.SwapChainAddress,
-                                            RuntimeToString(p.Runtime),
-                                            p.SyncInterval,
-                                            p.PresentFlags);
+    ColumnarFileHeader header = {};
+    header.mTimestampFrequency = pmSession.mTimestampFrequency.QuadPart;
+    header.mStartTimestamp     = pmSession.mStartTimestamp.QuadPart;
+    header.mStartFileTime      = pmSession.mStartFileTime;
+    header.mTimestampType      = pmSession.mTimestampType;
+    header.mTimeUnit           = (uint32_t) args.mTimeUnit;
+    header.mColumnMask         = (1u << COLUMNAR_APPLICATION) |
+                                 (1u << COLUMNAR_PROCESS_ID) |
+                                 (1u << COLUMNAR_SWAP_CHAIN_ADDRESS) |
+                                 (1u << COLUMNAR_PRESENT_RUNTIME) |
+                                 (1u << COLUMNAR_SYNC_INTERVAL) |
+                                 (1u << COLUMNAR_PRESENT_FLAGS) |
+                                 (1u << COLUMNAR_CPU_START) |
+                                 (1u << COLUMNAR_CPU_BUSY) |
+                                 (1u << COLUMNAR_CPU_WAIT);
     if (args.mTrackDisplay) {
-        fwprintf(fp, L",%d,%hs", p.SupportsTearing,
-                                 PresentModeToString(p.PresentMode));
+        header.mColumnMask |= (1u << COLUMNAR_ALLOWS_TEARING) |
+                              (1u << COLUMNAR_PRESENT_MODE) |
+                              (1u << COLUMNAR_DISPLAY_LATENCY) |
+                              (1u << COLUMNAR_DISPLAYED_TIME);
     }
     if (args.mTrackFrameType) {
-        fwprintf(fp, L",%hs", FrameTypeToString(p.FrameType));
-    }
-    switch (args.mTimeUnit) {
-    case TimeUnit::MilliSeconds:
-        fwprintf(fp, L",%.4lf", pmSession.TimestampToMilliSeconds(metrics.mCPUStart));
-        break;
-    case TimeUnit::QPC:
-        fwprintf(fp, L",%llu", metrics.mCPUStart);
-        break;
-    case TimeUnit::QPCMilliSeconds:
-        fwprintf(fp, L",%.4lf", pmSession.TimestampDeltaToMilliSeconds(metrics.mCPUStart));
-        break;
-    case TimeUnit::DateTime: {
-        SYSTEMTIME st = {};
-        uint64_t ns = 0;
-        pmSession.TimestampToLocalSystemTime(metrics.mCPUStart, &st, &ns);
-        fwprintf(fp, L",%u-%u-%u %u:%02u:%02u.%09llu", st.wYear,
-                                                       st.wMonth,
-                                                       st.wDay,
-                                                       st.wHour,
-                                                       st.wMinute,
-                                                       st.wSecond,
-                                                       ns);
-    }   break;
-    }
-    fwprintf(fp, L",%.4lf,%.4lf,%.4lf", metrics.mCPUBusy + metrics.mCPUWait,
-                                        metrics.mCPUBusy,
-                                        metrics.mCPUWait);
+        header.mColumnMask |= (1u << COLUMNAR_FRAME_TYPE);
+    }
     if (args.mTrackGPU) {
-        fwprintf(fp, L",%.4lf,%.4lf,%.4lf,%.4lf", metrics.mGPULatency,
-                                                  metrics.mGPUBusy + metrics.mGPUWait,
-                                                  metrics.mGPUBusy,
-                                                  metrics.mGPUWait);
+        header.mColumnMask |= (1u << COLUMNAR_GPU_LATENCY) |
+                              (1u << COLUMNAR_GPU_BUSY) |
+                              (1u << COLUMNAR_GPU_WAIT);
     }
     if (args.mTrackGPUVideo) {
-        fwprintf(fp, L",%.4lf", metrics.mVideoBusy);
+        header.mColumnMask |= (1u << COLUMNAR_VIDEO_BUSY);
     }
-    if (args.mTrackDisplay) {
-        if (metrics.mDisplayedTime == 0.0) {
-            fwprintf(fp, L",NA,NA");
-        } else {
-            fwprintf(fp, L",%.4lf,%.4lf", metrics.mDisplayLatency,
-                                          metrics.mDisplayedTime);
+    if (args.mTrackInput) {
+        header.mColumnMask |= (1u << COLUMNAR_CLICK_TO_PHOTON_LATENCY);
+    }
+
+    csv->mColumnar.reset(new ColumnarCaptureWriter);
+    csv->mColumnar->Begin(header);
+}
+
+// name must be a string literal, e.g., from PresentModeToString().
+static uint32_t GetColumnarNameIndex(CsvFile* csv, char const* name)
+{
+    auto ii = csv->mColumnarNames.find(name);
+    if (ii == csv->mColumnarNames.end()) {
+        ii = csv->mColumnarNames.emplace(name, csv->mColumnar->GetStringIndex(name)).first;
+    }
+    return ii->second;
+}
+
+static uint32_t GetColumnarApplicationIndex(CsvFile* csv, std::wstring const& moduleName)
+{
+    auto ii = csv->mColumnarApplications.find(moduleName);
+    if (ii == csv->mColumnarApplications.end()) {
+        auto length = WideCharToMultiByte(CP_UTF8, 0, moduleName.c_str(), (int) moduleName.size(), nullptr, 0, nullptr, nullptr);
+        std::string utf8((size_t) length, '\0');
+        WideCharToMultiByte(CP_UTF8, 0, moduleName.c_str(), (int) moduleName.size(), &utf8[0], length, nullptr, nullptr);
+        ii = csv->mColumnarApplications.emplace(moduleName, csv->mColumnar->GetStringIndex(utf8)).first;
+    }
+    return ii->second;
+}
+
+static void WriteColumnarFrame(
+    CsvFile* csv,
+    ProcessInfo const& processInfo,
+    PresentEvent const& p,
+    FrameMetrics const& metrics)
+{
+    ColumnarFrame frame = {};
+    frame.mApplication          = GetColumnarApplicationIndex(csv, processInfo.mModuleName);
+    frame.mProcessId            = p.ProcessId;
+    frame.mSwapChainAddress     = p.SwapChainAddress;
+    frame.mPresentRuntime       = GetColumnarNameIndex(csv, RuntimeToString(p.Runtime));
+    frame.mSyncInterval         = p.SyncInterval;
+    frame.mPresentFlags         = p.PresentFlags;
+    frame.mAllowsTearing        = p.SupportsTearing ? 1 : 0;
+    frame.mPresentMode          = GetColumnarNameIndex(csv, PresentModeToString(p.PresentMode));
+    frame.mFrameType            = GetColumnarNameIndex(csv, FrameTypeToString(p.FrameType));
+    frame.mCPUStart             = metrics.mCPUStart;
+    frame.mCPUBusy              = metrics.mCPUBusy;
+    frame.mCPUWait              = metrics.mCPUWait;
+    frame.mGPULatency           = metrics.mGPULatency;
+    frame.mGPUBusy              = metrics.mGPUBusy;
+    frame.mGPUWait              = metrics.mGPUWait;
+    frame.mVideoBusy            = metrics.mVideoBusy;
+    frame.mDisplayLatency       = metrics.mDisplayLatency;
+    frame.mDisplayedTime        = metrics.mDisplayedTime;
+    frame.mClickToPhotonLatency = metrics.mClickToPhotonLatency;
+
+    csv->mColumnar->AddFrame(frame);
+    csv->mRowCount += 1;
+    if (csv->mColumnar->mOutput.size() >= CSV_BUFFER_SIZE) {
+        csv->Flush();
+    }
+}
+
+// ParseCommandLine() doesn't allow --v1_metrics with columnar output.
+static void WriteColumnarFrame(CsvFile*, ProcessInfo const&, PresentEvent const&, FrameMetrics1 const&)
+{
+    assert(false);
+}
+
+template<typename FrameMetricsT>
+static bool OpenCsv(
+    PMTraceSession const& pmSession,
+    ProcessInfo* processInfo,
+    PresentEvent const& p,
+    CsvFile** csv)
+{
+    auto const& args = GetCommandLineArgs();
+
+    if (args.mCSVOutput == CSVOutput::File) {
+        wchar_t path[MAX_PATH];
+        GenerateFilename(path, processInfo->mModuleName, p.ProcessId);
+        FILE* fp = nullptr;
+        if (_wfopen_s(&fp, path, L"wb")) {
+            return false;
         }
+        *csv = new CsvFile(fp, false);
+
+        if (args.mCsvIndexRows > 0) {
+            auto indexPath = std::wstring(path) + L".idx";
+            if (_wfopen_s(&(*csv)->mIndexFile, indexPath.c_str(), L"wb")) {
+                PrintWarning(L"warning: failed to create CSV index: %s\n", indexPath.c_str());
+            } else {
+                (*csv)->mIndex.reset(new CsvIndexWriter);
+                (*csv)->mIndex->Begin(pmSession.mTimestampFrequency.QuadPart, pmSession.mStartTimestamp.QuadPart, args.mCsvIndexRows);
+            }
+        }
+    } else {
+        *csv = new CsvFile(stdout, true);
     }
-    if (args.mTrackInput) {
-        if (metrics.mClickToPhotonLatency == 0.0) {
-            fwprintf(fp, L",NA");
-        } else {
-            fwprintf(fp, L",%.4lf", metrics.mClickToPhotonLatency);
+
+    {
+        std::lock_guard<std::mutex> lock(gOpenCsvFilesMutex);
+        gOpenCsvFiles.push_back(*csv);
+    }
+
+    if (args.mColumnarOutput) {
+        WriteColumnarHeader(*csv, pmSession);
+    } else {
+        if (!(*csv)->mIsStdout) {
+            (*csv)->Append("\xef\xbb\xbf", 3);
         }
+        WriteCsvHeader<FrameMetricsT>(*csv);
     }
-    fwprintf(fp, L"\n");
+    return true;
 }
 
 template<typename FrameMetricsT>
@@ -361,7 +1000,8 @@ void UpdateCsvT(
     PMTraceSession const& pmSession,
     ProcessInfo* processInfo,
     PresentEvent const& p,
-    FrameMetricsT const& metrics)
+    FrameMetricsT const& metrics,
+    CsvFile* rowBuffer)
 {
     auto const& args = GetCommandLineArgs();
 
@@ -376,46 +1016,122 @@ void UpdateCsvT(
         return;
     }
 
+    // Rows for the global CSV that are computed on an output worker thread are formatted into its
+    // row buffer, and appended to the CSV later by AppendCsvRows().
+    if (rowBuffer != nullptr && !args.mMultiCsv) {
+        assert(!args.mColumnarOutput);
+        WriteCsvRow(rowBuffer, pmSession, *processInfo, p, metrics);
+        return;
+    }
+
     // Get/create file
-    FILE** fp = args.mMultiCsv
+    CsvFile** csv = args.mMultiCsv
         ? &processInfo->mOutputCsv
         : &gGlobalOutputCsv;
 
-    if (*fp == nullptr) {
-        if (args.mCSVOutput == CSVOutput::File) {
-            wchar_t path[MAX_PATH];
-            GenerateFilename(path, processInfo->mModuleName, p.ProcessId);
-            if (_wfopen_s(fp, path, L"w,ccs=UTF-8")) {
-                return;
-            }
-        } else {
-            *fp = stdout;
-        }
+    if (*csv == nullptr && !OpenCsv<FrameMetricsT>(pmSession, processInfo, p, csv)) {
+        return;
+    }
 
-        WriteCsvHeader<FrameMetricsT>(*fp);
+    // Output in CSV or columnar format
+    if (args.mColumnarOutput) {
+        WriteColumnarFrame(*csv, *processInfo, p, metrics);
+    } else {
+        WriteCsvRow(*csv, pmSession, *processInfo, p, metrics);
     }
+}
 
-    // Output in CSV format
-    WriteCsvRow(*fp, pmSession, *processInfo, p, metrics);
+void UpdateCsv(PMTraceSession const& pmSession, ProcessInfo* processInfo, PresentEvent const& p, FrameMetrics1 const& metrics, CsvFile* rowBuffer)
+{
+    UpdateCsvT(pmSession, processInfo, p, metrics, rowBuffer);
 }
 
-void UpdateCsv(PMTraceSession const& pmSession, ProcessInfo* processInfo, PresentEvent const& p, FrameMetrics1 const& metrics)
+void UpdateCsv(PMTraceSession const& pmSession, ProcessInfo* processInfo, PresentEvent const& p, FrameMetrics const& metrics, CsvFile* rowBuffer)
 {
-    UpdateCsvT(pmSession, processInfo, p, metrics);
+    UpdateCsvT(pmSession, processInfo, p, metrics, rowBuffer);
 }
 
-void UpdateCsv(PMTraceSession const& pmSession, ProcessInfo* processInfo, PresentEvent const& p, FrameMetrics const& metrics)
+// A row buffer is a CsvFile that isn't associated with a file, and so never gets flushed.
+CsvFile* CreateCsvRowBuffer()
 {
-    UpdateCsvT(pmSession, processInfo, p, metrics);
+    return new CsvFile(nullptr, GetCommandLineArgs().mCSVOutput == CSVOutput::Stdout);
 }
 
-static void CloseCsv(FILE** fp)
+void DestroyCsvRowBuffer(CsvFile* rowBuffer)
 {
-    if (*fp != nullptr) {
-        if (*fp != stdout) {
-            fclose(*fp);
+    delete rowBuffer;
+}
+
+void ClearCsvRowBuffer(CsvFile* rowBuffer)
+{
+    rowBuffer->mSize = 0;
+    rowBuffer->mRowCount = 0;
+    rowBuffer->ResetTimestampRange();
+}
+
+void BeginCsvRowSpan(CsvFile* rowBuffer, CsvRowSpan* span)
+{
+    span->mRowBuffer = rowBuffer;
+    span->mBegin = rowBuffer->mSize;
+    span->mEnd = rowBuffer->mSize;
+    span->mRowCount = rowBuffer->mRowCount;
+    rowBuffer->ResetTimestampRange();
+}
+
+void EndCsvRowSpan(CsvRowSpan* span)
+{
+    span->mEnd = span->mRowBuffer->mSize;
+    span->mRowCount = span->mRowBuffer->mRowCount - span->mRowCount;
+    span->mMinTimestamp = span->mRowBuffer->mMinTimestamp;
+    span->mMaxTimestamp = span->mRowBuffer->mMaxTimestamp;
+}
+
+void AppendCsvRows(PMTraceSession const& pmSession, ProcessInfo* processInfo, PresentEvent const& p, CsvRowSpan const& span)
+{
+    if (span.mRowCount == 0) {
+        return;
+    }
+
+    if (gGlobalOutputCsv == nullptr) {
+        auto opened = GetCommandLineArgs().mUseV1Metrics
+            ? OpenCsv<FrameMetrics1>(pmSession, processInfo, p, &gGlobalOutputCsv)
+            : OpenCsv<FrameMetrics>(pmSession, processInfo, p, &gGlobalOutputCsv);
+        if (!opened) {
+            return;
         }
-        *fp = nullptr;
+    }
+
+    // All of the span's rows are for p's swap chain.
+    auto csv = gGlobalOutputCsv;
+    if (csv->mIndex != nullptr) {
+        csv->mIndex->AddRows(csv->mFileOffset + csv->mSize, (uint32_t) span.mRowCount, span.mMinTimestamp, span.mMaxTimestamp,
+                             p.ProcessId, p.SwapChainAddress);
+    }
+    csv->Append(span.mRowBuffer->mBuffer.data() + span.mBegin, span.mEnd - span.mBegin);
+    csv->mRowCount += span.mRowCount;
+    if (csv->mSize >= CSV_BUFFER_SIZE - 4096) {
+        csv->Flush();
+    }
+}
+
+void FlushCsv()
+{
+    std::lock_guard<std::mutex> lock(gOpenCsvFilesMutex);
+    for (auto csv : gOpenCsvFiles) {
+        csv->Flush();
+    }
+}
+
+static void CloseCsv(CsvFile** csv)
+{
+    if (*csv != nullptr) {
+        (*csv)->Close();
+        {
+            std::lock_guard<std::mutex> lock(gOpenCsvFilesMutex);
+            gOpenCsvFiles.erase(std::find(gOpenCsvFiles.begin(), gOpenCsvFiles.end(), *csv));
+        }
+        delete *csv;
+        *csv = nullptr;
     }
 }
 
@@ -429,3 +1145,84 @@ void CloseGlobalCsv()
     CloseCsv(&gGlobalOutputCsv);
 }
 
+static void GenerateSummaryFilename(wchar_t* path)
+{
+    auto const& args = GetCommandLineArgs();
+
+    wchar_t drive[_MAX_DRIVE];
+    wchar_t dir[_MAX_DIR];
+    wchar_t name[_MAX_FNAME];
+    wchar_t ext[_MAX_EXT];
+    _wsplitpath_s(args.mSummaryFileName, drive, dir, name, ext);
+
+    // Append -INDEX if applicable, the same as the CSV.
+    if (args.mHotkeySupport) {
+        _snwprintf_s(path, MAX_PATH, _TRUNCATE, L"%s%s%s-%d%s", drive, dir, name, gRecordingCount, ext);
+    } else {
+        _snwprintf_s(path, MAX_PATH, _TRUNCATE, L"%s%s%s%s", drive, dir, name, ext);
+    }
+}
+
+static void WriteSummaryRow(CsvFile* csv, SwapChainSummaryRow const& row, char const* metric, QuantileSketch const& sketch)
+{
+    double const quantiles[] = { 0.01, 0.05, 0.5, 0.95, 0.99 };
+
+    csv->AppendUtf8(*row.mModuleName);
+    csv->AppendChar(',');
+    csv->AppendUInt(row.mProcessId);
+    csv->Append(",0x", 3);
+    csv->AppendHex(row.mSwapChainAddress);
+    csv->AppendChar(',');
+    csv->Append(metric);
+    csv->AppendChar(',');
+    csv->AppendUInt(sketch.mCount);
+    csv->AppendChar(',');
+    csv->AppendDouble(sketch.GetMean(), 4);
+    csv->AppendChar(',');
+    csv->AppendDouble(sketch.mMin, 4);
+    for (auto q : quantiles) {
+        csv->AppendChar(',');
+        csv->AppendDouble(sketch.GetQuantile(q), 4);
+    }
+    csv->AppendChar(',');
+    csv->AppendDouble(sketch.mMax, 4);
+    csv->EndRow();
+}
+
+// The summary is written by the CSV writer thread like the CSVs, but its rows are not counted in
+// the CsvWriterStats.
+void WriteSummaryFile(std::vector<SwapChainSummaryRow> const& rows)
+{
+    auto const& args = GetCommandLineArgs();
+
+    wchar_t path[MAX_PATH];
+    GenerateSummaryFilename(path);
+    FILE* fp = nullptr;
+    if (_wfopen_s(&fp, path, L"wb")) {
+        PrintError(L"error: failed to create summary file: %s\n", path);
+        return;
+    }
+
+    CsvFile csv(fp, false);
+    csv.Append("\xef\xbb\xbf", 3);
+    csv.Append("Application,ProcessID,SwapChainAddress,Metric,Count,Mean,Min,P01,P05,P50,P95,P99,Max");
+    csv.EndRow();
+
+    for (auto const& row : rows) {
+        auto summary = row.mSummary;
+        if (summary->mCPUBusy.mCount == 0) {
+            continue;
+        }
+
+        WriteSummaryRow(&csv, row, args.mUseV1Metrics ? "msBetweenPresents" : "CPUBusy", summary->mCPUBusy);
+        if (args.mTrackGPU) {
+            WriteSummaryRow(&csv, row, args.mUseV1Metrics ? "msGPUActive" : "GPUBusy", summary->mGPUBusy);
+        }
+        if (args.mTrackDisplay) {
+            WriteSummaryRow(&csv, row, args.mUseV1Metrics ? "msBetweenDisplayChange" : "DisplayedTime", summary->mDisplayedTime);
+            WriteSummaryRow(&csv, row, args.mUseV1Metrics ? "msUntilDisplayed" : "DisplayLatency", summary->mDisplayLatency);
+        }
+    }
+
+    csv.Close();
+}
@@ -52,6 +52,58 @@ static bool EnableScrollLock(bool enable)
     return enabled;
 }
 
+static void PrintConsumerStats(PMTraceConsumer const& pmConsumer)
+{
+    auto snapshot = std::make_unique<ConsumerStats::Snapshot>();
+    pmConsumer.mStats.GetSnapshot(snapshot.get());
+
+    fwprintf(stderr, L"Consumer stats:\n");
+    fwprintf(stderr, L"    %-28hs %12hs %12hs %14hs\n", "Provider", "Events", "ns/event", "Est. total ms");
+    for (uint32_t i = 0; i < ConsumerStats::Provider_Count; ++i) {
+        auto provider = (ConsumerStats::Provider) i;
+        auto eventCount = snapshot->GetEventCount(provider);
+        if (eventCount > 0) {
+            fwprintf(stderr, L"    %-28hs %12llu %12.1f %14.1f\n",
+                     ConsumerStats::GetProviderName(provider),
+                     eventCount,
+                     snapshot->GetHandlerAverageNs(provider),
+                     snapshot->GetHandlerTotalNs(provider) / 1000000.0);
+            for (uint32_t id = 0; id < ConsumerStats::EVENT_ID_COUNT; ++id) {
+                if (snapshot->mEventCount[i][id] > 0) {
+                    fwprintf(stderr, L"        id %-22u %12llu\n", id, snapshot->mEventCount[i][id]);
+                }
+            }
+        }
+    }
+
+    fwprintf(stderr, L"    Lost presents: %llu\n", snapshot->GetLostPresentCount());
+    for (uint32_t i = 0; i < ConsumerStats::LostPresent_Count; ++i) {
+        if (snapshot->mLostPresentCount[i] > 0) {
+            fwprintf(stderr, L"        %-36hs %12llu\n", ConsumerStats::GetLostPresentReasonName((ConsumerStats::LostPresentReason) i), snapshot->mLostPresentCount[i]);
+        }
+    }
+
+    fwprintf(stderr, L"    Peak sizes:\n");
+    for (uint32_t i = 0; i < ConsumerStats::Container_Count; ++i) {
+        fwprintf(stderr, L"        %-36hs %12llu\n", ConsumerStats::GetContainerName((ConsumerStats::Container) i), snapshot->mPeakSize[i]);
+    }
+
+    fwprintf(stderr, L"    Memory (KB):\n");
+    fwprintf(stderr, L"        %-36hs %12llu\n", "Budget", snapshot->mMemoryBudget >> 10);
+    fwprintf(stderr, L"        %-36hs %12llu\n", "Footprint", snapshot->mMemoryFootprint >> 10);
+    fwprintf(stderr, L"        %-36hs %12llu\n", "PeakFootprint", snapshot->mPeakMemoryFootprint >> 10);
+}
+
+static void PrintCsvWriterStats(CsvWriterStats const& stats)
+{
+    fwprintf(stderr, L"CSV writer stats:\n");
+    fwprintf(stderr, L"    %-36hs %12llu\n", "RowsWritten", stats.mRowsWritten);
+    fwprintf(stderr, L"    %-36hs %12llu\n", "RowsDropped", stats.mRowsDropped);
+    fwprintf(stderr, L"    %-36hs %12llu\n", "BackPressureWaits", stats.mBackPressureWaits);
+    fwprintf(stderr, L"    %-36hs %12llu\n", "BackPressureMs", stats.mBackPressureMs);
+    fwprintf(stderr, L"    %-36hs %12llu\n", "PeakQueuedKB", stats.mPeakQueuedBytes >> 10);
+}
+
 static bool IsRecording()
 {
     return gIsRecording;
@@ -212,8 +264,9 @@ int wmain(int argc, wchar_t** argv)
     // 
     // RestartAsAdministrator() waits for the elevated process to complete in
     // order to report stderr and obtain it's exit code.
-    if (args.mEtlFileName == nullptr && // realtime analysis
-        !EnableDebugPrivilege()) {      // failed to enable SeDebugPrivilege
+    if (args.mEtlFileName == nullptr &&              // realtime analysis
+        args.mReplayEventStreamFileName == nullptr &&
+        !EnableDebugPrivilege()) {                   // failed to enable SeDebugPrivilege
         if (args.mTryToElevate) {
             return RestartAsAdministrator(argc, argv);
         }
@@ -259,16 +312,29 @@ int wmain(int argc, wchar_t** argv)
     pmConsumer.mTrackGPUVideo  = args.mTrackGPUVideo;
     pmConsumer.mTrackInput     = args.mTrackInput;
     pmConsumer.mTrackFrameType = args.mTrackFrameType;
+    // Budgets that don't fit in a size_t (on 32-bit builds) are clamped; the
+    // consumer's rings are capped well below that anyway.
+    auto memoryBudget = (uint64_t) args.mMemoryBudgetMB << 20;
+    pmConsumer.SetMemoryBudget(memoryBudget > SIZE_MAX ? SIZE_MAX : (size_t) memoryBudget);
 
     if (args.mTargetPid != 0) {
         pmConsumer.mFilteredProcessIds = true;
         pmConsumer.AddTrackedProcessForFiltering(args.mTargetPid);
     }
 
-    // Start the ETW trace session.
+    // Start the ETW trace session, or replay a recorded event stream instead.
+    EventStreamReader eventStreamReader;
     PMTraceSession pmSession;
     pmSession.mPMConsumer = &pmConsumer;
-    auto status = pmSession.Start(args.mEtlFileName, args.mSessionName);
+    pmSession.mUseNativeEtlReader = args.mNativeEtlReader;
+    ULONG status = ERROR_SUCCESS;
+    if (args.mReplayEventStreamFileName != nullptr) {
+        status = eventStreamReader.Open(args.mReplayEventStreamFileName)
+            ? pmSession.StartReplay(&eventStreamReader)
+            : ERROR_FILE_CORRUPT;
+    } else {
+        status = pmSession.Start(args.mEtlFileName, args.mSessionName);
+    }
 
     // If a session with this same name is already running, we either exit or
     // stop it and start a new session.  This is useful if a previous process
@@ -306,7 +372,7 @@ int wmain(int argc, wchar_t** argv)
         case ERROR_PATH_NOT_FOUND: PrintError(L"path not found.\n"); break;
         case ERROR_BAD_PATHNAME:   PrintError(L"invalid --session_name.\n"); break;
         case ERROR_ACCESS_DENIED:  PrintError(L"access denied.\n"); break;
-        case ERROR_FILE_CORRUPT:   PrintError(L"invalid --etl_file.\n"); break;
+        case ERROR_FILE_CORRUPT:   PrintError(args.mReplayEventStreamFileName != nullptr ? L"invalid --replay_event_stream.\n" : L"invalid --etl_file.\n"); break;
         default:                   PrintError(L"error code %lu.\n", status); break;
         }
 
@@ -327,8 +393,19 @@ int wmain(int argc, wchar_t** argv)
         pmConsumer.mDeferralTimeLimit = pmSession.mTimestampFrequency.QuadPart * 2;
     }
 
+    // If requested, record all the events into an event stream that can be
+    // replayed later.
+    EventStreamWriter eventStreamWriter;
+    if (args.mEventStreamFileName != nullptr) {
+        if (eventStreamWriter.Open(args.mEventStreamFileName)) {
+            pmSession.mEventStreamWriter = &eventStreamWriter;
+        } else {
+            PrintWarning(L"warning: failed to create event stream file: %s\n", args.mEventStreamFileName);
+        }
+    }
+
     // Start the consumer and output threads
-    StartConsumerThread(pmSession.mTraceHandle);
+    StartConsumerThread(&pmSession);
     StartOutputThread(pmSession);
 
     // If the user wants to use the scroll lock key as an indicator of when
@@ -373,6 +450,10 @@ int wmain(int argc, wchar_t** argv)
     WaitForConsumerThreadToExit();
     StopOutputThread();
 
+    if (pmSession.mEventStreamWriter != nullptr && !eventStreamWriter.Close(pmSession)) {
+        PrintWarning(L"warning: failed to write event stream file: %s\n", args.mEventStreamFileName);
+    }
+
     // Output warning if events were lost.
     if (pmSession.mNumBuffersLost > 0) {
         PrintWarning(L"warning: %lu ETW buffers were lost.\n", pmSession.mNumBuffersLost);
@@ -380,6 +461,29 @@ int wmain(int argc, wchar_t** argv)
     if (pmSession.mNumEventsLost > 0) {
         PrintWarning(L"warning: %lu ETW events were lost.\n", pmSession.mNumEventsLost);
     }
+    CsvWriterStats csvStats = {};
+    GetCsvWriterStats(&csvStats);
+    if (args.mCSVOutput != CSVOutput::None) {
+        if (csvStats.mRowsDropped > 0) {
+            PrintWarning(L"warning: %llu CSV rows could not be written.\n", csvStats.mRowsDropped);
+        }
+        if (csvStats.mBackPressureMs > 0) {
+            PrintWarning(L"warning: processing was delayed for %llu ms waiting for CSV writes to complete.\n", csvStats.mBackPressureMs);
+        }
+    }
+    if (args.mMemoryBudgetMB != 0) {
+        auto snapshot = std::make_unique<ConsumerStats::Snapshot>();
+        pmConsumer.mStats.GetSnapshot(snapshot.get());
+        auto evictionCount = snapshot->GetEvictionCount();
+        if (evictionCount > 0) {
+            PrintWarning(L"warning: %llu presents were dropped because they did not fit in the memory budget.\n", evictionCount);
+        }
+    }
+
+    if (args.mPrintConsumerStats) {
+        PrintConsumerStats(pmConsumer);
+        PrintCsvWriterStats(csvStats);
+    }
 
     /* We cannot remove the Ctrl handler because it is in an infinite sleep so
      * this call will never return, either hanging the application or having
@@ -4,6 +4,9 @@
 #include "PresentMon.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <shlwapi.h>
 #include <thread>
 
@@ -28,6 +31,9 @@ static CRITICAL_SECTION gRecordingToggleCS;
 static std::vector<uint64_t> gRecordingToggleHistory;
 static bool gIsRecording = false;
 
+// The consumer that the output thread waits on, so that other threads can wake it up.
+static PMTraceConsumer* gPMConsumer = nullptr;
+
 void SetOutputRecordingState(bool record)
 {
     auto const& args = GetCommandLineArgs();
@@ -37,10 +43,10 @@ void SetOutputRecordingState(bool record)
     if (gIsRecording != record) {
         gIsRecording = record;
 
-        // When capturing from an ETL file, just use the current recording state.
+        // When capturing from an ETL file or an event stream, just use the current recording state.
         // It's not clear how best to map realtime to ETL QPC time, and there
         // aren't any realtime cues in this case.
-        if (args.mEtlFileName == nullptr) {
+        if (args.mEtlFileName == nullptr && args.mReplayEventStreamFileName == nullptr) {
             uint64_t qpc = 0;
             QueryPerformanceCounter((LARGE_INTEGER*) &qpc);
             gRecordingToggleHistory.emplace_back(qpc);
@@ -48,6 +54,9 @@ void SetOutputRecordingState(bool record)
     }
 
     LeaveCriticalSection(&gRecordingToggleCS);
+
+    // Wake up the output thread so that the toggle is handled promptly.
+    gPMConsumer->InterruptWaitForPresentEvents();
 }
 
 static bool CopyRecordingToggleHistory(std::vector<uint64_t>* recordingToggleHistory)
@@ -80,6 +89,17 @@ static bool CopyRecordingToggleHistory(std::vector<uint64_t>* recordingToggleHis
 static std::unordered_map<uint32_t, ProcessInfo> gProcesses;
 static uint32_t gTargetProcessCount = 0;
 
+// Summaries of swap chains that were pruned, or whose process terminated, while recording.  They
+// are kept until recording stops so that they are included in the --summary_file.
+struct RetiredSwapChainSummary {
+    std::wstring mModuleName;
+    uint32_t mProcessId;
+    uint64_t mSwapChainAddress;
+    SwapChainSummary mSummary;
+};
+
+static std::vector<RetiredSwapChainSummary> gRetiredSummaries;
+
 // Removes any directory and extension, and converts the remaining name to
 // lower case.
 void CanonicalizeProcessName(std::wstring* name)
@@ -133,8 +153,69 @@ static bool IsTargetProcess(uint32_t processId, std::wstring const& processName)
     return false;
 }
 
+static void ResetSwapChainSummary(
+    SwapChainSummary* summary)
+{
+    summary->mCPUBusy.Reset();
+    summary->mGPUBusy.Reset();
+    summary->mDisplayedTime.Reset();
+    summary->mDisplayLatency.Reset();
+}
+
+static void MergeSwapChainSummary(
+    SwapChainSummary* summary,
+    SwapChainSummary const& other)
+{
+    summary->mCPUBusy.Merge(other.mCPUBusy);
+    summary->mGPUBusy.Merge(other.mGPUBusy);
+    summary->mDisplayedTime.Merge(other.mDisplayedTime);
+    summary->mDisplayLatency.Merge(other.mDisplayLatency);
+}
+
+static RetiredSwapChainSummary* FindRetiredSummary(
+    uint32_t processId,
+    std::wstring const& moduleName,
+    uint64_t swapChainAddress)
+{
+    for (auto& retired : gRetiredSummaries) {
+        if (retired.mProcessId == processId &&
+            retired.mSwapChainAddress == swapChainAddress &&
+            retired.mModuleName == moduleName) {
+            return &retired;
+        }
+    }
+    return nullptr;
+}
+
+// A swap chain may be pruned and then seen again during the same recording, so its summaries are
+// merged.
+static void RetireSwapChainSummary(
+    uint32_t processId,
+    ProcessInfo const& processInfo,
+    uint64_t swapChainAddress,
+    SwapChainData const& chain)
+{
+    if (chain.mSummary.mCPUBusy.mCount == 0) {
+        return;
+    }
+
+    auto retired = FindRetiredSummary(processId, processInfo.mModuleName, swapChainAddress);
+    if (retired != nullptr) {
+        MergeSwapChainSummary(&retired->mSummary, chain.mSummary);
+    } else {
+        gRetiredSummaries.emplace_back();
+        retired = &gRetiredSummaries.back();
+        retired->mModuleName       = processInfo.mModuleName;
+        retired->mProcessId        = processId;
+        retired->mSwapChainAddress = swapChainAddress;
+        retired->mSummary          = chain.mSummary;
+    }
+}
+
 static void HandleTerminatedProcess(
-    ProcessInfo* processInfo)
+    uint32_t processId,
+    ProcessInfo* processInfo,
+    bool isRecording)
 {
     auto const& args = GetCommandLineArgs();
 
@@ -142,6 +223,14 @@ static void HandleTerminatedProcess(
         // Close this process' CSV.
         CloseMultiCsv(processInfo);
 
+        // Keep its swap chains' summaries until recording stops.
+        if (isRecording && args.mSummaryFileName != nullptr) {
+            for (auto& pair : processInfo->mSwapChain) {
+                RetireSwapChainSummary(processId, *processInfo, pair.first, pair.second);
+                ResetSwapChainSummary(&pair.second.mSummary);
+            }
+        }
+
         // Quit if this is the last process tracked for --terminate_on_proc_exit.
         gTargetProcessCount -= 1;
         if (args.mTerminateOnProcExit && gTargetProcessCount == 0) {
@@ -151,14 +240,15 @@ static void HandleTerminatedProcess(
 }
 
 static void ProcessProcessEvent(
-    ProcessEvent const& processEvent)
+    ProcessEvent const& processEvent,
+    bool isRecording)
 {
     if (processEvent.IsStartEvent) {
         auto pr = gProcesses.emplace(processEvent.ProcessId, ProcessInfo{});
         auto info = &pr.first->second;
 
         if (!pr.second) {
-            HandleTerminatedProcess(info);
+            HandleTerminatedProcess(processEvent.ProcessId, info, isRecording);
         }
 
         info->mHandle          = NULL;
@@ -172,7 +262,7 @@ static void ProcessProcessEvent(
     } else {
         auto ii = gProcesses.find(processEvent.ProcessId);
         if (ii != gProcesses.end()) {
-            HandleTerminatedProcess(&ii->second);
+            HandleTerminatedProcess(processEvent.ProcessId, &ii->second, isRecording);
             gProcesses.erase(std::move(ii));
         }
     }
@@ -252,8 +342,10 @@ static void ReportMetrics1(
     SwapChainData* chain,
     std::shared_ptr<PresentEvent> const& p,
     bool isRecording,
-    bool computeAvg)
+    bool computeAvg,
+    CsvFile* rowBuffer)
 {
+    auto const& args = GetCommandLineArgs();
     bool displayed = p->FinalState == PresentResult::Presented;
 
     FrameMetrics1 metrics;
@@ -268,7 +360,7 @@ static void ReportMetrics1(
     metrics.msSinceInput           = p->InputTime == 0 ? 0 : pmSession.TimestampDeltaToMilliSeconds(p->PresentStartTime - p->InputTime);
 
     if (isRecording) {
-        UpdateCsv(pmSession, processInfo, *p, metrics);
+        UpdateCsv(pmSession, processInfo, *p, metrics, rowBuffer);
     }
 
     if (computeAvg) {
@@ -282,6 +374,17 @@ static void ReportMetrics1(
         }
     }
 
+    if (computeAvg || (isRecording && args.mSummaryFileName != nullptr)) {
+        chain->mSummary.mCPUBusy.Add(metrics.msBetweenPresents);
+        chain->mSummary.mGPUBusy.Add(metrics.msGPUDuration);
+        if (metrics.msUntilDisplayed > 0) {
+            chain->mSummary.mDisplayLatency.Add(metrics.msUntilDisplayed);
+            if (metrics.msBetweenDisplayChange > 0) {
+                chain->mSummary.mDisplayedTime.Add(metrics.msBetweenDisplayChange);
+            }
+        }
+    }
+
     UpdateChain(chain, p);
 }
 
@@ -293,8 +396,11 @@ static void ReportMetrics(
     std::shared_ptr<PresentEvent> const& nextPresent,
     PresentEvent const* nextDisplayedPresent,
     bool isRecording,
-    bool computeAvg)
+    bool computeAvg,
+    CsvFile* rowBuffer)
 {
+    auto const& args = GetCommandLineArgs();
+
     // Ignore repeated frames
     if (p->FrameType == FrameType::Repeated) {
         if (p->FrameId == chain->mLastPresent->FrameId) {
@@ -361,7 +467,7 @@ static void ReportMetrics(
     }
 
     if (isRecording) {
-        UpdateCsv(pmSession, processInfo, *p, metrics);
+        UpdateCsv(pmSession, processInfo, *p, metrics, rowBuffer);
     }
 
     if (computeAvg) {
@@ -375,6 +481,17 @@ static void ReportMetrics(
         }
     }
 
+    if (computeAvg || (isRecording && args.mSummaryFileName != nullptr)) {
+        if (includeFrameData) {
+            chain->mSummary.mCPUBusy.Add(metrics.mCPUBusy);
+            chain->mSummary.mGPUBusy.Add(metrics.mGPUBusy);
+        }
+        if (metrics.mDisplayedTime != 0.0) { // Matches the frames with display metrics in the CSV
+            chain->mSummary.mDisplayLatency.Add(metrics.mDisplayLatency);
+            chain->mSummary.mDisplayedTime.Add(metrics.mDisplayedTime);
+        }
+    }
+
     if (p->FrameId == nextPresent->FrameId) {
         if (includeFrameData) {
             chain->mIncludeFrameData = false;
@@ -386,8 +503,10 @@ static void ReportMetrics(
 
 static void PruneOldSwapChainData(
     PMTraceSession const& pmSession,
-    uint64_t latestTimestamp)
+    uint64_t latestTimestamp,
+    bool isRecording)
 {
+    auto const& args = GetCommandLineArgs();
     auto minTimestamp = latestTimestamp - pmSession.MilliSecondsDeltaToTimestamp(4000.0);
 
     for (auto& pair : gProcesses) {
@@ -395,6 +514,9 @@ static void PruneOldSwapChainData(
         for (auto ii = processInfo->mSwapChain.begin(), ie = processInfo->mSwapChain.end(); ii != ie; ) {
             auto chain = &ii->second;
             if (chain->mLastPresent->PresentStartTime < minTimestamp) {
+                if (isRecording && args.mSummaryFileName != nullptr) {
+                    RetireSwapChainSummary(pair.first, *processInfo, ii->first, *chain);
+                }
                 ii = processInfo->mSwapChain.erase(ii);
             } else {
                 ++ii;
@@ -411,7 +533,7 @@ static void QueryProcessName(uint32_t processId, ProcessInfo* info)
     wchar_t* processName = L"<unknown>";
     HANDLE handle = NULL;
 
-    if (args.mEtlFileName == nullptr) {
+    if (args.mEtlFileName == nullptr && args.mReplayEventStreamFileName == nullptr) {
         handle = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
         if (handle != NULL) {
             DWORD numChars = _countof(path);
@@ -476,6 +598,31 @@ static bool GetPresentProcessInfo(
     return false;
 }
 
+static void WriteSummary()
+{
+    std::vector<SwapChainSummaryRow> rows;
+    for (auto const& pair : gProcesses) {
+        for (auto const& chainPair : pair.second.mSwapChain) {
+            auto retired = FindRetiredSummary(pair.first, pair.second.mModuleName, chainPair.first);
+            if (retired != nullptr) {
+                MergeSwapChainSummary(&retired->mSummary, chainPair.second.mSummary);
+            } else {
+                rows.push_back({ &pair.second.mModuleName, pair.first, chainPair.first, &chainPair.second.mSummary });
+            }
+        }
+    }
+    for (auto const& retired : gRetiredSummaries) {
+        rows.push_back({ &retired.mModuleName, retired.mProcessId, retired.mSwapChainAddress, &retired.mSummary });
+    }
+    std::stable_sort(rows.begin(), rows.end(), [](SwapChainSummaryRow const& a, SwapChainSummaryRow const& b) {
+        return a.mProcessId != b.mProcessId ? a.mProcessId < b.mProcessId : a.mSwapChainAddress < b.mSwapChainAddress;
+    });
+
+    WriteSummaryFile(rows);
+
+    gRetiredSummaries.clear();
+}
+
 static void ProcessRecordingToggle(
     bool* isRecording)
 {
@@ -484,6 +631,10 @@ static void ProcessRecordingToggle(
     if (*isRecording) {
         *isRecording = false;
 
+        if (args.mSummaryFileName != nullptr) {
+            WriteSummary();
+        }
+
         IncrementRecordingCount();
 
         if (args.mMultiCsv) {
@@ -495,7 +646,263 @@ static void ProcessRecordingToggle(
         }
     } else {
         *isRecording = true;
+
+        // Start new summaries for this recording.
+        for (auto& pair : gProcesses) {
+            for (auto& chainPair : pair.second.mSwapChain) {
+                ResetSwapChainSummary(&chainPair.second.mSummary);
+            }
+        }
+        gRetiredSummaries.clear();
+    }
+}
+
+// Update the metrics and pending presents for a present if we are recording or presenting metrics
+// to the console.  Otherwise, just update the latest present details in the chain.
+static void ProcessPresent(
+    PMTraceSession const& pmSession,
+    ProcessInfo* processInfo,
+    SwapChainData* chain,
+    std::shared_ptr<PresentEvent> const& presentEvent,
+    bool isRecording,
+    bool computeAvg,
+    CsvFile* rowBuffer)
+{
+    auto const& args = GetCommandLineArgs();
+
+    if (!isRecording && !computeAvg) {
+        UpdateChain(chain, presentEvent);
+        return;
+    }
+
+    if (args.mUseV1Metrics) {
+        ReportMetrics1(pmSession, processInfo, chain, presentEvent, isRecording, computeAvg, rowBuffer);
+        return;
+    }
+
+    // If there are more than one pending PresentEvents, then the first one is displayed and the
+    // rest aren't.  Otherwise, there will only be one (or zero) pending presents.
+    auto numPendingPresents = chain->mPendingPresents.size();
+    if (numPendingPresents > 0) {
+        if (presentEvent->FinalState == PresentResult::Presented) {
+            size_t i = 1;
+            for ( ; i < numPendingPresents; ++i) {
+                ReportMetrics(pmSession, processInfo, chain, chain->mPendingPresents[i - 1], chain->mPendingPresents[i], presentEvent.get(), isRecording, computeAvg, rowBuffer);
+            }
+            ReportMetrics(pmSession, processInfo, chain, chain->mPendingPresents[i - 1], presentEvent, presentEvent.get(), isRecording, computeAvg, rowBuffer);
+            chain->mPendingPresents.clear();
+        } else {
+            if (chain->mPendingPresents[0]->FinalState != PresentResult::Presented) {
+                ReportMetrics(pmSession, processInfo, chain, chain->mPendingPresents[0], presentEvent, nullptr, isRecording, computeAvg, rowBuffer);
+                chain->mPendingPresents.clear();
+            }
+        }
+    }
+
+    chain->mPendingPresents.push_back(presentEvent);
+}
+
+// With --output_threads, ProcessPresent() is run on a pool of output worker threads (including
+// the output thread itself).  ProcessEvents() still handles the process events and recording
+// toggles in order, but queues each present as an OutputWork instead of processing it immediately.
+// The queued work is partitioned by process, so each process's swap chains (and, with
+// --multi_csv, its CSV) are only updated by one thread, in the order the presents were queued.
+// Rows for the global CSV are formatted into a row buffer per thread, and appended to the CSV in
+// the order the presents were queued, so the output is the same as if it was processed serially.
+//
+// The queued work must be run before a process event or recording toggle is handled, and before
+// any swap chain state that it updates is used.
+struct OutputWork {
+    ProcessInfo* mProcessInfo;
+    SwapChainData* mChain;
+    std::shared_ptr<PresentEvent> const* mPresentEvent;
+    bool mIsRecording;
+    uint64_t mPresentTime;              // The chain's mLastPresent time before the work was run
+    CsvRowSpan mRows;                   // Rows for the global CSV
+};
+
+enum {
+    MIN_PARALLEL_OUTPUT_WORK = 64,      // Smaller amounts of work are run on the output thread
+};
+
+static std::vector<OutputWork> gOutputWork;
+static std::vector<std::vector<uint32_t>> gOutputPartitions;       // Indices into gOutputWork, per process
+static std::unordered_map<ProcessInfo*, uint32_t> gOutputPartitionIndex;
+static std::atomic<uint32_t> gNextOutputPartition { 0 };
+
+static std::vector<std::thread> gOutputWorkers;
+static std::vector<CsvFile*> gCsvRowBuffers;                        // Per thread, the output thread's is first
+static std::mutex gOutputWorkMutex;
+static std::condition_variable gOutputWorkReady;
+static std::condition_variable gOutputWorkDone;
+static uint32_t gOutputWorkGeneration = 0;
+static uint32_t gBusyOutputWorkers = 0;
+static bool gOutputWorkersQuit = false;
+
+static void RunOutputWork(PMTraceSession const& pmSession, OutputWork* work, CsvFile* rowBuffer)
+{
+    auto computeAvg = GetCommandLineArgs().mConsoleOutput == ConsoleOutput::Statistics;
+
+    work->mPresentTime = work->mChain->mLastPresent->PresentStartTime;
+    if (rowBuffer != nullptr) {
+        BeginCsvRowSpan(rowBuffer, &work->mRows);
     }
+    ProcessPresent(pmSession, work->mProcessInfo, work->mChain, *work->mPresentEvent, work->mIsRecording, computeAvg, rowBuffer);
+    if (rowBuffer != nullptr) {
+        EndCsvRowSpan(&work->mRows);
+    }
+}
+
+static void RunOutputPartitions(PMTraceSession const& pmSession, uint32_t threadIndex)
+{
+    auto rowBuffer = gCsvRowBuffers[threadIndex];
+    auto partitionCount = (uint32_t) gOutputPartitions.size();
+    for (;;) {
+        auto partitionIndex = gNextOutputPartition.fetch_add(1);
+        if (partitionIndex >= partitionCount) {
+            break;
+        }
+        for (auto workIndex : gOutputPartitions[partitionIndex]) {
+            RunOutputWork(pmSession, &gOutputWork[workIndex], rowBuffer);
+        }
+    }
+}
+
+static void OutputWorker(PMTraceSession const* pmSession, uint32_t threadIndex)
+{
+    SetThreadDescription(GetCurrentThread(), L"PresentMon Output Worker Thread");
+
+    uint32_t generation = 0;
+    std::unique_lock<std::mutex> lock(gOutputWorkMutex);
+    for (;;) {
+        gOutputWorkReady.wait(lock, [&]() { return gOutputWorkersQuit || gOutputWorkGeneration != generation; });
+        if (gOutputWorkersQuit) {
+            break;
+        }
+        generation = gOutputWorkGeneration;
+        lock.unlock();
+
+        RunOutputPartitions(*pmSession, threadIndex);
+
+        lock.lock();
+        gBusyOutputWorkers -= 1;
+        if (gBusyOutputWorkers == 0) {
+            gOutputWorkDone.notify_one();
+        }
+    }
+}
+
+static void StartOutputWorkers(PMTraceSession const* pmSession)
+{
+    auto const& args = GetCommandLineArgs();
+
+    gOutputWorkersQuit = false;
+    for (uint32_t i = 0; i < args.mOutputThreads; ++i) {
+        gCsvRowBuffers.push_back(CreateCsvRowBuffer());
+    }
+    for (uint32_t i = 1; i < args.mOutputThreads; ++i) {
+        gOutputWorkers.emplace_back(OutputWorker, pmSession, i);
+    }
+}
+
+static void StopOutputWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(gOutputWorkMutex);
+        gOutputWorkersQuit = true;
+    }
+    gOutputWorkReady.notify_all();
+    for (auto& thread : gOutputWorkers) {
+        thread.join();
+    }
+    gOutputWorkers.clear();
+
+    for (auto rowBuffer : gCsvRowBuffers) {
+        DestroyCsvRowBuffer(rowBuffer);
+    }
+    gCsvRowBuffers.clear();
+}
+
+static void QueueOutputWork(
+    ProcessInfo* processInfo,
+    SwapChainData* chain,
+    std::shared_ptr<PresentEvent> const& presentEvent,
+    bool isRecording)
+{
+    OutputWork work;
+    work.mProcessInfo  = processInfo;
+    work.mChain        = chain;
+    work.mPresentEvent = &presentEvent;
+    work.mIsRecording  = isRecording;
+    work.mPresentTime  = 0;
+    work.mRows         = {};
+    gOutputWork.push_back(work);
+
+    chain->mQueuedPresentTime = presentEvent->PresentStartTime;
+}
+
+// Run all the queued work, and return the mPresentTime of the last work item (or 0 if there wasn't
+// any).
+static uint64_t RunQueuedOutputWork(PMTraceSession const& pmSession)
+{
+    auto const& args = GetCommandLineArgs();
+
+    auto workCount = (uint32_t) gOutputWork.size();
+    if (workCount == 0) {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < workCount; ++i) {
+        auto ii = gOutputPartitionIndex.emplace(gOutputWork[i].mProcessInfo, (uint32_t) gOutputPartitions.size());
+        if (ii.second) {
+            gOutputPartitions.emplace_back();
+        }
+        gOutputPartitions[ii.first->second].push_back(i);
+    }
+
+    // Columnar output is encoded as it is written, so global columnar output is always processed
+    // serially.
+    auto globalCsvRows = args.mCSVOutput != CSVOutput::None && !args.mMultiCsv;
+    if (gOutputPartitions.size() < 2 || workCount < MIN_PARALLEL_OUTPUT_WORK || (globalCsvRows && args.mColumnarOutput)) {
+        for (auto& work : gOutputWork) {
+            RunOutputWork(pmSession, &work, nullptr);
+        }
+    } else {
+        gNextOutputPartition = 0;
+        {
+            std::lock_guard<std::mutex> lock(gOutputWorkMutex);
+            gBusyOutputWorkers = (uint32_t) gOutputWorkers.size();
+            gOutputWorkGeneration += 1;
+        }
+        gOutputWorkReady.notify_all();
+
+        RunOutputPartitions(pmSession, 0);
+
+        {
+            std::unique_lock<std::mutex> lock(gOutputWorkMutex);
+            gOutputWorkDone.wait(lock, []() { return gBusyOutputWorkers == 0; });
+        }
+
+        if (globalCsvRows) {
+            for (auto const& work : gOutputWork) {
+                AppendCsvRows(pmSession, work.mProcessInfo, **work.mPresentEvent, work.mRows);
+            }
+            for (auto rowBuffer : gCsvRowBuffers) {
+                ClearCsvRowBuffer(rowBuffer);
+            }
+        }
+    }
+
+    auto presentTime = gOutputWork.back().mPresentTime;
+
+    for (auto const& work : gOutputWork) {
+        work.mChain->mQueuedPresentTime = 0;
+    }
+    gOutputWork.clear();
+    gOutputPartitions.clear();
+    gOutputPartitionIndex.clear();
+
+    return presentTime;
 }
 
 static void ProcessEvents(
@@ -507,6 +914,7 @@ static void ProcessEvents(
 {
     auto const& args = GetCommandLineArgs();
     auto computeAvg = args.mConsoleOutput == ConsoleOutput::Statistics;
+    auto queueWork = args.mOutputThreads > 1;
 
     // Determine the recording state and when the next toggle is.
     size_t recordingToggleIndex = 0;
@@ -522,6 +930,7 @@ static void ProcessEvents(
     // Iterate through the processEvents, handling process events and recording toggles along the
     // way.
     uint64_t presentTime = 0;
+    bool presentTimeIsQueued = false;   // Whether presentTime should come from the last queued work
     for (auto const& presentEvent : presentEvents) {
 
         // Ignore failed and lost presents.
@@ -536,11 +945,24 @@ static void ProcessEvents(
         if (GetPresentProcessInfo(presentEvent, false, &processInfo, &chain, &presentTime)) {
             continue;
         }
+        presentTimeIsQueued = false;
+
+        // If there is queued work for this chain, then presentTime is out of date.  However, it
+        // can't be later than the last queued present, so the work only needs to be run now if a
+        // process event or recording toggle may have occurred before that.
+        if (chain != nullptr && chain->mQueuedPresentTime != 0) {
+            if ((checkProcessTime     && (*processEvents)[processEventIndex].QpcTime < chain->mQueuedPresentTime) ||
+                (checkRecordingToggle && (*recordingToggleHistory)[recordingToggleIndex] < chain->mQueuedPresentTime)) {
+                RunQueuedOutputWork(pmSession);
+                presentTime = chain->mLastPresent->PresentStartTime;
+            }
+        }
 
         // Handle any process events that occurred before this present
         if (checkProcessTime) {
             while ((*processEvents)[processEventIndex].QpcTime < presentTime) {
-                ProcessProcessEvent((*processEvents)[processEventIndex]);
+                RunQueuedOutputWork(pmSession);
+                ProcessProcessEvent((*processEvents)[processEventIndex], isRecording);
                 processEventIndex += 1;
                 if (processEventIndex == processEventCount) {
                     checkProcessTime = false;
@@ -552,6 +974,7 @@ static void ProcessEvents(
         // Handle any recording toggles that occurred before this present
         if (checkRecordingToggle) {
             while ((*recordingToggleHistory)[recordingToggleIndex] < presentTime) {
+                RunQueuedOutputWork(pmSession);
                 ProcessRecordingToggle(&isRecording);
                 recordingToggleIndex += 1;
                 if (recordingToggleIndex == recordingToggleCount) {
@@ -566,41 +989,21 @@ static void ProcessEvents(
             continue;
         }
 
-        // If we are recording or presenting metrics to console then update the metrics and pending
-        // presents.  Otherwise, just update the latest present details in the chain.
-        //
-        // If there are more than one pending PresentEvents, then the first one is displayed and the
-        // rest aren't.  Otherwise, there will only be one (or zero) pending presents.
-        if (isRecording || computeAvg) {
-            if (args.mUseV1Metrics) {
-                ReportMetrics1(pmSession, processInfo, chain, presentEvent, isRecording, computeAvg);
-            } else {
-                auto numPendingPresents = chain->mPendingPresents.size();
-                if (numPendingPresents > 0) {
-                    if (presentEvent->FinalState == PresentResult::Presented) {
-                        size_t i = 1;
-                        for ( ; i < numPendingPresents; ++i) {
-                            ReportMetrics(pmSession, processInfo, chain, chain->mPendingPresents[i - 1], chain->mPendingPresents[i], presentEvent.get(), isRecording, computeAvg);
-                        }
-                        ReportMetrics(pmSession, processInfo, chain, chain->mPendingPresents[i - 1], presentEvent, presentEvent.get(), isRecording, computeAvg);
-                        chain->mPendingPresents.clear();
-                    } else {
-                        if (chain->mPendingPresents[0]->FinalState != PresentResult::Presented) {
-                            ReportMetrics(pmSession, processInfo, chain, chain->mPendingPresents[0], presentEvent, nullptr, isRecording, computeAvg);
-                            chain->mPendingPresents.clear();
-                        }
-                    }
-                }
-
-                chain->mPendingPresents.push_back(presentEvent);
-            }
+        if (queueWork) {
+            QueueOutputWork(processInfo, chain, presentEvent, isRecording);
+            presentTimeIsQueued = true;
         } else {
-            UpdateChain(chain, presentEvent);
+            ProcessPresent(pmSession, processInfo, chain, presentEvent, isRecording, computeAvg, nullptr);
         }
     }
 
+    auto queuedPresentTime = RunQueuedOutputWork(pmSession);
+    if (presentTimeIsQueued) {
+        presentTime = queuedPresentTime;
+    }
+
     // Prune any SwapChainData that hasn't seen an update for over 4 seconds.
-    PruneOldSwapChainData(pmSession, presentTime);
+    PruneOldSwapChainData(pmSession, presentTime, isRecording);
 
     // Erase any recording toggles and process events that were processed.
     if (recordingToggleIndex > 0) {
@@ -624,6 +1027,17 @@ void Output(PMTraceSession const* pmSession)
     processEvents.reserve(128);
     presentEvents.reserve(4096);
 
+    StartCsvWriterThread();
+    if (args.mOutputThreads > 1) {
+        StartOutputWorkers(pmSession);
+    }
+
+    // The loop wakes up as soon as presents are ready, so limit console
+    // updates to once every --console_update_period.
+    ULONGLONG const consoleUpdatePeriod = args.mConsoleUpdatePeriod;
+    ULONGLONG lastConsoleUpdateTime = 0;
+
+    bool currentRecordingState = false;
     for (;;) {
         // Read gQuit here, but then check it after processing queued events.
         // This ensures that we call Dequeue*() at least once after
@@ -631,7 +1045,7 @@ void Output(PMTraceSession const* pmSession)
         auto quit = gQuit;
 
         // Copy recording toggle history from MainThread
-        bool currentRecordingState = CopyRecordingToggleHistory(&recordingToggleHistory);
+        currentRecordingState = CopyRecordingToggleHistory(&recordingToggleHistory);
 
         // Copy process events, present events, and lost present events from ConsumerThread.
         UpdateProcessEvents(pmSession->mPMConsumer, &processEvents);
@@ -642,6 +1056,8 @@ void Output(PMTraceSession const* pmSession)
         if (!presentEvents.empty()) {
             ProcessEvents(*pmSession, presentEvents, &processEvents, &recordingToggleHistory, currentRecordingState);
             presentEvents.clear();
+
+            FlushCsv();
         }
 
         // Display information to console if requested.  If debug build and
@@ -650,7 +1066,13 @@ void Output(PMTraceSession const* pmSession)
         // gIsRecording is the real timeline recording state.  Because we're
         // just reading it without correlation to gRecordingToggleHistory, we
         // don't need the critical section.
-        switch (args.mConsoleOutput) {
+        auto consoleOutput = ConsoleOutput::None;
+        auto now = GetTickCount64();
+        if (now - lastConsoleUpdateTime >= consoleUpdatePeriod) {
+            lastConsoleUpdateTime = now;
+            consoleOutput = args.mConsoleOutput;
+        }
+        switch (consoleOutput) {
         #if _DEBUG
         case ConsoleOutput::Simple:
             if (currentRecordingState && args.mCSVOutput != CSVOutput::None) {
@@ -679,8 +1101,23 @@ void Output(PMTraceSession const* pmSession)
             break;
         }
 
-        // Sleep to reduce overhead.
-        Sleep(100);
+        // Wait until a batch of presents is ready, or a process event or
+        // recording toggle needs to be handled, or we're quitting (see
+        // InterruptWaitForPresentEvents()).  Partial batches are output after
+        // --max_output_latency, and the console is updated on time even if
+        // no presents are ready.
+        ULONGLONG timeout = args.mMaxOutputLatency;
+        if (args.mConsoleOutput == ConsoleOutput::Statistics) {
+            auto sinceConsoleUpdate = GetTickCount64() - lastConsoleUpdateTime;
+            timeout = std::min(timeout, sinceConsoleUpdate < consoleUpdatePeriod ? consoleUpdatePeriod - sinceConsoleUpdate : 0);
+        }
+        pmSession->mPMConsumer->WaitForPresentEvents((uint32_t) timeout, args.mMinOutputBatch);
+    }
+
+    // If recording hadn't stopped by the last processed present, write the summary now.
+    auto isRecording = recordingToggleHistory.size() & 1 ? !currentRecordingState : currentRecordingState;
+    if (isRecording && args.mSummaryFileName != nullptr) {
+        WriteSummary();
     }
 
     // Close all CSV and process handles
@@ -692,8 +1129,11 @@ void Output(PMTraceSession const* pmSession)
         CloseMultiCsv(processInfo);
     }
     CloseGlobalCsv();
+    StopOutputWorkers();
+    StopCsvWriterThread();
 
     gProcesses.clear();
+    gRetiredSummaries.clear();
 
     gRecordingToggleHistory.clear();
     gRecordingToggleHistory.shrink_to_fit();
@@ -702,6 +1142,7 @@ void Output(PMTraceSession const* pmSession)
 void StartOutputThread(PMTraceSession const& pmSession)
 {
     InitializeCriticalSection(&gRecordingToggleCS);
+    gPMConsumer = pmSession.mPMConsumer;
     gQuit = false;
     gThread = std::thread(Output, &pmSession); // Doesn't work to pass a reference, it makes a copy
 }
@@ -710,6 +1151,7 @@ void StopOutputThread()
 {
     if (gThread.joinable()) {
         gQuit = true;
+        gPMConsumer->InterruptWaitForPresentEvents();
         gThread.join();
 
         DeleteCriticalSection(&gRecordingToggleCS);
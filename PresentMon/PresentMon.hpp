@@ -26,8 +26,11 @@ collected data is written to the CSV file(s) is controlled by a recording state
 which is controlled from MainThread based on user input or timer.
 */
 
+#include "../PresentData/EventStream.hpp"
+#include "../PresentData/ParallelEtlAnalysis.hpp"
 #include "../PresentData/PresentMonTraceConsumer.hpp"
 #include "../PresentData/PresentMonTraceSession.hpp"
+#include "../PresentData/QuantileSketch.hpp"
 
 #include <unordered_map>
 
@@ -58,10 +61,21 @@ struct CommandLineArgs {
     std::vector<std::wstring> mExcludeProcessNames;
     const wchar_t *mOutputCsvFileName;
     const wchar_t *mEtlFileName;
+    const wchar_t *mEventStreamFileName;
+    const wchar_t *mReplayEventStreamFileName;
     const wchar_t *mSessionName;
+    const wchar_t *mSummaryFileName;
     UINT mTargetPid;
     UINT mDelay;
     UINT mTimer;
+    UINT mEtlAnalysisThreads;
+    UINT mEtlAnalysisChunkMs;
+    UINT mMemoryBudgetMB;
+    UINT mMaxOutputLatency;
+    UINT mMinOutputBatch;
+    UINT mOutputThreads;
+    UINT mCsvIndexRows;
+    UINT mConsoleUpdatePeriod;
     UINT mHotkeyModifiers;
     UINT mHotkeyVirtualKeyCode;
     TimeUnit mTimeUnit;
@@ -81,8 +95,11 @@ struct CommandLineArgs {
     bool mHotkeySupport;
     bool mTryToElevate;
     bool mMultiCsv;
+    bool mColumnarOutput;
     bool mUseV1Metrics;
     bool mStopExistingSession;
+    bool mNativeEtlReader;
+    bool mPrintConsumerStats;
 };
 
 // Metrics computed per-frame.  Duration and Latency metrics are in milliseconds.
@@ -111,11 +128,20 @@ struct FrameMetrics1 {
     double msSinceInput;
 };
 
+// Distributions of key per-frame metrics, used for the percentiles displayed in the console and
+// written to the --summary_file.  They are reset each time recording starts.
+struct SwapChainSummary {
+    QuantileSketch mCPUBusy;            // msBetweenPresents with --v1_metrics
+    QuantileSketch mGPUBusy;            // msGPUActive with --v1_metrics
+    QuantileSketch mDisplayedTime;      // msBetweenDisplayChange with --v1_metrics
+    QuantileSketch mDisplayLatency;     // msUntilDisplayed with --v1_metrics
+};
+
 // We store SwapChainData per process and per swapchain, where we maintain:
 // - information on previous presents needed for console output or to compute metrics for upcoming
 //   presents,
 // - pending presents whose metrics cannot be computed until future presents are received,
-// - exponential averages of key metrics displayed in console output.
+// - exponential averages and distributions of key metrics displayed in console output.
 struct SwapChainData {
     // Pending presents waiting for the next displayed present.
     std::vector<std::shared_ptr<PresentEvent>> mPendingPresents;
@@ -130,18 +156,25 @@ struct SwapChainData {
     // Whether to include frame data in the next PresentEvent's FrameMetrics.
     bool mIncludeFrameData = true;
 
+    // The PresentStartTime of the latest present queued for an output worker thread, or 0 if none
+    // are queued (only used with --output_threads).
+    uint64_t mQueuedPresentTime = 0;
+
     // Frame statistics
     float mAvgCPUDuration = 0.f;
     float mAvgGPUDuration = 0.f;
     float mAvgDisplayLatency = 0.f;
     float mAvgDisplayedTime = 0.f;
+    SwapChainSummary mSummary;
 };
 
+struct CsvFile;
+
 struct ProcessInfo {
     std::wstring mModuleName;
     std::unordered_map<uint64_t, SwapChainData> mSwapChain;
     HANDLE mHandle;
-    FILE* mOutputCsv;
+    CsvFile* mOutputCsv;
     bool mIsTargetProcess;
 };
 
@@ -163,17 +196,59 @@ int PrintWarning(wchar_t const* format, ...);
 int PrintError(wchar_t const* format, ...);
 
 // ConsumerThread.cpp:
-void StartConsumerThread(TRACEHANDLE traceHandle);
+void StartConsumerThread(PMTraceSession* pmSession);
 void WaitForConsumerThreadToExit();
 
 // CsvOutput.cpp:
+struct CsvWriterStats {
+    uint64_t mRowsWritten;
+    uint64_t mRowsDropped;          // Rows that could not be written to the file
+    uint64_t mBackPressureWaits;    // Number of times the output thread waited for the writer thread
+    uint64_t mBackPressureMs;       // Total time the output thread waited for the writer thread
+    uint64_t mPeakQueuedBytes;
+};
+
+void StartCsvWriterThread();
+void StopCsvWriterThread();
+void GetCsvWriterStats(CsvWriterStats* stats);
 void IncrementRecordingCount();
 void CloseMultiCsv(ProcessInfo* processInfo);
 void CloseGlobalCsv();
+void FlushCsv();
 const char* PresentModeToString(PresentMode mode);
 const char* RuntimeToString(Runtime rt);
-void UpdateCsv(PMTraceSession const& pmSession, ProcessInfo* processInfo, PresentEvent const& p, FrameMetrics const& metrics);
-void UpdateCsv(PMTraceSession const& pmSession, ProcessInfo* processInfo, PresentEvent const& p, FrameMetrics1 const& metrics);
+
+// If rowBuffer is not null, rows for the global CSV are formatted into it instead of being written
+// to the CSV.  They can then be appended to the CSV, in whatever order is required, with
+// AppendCsvRows().  This is how ProcessEvents() keeps the global CSV deterministic when metrics
+// are computed on several threads.
+void UpdateCsv(PMTraceSession const& pmSession, ProcessInfo* processInfo, PresentEvent const& p, FrameMetrics const& metrics, CsvFile* rowBuffer);
+void UpdateCsv(PMTraceSession const& pmSession, ProcessInfo* processInfo, PresentEvent const& p, FrameMetrics1 const& metrics, CsvFile* rowBuffer);
+
+struct CsvRowSpan {
+    CsvFile* mRowBuffer;
+    size_t mBegin;
+    size_t mEnd;
+    uint64_t mRowCount;
+    uint64_t mMinTimestamp;     // Range of the rows' timestamps, for the CSV index
+    uint64_t mMaxTimestamp;
+};
+
+CsvFile* CreateCsvRowBuffer();
+void DestroyCsvRowBuffer(CsvFile* rowBuffer);
+void ClearCsvRowBuffer(CsvFile* rowBuffer);
+void BeginCsvRowSpan(CsvFile* rowBuffer, CsvRowSpan* span);
+void EndCsvRowSpan(CsvRowSpan* span);
+void AppendCsvRows(PMTraceSession const& pmSession, ProcessInfo* processInfo, PresentEvent const& p, CsvRowSpan const& span);
+
+struct SwapChainSummaryRow {
+    std::wstring const* mModuleName;
+    uint32_t mProcessId;
+    uint64_t mSwapChainAddress;
+    SwapChainSummary const* mSummary;
+};
+
+void WriteSummaryFile(std::vector<SwapChainSummaryRow> const& rows);
 
 // MainThread.cpp:
 void ExitMainThread();
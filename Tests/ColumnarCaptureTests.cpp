@@ -0,0 +1,226 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include "PresentMonTests.h"
+#include "../PresentData/ColumnarCapture.hpp"
+
+#include <limits>
+
+namespace {
+
+uint32_t const ALL_COLUMNS = (1u << COLUMNAR_COLUMN_COUNT) - 1;
+
+// Encode frameCount frames, writing mOutput out whenever it gets large like PresentMon does.
+std::vector<char> EncodeCapture(uint32_t frameCount, std::vector<ColumnarFrame>* frames, std::vector<std::string>* strings)
+{
+    ColumnarFileHeader header = {};
+    header.mTimestampFrequency = 10000000;
+    header.mStartTimestamp = 1000;
+    header.mColumnMask = ALL_COLUMNS;
+
+    ColumnarCaptureWriter writer;
+    writer.Begin(header);
+
+    std::vector<char> file;
+    uint64_t cpuStart = 1000;
+    for (uint32_t i = 0; i < frameCount; ++i) {
+        char application[32];
+        sprintf_s(application, "app%u.exe", i / 1000);
+
+        ColumnarFrame f = {};
+        f.mApplication          = writer.GetStringIndex(application);
+        f.mProcessId            = 100 + i / 1000;
+        f.mSwapChainAddress     = 0x1234567800000000ull + i / 3000;
+        f.mPresentRuntime       = writer.GetStringIndex("DXGI");
+        f.mSyncInterval         = i % 5 == 0 ? -1 : 1;
+        f.mPresentFlags         = i % 2;
+        f.mAllowsTearing        = i % 2;
+        f.mPresentMode          = writer.GetStringIndex(i % 7 == 0 ? "Composed: Flip" : "Hardware: Independent Flip");
+        f.mFrameType            = writer.GetStringIndex("Application");
+        f.mCPUStart             = cpuStart;
+        f.mCPUBusy              = 0.25 * i;
+        f.mCPUWait              = 16.6667 - 0.001 * (i % 100);
+        f.mGPULatency           = 1.5;
+        f.mGPUBusy              = 10.0 + i % 3;
+        f.mGPUWait              = 0.125;
+        f.mVideoBusy            = 0.0;
+        f.mDisplayLatency       = 30.0 + 0.01 * i;
+        f.mDisplayedTime        = i % 4 == 0 ? 0.0 : 16.6667;
+        f.mClickToPhotonLatency = i % 50 == 0 ? 45.0 : 0.0;
+        writer.AddFrame(f);
+        frames->push_back(f);
+
+        // Timestamps are usually increasing, but shouldn't be relied on.
+        cpuStart = i % 100 == 99 ? cpuStart - 5000 : cpuStart + 166667 + i % 13;
+
+        if (writer.mOutput.size() >= 64 * 1024) {
+            file.insert(file.end(), writer.mOutput.begin(), writer.mOutput.end());
+            writer.mOutputOffset += writer.mOutput.size();
+            writer.mOutput.clear();
+        }
+    }
+
+    writer.End();
+    file.insert(file.end(), writer.mOutput.begin(), writer.mOutput.end());
+    *strings = writer.mStrings;
+    return file;
+}
+
+void ExpectSameFrame(ColumnarCaptureReader const& reader, std::vector<std::string> const& strings, ColumnarFrame const& a, ColumnarFrame const& b)
+{
+    EXPECT_STREQ(reader.GetString(a.mApplication), strings[b.mApplication].c_str());
+    EXPECT_EQ(a.mProcessId, b.mProcessId);
+    EXPECT_EQ(a.mSwapChainAddress, b.mSwapChainAddress);
+    EXPECT_STREQ(reader.GetString(a.mPresentRuntime), strings[b.mPresentRuntime].c_str());
+    EXPECT_EQ(a.mSyncInterval, b.mSyncInterval);
+    EXPECT_EQ(a.mPresentFlags, b.mPresentFlags);
+    EXPECT_EQ(a.mAllowsTearing, b.mAllowsTearing);
+    EXPECT_STREQ(reader.GetString(a.mPresentMode), strings[b.mPresentMode].c_str());
+    EXPECT_STREQ(reader.GetString(a.mFrameType), strings[b.mFrameType].c_str());
+    EXPECT_EQ(a.mCPUStart, b.mCPUStart);
+    EXPECT_EQ(a.mCPUBusy, b.mCPUBusy);
+    EXPECT_EQ(a.mCPUWait, b.mCPUWait);
+    EXPECT_EQ(a.mGPULatency, b.mGPULatency);
+    EXPECT_EQ(a.mGPUBusy, b.mGPUBusy);
+    EXPECT_EQ(a.mGPUWait, b.mGPUWait);
+    EXPECT_EQ(a.mVideoBusy, b.mVideoBusy);
+    EXPECT_EQ(a.mDisplayLatency, b.mDisplayLatency);
+    EXPECT_EQ(a.mDisplayedTime, b.mDisplayedTime);
+    EXPECT_EQ(a.mClickToPhotonLatency, b.mClickToPhotonLatency);
+}
+
+}
+
+TEST(ColumnarCaptureTests, RoundTrip)
+{
+    std::vector<ColumnarFrame> expected;
+    std::vector<std::string> strings;
+    auto file = EncodeCapture(3 * COLUMNAR_CHUNK_FRAMES + 100, &expected, &strings);
+
+    ColumnarCaptureReader reader;
+    ASSERT_TRUE(reader.Open(std::move(file)));
+    EXPECT_TRUE(reader.mHasFooter);
+    EXPECT_EQ(reader.mHeader.mTimestampFrequency, 10000000ull);
+    EXPECT_EQ(reader.mHeader.mColumnMask, ALL_COLUMNS);
+    ASSERT_EQ(reader.mChunks.size(), 4u);
+
+    std::vector<ColumnarFrame> frames;
+    size_t frameIndex = 0;
+    for (size_t i = 0; i < reader.mChunks.size(); ++i) {
+        ASSERT_TRUE(reader.ReadChunk(i, &frames));
+        ASSERT_EQ(frames.size(), reader.mChunks[i].mFrameCount);
+        for (auto const& f : frames) {
+            ASSERT_LT(frameIndex, expected.size());
+            ExpectSameFrame(reader, strings, f, expected[frameIndex]);
+            frameIndex += 1;
+        }
+    }
+    EXPECT_EQ(frameIndex, expected.size());
+
+    auto const& lastFrame = expected[2 * COLUMNAR_CHUNK_FRAMES + 10];
+    auto chunkIndex = reader.FindChunk(lastFrame.mCPUStart);
+    EXPECT_LE(chunkIndex, 2u);
+    EXPECT_GE(reader.mChunks[chunkIndex].mMaxCPUStart, lastFrame.mCPUStart);
+}
+
+TEST(ColumnarCaptureTests, MissingColumns)
+{
+    ColumnarFileHeader header = {};
+    header.mTimestampFrequency = 10000000;
+    header.mColumnMask = (1u << COLUMNAR_PROCESS_ID) | (1u << COLUMNAR_CPU_START) | (1u << COLUMNAR_CPU_BUSY);
+
+    ColumnarCaptureWriter writer;
+    writer.Begin(header);
+
+    ColumnarFrame f = {};
+    f.mProcessId = 10;
+    f.mCPUStart = 12345;
+    f.mCPUBusy = 1.25;
+    f.mGPUBusy = 2.5;
+    writer.AddFrame(f);
+    writer.End();
+
+    ColumnarCaptureReader reader;
+    ASSERT_TRUE(reader.Open(std::move(writer.mOutput)));
+    std::vector<ColumnarFrame> frames;
+    ASSERT_TRUE(reader.ReadChunk(0, &frames));
+    ASSERT_EQ(frames.size(), 1u);
+    EXPECT_EQ(frames[0].mProcessId, 10u);
+    EXPECT_EQ(frames[0].mCPUStart, 12345ull);
+    EXPECT_EQ(frames[0].mCPUBusy, 1.25);
+    EXPECT_EQ(frames[0].mGPUBusy, 0.0);
+}
+
+// Metrics computed from a tick count should take a few bytes each, and any other double (including
+// ones that aren't a whole number of ticks, negative zero, infinities, and NaNs) should round trip
+// exactly.
+TEST(ColumnarCaptureTests, Metrics)
+{
+    ColumnarFileHeader header = {};
+    header.mTimestampFrequency = 10000000;
+    header.mColumnMask = (1u << COLUMNAR_CPU_START) | (1u << COLUMNAR_CPU_BUSY) | (1u << COLUMNAR_GPU_WAIT);
+
+    double const unusual[] = {
+        -0.0, -1.5, 1e300, -1e300, 5e-324, 0.1 + 0.2,
+        std::numeric_limits<double>::infinity(),
+        -std::numeric_limits<double>::infinity(),
+        std::numeric_limits<double>::quiet_NaN(),
+    };
+    uint32_t const frameCount = 1000;
+
+    ColumnarCaptureWriter writer;
+    writer.Begin(header);
+    std::vector<ColumnarFrame> expected;
+    for (uint32_t i = 0; i < frameCount; ++i) {
+        ColumnarFrame f = {};
+        f.mCPUStart = 1000 + 166667ull * i;
+        f.mCPUBusy  = 1000.0 * (150000 + i * 37 % 5000) / header.mTimestampFrequency;
+        f.mGPUWait  = i < _countof(unusual) ? unusual[i] : 1000.0 * (i % 7) / header.mTimestampFrequency;
+        writer.AddFrame(f);
+        expected.push_back(f);
+    }
+    writer.End();
+
+    // Stored raw, CPUBusy and GPUWait would take 16 bytes per frame.
+    EXPECT_LT(writer.mOutput.size(), 8u * frameCount);
+
+    ColumnarCaptureReader reader;
+    ASSERT_TRUE(reader.Open(std::move(writer.mOutput)));
+    std::vector<ColumnarFrame> frames;
+    ASSERT_TRUE(reader.ReadChunk(0, &frames));
+    ASSERT_EQ(frames.size(), (size_t) frameCount);
+    for (uint32_t i = 0; i < frameCount; ++i) {
+        EXPECT_EQ(memcmp(&frames[i].mCPUBusy, &expected[i].mCPUBusy, sizeof(double)), 0) << i;
+        EXPECT_EQ(memcmp(&frames[i].mGPUWait, &expected[i].mGPUWait, sizeof(double)), 0) << i;
+    }
+}
+
+TEST(ColumnarCaptureTests, Truncated)
+{
+    std::vector<ColumnarFrame> expected;
+    std::vector<std::string> strings;
+    auto file = EncodeCapture(3 * COLUMNAR_CHUNK_FRAMES, &expected, &strings);
+
+    // Chop the file in the middle of the third chunk, as if PresentMon was terminated.
+    ColumnarCaptureReader complete;
+    ASSERT_TRUE(complete.Open(std::vector<char>(file)));
+    ASSERT_EQ(complete.mChunks.size(), 3u);
+    file.resize((size_t) complete.mChunks[2].mOffset + complete.mChunks[2].mSize / 2);
+
+    ColumnarCaptureReader reader;
+    ASSERT_TRUE(reader.Open(std::move(file)));
+    EXPECT_FALSE(reader.mHasFooter);
+    ASSERT_EQ(reader.mChunks.size(), 2u);
+
+    std::vector<ColumnarFrame> frames;
+    ASSERT_TRUE(reader.ReadChunk(1, &frames));
+    ASSERT_EQ(frames.size(), (size_t) COLUMNAR_CHUNK_FRAMES);
+    ExpectSameFrame(reader, strings, frames.back(), expected[2 * COLUMNAR_CHUNK_FRAMES - 1]);
+}
+
+TEST(ColumnarCaptureTests, InvalidHeader)
+{
+    std::vector<char> data(256, 'x');
+    ColumnarCaptureReader reader;
+    EXPECT_FALSE(reader.Open(std::move(data)));
+}
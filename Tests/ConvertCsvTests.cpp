@@ -0,0 +1,207 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include "PresentMonTests.h"
+
+#include <algorithm>
+
+namespace {
+
+struct TestArgs {
+    std::wstring goldCsv_;
+    std::wstring name_;     // The gold CSV's file name, without ".csv"
+};
+
+// Runs pm_convert_csv with the given arguments, and expects it to succeed.
+void RunConvertCsv(char const* file, int line, std::wstring const& args)
+{
+    std::wstring cmdline;
+    cmdline += L'\"';
+    cmdline += convertCsvExePath_;
+    cmdline += L"\" ";
+    cmdline += args;
+
+    STARTUPINFO si = {};
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESTDHANDLES;
+
+    PROCESS_INFORMATION pi = {};
+    if (CreateProcess(nullptr, &cmdline[0], nullptr, nullptr, TRUE, 0, nullptr, nullptr, &si, &pi) == 0) {
+        AddTestFailure(file, line, "Failed to start pm_convert_csv");
+        return;
+    }
+
+    DWORD exitCode = 0;
+    WaitForSingleObject(pi.hProcess, INFINITE);
+    GetExitCodeProcess(pi.hProcess, &exitCode);
+    CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+
+    if (exitCode != 0) {
+        AddTestFailure(file, line, "pm_convert_csv exited with %u: %ls", exitCode, cmdline.c_str());
+    }
+}
+
+#define CONVERTCSV(_A) RunConvertCsv(__FILE__, __LINE__, _A)
+
+// Writes a copy of the CSV at srcPath to dstPath, without the column named by removeHeader.
+bool CopyCsvWithoutColumn(std::wstring const& srcPath, std::wstring const& dstPath, char const* removeHeader)
+{
+    CsvReader csv;
+    if (!csv.Open(srcPath.c_str())) {
+        AddTestFailure(__FILE__, __LINE__, "Failed to open file: %ls", srcPath.c_str());
+        return false;
+    }
+
+    FILE* fp = nullptr;
+    if (_wfopen_s(&fp, dstPath.c_str(), L"wb") != 0) {
+        AddTestFailure(__FILE__, __LINE__, "Failed to create file: %ls", dstPath.c_str());
+        return false;
+    }
+
+    auto removeIndex = SIZE_MAX;
+    std::string row;
+    while (csv.ReadRow()) {
+        if (csv.mLine == 1) {
+            for (size_t i = 0, n = csv.mFields.size(); i < n; ++i) {
+                if (csv.mFields[i] == removeHeader) {
+                    removeIndex = i;
+                }
+            }
+        }
+
+        row.clear();
+        for (size_t i = 0, n = csv.mFields.size(); i < n; ++i) {
+            if (i != removeIndex) {
+                if (!row.empty()) {
+                    row += ',';
+                }
+                row.append(csv.mFields[i].mData, csv.mFields[i].mSize);
+            }
+        }
+        row += '\n';
+        fwrite(row.data(), 1, row.size(), fp);
+    }
+
+    fclose(fp);
+    return !csv.mError;
+}
+
+bool ReadWholeFile(std::wstring const& path, std::vector<char>* data)
+{
+    FILE* fp = nullptr;
+    if (_wfopen_s(&fp, path.c_str(), L"rb") != 0) {
+        AddTestFailure(__FILE__, __LINE__, "Failed to open file: %ls", path.c_str());
+        return false;
+    }
+
+    data->clear();
+    char buffer[64 * 1024];
+    for (size_t n; (n = fread(buffer, 1, sizeof(buffer), fp)) > 0; ) {
+        data->insert(data->end(), buffer, buffer + n);
+    }
+
+    fclose(fp);
+    return true;
+}
+
+// Check that converting a v1 CSV with --split, dividing its swap chains between several threads,
+// writes exactly the same file as converting it on one thread.  The gold v1 CSVs have a QPCTime
+// column, so each is also converted with that column removed.
+class Tests : public ::testing::Test, TestArgs {
+public:
+    explicit Tests(TestArgs const& args)
+    {
+        TestArgs::operator=(args);
+    }
+
+    void CheckSplit(std::wstring const& inputCsv, std::wstring const& name)
+    {
+        auto sequentialDir = outDir_ + L"convert\\sequential";
+        auto splitDir      = outDir_ + L"convert\\split";
+        auto sequentialCsv = sequentialDir + L'\\' + name + L"_v2.csv";
+        auto splitCsv      = splitDir + L'\\' + name + L"_v2.csv";
+        if (!EnsureDirectoryCreated(sequentialDir) || !EnsureDirectoryCreated(splitDir)) {
+            AddTestFailure(__FILE__, __LINE__, "Output directory does not exist!");
+            return;
+        }
+        DeleteFile(sequentialCsv.c_str());
+        DeleteFile(splitCsv.c_str());
+
+        CONVERTCSV(L"--threads 1 --output_dir \"" + sequentialDir + L"\" \"" + inputCsv + L"\"");
+        CONVERTCSV(L"--split --threads 4 --output_dir \"" + splitDir + L"\" \"" + inputCsv + L"\"");
+
+        std::vector<char> expected;
+        std::vector<char> actual;
+        if (!ReadWholeFile(sequentialCsv, &expected) || !ReadWholeFile(splitCsv, &actual)) {
+            return;
+        }
+
+        EXPECT_FALSE(expected.empty()) << Convert(sequentialCsv);
+        if (expected != actual) {
+            auto mismatch = std::mismatch(expected.begin(), expected.end(), actual.begin(), actual.end());
+            auto line = 1 + std::count(expected.begin(), mismatch.first, '\n');
+            AddTestFailure(__FILE__, __LINE__, "--split output differs on line %zu", (size_t) line);
+            printf("SEQUENTIAL = %ls\n", sequentialCsv.c_str());
+            printf("SPLIT      = %ls\n", splitCsv.c_str());
+        }
+    }
+
+    void TestBody() override
+    {
+        CheckSplit(goldCsv_, name_);
+
+        auto noQpcTimeDir = outDir_ + L"convert\\input";
+        auto noQpcTimeCsv = noQpcTimeDir + L'\\' + name_ + L"_no_qpc_time.csv";
+        if (!EnsureDirectoryCreated(noQpcTimeDir)) {
+            AddTestFailure(__FILE__, __LINE__, "Output directory does not exist!");
+            return;
+        }
+        if (CopyCsvWithoutColumn(goldCsv_, noQpcTimeCsv, "QPCTime")) {
+            CheckSplit(noQpcTimeCsv, name_ + L"_no_qpc_time");
+        }
+    }
+};
+
+}
+
+void AddConvertCsvTests(
+    std::wstring const& dir)
+{
+    WIN32_FIND_DATA ff = {};
+    auto h = FindFirstFile((dir + L'*').c_str(), &ff);
+    if (h == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    do
+    {
+        if (ff.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            if (wcscmp(ff.cFileName, L".") == 0) continue;
+            if (wcscmp(ff.cFileName, L"..") == 0) continue;
+            AddConvertCsvTests(dir + ff.cFileName + L'\\');
+        } else {
+            // Add a test for each v1 CSV (filename_v1.csv)
+            auto len = wcslen(ff.cFileName);
+            if (len >= 7 && _wcsicmp(ff.cFileName + len - 7, L"_v1.csv") == 0) {
+                TestArgs args;
+                args.goldCsv_ = dir + ff.cFileName;
+                args.name_    = std::wstring(ff.cFileName, len - 4);
+
+                // Replace any '-' characters in the name, as they will screw up googletest
+                // filters.
+                std::string name(Convert(args.name_));
+                for (auto& ch : name) {
+                    if (ch == '-') {
+                        ch = '_';
+                    }
+                }
+
+                ::testing::RegisterTest(
+                    "ConvertCsvSplitTests", name.c_str(), nullptr, nullptr, __FILE__, __LINE__,
+                    [=]() -> ::testing::Test* { return new Tests(std::move(args)); });
+            }
+        }
+    } while (FindNextFile(h, &ff) != 0);
+
+    FindClose(h);
+}
@@ -0,0 +1,235 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include "PresentMonTests.h"
+#include "../PresentData/CsvIndex.hpp"
+
+namespace {
+
+struct IndexedRow {
+    uint64_t mOffset;
+    uint64_t mTimestamp;
+    uint32_t mProcessId;
+    uint64_t mSwapChainAddress;
+};
+
+// Add rows for three swap chains of two processes, in runs of one to three rows of the same swap
+// chain like PresentMon does.  Timestamps mostly increase.
+std::vector<IndexedRow> AddRows(CsvIndexWriter* writer, uint32_t rowCount)
+{
+    std::vector<IndexedRow> rows;
+    uint64_t offset = 100;
+    for (uint32_t i = 0; i < rowCount; ) {
+        auto runLength = std::min(1 + i % 3, rowCount - i);
+        auto processId = i % 5 == 0 ? 20u : 10u;
+        auto swapChainAddress = processId == 10 && i % 2 == 0 ? 0x1000ull : 0x2000ull;
+
+        uint64_t minTimestamp = UINT64_MAX;
+        uint64_t maxTimestamp = 0;
+        for (uint32_t j = 0; j < runLength; ++j) {
+            IndexedRow row = {};
+            row.mOffset = offset;
+            row.mTimestamp = 1000 + 100 * (i + j) - (i % 10 == 9 ? 150 : 0);
+            row.mProcessId = processId;
+            row.mSwapChainAddress = swapChainAddress;
+            rows.push_back(row);
+
+            offset += 50 + i % 7;
+            minTimestamp = std::min(minTimestamp, row.mTimestamp);
+            maxTimestamp = std::max(maxTimestamp, row.mTimestamp);
+        }
+
+        writer->AddRows(rows[i].mOffset, runLength, minTimestamp, maxTimestamp, processId, swapChainAddress);
+        i += runLength;
+    }
+    return rows;
+}
+
+// The blocks that FindBlocks() returns should include every row that matches the query.
+void ExpectRowsFound(CsvIndexReader const& reader, std::vector<IndexedRow> const& rows, CsvIndexQuery const& query)
+{
+    std::vector<uint32_t> blocks;
+    reader.FindBlocks(query, &blocks);
+    for (size_t i = 1; i < blocks.size(); ++i) {
+        EXPECT_LT(blocks[i - 1], blocks[i]);
+    }
+
+    std::vector<bool> rowFound(rows.size(), false);
+    for (auto b : blocks) {
+        auto const& block = reader.mBlocks[b];
+        for (uint32_t i = 0; i < block.mRowCount; ++i) {
+            rowFound[block.mFirstRow + i] = true;
+        }
+    }
+
+    for (size_t i = 0; i < rows.size(); ++i) {
+        auto const& row = rows[i];
+        auto matches = row.mTimestamp >= query.mBeginTimestamp &&
+                       row.mTimestamp <= query.mEndTimestamp &&
+                       (query.mProcessId        == CSV_INDEX_ANY_PROCESS    || query.mProcessId        == row.mProcessId) &&
+                       (query.mSwapChainAddress == CSV_INDEX_ANY_SWAP_CHAIN || query.mSwapChainAddress == row.mSwapChainAddress);
+        if (matches) {
+            EXPECT_TRUE(rowFound[i]) << "row " << i;
+        }
+    }
+}
+
+}
+
+TEST(CsvIndexTests, WriteAndRead)
+{
+    CsvIndexWriter writer;
+    writer.Begin(10000000, 1000, 8);
+    auto rows = AddRows(&writer, 1000);
+    std::vector<char> data;
+    writer.End(123456, &data);
+
+    CsvIndexReader reader;
+    ASSERT_TRUE(reader.Open(data));
+    EXPECT_EQ(reader.mHeader.mTimestampFrequency, 10000000u);
+    EXPECT_EQ(reader.mHeader.mStartTimestamp, 1000u);
+    EXPECT_EQ(reader.mHeader.mCsvSize, 123456u);
+    EXPECT_EQ(reader.mHeader.mRowCount, 1000u);
+    EXPECT_EQ(reader.mSwapChains.size(), 3u);
+
+    // Blocks are filled up to mRowsPerBlock, but runs of rows aren't split.
+    uint64_t rowCount = 0;
+    for (auto const& block : reader.mBlocks) {
+        EXPECT_EQ(block.mFirstRow, rowCount);
+        EXPECT_EQ(block.mOffset, rows[block.mFirstRow].mOffset);
+        EXPECT_GE(block.mRowCount, 1u);
+        EXPECT_LE(block.mRowCount, 8u + 2u);
+        rowCount += block.mRowCount;
+    }
+    EXPECT_EQ(rowCount, 1000u);
+
+    CsvIndexQuery query;
+    ExpectRowsFound(reader, rows, query);
+    std::vector<uint32_t> blocks;
+    reader.FindBlocks(query, &blocks);
+    EXPECT_EQ(blocks.size(), reader.mBlocks.size());
+
+    query.mBeginTimestamp = 20000;
+    query.mEndTimestamp = 30000;
+    ExpectRowsFound(reader, rows, query);
+    reader.FindBlocks(query, &blocks);
+    EXPECT_LT(blocks.size(), reader.mBlocks.size() / 5);
+
+    query.mProcessId = 20;
+    ExpectRowsFound(reader, rows, query);
+    query.mSwapChainAddress = 0x1000;
+    reader.FindBlocks(query, &blocks);
+    EXPECT_TRUE(blocks.empty());
+
+    query = CsvIndexQuery();
+    query.mSwapChainAddress = 0x2000;
+    ExpectRowsFound(reader, rows, query);
+    query.mProcessId = 10;
+    ExpectRowsFound(reader, rows, query);
+    query.mBeginTimestamp = 200000;
+    reader.FindBlocks(query, &blocks);
+    EXPECT_TRUE(blocks.empty());
+
+    EXPECT_EQ(reader.MilliSecondsToTimestamp(0.0), 1000u);
+    EXPECT_EQ(reader.MilliSecondsToTimestamp(2.5), 26000u);
+    EXPECT_EQ(reader.MilliSecondsToTimestamp(-1000.0), 0u);
+    EXPECT_EQ(reader.TimestampToMilliSeconds(26000), 2.5);
+    EXPECT_EQ(reader.TimestampToMilliSeconds(0), -0.1);
+}
+
+TEST(CsvIndexTests, InvalidIndex)
+{
+    CsvIndexWriter writer;
+    writer.Begin(10000000, 0, 4);
+    AddRows(&writer, 100);
+    std::vector<char> data;
+    writer.End(5000, &data);
+
+    CsvIndexReader reader;
+    ASSERT_TRUE(reader.Open(data));
+    auto swapChainCount = (uint32_t) reader.mSwapChains.size();
+
+    EXPECT_FALSE(reader.Open(std::vector<char>()));
+    EXPECT_FALSE(reader.Open(std::vector<char>(data.begin(), data.begin() + sizeof(CsvIndexHeader))));
+    EXPECT_FALSE(reader.Open(std::vector<char>(data.begin(), data.end() - 1)));
+
+    auto copy = data;
+    copy.push_back(0);
+    EXPECT_FALSE(reader.Open(copy));
+
+    copy = data;
+    copy[0] = 'X';
+    EXPECT_FALSE(reader.Open(copy));
+
+    // Swap chain list entries must refer to a swap chain.
+    copy = data;
+    memcpy(copy.data() + copy.size() - sizeof(uint32_t), &swapChainCount, sizeof(uint32_t));
+    EXPECT_FALSE(reader.Open(copy));
+
+    // Blocks' swap chain lists must be within the lists.
+    copy = data;
+    auto blockOffset = sizeof(CsvIndexHeader) + swapChainCount * sizeof(CsvIndexSwapChain);
+    auto block = (CsvIndexBlock*) (copy.data() + blockOffset);
+    block->mSwapChainListCount = 1000000;
+    EXPECT_FALSE(reader.Open(copy));
+}
+
+// Write a CSV and its index, and read the rows of one swap chain by seeking to the blocks that the
+// index finds.
+TEST(CsvIndexTests, SeekCsv)
+{
+    ASSERT_TRUE(EnsureDirectoryCreated(outDir_));
+    auto path = outDir_ + L"CsvIndexTests.csv";
+
+    FILE* fp = nullptr;
+    ASSERT_EQ(_wfopen_s(&fp, path.c_str(), L"wb"), 0);
+    CsvIndexWriter writer;
+    writer.Begin(1000, 0, 64);
+    uint64_t offset = (uint64_t) fprintf(fp, "ProcessID,SwapChainAddress,TimeInMs\n");
+    uint32_t expectedCount = 0;
+    for (uint32_t i = 0; i < 10000; ++i) {
+        auto processId = i % 17 == 0 ? 2u : 1u;
+        auto timestamp = (uint64_t) i;
+        writer.AddRows(offset, 1, timestamp, timestamp, processId, 0x1000);
+        offset += (uint64_t) fprintf(fp, "%u,0x%016llX,%llu\n", processId, 0x1000ull, timestamp);
+        expectedCount += processId == 2 && timestamp >= 5000 ? 1 : 0;
+    }
+    fclose(fp);
+
+    std::vector<char> data;
+    writer.End(offset, &data);
+    CsvIndexReader reader;
+    ASSERT_TRUE(reader.Open(data));
+
+    CsvIndexQuery query;
+    query.mProcessId = 2;
+    query.mBeginTimestamp = reader.MilliSecondsToTimestamp(5000.0);
+    std::vector<uint32_t> blocks;
+    reader.FindBlocks(query, &blocks);
+    EXPECT_LE(blocks.size(), reader.mBlocks.size() / 2 + 1);
+
+    CsvReader csv;
+    ASSERT_TRUE(csv.Open(path.c_str()));
+    EXPECT_EQ(csv.mFileSize, reader.mHeader.mCsvSize);
+    uint32_t count = 0;
+    for (auto b : blocks) {
+        auto const& block = reader.mBlocks[b];
+        ASSERT_TRUE(csv.Seek(block.mOffset, block.mFirstRow + 2));
+        for (uint32_t i = 0; i < block.mRowCount; ++i) {
+            ASSERT_TRUE(csv.ReadRow());
+            ASSERT_EQ(csv.mFields.size(), 3u);
+            EXPECT_EQ(csv.mLine, block.mFirstRow + i + 2);
+
+            uint32_t processId = 0;
+            uint64_t timestamp = 0;
+            EXPECT_TRUE(csv.mFields[0].ParseUInt32(&processId));
+            EXPECT_TRUE(csv.mFields[2].ParseUInt64(&timestamp));
+            EXPECT_EQ(timestamp, block.mFirstRow + i);
+            count += processId == 2 && timestamp >= 5000 ? 1 : 0;
+        }
+    }
+    EXPECT_EQ(count, expectedCount);
+    csv.Close();
+
+    DeleteFileW(path.c_str());
+}
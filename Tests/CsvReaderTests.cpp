@@ -0,0 +1,166 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include "PresentMonTests.h"
+#include "../PresentData/CsvReader.hpp"
+
+namespace {
+
+std::vector<char> ToVector(char const* s)
+{
+    return std::vector<char>(s, s + strlen(s));
+}
+
+void ExpectRow(CsvReader* csv, std::initializer_list<char const*> const& fields)
+{
+    ASSERT_TRUE(csv->ReadRow());
+    ASSERT_EQ(csv->mFields.size(), fields.size());
+    size_t i = 0;
+    for (auto field : fields) {
+        EXPECT_EQ(csv->mFields[i].ToString(), field) << "line " << csv->mLine << " field " << i;
+        i += 1;
+    }
+}
+
+}
+
+TEST(CsvReaderTests, Rows)
+{
+    CsvReader csv;
+    ASSERT_TRUE(csv.Open(ToVector("\xef\xbb\xbf" "Application,ProcessID,SwapChainAddress\r\n"
+                                  "a.exe,10,0x0000000000001234\r\n"
+                                  ",,\n"
+                                  "a much longer application name.exe,12345678,0x00000000ABCDEF00,1,2,3,4,5,6,7,8,9,10\n"
+                                  "\n"
+                                  "last,row")));
+    ExpectRow(&csv, { "Application", "ProcessID", "SwapChainAddress" });
+    ExpectRow(&csv, { "a.exe", "10", "0x0000000000001234" });
+    EXPECT_EQ(csv.mRowOffset, 43u);
+    ExpectRow(&csv, { "", "", "" });
+    ExpectRow(&csv, { "a much longer application name.exe", "12345678", "0x00000000ABCDEF00", "1", "2", "3", "4", "5", "6", "7", "8", "9", "10" });
+    ExpectRow(&csv, { "" });
+    ExpectRow(&csv, { "last", "row" });
+    EXPECT_EQ(csv.mLine, 6u);
+    EXPECT_FALSE(csv.ReadRow());
+    EXPECT_FALSE(csv.mError);
+}
+
+TEST(CsvReaderTests, ParseIntegers)
+{
+    auto field = [](char const* s) { return CsvField{ s, strlen(s) }; };
+
+    uint32_t u32 = 0;
+    EXPECT_TRUE(field("4294967295").ParseUInt32(&u32));
+    EXPECT_EQ(u32, 4294967295u);
+    EXPECT_FALSE(field("4294967296").ParseUInt32(&u32));
+    EXPECT_FALSE(field("").ParseUInt32(&u32));
+    EXPECT_FALSE(field("NA").ParseUInt32(&u32));
+    EXPECT_FALSE(field("12 ").ParseUInt32(&u32));
+
+    int32_t i32 = 0;
+    EXPECT_TRUE(field("-1").ParseInt32(&i32));
+    EXPECT_EQ(i32, -1);
+    EXPECT_TRUE(field("-2147483648").ParseInt32(&i32));
+    EXPECT_EQ(i32, INT32_MIN);
+    EXPECT_FALSE(field("2147483648").ParseInt32(&i32));
+    EXPECT_FALSE(field("-").ParseInt32(&i32));
+
+    uint64_t u64 = 0;
+    EXPECT_TRUE(field("18446744073709551615").ParseUInt64(&u64));
+    EXPECT_EQ(u64, UINT64_MAX);
+    EXPECT_FALSE(field("18446744073709551616").ParseUInt64(&u64));
+    EXPECT_TRUE(field("0x00000000ABCDEF09").ParseHex(&u64));
+    EXPECT_EQ(u64, 0xABCDEF09ull);
+    EXPECT_TRUE(field("ffffffffffffffff").ParseHex(&u64));
+    EXPECT_EQ(u64, UINT64_MAX);
+    EXPECT_FALSE(field("0x").ParseHex(&u64));
+    EXPECT_FALSE(field("0x1g").ParseHex(&u64));
+}
+
+TEST(CsvReaderTests, ParseDouble)
+{
+    auto field = [](char const* s) { return CsvField{ s, strlen(s) }; };
+
+    double d = 0.0;
+    EXPECT_FALSE(field("").ParseDouble(&d));
+    EXPECT_FALSE(field("NA").ParseDouble(&d));
+    EXPECT_FALSE(field("-").ParseDouble(&d));
+    EXPECT_FALSE(field("1.5ms").ParseDouble(&d));
+    EXPECT_TRUE(field("-0.000000").ParseDouble(&d));
+    EXPECT_EQ(d, 0.0);
+    EXPECT_TRUE(field("1e-3").ParseDouble(&d));
+    EXPECT_EQ(d, 0.001);
+
+    // Values should be parsed exactly as strtod() does, in the formats PresentMon uses and others.
+    char const* formats[] = { "%.4lf", "%.6lf", "%.9lf", "%.17g", "%lg" };
+    uint64_t x = 0x9e3779b97f4a7c15ull;
+    for (uint32_t i = 0; i < 100000; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        auto value = (double) (x >> 11) / (double) (1ull << (x % 64));
+
+        char s[64];
+        sprintf_s(s, formats[i % _countof(formats)], i % 3 == 0 ? -value : value);
+        ASSERT_TRUE(field(s).ParseDouble(&d)) << s;
+        ASSERT_EQ(d, strtod(s, nullptr)) << s;
+    }
+}
+
+TEST(CsvReaderTests, FileViews)
+{
+    ASSERT_TRUE(EnsureDirectoryCreated(outDir_));
+    auto path = outDir_ + L"CsvReaderTests.csv";
+
+    // Write enough rows to need several views, some of which will start in the middle of a row.
+    FILE* fp = nullptr;
+    ASSERT_EQ(_wfopen_s(&fp, path.c_str(), L"wb"), 0);
+    std::vector<uint64_t> rowOffsets;
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < 20000; ++i) {
+        rowOffsets.push_back(offset);
+        offset += (uint64_t) fprintf(fp, "app%u.exe,%u,0x%016llX,%.4lf\n", i % 7, i, 0x1000ull * i, i * 0.25);
+    }
+    fclose(fp);
+
+    CsvReader csv;
+    csv.mMaxViewSize = 64 * 1024;
+    ASSERT_TRUE(csv.Open(path.c_str()));
+    EXPECT_EQ(csv.mFileSize, offset);
+    for (uint32_t i = 0; i < 20000; ++i) {
+        ASSERT_TRUE(csv.ReadRow());
+        ASSERT_EQ(csv.mFields.size(), 4u);
+        EXPECT_EQ(csv.mRowOffset, rowOffsets[i]);
+
+        uint32_t processId = 0;
+        uint64_t address = 0;
+        double time = 0.0;
+        EXPECT_TRUE(csv.mFields[1].ParseUInt32(&processId));
+        EXPECT_TRUE(csv.mFields[2].ParseHex(&address));
+        EXPECT_TRUE(csv.mFields[3].ParseDouble(&time));
+        EXPECT_EQ(processId, i);
+        EXPECT_EQ(address, 0x1000ull * i);
+        EXPECT_EQ(time, i * 0.25);
+    }
+    EXPECT_FALSE(csv.ReadRow());
+    EXPECT_FALSE(csv.mError);
+
+    // Seek back to rows in earlier views, and to the end of the file.
+    for (uint32_t i : { 19999u, 0u, 12345u, 1u }) {
+        ASSERT_TRUE(csv.Seek(rowOffsets[i], i + 1));
+        ASSERT_TRUE(csv.ReadRow());
+        EXPECT_EQ(csv.mLine, i + 1);
+        EXPECT_EQ(csv.mRowOffset, rowOffsets[i]);
+
+        uint32_t processId = 0;
+        EXPECT_TRUE(csv.mFields[1].ParseUInt32(&processId));
+        EXPECT_EQ(processId, i);
+    }
+    ASSERT_TRUE(csv.Seek(offset, 20001));
+    EXPECT_FALSE(csv.ReadRow());
+    EXPECT_FALSE(csv.Seek(offset + 1, 20002));
+    EXPECT_FALSE(csv.mError);
+    csv.Close();
+
+    DeleteFileW(path.c_str());
+}
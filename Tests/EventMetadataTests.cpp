@@ -0,0 +1,217 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include "PresentMonTests.h"
+#include "../PresentData/TraceConsumer.hpp"
+
+namespace {
+
+// {F1D2E3C4-0000-4000-8000-0000000000AB}
+GUID const TestProviderGuid = { 0xf1d2e3c4, 0x0000, 0x4000, { 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xab } };
+
+struct TestProperty {
+    wchar_t const* name_;
+    USHORT inType_;
+    USHORT length_;
+};
+
+// Creates an event with synthetic metadata (as would be embedded in an ETL)
+// and a user data buffer laid out to match it.
+struct TestEvent {
+    std::vector<uint8_t> metadata_;
+    std::vector<uint8_t> userData_;
+    EVENT_RECORD eventRecord_;
+
+    TestEvent(USHORT eventId, std::initializer_list<TestProperty> props)
+    {
+        EVENT_DESCRIPTOR desc = {};
+        desc.Id = eventId;
+
+        auto propCount = (uint32_t) props.size();
+        auto nameOffset = (uint32_t) (offsetof(TRACE_EVENT_INFO, EventPropertyInfoArray) + propCount * sizeof(EVENT_PROPERTY_INFO));
+        auto metadataSize = nameOffset;
+        for (auto const& prop : props) {
+            metadataSize += (uint32_t) ((wcslen(prop.name_) + 1) * sizeof(wchar_t));
+        }
+
+        metadata_.resize(metadataSize, 0);
+        auto tei = (TRACE_EVENT_INFO*) metadata_.data();
+        tei->ProviderGuid = TestProviderGuid;
+        tei->EventDescriptor = desc;
+        tei->DecodingSource = DecodingSourceXMLFile;
+        tei->PropertyCount = propCount;
+        tei->TopLevelPropertyCount = propCount;
+
+        uint32_t i = 0;
+        for (auto const& prop : props) {
+            auto nameSize = (uint32_t) ((wcslen(prop.name_) + 1) * sizeof(wchar_t));
+            memcpy(metadata_.data() + nameOffset, prop.name_, nameSize);
+
+            auto epi = &tei->EventPropertyInfoArray[i++];
+            epi->NameOffset = nameOffset;
+            epi->nonStructType.InType = prop.inType_;
+            epi->count = 1;
+            epi->length = prop.length_;
+
+            nameOffset += nameSize;
+        }
+
+        memset(&eventRecord_, 0, sizeof(eventRecord_));
+        eventRecord_.EventHeader.ProviderId = TestProviderGuid;
+        eventRecord_.EventHeader.EventDescriptor = desc;
+        eventRecord_.EventHeader.Flags = EVENT_HEADER_FLAG_64_BIT_HEADER;
+    }
+
+    template<typename T>
+    void Append(T const& value)
+    {
+        auto p = (uint8_t const*) &value;
+        userData_.insert(userData_.end(), p, p + sizeof(T));
+    }
+
+    void AppendString(wchar_t const* s)
+    {
+        auto p = (uint8_t const*) s;
+        userData_.insert(userData_.end(), p, p + (wcslen(s) + 1) * sizeof(wchar_t));
+    }
+
+    EVENT_RECORD* Record()
+    {
+        eventRecord_.UserData = userData_.data();
+        eventRecord_.UserDataLength = (USHORT) userData_.size();
+        return &eventRecord_;
+    }
+
+    void AddTo(EventMetadata* metadata) const
+    {
+        EventMetadataKey key;
+        key.guid_ = eventRecord_.EventHeader.ProviderId;
+        key.desc_ = eventRecord_.EventHeader.EventDescriptor;
+        metadata->metadata_.emplace(key, metadata_);
+    }
+};
+
+EventDecodePlan const* FindPlan(EventMetadata const& metadata, TestEvent const& event)
+{
+    EventMetadataKey key;
+    key.guid_ = event.eventRecord_.EventHeader.ProviderId;
+    key.desc_ = event.eventRecord_.EventHeader.EventDescriptor;
+    auto ii = metadata.plans_.find(key);
+    return ii == metadata.plans_.end() ? nullptr : &ii->second;
+}
+
+void ExpectSameDesc(EventDataDesc const& a, EventDataDesc const& b)
+{
+    EXPECT_EQ(a.data_,   b.data_);
+    EXPECT_EQ(a.size_,   b.size_);
+    EXPECT_EQ(a.count_,  b.count_);
+    EXPECT_EQ(a.status_, b.status_);
+}
+
+}
+
+TEST(EventMetadataTests, FixedLayout)
+{
+    TestEvent event(1, {
+        { L"pDmaBuffer",            TDH_INTYPE_POINTER, 8 },
+        { L"hContext",              TDH_INTYPE_POINTER, 8 },
+        { L"PacketType",            TDH_INTYPE_UINT32,  4 },
+        { L"SubmitSequence",        TDH_INTYPE_UINT32,  4 },
+        { L"ulQueueSubmitSequence", TDH_INTYPE_UINT64,  8 },
+    });
+    event.Append<uint64_t>(0x1000);
+    event.Append<uint64_t>(0x2000);
+    event.Append<uint32_t>(3);
+    event.Append<uint32_t>(4);
+    event.Append<uint64_t>(5);
+
+    EventMetadata planned;
+    EventMetadata walked;
+    walked.decodePlansEnabled_ = false;
+    event.AddTo(&planned);
+    event.AddTo(&walked);
+
+    // Decode twice so the second request uses the resolved names.
+    for (int i = 0; i < 2; ++i) {
+        EventDataDesc plannedDesc[] = {
+            { L"ulQueueSubmitSequence" },
+            { L"hContext" },
+            { L"SubmitSequence" },
+        };
+        EventDataDesc walkedDesc[] = {
+            { L"ulQueueSubmitSequence" },
+            { L"hContext" },
+            { L"SubmitSequence" },
+        };
+        planned.GetEventData(event.Record(), plannedDesc, _countof(plannedDesc));
+        walked.GetEventData(event.Record(), walkedDesc, _countof(walkedDesc));
+
+        for (uint32_t j = 0; j < _countof(plannedDesc); ++j) {
+            ExpectSameDesc(plannedDesc[j], walkedDesc[j]);
+        }
+        EXPECT_EQ(plannedDesc[0].GetData<uint64_t>(), 5ull);
+        EXPECT_EQ(plannedDesc[1].GetData<uint64_t>(), 0x2000ull);
+        EXPECT_EQ(plannedDesc[2].GetData<uint32_t>(), 4u);
+    }
+
+    auto plan = FindPlan(planned, event);
+    ASSERT_NE(plan, nullptr);
+    EXPECT_TRUE(plan->complete_);
+    EXPECT_EQ(plan->properties_.size(), 5u);
+    EXPECT_EQ(FindPlan(walked, event), nullptr);
+
+    // A missing optional property is reported as not found.
+    EventDataDesc desc[] = {
+        { L"PacketType" },
+        { L"NotAProperty" },
+    };
+    planned.GetEventData(event.Record(), desc, _countof(desc), 1);
+    EXPECT_EQ(desc[0].GetData<uint32_t>(), 3u);
+    EXPECT_EQ(desc[1].status_, (uint32_t) PROP_STATUS_NOT_FOUND);
+}
+
+TEST(EventMetadataTests, VariableLayout)
+{
+    TestEvent event(2, {
+        { L"ProcessId",     TDH_INTYPE_UINT32,        4 },
+        { L"ImageFileName", TDH_INTYPE_UNICODESTRING, 0 },
+        { L"ParentId",      TDH_INTYPE_UINT64,        8 },
+    });
+    event.Append<uint32_t>(1234);
+    event.AppendString(L"Game.exe");
+    event.Append<uint64_t>(5678);
+
+    EventMetadata planned;
+    EventMetadata walked;
+    walked.decodePlansEnabled_ = false;
+    event.AddTo(&planned);
+    event.AddTo(&walked);
+
+    EventDataDesc plannedDesc[] = {
+        { L"ProcessId" },
+        { L"ImageFileName" },
+        { L"ParentId" },
+    };
+    EventDataDesc walkedDesc[] = {
+        { L"ProcessId" },
+        { L"ImageFileName" },
+        { L"ParentId" },
+    };
+    planned.GetEventData(event.Record(), plannedDesc, _countof(plannedDesc));
+    walked.GetEventData(event.Record(), walkedDesc, _countof(walkedDesc));
+
+    for (uint32_t j = 0; j < _countof(plannedDesc); ++j) {
+        ExpectSameDesc(plannedDesc[j], walkedDesc[j]);
+    }
+    EXPECT_EQ(plannedDesc[0].GetData<uint32_t>(), 1234u);
+    EXPECT_EQ(plannedDesc[1].GetData<std::wstring>(), L"Game.exe");
+    EXPECT_EQ(plannedDesc[2].GetData<uint64_t>(), 5678ull);
+
+    // Only the property before the string is planned; properties in the planned
+    // region are still decoded directly.
+    auto plan = FindPlan(planned, event);
+    ASSERT_NE(plan, nullptr);
+    EXPECT_FALSE(plan->complete_);
+    EXPECT_EQ(plan->properties_.size(), 1u);
+    EXPECT_EQ(planned.GetEventData<uint32_t>(event.Record(), L"ProcessId"), 1234u);
+}
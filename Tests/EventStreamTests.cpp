@@ -0,0 +1,135 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include "PresentMonTests.h"
+#include "../PresentData/EventStream.hpp"
+#include "../PresentData/PresentMonTraceConsumer.hpp"
+#include "../PresentData/PresentMonTraceSession.hpp"
+
+namespace {
+
+// {F1D2E3C4-0000-4000-8000-0000000000CD}
+GUID const TestProviderGuid = { 0xf1d2e3c4, 0x0000, 0x4000, { 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xcd } };
+
+struct TempFile {
+    wchar_t path_[MAX_PATH];
+
+    TempFile()
+    {
+        wchar_t dir[MAX_PATH];
+        GetTempPathW(MAX_PATH, dir);
+        GetTempFileNameW(dir, L"pms", 0, path_);
+    }
+
+    ~TempFile()
+    {
+        DeleteFileW(path_);
+    }
+};
+
+EVENT_RECORD MakeEvent(USHORT id, ULONG processId, LONGLONG timestamp, std::vector<uint8_t>* userData)
+{
+    EVENT_RECORD eventRecord = {};
+    eventRecord.EventHeader.ProviderId = TestProviderGuid;
+    eventRecord.EventHeader.EventDescriptor.Id = id;
+    eventRecord.EventHeader.EventDescriptor.Version = 2;
+    eventRecord.EventHeader.EventDescriptor.Opcode = 1;
+    eventRecord.EventHeader.EventDescriptor.Keyword = 0x8000000000000001ull;
+    eventRecord.EventHeader.Flags = EVENT_HEADER_FLAG_64_BIT_HEADER;
+    eventRecord.EventHeader.ProcessId = processId;
+    eventRecord.EventHeader.ThreadId = processId + 1;
+    eventRecord.EventHeader.TimeStamp.QuadPart = timestamp;
+    eventRecord.UserData = userData->data();
+    eventRecord.UserDataLength = (USHORT) userData->size();
+    return eventRecord;
+}
+
+void ExpectSameEvent(EVENT_RECORD const& a, EVENT_RECORD const& b)
+{
+    EXPECT_TRUE(a.EventHeader.ProviderId == b.EventHeader.ProviderId);
+    EXPECT_EQ(a.EventHeader.EventDescriptor.Id,      b.EventHeader.EventDescriptor.Id);
+    EXPECT_EQ(a.EventHeader.EventDescriptor.Version, b.EventHeader.EventDescriptor.Version);
+    EXPECT_EQ(a.EventHeader.EventDescriptor.Opcode,  b.EventHeader.EventDescriptor.Opcode);
+    EXPECT_EQ(a.EventHeader.EventDescriptor.Keyword, b.EventHeader.EventDescriptor.Keyword);
+    EXPECT_EQ(a.EventHeader.Flags,                   b.EventHeader.Flags);
+    EXPECT_EQ(a.EventHeader.ProcessId,               b.EventHeader.ProcessId);
+    EXPECT_EQ(a.EventHeader.ThreadId,                b.EventHeader.ThreadId);
+    EXPECT_EQ(a.EventHeader.TimeStamp.QuadPart,      b.EventHeader.TimeStamp.QuadPart);
+    ASSERT_EQ(a.UserDataLength,                      b.UserDataLength);
+    EXPECT_EQ(memcmp(a.UserData, b.UserData, a.UserDataLength), 0);
+}
+
+}
+
+TEST(EventStreamTests, RoundTrip)
+{
+    TempFile file;
+
+    std::vector<uint8_t> userData1 = { 1, 2, 3, 4, 5 };
+    std::vector<uint8_t> userData2;
+    std::vector<uint8_t> userData3(300, 0xab);
+    EVENT_RECORD events[] = {
+        MakeEvent(10, 100, 1000, &userData1),
+        MakeEvent(11, 200, 2000, &userData2),
+        MakeEvent(12, 300, 3000, &userData3),
+    };
+
+    PMTraceConsumer pmConsumer;
+    PMTraceSession pmSession;
+    pmSession.mPMConsumer = &pmConsumer;
+    pmSession.mTimestampFrequency.QuadPart = 10000000;
+    pmSession.mStartTimestamp.QuadPart = 1000;
+    pmSession.mStartFileTime = 0x01d0000000000000ull;
+    pmSession.mTimestampType = PMTraceSession::TIMESTAMP_TYPE_QPC;
+
+    EventMetadataKey key = {};
+    key.guid_ = TestProviderGuid;
+    key.desc_ = events[0].EventHeader.EventDescriptor;
+    std::vector<uint8_t> metadata = { 9, 8, 7, 6, 5, 4, 3, 2, 1 };
+    pmConsumer.mMetadata.metadata_.emplace(key, metadata);
+
+    EventStreamWriter writer;
+    ASSERT_TRUE(writer.Open(file.path_));
+    for (auto const& event : events) {
+        writer.WriteEvent(&event);
+    }
+    EXPECT_EQ(writer.mEventCount, _countof(events));
+    ASSERT_TRUE(writer.Close(pmSession));
+
+    EventStreamReader reader;
+    ASSERT_TRUE(reader.Open(file.path_));
+    EXPECT_EQ(reader.Header().mTimestampFrequency, 10000000ull);
+    EXPECT_EQ(reader.Header().mStartTimestamp, 1000ull);
+    EXPECT_EQ(reader.Header().mStartFileTime, 0x01d0000000000000ull);
+    EXPECT_EQ(reader.Header().mTimestampType, (uint32_t) PMTraceSession::TIMESTAMP_TYPE_QPC);
+
+    EventMetadata loaded;
+    reader.LoadMetadata(&loaded);
+    ASSERT_EQ(loaded.metadata_.size(), 1u);
+    auto ii = loaded.metadata_.find(key);
+    ASSERT_TRUE(ii != loaded.metadata_.end());
+    EXPECT_EQ(ii->second, metadata);
+
+    EVENT_RECORD eventRecord = {};
+    for (auto const& event : events) {
+        ASSERT_TRUE(reader.ReadEvent(&eventRecord));
+        ExpectSameEvent(eventRecord, event);
+    }
+    EXPECT_FALSE(reader.ReadEvent(&eventRecord));
+    EXPECT_FALSE(reader.mCorrupt);
+
+    // A truncated stream is reported as corrupt once the partial record is reached.
+    auto truncated = reader.mData;
+    truncated.resize(truncated.size() - 4);
+    ASSERT_TRUE(reader.Open(std::move(truncated)));
+    while (reader.ReadEvent(&eventRecord)) {
+    }
+    EXPECT_TRUE(reader.mCorrupt);
+}
+
+TEST(EventStreamTests, InvalidHeader)
+{
+    EventStreamReader reader;
+    EXPECT_FALSE(reader.Open(std::vector<uint8_t>(sizeof(EventStreamFileHeader), 0)));
+    EXPECT_FALSE(reader.Open(std::vector<uint8_t>(4, 0)));
+}
@@ -3,14 +3,182 @@
 
 #include "PresentMonTests.h"
 
+#include <algorithm>
+
 namespace {
 
+enum class Mode {
+    ProcessTrace,           // Read the ETL with ProcessTrace()
+    CsvIndex,               // Also write a CSV index, and check that queries on it find the right rows
+    NativeEtlReader,        // Read the ETL with EtlReader
+    ReplayEventStream,      // Record the ETL's events into an event stream, then replay the stream
+    ParallelAnalysis,       // Analyze the ETL in parallel chunks, stitching them through a small ring
+    OutputThreads,          // Compute the metrics on several output threads
+    OutputThreadsMultiCsv,  // Compute the metrics on several output threads, writing a CSV per process
+    CsvStdout,              // Write the CSV to stdout, and check the CSV writer thread's row counts
+};
+
 struct TestArgs {
     std::wstring etl_;
     std::wstring goldCsv_;
     std::wstring testCsv_;
+    Mode mode_;
 };
 
+// Read a CSV's bytes without a UTF-8 BOM, and with LF line endings.  PresentMon writes a BOM and
+// CRLF, but the gold CSVs may be checked out with either line ending.
+bool ReadNormalizedCsv(std::wstring const& path, std::string* text)
+{
+    FILE* fp = nullptr;
+    if (_wfopen_s(&fp, path.c_str(), L"rb") != 0) {
+        AddTestFailure(__FILE__, __LINE__, "Failed to open file: %ls", path.c_str());
+        return false;
+    }
+
+    text->clear();
+    char buffer[64 * 1024];
+    for (size_t n; (n = fread(buffer, 1, sizeof(buffer), fp)) > 0; ) {
+        text->append(buffer, n);
+    }
+    fclose(fp);
+
+    if (text->compare(0, 3, "\xef\xbb\xbf") == 0) {
+        text->erase(0, 3);
+    }
+    text->erase(std::remove(text->begin(), text->end(), '\r'), text->end());
+    return true;
+}
+
+// The CSV must be byte-identical to the gold CSV (apart from the BOM and line endings), not just
+// equal within the rounding tolerance that CompareCsvRows() allows, so that changes in number
+// formatting (e.g., hex case, zero padding, or rounding) are caught.
+void CompareCsvBytes(std::wstring const& goldPath, std::wstring const& testPath)
+{
+    std::string gold;
+    std::string test;
+    if (!ReadNormalizedCsv(goldPath, &gold) || !ReadNormalizedCsv(testPath, &test)) {
+        return;
+    }
+    if (gold == test) {
+        return;
+    }
+
+    // Report the first line that differs.  The files are the same up to the start of that line.
+    auto offset = (size_t) (std::mismatch(gold.begin(), gold.end(), test.begin(), test.end()).first - gold.begin());
+    auto lineBegin = offset == 0 ? std::string::npos : gold.rfind('\n', offset - 1);
+    lineBegin = lineBegin == std::string::npos ? 0 : lineBegin + 1;
+    auto line = 1 + std::count(gold.begin(), gold.begin() + lineBegin, '\n');
+
+    AddTestFailure(__FILE__, __LINE__, "GOLD and TEST CSV bytes differ on line: %zu", (size_t) line);
+    printf("GOLD = %ls\n", goldPath.c_str());
+    printf("TEST = %ls\n", testPath.c_str());
+    printf("    GOLD LINE: %s\n", gold.substr(lineBegin, gold.find('\n', lineBegin) - lineBegin).c_str());
+    printf("    TEST LINE: %s\n", test.substr(lineBegin, test.find('\n', lineBegin) - lineBegin).c_str());
+}
+
+// Returns the value of a --print_consumer_stats counter, or UINT64_MAX if it wasn't printed.
+uint64_t FindPrintedStat(std::string const& text, char const* name)
+{
+    auto i = text.find(name);
+    if (i == std::string::npos) {
+        return UINT64_MAX;
+    }
+    return strtoull(text.c_str() + i + strlen(name), nullptr, 10);
+}
+
+// Check that reading the rows of one swap chain, in the middle third of the capture, by seeking to
+// the blocks that the CSV's index finds gives the same rows as reading the whole CSV.
+void CheckCsvIndex(std::wstring const& path)
+{
+    struct Row {
+        size_t mLine;
+        uint32_t mProcessId;
+        uint64_t mSwapChainAddress;
+        double mTime;
+    };
+
+    PresentMonCsv csv;
+    if (!csv.CSVOPEN(path)) {
+        return;
+    }
+
+    // The index's timestamps are those that CPUStartTime (or TimeInSeconds) is computed from.
+    auto idxProcessID        = csv.headerColumnIndex_[PresentMonCsv::Header_ProcessID];
+    auto idxSwapChainAddress = csv.headerColumnIndex_[PresentMonCsv::Header_SwapChainAddress];
+    auto idxTime             = csv.headerColumnIndex_[PresentMonCsv::Header_CPUStartTime];
+    auto timeScale           = 1.0;
+    if (idxTime == SIZE_MAX) {
+        idxTime   = csv.headerColumnIndex_[PresentMonCsv::Header_TimeInSeconds];
+        timeScale = 1000.0;
+    }
+
+    auto readRow = [&](PresentMonCsv const& c) {
+        Row row = {};
+        row.mLine             = c.line_;
+        row.mProcessId        = strtoul(c.cols_[idxProcessID], nullptr, 10);
+        row.mSwapChainAddress = strtoull(c.cols_[idxSwapChainAddress], nullptr, 16);
+        row.mTime             = idxTime == SIZE_MAX ? 0.0 : timeScale * strtod(c.cols_[idxTime], nullptr);
+        return row;
+    };
+
+    std::vector<Row> rows;
+    while (csv.ReadRow()) {
+        rows.push_back(readRow(csv));
+    }
+    csv.Close();
+    if (rows.empty()) {
+        return;
+    }
+
+    auto const& selected = rows[rows.size() / 2];
+    auto minTime = rows[0].mTime;
+    auto maxTime = rows[0].mTime;
+    for (auto const& row : rows) {
+        minTime = std::min(minTime, row.mTime);
+        maxTime = std::max(maxTime, row.mTime);
+    }
+    auto beginTime = minTime + (maxTime - minTime) / 3.0;
+    auto endTime   = minTime + (maxTime - minTime) * 2.0 / 3.0;
+    auto matches = [&](Row const& row) {
+        return row.mProcessId        == selected.mProcessId &&
+               row.mSwapChainAddress == selected.mSwapChainAddress &&
+               row.mTime >= beginTime &&
+               row.mTime <= endTime;
+    };
+
+    std::vector<size_t> expectedLines;
+    for (auto const& row : rows) {
+        if (matches(row)) {
+            expectedLines.push_back(row.mLine);
+        }
+    }
+
+    if (!csv.CSVOPEN(path) || !csv.CSVOPENINDEX()) {
+        return;
+    }
+
+    // The times in the CSV are rounded, so widen the query's time range a little.
+    CsvIndexQuery query;
+    query.mProcessId        = selected.mProcessId;
+    query.mSwapChainAddress = selected.mSwapChainAddress;
+    if (idxTime != SIZE_MAX) {
+        query.mBeginTimestamp = csv.index_.MilliSecondsToTimestamp(beginTime - 1.0);
+        query.mEndTimestamp   = csv.index_.MilliSecondsToTimestamp(endTime + 1.0);
+    }
+    csv.SelectRows(query);
+
+    std::vector<size_t> lines;
+    while (csv.ReadRow()) {
+        auto row = readRow(csv);
+        if (matches(row)) {
+            lines.push_back(row.mLine);
+        }
+    }
+    csv.Close();
+
+    EXPECT_EQ(lines, expectedLines) << "CSV index: " << Convert(path) << ".idx";
+}
+
 class Tests : public ::testing::Test, TestArgs {
 public:
     explicit Tests(TestArgs const& args)
@@ -18,62 +186,44 @@ public:
         TestArgs::operator=(args);
     }
 
-    void TestBody() override
+    // Read the next row of the gold CSV, skipping the rows of other processes if processId is not
+    // UINT32_MAX.
+    static bool ReadGoldRow(PresentMonCsv* goldCsv, uint32_t processId)
     {
-        // Open the gold CSV
-        PresentMonCsv goldCsv;
-        if (!goldCsv.CSVOPEN(goldCsv_)) {
-            return;
-        }
-
-        // Make sure output directory exists.
-        for (auto i = testCsv_.find_last_of(L"/\\"); i == std::wstring::npos || !EnsureDirectoryCreated(testCsv_.substr(0, i)); ) {
-            AddTestFailure(__FILE__, __LINE__, "Output directory does not exist!");
-            goldCsv.Close();
-            return;
-        }
-
-        // Generate command line, querying gold CSV to try and match expected
-        // data.
-        PresentMon pm;
-        pm.Add(L"--stop_existing_session");
-        pm.AddEtlPath(etl_);
-        pm.AddCsvPath(testCsv_);
-        for (auto param : goldCsv.params_) {
-            pm.Add(param);
-        }
-        pm.PMSTART();
-        pm.PMEXITED();
-
-        // Open test CSV file and check it has the same columns as gold
-        PresentMonCsv testCsv;
-        if (!testCsv.CSVOPEN(testCsv_)) {
-            goldCsv.Close();
-            return;
+        while (goldCsv->ReadRow()) {
+            auto idxProcessID = goldCsv->headerColumnIndex_[PresentMonCsv::Header_ProcessID];
+            if (processId == UINT32_MAX || strtoul(goldCsv->cols_[idxProcessID], nullptr, 10) == processId) {
+                return true;
+            }
         }
+        return false;
+    }
 
-        // Compare gold/test CSV data rows
+    // Compare the gold CSV's rows (of processId, or all rows if processId is UINT32_MAX) with the
+    // test CSV's rows.
+    void CompareCsvRows(PresentMonCsv* goldCsv, PresentMonCsv* testCsv, std::wstring const& testPath, uint32_t processId)
+    {
         for (;;) {
-            auto goldDone = !goldCsv.ReadRow();
-            auto testDone = !testCsv.ReadRow();
+            auto goldDone = !ReadGoldRow(goldCsv, processId);
+            auto testDone = !testCsv->ReadRow();
             if (goldDone || testDone) {
                 if (!goldDone || !testDone) {
                     AddTestFailure(__FILE__, __LINE__, "GOLD and TEST CSV had different number of rows");
                     printf("GOLD = %ls\n", goldCsv_.c_str());
-                    printf("TEST = %ls\n", testCsv_.c_str());
+                    printf("TEST = %ls\n", testPath.c_str());
                 }
                 break;
             }
 
             auto rowOk = true;
             for (size_t h = 0; h < PresentMonCsv::KnownHeaderCount; ++h) {
-                if (testCsv.headerColumnIndex_[h] != SIZE_MAX && goldCsv.headerColumnIndex_[h] != SIZE_MAX) {
+                if (testCsv->headerColumnIndex_[h] != SIZE_MAX && goldCsv->headerColumnIndex_[h] != SIZE_MAX) {
                     // Need to protect against missing columns on each line as
                     // the file may be corrupted.
-                    auto testColIdx = testCsv.headerColumnIndex_[h];
-                    auto goldColIdx = goldCsv.headerColumnIndex_[h];
-                    char const* a = testColIdx < testCsv.cols_.size() ? testCsv.cols_[testColIdx] : "<missing>";
-                    char const* b = goldColIdx < goldCsv.cols_.size() ? goldCsv.cols_[goldColIdx] : "<missing>";
+                    auto testColIdx = testCsv->headerColumnIndex_[h];
+                    auto goldColIdx = goldCsv->headerColumnIndex_[h];
+                    char const* a = testColIdx < testCsv->cols_.size() ? testCsv->cols_[testColIdx] : "<missing>";
+                    char const* b = goldColIdx < goldCsv->cols_.size() ? goldCsv->cols_[goldColIdx] : "<missing>";
                     if (_stricmp(a, b) == 0) {
                         continue;
                     }
@@ -103,12 +253,12 @@ public:
                     if (rowOk) {
                         rowOk = false;
                         printf("GOLD = %ls\n", goldCsv_.c_str());
-                        printf("TEST = %ls\n", testCsv_.c_str());
-                        AddTestFailure(__FILE__, __LINE__, "Difference on line: %zu", testCsv.line_);
+                        printf("TEST = %ls\n", testPath.c_str());
+                        AddTestFailure(__FILE__, __LINE__, "Difference on line: %zu", testCsv->line_);
                         printf("    COLUMN                    TEST VALUE                            GOLD VALUE\n");
                     }
 
-                    auto r = printf("    %s", testCsv.GetHeaderString((PresentMonCsv::Header) h));
+                    auto r = printf("    %s", testCsv->GetHeaderString((PresentMonCsv::Header) h));
                     printf("%*s", r < 29 ? 29 - r : 0, "");
                     r = printf(" %s", a);
                     printf("%*s", r < 38 ? 38 - r : 0, "");
@@ -119,10 +269,200 @@ public:
                 break;
             }
         }
+    }
+
+    // Delete the CSVs written by a previous --multi_csv run, as processes that are no longer in the
+    // output would otherwise be compared.
+    static void DeleteMultiCsv(std::wstring const& testBase)
+    {
+        auto dir = testBase.substr(0, testBase.find_last_of(L"/\\") + 1);
+        WIN32_FIND_DATA ff = {};
+        auto h = FindFirstFile((testBase + L"-*.csv").c_str(), &ff);
+        if (h != INVALID_HANDLE_VALUE) {
+            do
+            {
+                DeleteFile((dir + ff.cFileName).c_str());
+            } while (FindNextFile(h, &ff) != 0);
+
+            FindClose(h);
+        }
+    }
+
+    // With --multi_csv, PresentMon writes <base>[-<module>]-<pid>.csv for each process.  Compare
+    // each of them with the gold CSV's rows of that process, and check that every process in the
+    // gold CSV has a CSV.
+    void CompareMultiCsv(std::wstring const& testBase)
+    {
+        std::vector<uint32_t> goldProcessIds;
+        {
+            PresentMonCsv goldCsv;
+            if (!goldCsv.CSVOPEN(goldCsv_)) {
+                return;
+            }
+            auto idxProcessID = goldCsv.headerColumnIndex_[PresentMonCsv::Header_ProcessID];
+            while (goldCsv.ReadRow()) {
+                auto processId = strtoul(goldCsv.cols_[idxProcessID], nullptr, 10);
+                if (std::find(goldProcessIds.begin(), goldProcessIds.end(), processId) == goldProcessIds.end()) {
+                    goldProcessIds.push_back(processId);
+                }
+            }
+            goldCsv.Close();
+        }
+
+        auto dir = testBase.substr(0, testBase.find_last_of(L"/\\") + 1);
+        std::vector<uint32_t> testProcessIds;
+        WIN32_FIND_DATA ff = {};
+        auto h = FindFirstFile((testBase + L"-*.csv").c_str(), &ff);
+        if (h != INVALID_HANDLE_VALUE) {
+            do
+            {
+                std::wstring fileName(ff.cFileName);
+                auto testPath = dir + fileName;
+                auto processId = wcstoul(fileName.c_str() + fileName.find_last_of(L'-') + 1, nullptr, 10);
+                testProcessIds.push_back(processId);
+
+                PresentMonCsv goldCsv;
+                PresentMonCsv testCsv;
+                if (goldCsv.CSVOPEN(goldCsv_)) {
+                    if (testCsv.CSVOPEN(testPath)) {
+                        CompareCsvRows(&goldCsv, &testCsv, testPath, processId);
+                        testCsv.Close();
+                    }
+                    goldCsv.Close();
+                }
+            } while (FindNextFile(h, &ff) != 0);
+
+            FindClose(h);
+        }
+
+        std::sort(goldProcessIds.begin(), goldProcessIds.end());
+        std::sort(testProcessIds.begin(), testProcessIds.end());
+        EXPECT_EQ(testProcessIds, goldProcessIds) << "processes with a CSV: " << Convert(testBase) << "-*.csv";
+    }
+
+    void TestBody() override
+    {
+        // Open the gold CSV
+        PresentMonCsv goldCsv;
+        if (!goldCsv.CSVOPEN(goldCsv_)) {
+            return;
+        }
+
+        // Make sure output directory exists.
+        for (auto i = testCsv_.find_last_of(L"/\\"); i == std::wstring::npos || !EnsureDirectoryCreated(testCsv_.substr(0, i)); ) {
+            AddTestFailure(__FILE__, __LINE__, "Output directory does not exist!");
+            goldCsv.Close();
+            return;
+        }
+
+        // When replaying, first record the ETL's events into an event stream.  The same options
+        // are used so that the same events are recorded.
+        std::wstring eventStream;
+        if (mode_ == Mode::ReplayEventStream) {
+            eventStream = testCsv_.substr(0, testCsv_.size() - 4) + L".pmes";
+            DeleteFile(eventStream.c_str());
+
+            PresentMon pm;
+            pm.Add(L"--stop_existing_session");
+            pm.AddEtlPath(etl_);
+            pm.Add((L"--write_event_stream \"" + eventStream + L"\"").c_str());
+            for (auto param : goldCsv.params_) {
+                pm.Add(param);
+            }
+            pm.PMSTART();
+            pm.PMEXITED();
+        }
+
+        // Generate command line, querying gold CSV to try and match expected
+        // data.
+        PresentMon pm;
+        pm.Add(L"--stop_existing_session");
+        if (mode_ == Mode::ReplayEventStream) {
+            pm.Add((L"--replay_event_stream \"" + eventStream + L"\"").c_str());
+        } else {
+            pm.AddEtlPath(etl_);
+        }
+        auto testBase = testCsv_.substr(0, testCsv_.size() - 4);
+        if (mode_ == Mode::CsvStdout) {
+            pm.AddCsvStdout();
+            pm.RedirectOutput(testBase + L".stdout.txt", testBase + L".stderr.txt");
+            DeleteFile(testCsv_.c_str());
+        } else {
+            pm.AddCsvPath(testCsv_);
+        }
+        switch (mode_) {
+        case Mode::CsvIndex:        pm.Add(L"--csv_index 256"); break;
+        case Mode::NativeEtlReader: pm.Add(L"--native_etl_reader"); break;
+        case Mode::ParallelAnalysis:
+            // Use short enough chunks that every gold ETL is split, and the smallest memory
+            // budget so that the stitched presents don't fit in the consumer's rings.
+            pm.Add(L"--etl_analysis_threads 4 --etl_analysis_chunk_ms 250 --memory_budget 1");
+            break;
+        case Mode::OutputThreads:   pm.Add(L"--output_threads 4"); break;
+        case Mode::OutputThreadsMultiCsv:
+            pm.Add(L"--output_threads 4 --multi_csv");
+            DeleteMultiCsv(testBase);
+            break;
+        case Mode::CsvStdout:       pm.Add(L"--print_consumer_stats"); break;
+        default: break;
+        }
+        for (auto param : goldCsv.params_) {
+            pm.Add(param);
+        }
+        pm.PMSTART();
+        pm.PMEXITED();
+
+        if (mode_ == Mode::OutputThreadsMultiCsv) {
+            goldCsv.Close();
+            CompareMultiCsv(testBase);
+            return;
+        }
+
+        // The CSV was written to stdout by the CSV writer thread.  Save it as UTF-8 to compare it
+        // like the other modes, and check that the writer counted every row as written.
+        if (mode_ == Mode::CsvStdout) {
+            std::string csvText;
+            std::string statsText;
+            if (!ReadUtf16File(testBase + L".stdout.txt", &csvText) ||
+                !ReadUtf16File(testBase + L".stderr.txt", &statsText)) {
+                AddTestFailure(__FILE__, __LINE__, "Failed to read PresentMon's output: %ls.*.txt", testBase.c_str());
+                goldCsv.Close();
+                return;
+            }
+
+            FILE* fp = nullptr;
+            if (_wfopen_s(&fp, testCsv_.c_str(), L"wb") == 0) {
+                fwrite(csvText.data(), 1, csvText.size(), fp);
+                fclose(fp);
+            }
+
+            auto rowCount = (uint64_t) std::count(csvText.begin(), csvText.end(), '\n');
+            rowCount -= rowCount > 0 ? 1 : 0; // Header
+            EXPECT_EQ(FindPrintedStat(statsText, "RowsWritten"), rowCount) << Convert(testBase) << ".stderr.txt";
+            EXPECT_EQ(FindPrintedStat(statsText, "RowsDropped"), 0u) << Convert(testBase) << ".stderr.txt";
+        }
+
+        // Open test CSV file and check it has the same columns as gold
+        PresentMonCsv testCsv;
+        if (!testCsv.CSVOPEN(testCsv_)) {
+            goldCsv.Close();
+            return;
+        }
+
+        // Compare gold/test CSV data rows
+        CompareCsvRows(&goldCsv, &testCsv, testCsv_, UINT32_MAX);
 
         goldCsv.Close();
         testCsv.Close();
 
+        if (!::testing::Test::HasFailure()) {
+            CompareCsvBytes(goldCsv_, testCsv_);
+        }
+
+        if (mode_ == Mode::CsvIndex) {
+            CheckCsvIndex(testCsv_);
+        }
+
         if (::testing::Test::HasFailure() && !diffPath_.empty()) {
             std::wstring cmd;
             cmd += diffPath_;
@@ -184,6 +524,7 @@ void AddGoldEtlCsvTests(
                             args.etl_     = etl;
                             args.goldCsv_ = dir + fileName;
                             args.testCsv_ = outDir_ + fileName;
+                            args.mode_    = Mode::ProcessTrace;
 
                             // Replace any '-' characters in the name, as they will screw up googletest
                             // filters.
@@ -198,6 +539,66 @@ void AddGoldEtlCsvTests(
                                 "GoldEtlCsvTests", name.c_str(), nullptr, nullptr, __FILE__, __LINE__,
                                 [=]() -> ::testing::Test* { return new Tests(std::move(args)); });
 
+                            // Also check that writing a CSV index doesn't change the CSV, and that
+                            // the index finds the right rows.
+                            TestArgs csvIndexArgs = args;
+                            csvIndexArgs.testCsv_ = outDir_ + L"csv_index\\" + fileName;
+                            csvIndexArgs.mode_    = Mode::CsvIndex;
+                            ::testing::RegisterTest(
+                                "GoldEtlCsvCsvIndexTests", name.c_str(), nullptr, nullptr, __FILE__, __LINE__,
+                                [=]() -> ::testing::Test* { return new Tests(std::move(csvIndexArgs)); });
+
+                            // Also check that EtlReader produces the same results as ProcessTrace().
+                            TestArgs nativeArgs = args;
+                            nativeArgs.testCsv_ = outDir_ + L"native\\" + fileName;
+                            nativeArgs.mode_    = Mode::NativeEtlReader;
+                            ::testing::RegisterTest(
+                                "GoldEtlCsvNativeEtlReaderTests", name.c_str(), nullptr, nullptr, __FILE__, __LINE__,
+                                [=]() -> ::testing::Test* { return new Tests(std::move(nativeArgs)); });
+
+                            // Also check that recording the ETL's events into an event stream and
+                            // replaying it produces the same results.
+                            TestArgs replayArgs = args;
+                            replayArgs.testCsv_ = outDir_ + L"replay\\" + fileName;
+                            replayArgs.mode_    = Mode::ReplayEventStream;
+                            ::testing::RegisterTest(
+                                "GoldEtlCsvReplayEventStreamTests", name.c_str(), nullptr, nullptr, __FILE__, __LINE__,
+                                [=]() -> ::testing::Test* { return new Tests(std::move(replayArgs)); });
+
+                            // Also check that analyzing the ETL in parallel chunks produces the same
+                            // results as the serial analysis.
+                            TestArgs parallelArgs = args;
+                            parallelArgs.testCsv_ = outDir_ + L"parallel\\" + fileName;
+                            parallelArgs.mode_    = Mode::ParallelAnalysis;
+                            ::testing::RegisterTest(
+                                "GoldEtlCsvParallelAnalysisTests", name.c_str(), nullptr, nullptr, __FILE__, __LINE__,
+                                [=]() -> ::testing::Test* { return new Tests(std::move(parallelArgs)); });
+
+                            // Also check that computing the metrics on several output threads
+                            // produces the same results, both into one CSV and into a CSV per
+                            // process.
+                            TestArgs outputThreadsArgs = args;
+                            outputThreadsArgs.testCsv_ = outDir_ + L"output_threads\\" + fileName;
+                            outputThreadsArgs.mode_    = Mode::OutputThreads;
+                            ::testing::RegisterTest(
+                                "GoldEtlCsvOutputThreadsTests", name.c_str(), nullptr, nullptr, __FILE__, __LINE__,
+                                [=]() -> ::testing::Test* { return new Tests(std::move(outputThreadsArgs)); });
+
+                            TestArgs multiCsvArgs = args;
+                            multiCsvArgs.testCsv_ = outDir_ + L"output_threads_multi_csv\\" + fileName;
+                            multiCsvArgs.mode_    = Mode::OutputThreadsMultiCsv;
+                            ::testing::RegisterTest(
+                                "GoldEtlCsvOutputThreadsMultiCsvTests", name.c_str(), nullptr, nullptr, __FILE__, __LINE__,
+                                [=]() -> ::testing::Test* { return new Tests(std::move(multiCsvArgs)); });
+
+                            // Also check the CSV written to stdout by the CSV writer thread.
+                            TestArgs stdoutArgs = args;
+                            stdoutArgs.testCsv_ = outDir_ + L"stdout\\" + fileName;
+                            stdoutArgs.mode_    = Mode::CsvStdout;
+                            ::testing::RegisterTest(
+                                "GoldEtlCsvStdoutTests", name.c_str(), nullptr, nullptr, __FILE__, __LINE__,
+                                [=]() -> ::testing::Test* { return new Tests(std::move(stdoutArgs)); });
+
                             csvCount += 1;
                         }
                     } while (FindNextFile(csvh, &csvff) != 0);
@@ -18,6 +18,28 @@ void AddTestFailure(char const* file, int line, char const* fmt, ...)
     GTEST_MESSAGE_AT_(file, line, buffer, ::testing::TestPartResult::kNonFatalFailure);
 }
 
+// Read a file of UTF-16 text, such as PresentMon's redirected stdout or stderr, into UTF-8.
+bool ReadUtf16File(std::wstring const& path, std::string* utf8)
+{
+    FILE* fp = nullptr;
+    if (_wfopen_s(&fp, path.c_str(), L"rb") != 0) {
+        return false;
+    }
+
+    std::wstring text;
+    wchar_t buffer[16 * 1024];
+    for (size_t n; (n = fread(buffer, sizeof(wchar_t), _countof(buffer), fp)) > 0; ) {
+        text.append(buffer, n);
+    }
+    fclose(fp);
+
+    if (!text.empty() && text[0] == 0xfeff) {
+        text.erase(0, 1);
+    }
+    *utf8 = Convert(text);
+    return true;
+}
+
 namespace {
 
 void CheckAll(size_t const* columnIndex, bool* ok, std::initializer_list<PresentMonCsv::Header> const& headers)
@@ -83,19 +105,11 @@ bool PresentMonCsv::Open(char const* file, int line, std::wstring const& path)
     path_ = path;
     line_ = 0;
 
-    if (_wfopen_s(&fp_, path.c_str(), L"r")) {
+    if (!csv_.Open(path.c_str())) {
         AddTestFailure(file, line, "Failed to open file: %ls", path.c_str());
         return false;
     }
 
-    // Remove UTF-8 marker if there is one.
-    if (fread(row_, 3, 1, fp_) != 1 ||
-        row_[0] != -17 || // 0xef
-        row_[1] != -69 || // 0xbb
-        row_[2] != -65) { // 0xbf
-        fseek(fp_, 0, SEEK_SET);
-    }
-
     // Read the header and ensure required columns are present
     ReadRow();
 
@@ -195,18 +209,58 @@ bool PresentMonCsv::Open(char const* file, int line, std::wstring const& path)
 
 void PresentMonCsv::Close()
 {
-    fclose(fp_);
-    fp_ = nullptr;
+    csv_.Close();
+    rowsSelected_ = false;
+}
+
+bool PresentMonCsv::OpenIndex(char const* file, int line)
+{
+    auto indexPath = path_ + L".idx";
+    if (!index_.Open(indexPath.c_str())) {
+        AddTestFailure(file, line, "Failed to open CSV index: %ls", indexPath.c_str());
+        return false;
+    }
+    if (index_.mHeader.mCsvSize != csv_.mFileSize) {
+        AddTestFailure(file, line, "CSV index is for a %llu byte CSV, but the CSV is %llu bytes: %ls",
+                       index_.mHeader.mCsvSize, csv_.mFileSize, indexPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+void PresentMonCsv::SelectRows(CsvIndexQuery const& query)
+{
+    index_.FindBlocks(query, &selectedBlocks_);
+    nextSelectedBlock_ = 0;
+    selectedRowsLeft_ = 0;
+    rowsSelected_ = true;
 }
 
 bool PresentMonCsv::ReadRow()
 {
-    row_[0] = '\0';
+    row_.clear();
     cols_.clear();
 
+    // Seek to the next selected block once all the rows of the current one have been read
+    if (rowsSelected_) {
+        while (selectedRowsLeft_ == 0) {
+            if (nextSelectedBlock_ == selectedBlocks_.size()) {
+                return false;
+            }
+            auto const& block = index_.mBlocks[selectedBlocks_[nextSelectedBlock_++]];
+            if (!csv_.Seek(block.mOffset, block.mFirstRow + 2)) {
+                AddTestFailure(Convert(path_).c_str(), (int) line_, "Invalid CSV index block offset: %llu", block.mOffset);
+                return false;
+            }
+            line_ = (size_t) block.mFirstRow + 1;
+            selectedRowsLeft_ = block.mRowCount;
+        }
+        selectedRowsLeft_ -= 1;
+    }
+
     // Read a line
-    if (fgets(row_, _countof(row_), fp_) == nullptr) {
-        if (ferror(fp_) != 0) {
+    if (!csv_.ReadRow()) {
+        if (csv_.mError) {
             AddTestFailure(Convert(path_).c_str(), (int) line_, "File read error");
         }
         return false;
@@ -214,18 +268,18 @@ bool PresentMonCsv::ReadRow()
 
     line_ += 1;
 
-    // Split line into columns, skipping leading/trailing whitespace
-    auto p0 = row_;
-    for (; *p0 == ' ' || *p0 == '\t'; ++p0) *p0 = '\0';
-    for (auto p = p0; ; ++p) {
-        auto ch = *p;
-        if (ch == ',' || ch == '\0') {
-            *p = '\0';
-            cols_.push_back(p0);
-            for (p0 = p + 1; *p0 == ' ' || *p0 == '\t'; ++p0) *p0 = '\0';
-            for (auto q = p - 1; *q == ' ' || *q == '\t' || *q == '\n' || *q == '\r'; --q) *q = '\0';
-            if (ch == '\0') break;
-        }
+    // Copy the columns into NUL-terminated strings, skipping leading/trailing whitespace
+    for (auto const& field : csv_.mFields) {
+        auto p0 = field.mData;
+        auto p1 = field.mData + field.mSize;
+        for (; p0 < p1 && (*p0 == ' ' || *p0 == '\t'); ++p0) {}
+        for (; p1 > p0 && (p1[-1] == ' ' || p1[-1] == '\t' || p1[-1] == '\r'); --p1) {}
+        row_.insert(row_.end(), p0, p1);
+        row_.push_back('\0');
+    }
+    for (size_t i = 0, n = csv_.mFields.size(), offset = 0; i < n; ++i) {
+        cols_.push_back(row_.data() + offset);
+        offset += strlen(cols_.back()) + 1;
     }
 
     // Hard-code some per-row validation
@@ -298,6 +352,8 @@ size_t PresentMonCsv::GetColumnIndex(char const* header) const
 PresentMon::PresentMon()
     : cmdline_()
     , csvArgSet_(false)
+    , stdout_(NULL)
+    , stderr_(NULL)
 {
     cmdline_ += L'\"';
     cmdline_ += exePath_;
@@ -306,6 +362,12 @@ PresentMon::PresentMon()
 
 PresentMon::~PresentMon()
 {
+    for (auto h : { stdout_, stderr_ }) {
+        if (h != NULL && h != INVALID_HANDLE_VALUE) {
+            CloseHandle(h);
+        }
+    }
+
     if (::testing::Test::HasFailure()) {
         printf("%ls\n", cmdline_.c_str());
     }
@@ -331,6 +393,25 @@ void PresentMon::AddCsvPath(std::wstring const& csvPath)
     DeleteFile(csvPath.c_str());
 }
 
+void PresentMon::AddCsvStdout()
+{
+    EXPECT_FALSE(csvArgSet_);
+    cmdline_ += L" --output_stdout";
+    csvArgSet_ = true;
+}
+
+void PresentMon::RedirectOutput(std::wstring const& stdoutPath, std::wstring const& stderrPath)
+{
+    SECURITY_ATTRIBUTES sa = {};
+    sa.nLength = sizeof(sa);
+    sa.bInheritHandle = TRUE;
+
+    stdout_ = CreateFile(stdoutPath.c_str(), GENERIC_WRITE, FILE_SHARE_READ, &sa, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    stderr_ = CreateFile(stderrPath.c_str(), GENERIC_WRITE, FILE_SHARE_READ, &sa, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    EXPECT_NE(stdout_, INVALID_HANDLE_VALUE) << Convert(stdoutPath);
+    EXPECT_NE(stderr_, INVALID_HANDLE_VALUE) << Convert(stderrPath);
+}
+
 void PresentMon::Add(wchar_t const* args)
 {
     cmdline_ += L' ';
@@ -347,9 +428,19 @@ void PresentMon::Start(char const* file, int line)
     STARTUPINFO si = {};
     si.cb = sizeof(si);
     si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdOutput = stdout_;
+    si.hStdError = stderr_;
     if (CreateProcess(nullptr, &cmdline_[0], nullptr, nullptr, TRUE, 0, nullptr, nullptr, &si, (PROCESS_INFORMATION*) this) == 0) {
         AddTestFailure(file, line, "Failed to start PresentMon");
     }
+
+    // The process has its own handles to the redirected files.
+    for (auto h : { &stdout_, &stderr_ }) {
+        if (*h != NULL && *h != INVALID_HANDLE_VALUE) {
+            CloseHandle(*h);
+        }
+        *h = NULL;
+    }
 }
 
 bool PresentMon::IsRunning(DWORD timeoutMilliseconds) const
@@ -111,6 +111,7 @@ bool CheckPath(
 
 std::wstring PresentMon::exePath_;
 std::wstring outDir_;
+std::wstring convertCsvExePath_;
 bool reportAllCsvDiffs_ = false;
 bool warnOnMissingCsv_ = true;
 std::wstring diffPath_;
@@ -197,6 +198,9 @@ int wmain(
                 "PresentMonTests.exe [options]\n"
                 "options:\n"
                 "    --presentmon=path    Path to the PresentMon exe path to test (default=%ls).\n"
+                "    --pm_convert_csv=path\n"
+                "                         Path to the pm_convert_csv exe to test (default=pm_convert_csv.exe\n"
+                "                         in the PresentMon exe's directory).\n"
                 "    --golddir=path       Path to directory of test ETLs and gold CSVs (default=%ls).\n"
                 "    --outdir=path        Path to directory for test outputs (default=%%temp%%/PresentMonTestOutput).\n"
                 "    --nodelete           Keep the output directory after tests.\n"
@@ -220,6 +224,7 @@ int wmain(
 
     // Parse remaining command line arguments for custom commands.
     wchar_t* presentMonPathArg = nullptr;
+    wchar_t* convertCsvPathArg = nullptr;
     wchar_t* goldDirArg = nullptr;
     wchar_t* outDirArg = nullptr;
     bool deleteOutDir = true;
@@ -229,6 +234,11 @@ int wmain(
             continue;
         }
 
+        if (_wcsnicmp(argv[i], L"--pm_convert_csv=", 17) == 0) {
+            convertCsvPathArg = argv[i] + 17;
+            continue;
+        }
+
         if (_wcsnicmp(argv[i], L"--golddir=", 10) == 0) {
             goldDirArg = argv[i] + 10;
             continue;
@@ -273,8 +283,22 @@ int wmain(
         return 1;
     }
 
+    // pm_convert_csv is built into the same directory as PresentMon by default.
+    bool convertCsvExists = true;
+    convertCsvExePath_ = PresentMon::exePath_.substr(0, PresentMon::exePath_.find_last_of(L"/\\") + 1) + L"pm_convert_csv.exe";
+    if (!CheckPath("--pm_convert_csv", &convertCsvExePath_, convertCsvPathArg, false, &convertCsvExists)) {
+        return 1;
+    }
+
     if (goldDirExists) {
         AddGoldEtlCsvTests(goldDir, goldDir.size());
+        if (convertCsvExists) {
+            AddConvertCsvTests(goldDir);
+        } else {
+            fprintf(stderr, "warning: pm_convert_csv does not exist: %ls\n", convertCsvExePath_.c_str());
+            fprintf(stderr, "         Continuing, but no ConvertCsvSplitTests.* will run.  Specify a new path\n");
+            fprintf(stderr, "         using the --pm_convert_csv command line argument.\n");
+        }
     } else {
         fprintf(stderr, "warning: gold directory does not exist: %ls\n", goldDir.c_str());
         fprintf(stderr, "         Continuing, but no GoldEtlCsvTests.* will run.  Specify a new path\n");
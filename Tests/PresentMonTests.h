@@ -10,6 +10,9 @@
 #include <unordered_map>
 #include <windows.h>
 
+#include "../PresentData/CsvIndex.hpp"
+#include "../PresentData/CsvReader.hpp"
+
 struct PresentMonCsv
 {
     enum Header {
@@ -112,35 +115,57 @@ struct PresentMonCsv
 
     std::wstring path_;
     size_t line_ = 0;
-    FILE* fp_ = nullptr;
+    CsvReader csv_;
 
     // headerColumnIndex_[h] is the file column index where h was found, or SIZE_MAX if
     // h wasn't found in the file.
     size_t headerColumnIndex_[KnownHeaderCount];
 
-    char row_[1024];
+    std::vector<char> row_;             // The current row's columns, NUL-terminated
     std::vector<char const*> cols_;
     std::vector<wchar_t const*> params_;
 
+    // The CSV's index (written with --csv_index), and the blocks of rows selected by SelectRows().
+    CsvIndexReader index_;
+    std::vector<uint32_t> selectedBlocks_;
+    size_t nextSelectedBlock_ = 0;
+    uint32_t selectedRowsLeft_ = 0;
+    bool rowsSelected_ = false;
+
     bool Open(char const* file, int line, std::wstring const& path);
     void Close();
     bool ReadRow();
 
+    // Open the CSV's index (path_ + ".idx"), and check that it was written for the CSV.
+    bool OpenIndex(char const* file, int line);
+
+    // After SelectRows(), ReadRow() seeks to and reads only the blocks of rows that the index
+    // finds for the query.
+    void SelectRows(CsvIndexQuery const& query);
+
     size_t GetColumnIndex(char const* header) const;
 };
 
 #define CSVOPEN(_P) Open(__FILE__, __LINE__, _P)
+#define CSVOPENINDEX() OpenIndex(__FILE__, __LINE__)
 
 struct PresentMon : PROCESS_INFORMATION {
     static std::wstring exePath_;
     std::wstring cmdline_;
     bool csvArgSet_;
+    HANDLE stdout_;     // Files that the process' stdout and stderr are redirected to, or NULL
+    HANDLE stderr_;
 
     PresentMon();
     ~PresentMon();
 
     void AddEtlPath(std::wstring const& etlPath);
     void AddCsvPath(std::wstring const& csvPath);
+    void AddCsvStdout();
+
+    // Redirect the process' stdout and stderr into new files.  PresentMon writes them as UTF-16
+    // text (see ReadUtf16File()).
+    void RedirectOutput(std::wstring const& stdoutPath, std::wstring const& stderrPath);
     void Add(wchar_t const* args);
     void Start(char const* file, int line);
 
@@ -157,6 +182,7 @@ struct PresentMon : PROCESS_INFORMATION {
 
 // PresentMonTests.cpp
 extern std::wstring outDir_;
+extern std::wstring convertCsvExePath_;
 extern bool reportAllCsvDiffs_;
 extern bool warnOnMissingCsv_;
 extern std::wstring diffPath_;
@@ -167,6 +193,10 @@ std::wstring Convert(std::string const& s);
 
 // PresentMon.cpp
 void AddTestFailure(char const* file, int line, char const* fmt, ...);
+bool ReadUtf16File(std::wstring const& path, std::string* utf8);
 
 // GoldEtlCsvTests.cpp
 void AddGoldEtlCsvTests(std::wstring const& dir, size_t relIdx);
+
+// ConvertCsvTests.cpp
+void AddConvertCsvTests(std::wstring const& dir);
@@ -0,0 +1,85 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include "PresentMonTests.h"
+#include "../PresentData/PresentMonTraceConsumer.hpp"
+
+namespace {
+
+std::vector<std::shared_ptr<PresentEvent>> CreatePresents(uint32_t count, uint64_t firstPresentStartTime)
+{
+    std::vector<std::shared_ptr<PresentEvent>> presents;
+    for (uint32_t i = 0; i < count; ++i) {
+        auto present = std::make_shared<PresentEvent>();
+        present->PresentStartTime = firstPresentStartTime + i;
+        presents.emplace_back(present);
+    }
+    return presents;
+}
+
+void ExpectSamePresents(std::vector<std::shared_ptr<PresentEvent>> const& a, std::vector<std::shared_ptr<PresentEvent>> const& b)
+{
+    ASSERT_EQ(a.size(), b.size());
+    for (size_t i = 0; i < a.size(); ++i) {
+        EXPECT_EQ(a[i], b[i]) << "present " << i;
+    }
+}
+
+}
+
+// Presents that complete while the ready ring is full must still be dequeued, in order, even if
+// the consumer never completes another present (e.g., at the end of a trace).
+TEST(PresentMonTraceConsumerTests, DequeueMoreThanRingSize)
+{
+    PMTraceConsumer consumer;
+    consumer.SetMemoryBudget(1);
+    auto ringSize = consumer.mRingSize;
+
+    auto presents = CreatePresents(ringSize + ringSize / 2, 1000);
+    EXPECT_EQ(consumer.EnqueuePresentEvents(presents.data(), presents.size()), presents.size());
+    EXPECT_TRUE(consumer.WaitForPresentEvents(0, (uint32_t) presents.size()));
+
+    std::vector<std::shared_ptr<PresentEvent>> dequeued;
+    consumer.DequeuePresentEvents(dequeued);
+    ExpectSamePresents(dequeued, presents);
+
+    consumer.DequeuePresentEvents(dequeued);
+    EXPECT_TRUE(dequeued.empty());
+
+    // Once the backlog has been dequeued, presents go through the ring again.
+    presents = CreatePresents(ringSize / 2, 2000);
+    EXPECT_EQ(consumer.EnqueuePresentEvents(presents.data(), presents.size()), presents.size());
+    consumer.DequeuePresentEvents(dequeued);
+    ExpectSamePresents(dequeued, presents);
+
+    ConsumerStats::Snapshot snapshot;
+    consumer.mStats.GetSnapshot(&snapshot);
+    EXPECT_EQ(snapshot.GetLostPresentCount(), 0u);
+}
+
+// EnqueuePresentEvents() stops once the ready ring and its overflow are full, rather than dropping
+// presents, and accepts the rest once the application has dequeued them.
+TEST(PresentMonTraceConsumerTests, EnqueueStopsWhenFull)
+{
+    PMTraceConsumer consumer;
+    consumer.SetMemoryBudget(1);
+    auto ringSize = consumer.mRingSize;
+
+    auto presents = CreatePresents(3 * ringSize, 1000);
+    auto count = consumer.EnqueuePresentEvents(presents.data(), presents.size());
+    EXPECT_EQ(count, 2 * (size_t) ringSize);
+
+    std::vector<std::shared_ptr<PresentEvent>> dequeued;
+    std::vector<std::shared_ptr<PresentEvent>> all;
+    consumer.DequeuePresentEvents(dequeued);
+    all.insert(all.end(), dequeued.begin(), dequeued.end());
+
+    EXPECT_EQ(consumer.EnqueuePresentEvents(presents.data() + count, presents.size() - count), presents.size() - count);
+    consumer.DequeuePresentEvents(dequeued);
+    all.insert(all.end(), dequeued.begin(), dequeued.end());
+    ExpectSamePresents(all, presents);
+
+    ConsumerStats::Snapshot snapshot;
+    consumer.mStats.GetSnapshot(&snapshot);
+    EXPECT_EQ(snapshot.GetLostPresentCount(), 0u);
+}
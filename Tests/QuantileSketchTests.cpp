@@ -0,0 +1,77 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+#include "PresentMonTests.h"
+#include "../PresentData/QuantileSketch.hpp"
+
+#include <algorithm>
+#include <random>
+
+TEST(QuantileSketchTests, Empty)
+{
+    QuantileSketch sketch;
+    EXPECT_EQ(sketch.mCount, 0ull);
+    EXPECT_EQ(sketch.GetQuantile(0.5), 0.0);
+    EXPECT_EQ(sketch.GetMean(), 0.0);
+}
+
+TEST(QuantileSketchTests, RelativeAccuracy)
+{
+    // Frame times around 16ms, with a long tail and some zeros.
+    std::mt19937 rng(1234);
+    std::lognormal_distribution<double> frameTime(2.8, 0.4);
+
+    std::vector<double> values;
+    QuantileSketch sketch;
+    for (uint32_t i = 0; i < 100000; ++i) {
+        auto value = i % 1000 == 0 ? 0.0 : frameTime(rng);
+        values.push_back(value);
+        sketch.Add(value);
+    }
+    std::sort(values.begin(), values.end());
+
+    EXPECT_EQ(sketch.mCount, values.size());
+    EXPECT_EQ(sketch.mZeroCount, 100ull);
+    EXPECT_EQ(sketch.GetQuantile(0.0), values.front());
+    EXPECT_EQ(sketch.GetQuantile(1.0), values.back());
+    EXPECT_EQ(sketch.GetQuantile(0.0005), 0.0);
+
+    for (auto q : { 0.01, 0.05, 0.25, 0.5, 0.75, 0.95, 0.99, 0.999 }) {
+        auto expected = values[(size_t) (q * (values.size() - 1))];
+        EXPECT_NEAR(sketch.GetQuantile(q), expected, expected * QuantileSketch::RELATIVE_ACCURACY) << "q=" << q;
+    }
+}
+
+TEST(QuantileSketchTests, Merge)
+{
+    QuantileSketch a;
+    QuantileSketch b;
+    QuantileSketch both;
+    for (uint32_t i = 1; i <= 1000; ++i) {
+        auto value = 0.01 * i;
+        (i & 1 ? a : b).Add(value);
+        both.Add(value);
+    }
+
+    a.Merge(b);
+    EXPECT_EQ(a.mCount, both.mCount);
+    EXPECT_EQ(a.mMin, both.mMin);
+    EXPECT_EQ(a.mMax, both.mMax);
+    EXPECT_DOUBLE_EQ(a.GetMean(), both.GetMean());
+    for (auto q : { 0.01, 0.5, 0.99 }) {
+        EXPECT_EQ(a.GetQuantile(q), both.GetQuantile(q)) << "q=" << q;
+    }
+}
+
+TEST(QuantileSketchTests, OutOfRange)
+{
+    QuantileSketch sketch;
+    sketch.Add(1e-9);
+    sketch.Add(1e9);
+
+    // Values outside of the bins' range are still bounded by the exact min and max.
+    EXPECT_EQ(sketch.GetQuantile(0.0), 1e-9);
+    EXPECT_EQ(sketch.GetQuantile(1.0), 1e9);
+    EXPECT_GE(sketch.GetQuantile(0.5), 1e-9);
+    EXPECT_LE(sketch.GetQuantile(0.5), 1e9);
+}
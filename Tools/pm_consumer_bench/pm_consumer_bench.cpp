@@ -0,0 +1,1018 @@
+// Copyright (C) 2017-2024 Intel Corporation
+// SPDX-License-Identifier: MIT
+
+// pm_consumer_bench measures how quickly PMTraceConsumer analyzes events.
+//
+// For each present path documented at the top of
+// PresentData/PresentMonTraceConsumer.hpp, it synthesizes the sequence of
+// DXGI/D3D9/DxgKrnl/Win32k/DWM events that PresentMon sees for every frame,
+// along with the TRACE_EVENT_INFO metadata that TDH would otherwise provide,
+// and feeds them through the same callback used for offline (ETL) analysis.
+// Since there is no trace session or file I/O involved, the results only
+// reflect the cost of the analysis itself.
+//
+// The synthetic events only carry the properties that the consumer reads, so
+// the per-event decode cost is somewhat lower than for real traces.
+//
+// With --etl, it instead analyzes a real ETL file, once reading it with
+// ProcessTrace() and once with EtlReader, to compare the two readers.
+
+#include "../../PresentData/PresentMonTraceConsumer.hpp"
+#include "../../PresentData/PresentMonTraceSession.hpp"
+#include "../../PresentData/ETW/Microsoft_Windows_D3D9.h"
+#include "../../PresentData/ETW/Microsoft_Windows_Dwm_Core.h"
+#include "../../PresentData/ETW/Microsoft_Windows_DXGI.h"
+#include "../../PresentData/ETW/Microsoft_Windows_DxgKrnl.h"
+#include "../../PresentData/ETW/Microsoft_Windows_Win32k.h"
+
+#include <algorithm>
+#include <atomic>
+#include <psapi.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Synthetic timestamps use a 10MHz clock, with frames at 60Hz and a short gap
+// between consecutive events.
+uint64_t const TIMESTAMP_FREQUENCY = 10000000;
+uint64_t const FRAME_TICKS         = TIMESTAMP_FREQUENCY / 60;
+uint64_t const EVENT_TICKS         = 200;
+
+// How many events are analyzed between each DequeuePresentEvents() call.
+size_t const DEQUEUE_INTERVAL = 4096;
+
+uint32_t const DWM_PROCESS_ID = 0x800;
+
+// When generating GPU work, each application has a context on each of this
+// many nodes of a single adapter.
+uint32_t const GPU_NODE_COUNT = 4;
+uint64_t const GPU_ADAPTER    = 0x70000000;
+
+enum EventType {
+    DXGI_Present_Start,
+    DXGI_Present_Stop,
+    D3D9_Present_Start,
+    D3D9_Present_Stop,
+    DxgKrnl_Blit_Info,
+    DxgKrnl_Flip_Info,
+    DxgKrnl_MMIOFlip_Info,
+    DxgKrnl_Present_Info,
+    DxgKrnl_PresentHistory_Start,
+    DxgKrnl_PresentHistoryDetailed_Start,
+    DxgKrnl_PresentHistory_Info,
+    DxgKrnl_QueuePacket_Start,
+    DxgKrnl_QueuePacket_Stop,
+    DxgKrnl_VSyncDPC_Info,
+    DxgKrnl_VSyncDPCMultiPlane_Info,
+    Win32k_TokenCompositionSurfaceObject_Info,
+    Win32k_TokenStateChanged_Info,
+    Dwm_FlipChain_Pending,
+    Dwm_GetPresentHistory_Info,
+    Dwm_SCHEDULE_PRESENT_Start,
+    Dwm_SCHEDULE_SURFACEUPDATE_Info,
+    DxgKrnl_Device_Start,
+    DxgKrnl_Context_Start,
+    DxgKrnl_DmaPacket_Start,
+    DxgKrnl_DmaPacket_Info,
+    EVENT_TYPE_COUNT
+};
+
+// Event metadata
+// ----------------------------------------------------------------------------
+
+USHORT const NO_COUNT = 0xffff;
+
+struct Property {
+    wchar_t const* mName;
+    USHORT mInType;
+    USHORT mLength;
+    USHORT mCountIndex; // Index of the property holding the element count, or NO_COUNT
+};
+
+Property Int32(wchar_t const* name)   { return { name, TDH_INTYPE_INT32,   4, NO_COUNT }; }
+Property UInt32(wchar_t const* name)  { return { name, TDH_INTYPE_UINT32,  4, NO_COUNT }; }
+Property Bool(wchar_t const* name)    { return { name, TDH_INTYPE_BOOLEAN, 4, NO_COUNT }; }
+Property UInt64(wchar_t const* name)  { return { name, TDH_INTYPE_UINT64,  8, NO_COUNT }; }
+Property Pointer(wchar_t const* name) { return { name, TDH_INTYPE_POINTER, 8, NO_COUNT }; }
+Property UInt64Array(wchar_t const* name, USHORT countIndex) { return { name, TDH_INTYPE_UINT64, 8, countIndex }; }
+
+struct EventSchema {
+    char const* mName;
+    GUID mProviderId;
+    EVENT_DESCRIPTOR mDescriptor;
+    std::vector<uint8_t> mMetadata; // TRACE_EVENT_INFO, as would be returned by TdhGetEventInformation()
+};
+
+template<typename T>
+void InitSchema(EventSchema* schema, char const* name, GUID const& providerId, std::initializer_list<Property> props)
+{
+    schema->mName = name;
+    schema->mProviderId = providerId;
+    schema->mDescriptor.Id      = T::Id;
+    schema->mDescriptor.Version = T::Version;
+    schema->mDescriptor.Channel = T::Channel;
+    schema->mDescriptor.Level   = T::Level;
+    schema->mDescriptor.Opcode  = T::Opcode;
+    schema->mDescriptor.Task    = T::Task;
+    schema->mDescriptor.Keyword = (ULONGLONG) T::Keyword;
+
+    // The property names are stored after the EVENT_PROPERTY_INFO array.
+    auto propCount = (uint32_t) props.size();
+    auto nameOffset = (uint32_t) (offsetof(TRACE_EVENT_INFO, EventPropertyInfoArray) + propCount * sizeof(EVENT_PROPERTY_INFO));
+    auto metadataSize = nameOffset;
+    for (auto const& prop : props) {
+        metadataSize += (uint32_t) ((wcslen(prop.mName) + 1) * sizeof(wchar_t));
+    }
+
+    schema->mMetadata.assign(metadataSize, 0);
+    auto tei = (TRACE_EVENT_INFO*) schema->mMetadata.data();
+    tei->ProviderGuid = providerId;
+    tei->EventDescriptor = schema->mDescriptor;
+    tei->DecodingSource = DecodingSourceXMLFile;
+    tei->PropertyCount = propCount;
+    tei->TopLevelPropertyCount = propCount;
+
+    uint32_t i = 0;
+    for (auto const& prop : props) {
+        auto nameSize = (uint32_t) ((wcslen(prop.mName) + 1) * sizeof(wchar_t));
+        memcpy(schema->mMetadata.data() + nameOffset, prop.mName, nameSize);
+
+        auto epi = &tei->EventPropertyInfoArray[i++];
+        epi->NameOffset = nameOffset;
+        epi->nonStructType.InType = prop.mInType;
+        epi->length = prop.mLength;
+        if (prop.mCountIndex == NO_COUNT) {
+            epi->count = 1;
+        } else {
+            epi->Flags = PropertyParamCount;
+            epi->countPropertyIndex = prop.mCountIndex;
+        }
+
+        nameOffset += nameSize;
+    }
+}
+
+std::vector<EventSchema> CreateSchemas()
+{
+    namespace D3D9    = Microsoft_Windows_D3D9;
+    namespace DXGI    = Microsoft_Windows_DXGI;
+    namespace DxgKrnl = Microsoft_Windows_DxgKrnl;
+    namespace Dwm     = Microsoft_Windows_Dwm_Core;
+    namespace Win32k  = Microsoft_Windows_Win32k;
+
+    std::vector<EventSchema> s(EVENT_TYPE_COUNT);
+    InitSchema<DXGI::Present_Start>(&s[DXGI_Present_Start], "DXGI::Present_Start", DXGI::GUID, {
+        Pointer(L"pIDXGISwapChain"), UInt32(L"Flags"), Int32(L"SyncInterval") });
+    InitSchema<DXGI::Present_Stop>(&s[DXGI_Present_Stop], "DXGI::Present_Stop", DXGI::GUID, {
+        UInt32(L"Result") });
+    InitSchema<D3D9::Present_Start>(&s[D3D9_Present_Start], "D3D9::Present_Start", D3D9::GUID, {
+        Pointer(L"pSwapchain"), UInt32(L"Flags") });
+    InitSchema<D3D9::Present_Stop>(&s[D3D9_Present_Stop], "D3D9::Present_Stop", D3D9::GUID, {
+        UInt32(L"Result") });
+    InitSchema<DxgKrnl::Blit_Info>(&s[DxgKrnl_Blit_Info], "DxgKrnl::Blit_Info", DxgKrnl::GUID, {
+        Pointer(L"hwnd"), UInt32(L"bRedirectedPresent") });
+    InitSchema<DxgKrnl::Flip_Info>(&s[DxgKrnl_Flip_Info], "DxgKrnl::Flip_Info", DxgKrnl::GUID, {
+        UInt32(L"FlipInterval"), Bool(L"MMIOFlip") });
+    InitSchema<DxgKrnl::MMIOFlip_Info>(&s[DxgKrnl_MMIOFlip_Info], "DxgKrnl::MMIOFlip_Info", DxgKrnl::GUID, {
+        UInt32(L"FlipSubmitSequence"), UInt32(L"Flags") });
+    InitSchema<DxgKrnl::Present_Info>(&s[DxgKrnl_Present_Info], "DxgKrnl::Present_Info", DxgKrnl::GUID, {
+        Pointer(L"hWindow") });
+    InitSchema<DxgKrnl::PresentHistory_Start>(&s[DxgKrnl_PresentHistory_Start], "DxgKrnl::PresentHistory_Start", DxgKrnl::GUID, {
+        UInt64(L"Token"), UInt32(L"Model"), UInt64(L"TokenData") });
+    InitSchema<DxgKrnl::PresentHistoryDetailed_Start>(&s[DxgKrnl_PresentHistoryDetailed_Start], "DxgKrnl::PresentHistoryDetailed_Start", DxgKrnl::GUID, {
+        UInt64(L"Token"), UInt32(L"Model"), UInt64(L"TokenData") });
+    InitSchema<DxgKrnl::PresentHistory_Info>(&s[DxgKrnl_PresentHistory_Info], "DxgKrnl::PresentHistory_Info", DxgKrnl::GUID, {
+        UInt64(L"Token") });
+    InitSchema<DxgKrnl::QueuePacket_Start>(&s[DxgKrnl_QueuePacket_Start], "DxgKrnl::QueuePacket_Start", DxgKrnl::GUID, {
+        UInt32(L"PacketType"), UInt32(L"SubmitSequence"), Pointer(L"hContext"), Bool(L"bPresent") });
+    InitSchema<DxgKrnl::QueuePacket_Stop>(&s[DxgKrnl_QueuePacket_Stop], "DxgKrnl::QueuePacket_Stop", DxgKrnl::GUID, {
+        Pointer(L"hContext"), UInt32(L"SubmitSequence") });
+    InitSchema<DxgKrnl::VSyncDPC_Info>(&s[DxgKrnl_VSyncDPC_Info], "DxgKrnl::VSyncDPC_Info", DxgKrnl::GUID, {
+        UInt64(L"FlipFenceId") });
+    InitSchema<DxgKrnl::VSyncDPCMultiPlane_Info>(&s[DxgKrnl_VSyncDPCMultiPlane_Info], "DxgKrnl::VSyncDPCMultiPlane_Info", DxgKrnl::GUID, {
+        UInt32(L"PlaneCount"), UInt64Array(L"PresentIdOrPhysicalAddress", 0), UInt32(L"FlipEntryCount"), UInt64Array(L"FlipSubmitSequence", 2) });
+    InitSchema<Win32k::TokenCompositionSurfaceObject_Info>(&s[Win32k_TokenCompositionSurfaceObject_Info], "Win32k::TokenCompositionSurfaceObject_Info", Win32k::GUID, {
+        UInt64(L"CompositionSurfaceLuid"), UInt64(L"PresentCount"), UInt64(L"BindId"), UInt32(L"DestWidth"), UInt32(L"DestHeight") });
+    InitSchema<Win32k::TokenStateChanged_Info>(&s[Win32k_TokenStateChanged_Info], "Win32k::TokenStateChanged_Info", Win32k::GUID, {
+        UInt64(L"CompositionSurfaceLuid"), UInt32(L"PresentCount"), UInt64(L"BindId"), UInt32(L"NewState"), Bool(L"IndependentFlip") });
+    InitSchema<Dwm::FlipChain_Pending>(&s[Dwm_FlipChain_Pending], "Dwm::FlipChain_Pending", Dwm::GUID, {
+        UInt32(L"ulFlipChain"), UInt32(L"ulSerialNumber"), Pointer(L"hwnd") });
+    InitSchema<Dwm::MILEVENT_MEDIA_UCE_PROCESSPRESENTHISTORY_GetPresentHistory_Info>(&s[Dwm_GetPresentHistory_Info], "Dwm::GetPresentHistory_Info", Dwm::GUID, {});
+    InitSchema<Dwm::SCHEDULE_PRESENT_Start>(&s[Dwm_SCHEDULE_PRESENT_Start], "Dwm::SCHEDULE_PRESENT_Start", Dwm::GUID, {});
+    InitSchema<Dwm::SCHEDULE_SURFACEUPDATE_Info>(&s[Dwm_SCHEDULE_SURFACEUPDATE_Info], "Dwm::SCHEDULE_SURFACEUPDATE_Info", Dwm::GUID, {
+        UInt64(L"luidSurface"), UInt64(L"PresentCount"), UInt64(L"bindId") });
+    InitSchema<DxgKrnl::Device_Start>(&s[DxgKrnl_Device_Start], "DxgKrnl::Device_Start", DxgKrnl::GUID, {
+        Pointer(L"pDxgAdapter"), Pointer(L"hDevice") });
+    InitSchema<DxgKrnl::Context_Start>(&s[DxgKrnl_Context_Start], "DxgKrnl::Context_Start", DxgKrnl::GUID, {
+        Pointer(L"hContext"), Pointer(L"hDevice"), UInt32(L"NodeOrdinal") });
+    InitSchema<DxgKrnl::DmaPacket_Start>(&s[DxgKrnl_DmaPacket_Start], "DxgKrnl::DmaPacket_Start", DxgKrnl::GUID, {
+        Pointer(L"hContext"), UInt32(L"ulQueueSubmitSequence") });
+    InitSchema<DxgKrnl::DmaPacket_Info>(&s[DxgKrnl_DmaPacket_Info], "DxgKrnl::DmaPacket_Info", DxgKrnl::GUID, {
+        Pointer(L"hContext"), UInt32(L"ulQueueSubmitSequence") });
+    return s;
+}
+
+void AddMetadata(EventMetadata* metadata, std::vector<EventSchema> const& schemas)
+{
+    for (auto const& schema : schemas) {
+        EventMetadataKey key;
+        key.guid_ = schema.mProviderId;
+        key.desc_ = schema.mDescriptor;
+        metadata->metadata_.emplace(key, schema.mMetadata);
+    }
+}
+
+// Event generation
+// ----------------------------------------------------------------------------
+
+struct SyntheticEvent {
+    uint64_t mTimestamp;
+    uint32_t mProcessId;
+    uint32_t mThreadId;
+    uint32_t mDataOffset;
+    uint16_t mDataSize;
+    uint16_t mType;
+};
+
+struct SyntheticTrace {
+    std::vector<SyntheticEvent> mEvents;
+    std::vector<uint8_t> mData;
+    uint64_t mTimestamp = 0;
+
+    SyntheticTrace& Add(EventType type, uint32_t processId, uint32_t threadId)
+    {
+        mTimestamp += EVENT_TICKS;
+
+        SyntheticEvent e;
+        e.mTimestamp  = mTimestamp;
+        e.mProcessId  = processId;
+        e.mThreadId   = threadId;
+        e.mDataOffset = (uint32_t) mData.size();
+        e.mDataSize   = 0;
+        e.mType       = (uint16_t) type;
+        mEvents.emplace_back(e);
+        return *this;
+    }
+
+    template<typename T>
+    SyntheticTrace& Data(T value)
+    {
+        auto p = (uint8_t const*) &value;
+        mData.insert(mData.end(), p, p + sizeof(T));
+        mEvents.back().mDataSize = (uint16_t) (mEvents.back().mDataSize + sizeof(T));
+        return *this;
+    }
+
+    size_t SizeInBytes() const
+    {
+        return mEvents.size() * sizeof(SyntheticEvent) + mData.size();
+    }
+};
+
+// An application presenting to its own window/swap chain.
+struct App {
+    uint32_t mProcessId;
+    uint32_t mThreadId;
+    uint64_t mSwapChain;
+    uint64_t mHwnd;
+    uint64_t mContext;
+    uint64_t mDevice;
+    uint64_t mSurfaceLuid;
+    uint64_t mPlaneAddress;
+    uint32_t mFlipChain;
+    uint32_t mPresentCount;
+    uint32_t mDmaSequence;
+};
+
+struct Generator {
+    SyntheticTrace* mTrace;
+    PresentMode mMode;
+    std::vector<App> mApps;
+    App mDwm;
+    uint32_t mNextSubmitSequence;
+    uint64_t mNextToken;
+    uint32_t mGpuPacketCount;   // DMA packets per application frame
+
+    // DPC and packet completion events are not attributed to the presenting
+    // process.
+    static uint32_t const SYSTEM_PROCESS_ID = 4;
+    static uint32_t const SYSTEM_THREAD_ID  = 8;
+
+    Generator(SyntheticTrace* trace, PresentMode mode, uint32_t appCount, uint32_t gpuPacketCount)
+        : mTrace(trace)
+        , mMode(mode)
+        , mApps(appCount)
+        , mNextSubmitSequence(1)
+        , mNextToken(0x1000)
+        , mGpuPacketCount(gpuPacketCount)
+    {
+        for (uint32_t i = 0; i < appCount; ++i) {
+            InitApp(&mApps[i], 0x1000 + 4 * i);
+        }
+        InitApp(&mDwm, DWM_PROCESS_ID);
+
+        if (mGpuPacketCount > 0) {
+            for (auto const& app : mApps) {
+                mTrace->Add(DxgKrnl_Device_Start, app.mProcessId, app.mThreadId).Data(GPU_ADAPTER).Data(app.mDevice);
+                for (uint32_t node = 0; node < GPU_NODE_COUNT; ++node) {
+                    mTrace->Add(DxgKrnl_Context_Start, app.mProcessId, app.mThreadId).Data(GpuContext(app, node)).Data(app.mDevice).Data(node);
+                }
+            }
+        }
+    }
+
+    static void InitApp(App* app, uint32_t id)
+    {
+        app->mProcessId    = id;
+        app->mThreadId     = id + 1;
+        app->mSwapChain    = 0x10000000ull + id;
+        app->mHwnd         = 0x20000000ull + id;
+        app->mContext      = 0x30000000ull + id;
+        app->mDevice       = 0x60000000ull + id;
+        app->mSurfaceLuid  = 0x40000000ull + id;
+        app->mPlaneAddress = 0x50000000ull + id;
+        app->mFlipChain    = id;
+        app->mPresentCount = 0;
+        app->mDmaSequence  = 0;
+    }
+
+    static uint64_t GpuContext(App const& app, uint32_t node)
+    {
+        return 0x80000000ull + app.mProcessId * GPU_NODE_COUNT + node;
+    }
+
+    bool UsesD3D9() const
+    {
+        return mMode == PresentMode::Hardware_Legacy_Copy_To_Front_Buffer;
+    }
+
+    bool UsesDwm() const
+    {
+        return mMode == PresentMode::Composed_Flip ||
+               mMode == PresentMode::Composed_Copy_GPU_GDI ||
+               mMode == PresentMode::Composed_Copy_CPU_GDI;
+    }
+
+    void RuntimePresentStart(App const& app)
+    {
+        if (UsesD3D9()) {
+            mTrace->Add(D3D9_Present_Start, app.mProcessId, app.mThreadId).Data(app.mSwapChain).Data<uint32_t>(0);
+        } else {
+            mTrace->Add(DXGI_Present_Start, app.mProcessId, app.mThreadId).Data(app.mSwapChain).Data<uint32_t>(0).Data<int32_t>(1);
+        }
+    }
+
+    void RuntimePresentStop(App const& app)
+    {
+        mTrace->Add(UsesD3D9() ? D3D9_Present_Stop : DXGI_Present_Stop, app.mProcessId, app.mThreadId).Data<uint32_t>(S_OK);
+    }
+
+    void QueuePacketStart(App const& app, Microsoft_Windows_DxgKrnl::QueuePacketType packetType, uint32_t submitSequence)
+    {
+        mTrace->Add(DxgKrnl_QueuePacket_Start, app.mProcessId, app.mThreadId)
+            .Data((uint32_t) packetType).Data(submitSequence).Data(app.mContext).Data<BOOL>(TRUE);
+    }
+
+    void QueuePacketStop(App const& app, uint32_t submitSequence)
+    {
+        mTrace->Add(DxgKrnl_QueuePacket_Stop, SYSTEM_PROCESS_ID, SYSTEM_THREAD_ID).Data(app.mContext).Data(submitSequence);
+    }
+
+    void FlipToScreen(uint32_t submitSequence)
+    {
+        auto flags = (uint32_t) Microsoft_Windows_DxgKrnl::SetVidPnSourceAddressFlags::FlipOnNextVSync;
+        mTrace->Add(DxgKrnl_MMIOFlip_Info, SYSTEM_PROCESS_ID, SYSTEM_THREAD_ID).Data(submitSequence).Data(flags);
+        mTrace->Add(DxgKrnl_VSyncDPC_Info, SYSTEM_PROCESS_ID, SYSTEM_THREAD_ID).Data((uint64_t) submitSequence << 32);
+    }
+
+    void TokenStateChanged(App const& app, Microsoft_Windows_Win32k::TokenState state, bool independentFlip)
+    {
+        mTrace->Add(Win32k_TokenStateChanged_Info, mDwm.mProcessId, mDwm.mThreadId)
+            .Data(app.mSurfaceLuid).Data(app.mPresentCount).Data<uint64_t>(1).Data((uint32_t) state).Data<BOOL>(independentFlip);
+    }
+
+    // An application present that is flipped to screen by DxgKrnl
+    // (Hardware_Legacy_Flip).
+    void LegacyFlip(App const& app)
+    {
+        auto submitSequence = mNextSubmitSequence++;
+
+        RuntimePresentStart(app);
+        mTrace->Add(DxgKrnl_Flip_Info, app.mProcessId, app.mThreadId).Data<uint32_t>(1).Data<BOOL>(TRUE);
+        QueuePacketStart(app, Microsoft_Windows_DxgKrnl::QueuePacketType::DXGKETW_MMIOFLIP_COMMAND_BUFFER, submitSequence);
+        mTrace->Add(DxgKrnl_Present_Info, app.mProcessId, app.mThreadId).Data(app.mHwnd);
+        RuntimePresentStop(app);
+
+        FlipToScreen(submitSequence);
+        QueuePacketStop(app, submitSequence);
+    }
+
+    // A fullscreen blt, completed when its present packet completes
+    // (Hardware_Legacy_Copy_To_Front_Buffer).
+    void LegacyBlt(App const& app)
+    {
+        auto submitSequence = mNextSubmitSequence++;
+
+        RuntimePresentStart(app);
+        mTrace->Add(DxgKrnl_Blit_Info, app.mProcessId, app.mThreadId).Data(app.mHwnd).Data<uint32_t>(FALSE);
+        QueuePacketStart(app, Microsoft_Windows_DxgKrnl::QueuePacketType::DXGKETW_RENDER_COMMAND_BUFFER, submitSequence);
+        mTrace->Add(DxgKrnl_Present_Info, app.mProcessId, app.mThreadId).Data(app.mHwnd);
+        RuntimePresentStop(app);
+
+        QueuePacketStop(app, submitSequence);
+    }
+
+    // A flip model present that is either composed by DWM or, if
+    // independentFlip, flipped directly to screen (Composed_Flip,
+    // Hardware_Independent_Flip, or Hardware_Composed_Independent_Flip when
+    // multiPlane).
+    void FlipModel(App* app, bool independentFlip, bool multiPlane)
+    {
+        auto submitSequence = mNextSubmitSequence++;
+        auto token = mNextToken++;
+        app->mPresentCount += 1;
+
+        RuntimePresentStart(*app);
+        mTrace->Add(Win32k_TokenCompositionSurfaceObject_Info, app->mProcessId, app->mThreadId)
+            .Data(app->mSurfaceLuid).Data((uint64_t) app->mPresentCount).Data<uint64_t>(1).Data<uint32_t>(1920).Data<uint32_t>(1080);
+        mTrace->Add(DxgKrnl_PresentHistoryDetailed_Start, app->mProcessId, app->mThreadId)
+            .Data(token).Data((uint32_t) Microsoft_Windows_DxgKrnl::PresentModel::D3DKMT_PM_REDIRECTED_FLIP).Data<uint64_t>(0);
+        QueuePacketStart(*app, Microsoft_Windows_DxgKrnl::QueuePacketType::DXGKETW_RENDER_COMMAND_BUFFER, submitSequence);
+        mTrace->Add(DxgKrnl_Present_Info, app->mProcessId, app->mThreadId).Data(app->mHwnd);
+        RuntimePresentStop(*app);
+
+        mTrace->Add(DxgKrnl_PresentHistory_Info, app->mProcessId, app->mThreadId).Data(token);
+        TokenStateChanged(*app, Microsoft_Windows_Win32k::TokenState::InFrame, independentFlip);
+        if (!independentFlip) {
+            mTrace->Add(Dwm_SCHEDULE_SURFACEUPDATE_Info, mDwm.mProcessId, mDwm.mThreadId)
+                .Data(app->mSurfaceLuid).Data((uint64_t) app->mPresentCount).Data<uint64_t>(1);
+        }
+        TokenStateChanged(*app, Microsoft_Windows_Win32k::TokenState::Confirmed, false);
+
+        if (independentFlip) {
+            FlipToScreen(submitSequence);
+
+            // The planes that were scanned out, and the flips that completed.
+            uint32_t planeCount = multiPlane ? 2 : 1;
+            auto& e = mTrace->Add(DxgKrnl_VSyncDPCMultiPlane_Info, SYSTEM_PROCESS_ID, SYSTEM_THREAD_ID).Data(planeCount);
+            for (uint32_t i = 0; i < planeCount; ++i) {
+                e.Data(app->mPlaneAddress + i);
+            }
+            e.Data<uint32_t>(1).Data((uint64_t) submitSequence << 32);
+        }
+
+        QueuePacketStop(*app, submitSequence);
+    }
+
+    // A windowed blt that DWM copies from, either via the GPU
+    // (Composed_Copy_GPU_GDI) or, if redirected, via the CPU
+    // (Composed_Copy_CPU_GDI).
+    void ComposedBlt(App* app, bool redirected)
+    {
+        auto token = mNextToken++;
+        app->mPresentCount += 1;
+
+        RuntimePresentStart(*app);
+        mTrace->Add(DxgKrnl_Blit_Info, app->mProcessId, app->mThreadId).Data(app->mHwnd).Data<uint32_t>(redirected);
+        if (redirected) {
+            auto tokenData = ((uint64_t) app->mFlipChain << 32) | app->mPresentCount;
+            mTrace->Add(DxgKrnl_PresentHistory_Start, app->mProcessId, app->mThreadId)
+                .Data(token).Data((uint32_t) Microsoft_Windows_DxgKrnl::PresentModel::D3DKMT_PM_REDIRECTED_VISTABLT).Data(tokenData);
+            RuntimePresentStop(*app);
+
+            mTrace->Add(DxgKrnl_PresentHistory_Info, app->mProcessId, app->mThreadId).Data(token);
+            mTrace->Add(Dwm_FlipChain_Pending, mDwm.mProcessId, mDwm.mThreadId)
+                .Data(app->mFlipChain).Data(app->mPresentCount).Data(app->mHwnd);
+        } else {
+            auto submitSequence = mNextSubmitSequence++;
+            mTrace->Add(DxgKrnl_PresentHistoryDetailed_Start, app->mProcessId, app->mThreadId)
+                .Data(token).Data((uint32_t) Microsoft_Windows_DxgKrnl::PresentModel::D3DKMT_PM_REDIRECTED_BLT).Data<uint64_t>(0);
+            QueuePacketStart(*app, Microsoft_Windows_DxgKrnl::QueuePacketType::DXGKETW_RENDER_COMMAND_BUFFER, submitSequence);
+            mTrace->Add(DxgKrnl_Present_Info, app->mProcessId, app->mThreadId).Data(app->mHwnd);
+            RuntimePresentStop(*app);
+
+            mTrace->Add(DxgKrnl_PresentHistory_Info, app->mProcessId, app->mThreadId).Data(token);
+            QueuePacketStop(*app, submitSequence);
+        }
+    }
+
+    // A DWM composition, whose flip completes the application presents that
+    // were composed into it.
+    void DwmFrame()
+    {
+        auto submitSequence = mNextSubmitSequence++;
+
+        if (mMode == PresentMode::Composed_Copy_GPU_GDI || mMode == PresentMode::Composed_Copy_CPU_GDI) {
+            mTrace->Add(Dwm_GetPresentHistory_Info, mDwm.mProcessId, mDwm.mThreadId);
+        }
+        mTrace->Add(Dwm_SCHEDULE_PRESENT_Start, mDwm.mProcessId, mDwm.mThreadId);
+        mTrace->Add(DxgKrnl_Flip_Info, mDwm.mProcessId, mDwm.mThreadId).Data<uint32_t>(1).Data<BOOL>(TRUE);
+        QueuePacketStart(mDwm, Microsoft_Windows_DxgKrnl::QueuePacketType::DXGKETW_MMIOFLIP_COMMAND_BUFFER, submitSequence);
+        mTrace->Add(DxgKrnl_Present_Info, mDwm.mProcessId, mDwm.mThreadId).Data<uint64_t>(0);
+
+        FlipToScreen(submitSequence);
+        QueuePacketStop(mDwm, submitSequence);
+    }
+
+    // The application's rendering work, submitted round-robin to its contexts
+    // on each node.  All packets are submitted before the first one
+    // completes, so each node has several packets queued.
+    void GpuWork(App* app)
+    {
+        auto firstSequence = app->mDmaSequence + 1;
+        for (uint32_t i = 0; i < mGpuPacketCount; ++i) {
+            mTrace->Add(DxgKrnl_DmaPacket_Start, app->mProcessId, app->mThreadId)
+                .Data(GpuContext(*app, i % GPU_NODE_COUNT)).Data(++app->mDmaSequence);
+        }
+        for (uint32_t i = 0; i < mGpuPacketCount; ++i) {
+            mTrace->Add(DxgKrnl_DmaPacket_Info, SYSTEM_PROCESS_ID, SYSTEM_THREAD_ID)
+                .Data(GpuContext(*app, i % GPU_NODE_COUNT)).Data(firstSequence + i);
+        }
+    }
+
+    void Frame(uint64_t frameIndex)
+    {
+        mTrace->mTimestamp = std::max(mTrace->mTimestamp, (frameIndex + 1) * FRAME_TICKS);
+
+        for (auto& app : mApps) {
+            GpuWork(&app);
+
+            switch (mMode) {
+            case PresentMode::Hardware_Legacy_Flip:                 LegacyFlip(app); break;
+            case PresentMode::Hardware_Legacy_Copy_To_Front_Buffer: LegacyBlt(app); break;
+            case PresentMode::Hardware_Independent_Flip:            FlipModel(&app, true, false); break;
+            case PresentMode::Hardware_Composed_Independent_Flip:   FlipModel(&app, true, true); break;
+            case PresentMode::Composed_Flip:                        FlipModel(&app, false, false); break;
+            case PresentMode::Composed_Copy_GPU_GDI:                ComposedBlt(&app, false); break;
+            case PresentMode::Composed_Copy_CPU_GDI:                ComposedBlt(&app, true); break;
+            }
+        }
+
+        if (UsesDwm()) {
+            DwmFrame();
+        }
+    }
+};
+
+// Benchmark
+// ----------------------------------------------------------------------------
+
+struct ModeInfo {
+    PresentMode mMode;
+    wchar_t const* mName;
+};
+
+ModeInfo const MODES[] = {
+    { PresentMode::Hardware_Legacy_Flip,                 L"Hardware_Legacy_Flip" },
+    { PresentMode::Hardware_Legacy_Copy_To_Front_Buffer, L"Hardware_Legacy_Copy_To_Front_Buffer" },
+    { PresentMode::Hardware_Independent_Flip,            L"Hardware_Independent_Flip" },
+    { PresentMode::Hardware_Composed_Independent_Flip,   L"Hardware_Composed_Independent_Flip" },
+    { PresentMode::Composed_Flip,                        L"Composed_Flip" },
+    { PresentMode::Composed_Copy_GPU_GDI,                L"Composed_Copy_GPU_GDI" },
+    { PresentMode::Composed_Copy_CPU_GDI,                L"Composed_Copy_CPU_GDI" },
+};
+
+struct HandlerStats {
+    uint64_t mTicks = 0;
+    uint64_t mCount = 0;
+};
+
+struct RunResult {
+    uint64_t mTicks;                // Duration of the analysis, in QPC ticks
+    uint64_t mPresentCount;         // Application presents dequeued
+    uint64_t mExpectedPresentCount; // Presents dequeued with the expected PresentMode that were displayed
+    size_t mPrivateBytes;           // Increase in private bytes during the analysis
+};
+
+size_t GetPrivateBytes()
+{
+    PROCESS_MEMORY_COUNTERS_EX pmc = {};
+    pmc.cb = sizeof(pmc);
+    GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*) &pmc, sizeof(pmc));
+    return pmc.PrivateUsage;
+}
+
+size_t GetPeakWorkingSet()
+{
+    PROCESS_MEMORY_COUNTERS_EX pmc = {};
+    pmc.cb = sizeof(pmc);
+    GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*) &pmc, sizeof(pmc));
+    return pmc.PeakWorkingSetSize;
+}
+
+// The average cost of the QueryPerformanceCounter() calls used to time each
+// event, to be subtracted from the per-handler timings.
+double MeasureTimerOverhead()
+{
+    uint32_t const count = 1000000;
+    LARGE_INTEGER t0 = {};
+    LARGE_INTEGER t1 = {};
+    LARGE_INTEGER t = {};
+    uint64_t ticks = 0;
+    QueryPerformanceCounter(&t0);
+    for (uint32_t i = 0; i < count; ++i) {
+        QueryPerformanceCounter(&t);
+        QueryPerformanceCounter(&t1);
+        ticks += t1.QuadPart - t.QuadPart;
+    }
+    return (double) ticks / (double) count;
+}
+
+void CountPresents(
+    std::vector<std::shared_ptr<PresentEvent>> const& presents,
+    PresentMode expectedMode,
+    RunResult* result)
+{
+    for (auto const& p : presents) {
+        if (p->ProcessId == DWM_PROCESS_ID) {
+            continue;
+        }
+
+        result->mPresentCount += 1;
+        if (p->PresentMode == expectedMode && p->FinalState == PresentResult::Presented) {
+            result->mExpectedPresentCount += 1;
+        }
+    }
+}
+
+template<bool TIME_HANDLERS>
+void Run(
+    std::vector<EventSchema> const& schemas,
+    SyntheticTrace const& trace,
+    PresentMode expectedMode,
+    bool trackGpu,
+    size_t memoryBudget,
+    bool decodePlans,
+    HandlerStats* handlerStats,
+    RunResult* result)
+{
+    result->mPresentCount = 0;
+    result->mExpectedPresentCount = 0;
+
+    auto privateBytes = GetPrivateBytes();
+
+    PMTraceConsumer consumer;
+    consumer.mTrackDisplay = true;
+    consumer.mTrackGPU = trackGpu;
+    consumer.mDeferralTimeLimit = 2 * TIMESTAMP_FREQUENCY;
+    consumer.SetMemoryBudget(memoryBudget);
+    consumer.mMetadata.decodePlansEnabled_ = decodePlans;
+    AddMetadata(&consumer.mMetadata, schemas);
+
+    PMTraceSession session;
+    session.mPMConsumer = &consumer;
+    session.mTimestampFrequency.QuadPart = TIMESTAMP_FREQUENCY;
+    auto eventRecordCallback = session.GetOfflineEventRecordCallback();
+
+    EVENT_RECORD eventRecord = {};
+    eventRecord.EventHeader.Flags = EVENT_HEADER_FLAG_64_BIT_HEADER;
+    eventRecord.UserContext = &session;
+
+    std::vector<std::shared_ptr<PresentEvent>> presents;
+    presents.reserve(DEQUEUE_INTERVAL);
+
+    LARGE_INTEGER start = {};
+    LARGE_INTEGER stop = {};
+    QueryPerformanceCounter(&start);
+
+    auto eventCount = trace.mEvents.size();
+    for (size_t i = 0; i < eventCount; ++i) {
+        auto const& e = trace.mEvents[i];
+        auto const& schema = schemas[e.mType];
+        eventRecord.EventHeader.ProviderId = schema.mProviderId;
+        eventRecord.EventHeader.EventDescriptor = schema.mDescriptor;
+        eventRecord.EventHeader.TimeStamp.QuadPart = e.mTimestamp;
+        eventRecord.EventHeader.ProcessId = e.mProcessId;
+        eventRecord.EventHeader.ThreadId = e.mThreadId;
+        eventRecord.UserData = (void*) (trace.mData.data() + e.mDataOffset);
+        eventRecord.UserDataLength = e.mDataSize;
+
+        #pragma warning(suppress: 4127) // conditional expression is constant
+        if (TIME_HANDLERS) {
+            LARGE_INTEGER t0 = {};
+            LARGE_INTEGER t1 = {};
+            QueryPerformanceCounter(&t0);
+            (*eventRecordCallback)(&eventRecord);
+            QueryPerformanceCounter(&t1);
+            handlerStats[e.mType].mTicks += t1.QuadPart - t0.QuadPart;
+            handlerStats[e.mType].mCount += 1;
+        } else {
+            (*eventRecordCallback)(&eventRecord);
+        }
+
+        if ((i + 1) % DEQUEUE_INTERVAL == 0) {
+            consumer.DequeuePresentEvents(presents);
+            CountPresents(presents, expectedMode, result);
+        }
+    }
+    consumer.DequeuePresentEvents(presents);
+    CountPresents(presents, expectedMode, result);
+
+    QueryPerformanceCounter(&stop);
+    result->mTicks = stop.QuadPart - start.QuadPart;
+
+    auto privateBytesAfter = GetPrivateBytes();
+    result->mPrivateBytes = privateBytesAfter > privateBytes ? privateBytesAfter - privateBytes : 0;
+}
+
+struct EtlRunResult {
+    uint64_t mTicks;                // Duration of the analysis, including opening the ETL
+    uint64_t mPresentCount;         // Presents dequeued
+};
+
+// Analyze an ETL with either ProcessTrace() or EtlReader.  As in PresentMon, the events are
+// processed on another thread while this thread dequeues the results.  Returns false if the ETL
+// couldn't be opened, or if EtlReader was requested but doesn't support the ETL.
+bool RunEtl(
+    wchar_t const* etlPath,
+    bool nativeEtlReader,
+    size_t memoryBudget,
+    bool decodePlans,
+    EtlRunResult* result)
+{
+    result->mPresentCount = 0;
+
+    PMTraceConsumer consumer;
+    consumer.mTrackDisplay = true;
+    consumer.mTrackGPU = true;
+    consumer.mTrackInput = true;
+    consumer.SetMemoryBudget(memoryBudget);
+    consumer.mMetadata.decodePlansEnabled_ = decodePlans;
+
+    LARGE_INTEGER start = {};
+    LARGE_INTEGER stop = {};
+    QueryPerformanceCounter(&start);
+
+    PMTraceSession session;
+    session.mPMConsumer = &consumer;
+    session.mUseNativeEtlReader = nativeEtlReader;
+    if (session.Start(etlPath, L"pm_consumer_bench") != ERROR_SUCCESS) {
+        return false;
+    }
+    if (nativeEtlReader && session.mEtlReader == nullptr) {
+        session.Stop();
+        return false;
+    }
+    consumer.mDeferralTimeLimit = session.mTimestampFrequency.QuadPart * 2;
+
+    std::atomic<bool> done(false);
+    std::thread thread([&]() {
+        if (session.mEtlReader != nullptr) {
+            session.ProcessEtlReader();
+        } else {
+            ProcessTrace(&session.mTraceHandle, 1, NULL, NULL);
+        }
+        done = true;
+        consumer.InterruptWaitForPresentEvents();
+    });
+
+    std::vector<ProcessEvent> processEvents;
+    std::vector<std::shared_ptr<PresentEvent>> presents;
+    for (;;) {
+        auto last = done.load();
+        consumer.DequeueProcessEvents(processEvents);
+        consumer.DequeuePresentEvents(presents);
+        result->mPresentCount += presents.size();
+        if (last) {
+            break;
+        }
+        consumer.WaitForPresentEvents(10, (uint32_t) DEQUEUE_INTERVAL);
+    }
+
+    thread.join();
+    session.Stop();
+
+    QueryPerformanceCounter(&stop);
+    result->mTicks = stop.QuadPart - start.QuadPart;
+    return true;
+}
+
+int RunEtlBenchmark(
+    wchar_t const* etlPath,
+    uint32_t iterationCount,
+    size_t memoryBudget,
+    bool decodePlans)
+{
+    LARGE_INTEGER frequency = {};
+    QueryPerformanceFrequency(&frequency);
+
+    printf("%-14s %10s %11s %9s\n", "Reader", "Presents", "ms", "Speedup");
+
+    double processTraceMs = 0.0;
+    for (auto nativeEtlReader : { false, true }) {
+        EtlRunResult best = {};
+        best.mTicks = UINT64_MAX;
+        for (uint32_t i = 0; i < iterationCount; ++i) {
+            EtlRunResult result = {};
+            if (!RunEtl(etlPath, nativeEtlReader, memoryBudget, decodePlans, &result)) {
+                fprintf(stderr, "error: failed to %s: %ls\n", nativeEtlReader ? "read the ETL with EtlReader" : "open the ETL", etlPath);
+                return 1;
+            }
+            if (result.mTicks < best.mTicks) {
+                best = result;
+            }
+        }
+
+        auto ms = 1000.0 * (double) best.mTicks / (double) frequency.QuadPart;
+        if (!nativeEtlReader) {
+            processTraceMs = ms;
+        }
+        printf("%-14s %10llu %11.1f %8.2fx\n",
+            nativeEtlReader ? "EtlReader" : "ProcessTrace",
+            best.mPresentCount,
+            ms,
+            processTraceMs / ms);
+    }
+
+    return 0;
+}
+
+void usage()
+{
+    fprintf(stderr,
+        "Measure PMTraceConsumer's event analysis throughput using synthetic events.\n"
+        "usage: pm_consumer_bench.exe [options]\n"
+        "    --mode NAME       Present mode to generate events for, or 'all' (default).\n"
+        "    --apps N          Number of applications presenting concurrently (default 1).\n"
+        "    --frames N        Number of frames to generate per application (default 100000).\n"
+        "    --iterations N    Number of times to analyze the events; the fastest is reported (default 5).\n"
+        "    --handlers        Also report the time spent handling each type of event.\n"
+        "    --gpu_packets N   Also generate N DMA packets per application frame, and track GPU work.\n"
+        "    --memory_kb N     Limit the memory the consumer uses to track presents to about N KB.\n"
+        "    --no_decode_plans Decode every event by walking its metadata, instead of using the cached\n"
+        "                      decode plans, to measure how much the plans save.\n"
+        "    --etl PATH        Instead of synthetic events, analyze the ETL at PATH reading it with\n"
+        "                      ProcessTrace() and then with EtlReader, and compare their times.\n"
+        "present modes:\n");
+    for (auto const& mode : MODES) {
+        fprintf(stderr, "    %ls\n", mode.mName);
+    }
+}
+
+bool ParseUInt(wchar_t const* s, uint32_t* value)
+{
+    wchar_t* end = nullptr;
+    auto v = wcstoul(s, &end, 10);
+    if (end == s || *end != L'\0' || v == 0) {
+        return false;
+    }
+    *value = (uint32_t) v;
+    return true;
+}
+
+}
+
+int wmain(
+    int argc,
+    wchar_t** argv)
+{
+    wchar_t const* modeName = L"all";
+    wchar_t const* etlPath = nullptr;
+    uint32_t appCount = 1;
+    uint32_t frameCount = 100000;
+    uint32_t iterationCount = 5;
+    uint32_t gpuPacketCount = 0;
+    uint32_t memoryBudgetKB = 0;
+    bool timeHandlers = false;
+    bool decodePlans = true;
+    for (int i = 1; i < argc; ++i) {
+        if (wcscmp(argv[i], L"--handlers") == 0) {
+            timeHandlers = true;
+            continue;
+        }
+        if (wcscmp(argv[i], L"--no_decode_plans") == 0) {
+            decodePlans = false;
+            continue;
+        }
+        if (i + 1 < argc) {
+            if (wcscmp(argv[i], L"--mode") == 0) {
+                modeName = argv[++i];
+                continue;
+            }
+            if (wcscmp(argv[i], L"--etl") == 0) {
+                etlPath = argv[++i];
+                continue;
+            }
+            if (wcscmp(argv[i], L"--apps") == 0 && ParseUInt(argv[i + 1], &appCount)) {
+                i += 1;
+                continue;
+            }
+            if (wcscmp(argv[i], L"--frames") == 0 && ParseUInt(argv[i + 1], &frameCount)) {
+                i += 1;
+                continue;
+            }
+            if (wcscmp(argv[i], L"--iterations") == 0 && ParseUInt(argv[i + 1], &iterationCount)) {
+                i += 1;
+                continue;
+            }
+            if (wcscmp(argv[i], L"--gpu_packets") == 0 && ParseUInt(argv[i + 1], &gpuPacketCount)) {
+                i += 1;
+                continue;
+            }
+            if (wcscmp(argv[i], L"--memory_kb") == 0 && ParseUInt(argv[i + 1], &memoryBudgetKB)) {
+                i += 1;
+                continue;
+            }
+        }
+        fprintf(stderr, "error: unrecognized argument: %ls\n", argv[i]);
+        usage();
+        return 1;
+    }
+
+    auto memoryBudget64 = (uint64_t) memoryBudgetKB << 10;
+    auto memoryBudget = memoryBudget64 > SIZE_MAX ? SIZE_MAX : (size_t) memoryBudget64;
+
+    if (etlPath != nullptr) {
+        return RunEtlBenchmark(etlPath, iterationCount, memoryBudget, decodePlans);
+    }
+
+    std::vector<ModeInfo> modes;
+    for (auto const& mode : MODES) {
+        if (wcscmp(modeName, L"all") == 0 || wcscmp(modeName, mode.mName) == 0) {
+            modes.emplace_back(mode);
+        }
+    }
+    if (modes.empty()) {
+        fprintf(stderr, "error: unrecognized present mode: %ls\n", modeName);
+        usage();
+        return 1;
+    }
+
+    LARGE_INTEGER frequency = {};
+    QueryPerformanceFrequency(&frequency);
+    auto ticksToNs = 1000000000.0 / (double) frequency.QuadPart;
+    auto timerOverheadNs = timeHandlers ? MeasureTimerOverhead() * ticksToNs : 0.0;
+
+    auto schemas = CreateSchemas();
+
+    printf("%-36s %10s %10s %9s %9s %11s %11s\n", "PresentMode", "Events", "Presents", "Expected", "Mevents/s", "ns/event", "PrivateMB");
+
+    bool allExpected = true;
+    for (auto const& mode : modes) {
+        SyntheticTrace trace;
+        {
+            Generator generator(&trace, mode.mMode, appCount, gpuPacketCount);
+            for (uint32_t i = 0; i < frameCount; ++i) {
+                generator.Frame(i);
+            }
+        }
+
+        RunResult best = {};
+        best.mTicks = UINT64_MAX;
+        for (uint32_t i = 0; i < iterationCount; ++i) {
+            RunResult result = {};
+            Run<false>(schemas, trace, mode.mMode, gpuPacketCount > 0, memoryBudget, decodePlans, nullptr, &result);
+            if (result.mTicks < best.mTicks) {
+                best = result;
+            }
+        }
+
+        auto eventCount = trace.mEvents.size();
+        auto ns = (double) best.mTicks * ticksToNs;
+        auto expectedPercent = best.mPresentCount == 0 ? 0.0 : 100.0 * (double) best.mExpectedPresentCount / (double) best.mPresentCount;
+        printf("%-36ls %10zu %10llu %8.1f%% %9.2f %11.1f %11.1f\n",
+            mode.mName,
+            eventCount,
+            best.mPresentCount,
+            expectedPercent,
+            (double) eventCount * 1000.0 / ns,
+            ns / (double) eventCount,
+            (double) best.mPrivateBytes / (1024.0 * 1024.0));
+
+        // Nearly every generated present should be analyzed as the intended
+        // mode, otherwise the generator no longer matches what the consumer
+        // expects and the results aren't meaningful.
+        if (expectedPercent < 99.0) {
+            allExpected = false;
+        }
+
+        if (timeHandlers) {
+            std::vector<HandlerStats> handlerStats(EVENT_TYPE_COUNT);
+            RunResult result = {};
+            Run<true>(schemas, trace, mode.mMode, gpuPacketCount > 0, memoryBudget, decodePlans, handlerStats.data(), &result);
+
+            for (uint32_t i = 0; i < EVENT_TYPE_COUNT; ++i) {
+                auto const& stats = handlerStats[i];
+                if (stats.mCount > 0) {
+                    auto handlerNs = std::max((double) stats.mTicks * ticksToNs / (double) stats.mCount - timerOverheadNs, 0.0);
+                    printf("    %-48s %10llu %11.1f\n", schemas[i].mName, stats.mCount, handlerNs);
+                }
+            }
+        }
+    }
+
+    printf("\nPeak working set: %.1f MB (includes the generated events)\n", (double) GetPeakWorkingSet() / (1024.0 * 1024.0));
+    if (timeHandlers) {
+        printf("Handler times are averages of individually-timed events, less %.1f ns of timer overhead.\n", timerOverheadNs);
+    }
+
+    if (!allExpected) {
+        fflush(stdout);
+        fprintf(stderr, "error: some presents were not analyzed as the expected PresentMode.\n");
+        return 2;
+    }
+
+    return 0;
+}
@@ -1,12 +1,29 @@
 // Copyright (C) 2017-2024 Intel Corporation
 // SPDX-License-Identifier: MIT
 
-#include <array>
-#include <fstream>
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+
+#include "../../PresentData/ColumnarCapture.hpp"
+#include "../../PresentData/CsvIndex.hpp"
+#include "../../PresentData/CsvReader.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <float.h>
+#include <functional>
+#include <memory>
+#include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include <string>
-#include <sstream>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace {
 
@@ -44,18 +61,44 @@ struct Options {
     bool mQpcTime;
 };
 
+// The rows to convert (--start_time, --end_time, --process_id, and --swap_chain).  Times are in
+// seconds, like the TimeInSeconds column.
+struct Filter {
+    double mStartTime = -DBL_MAX;
+    double mEndTime = DBL_MAX;
+    uint32_t mProcessId = CSV_INDEX_ANY_PROCESS;
+    uint64_t mSwapChainAddress = CSV_INDEX_ANY_SWAP_CHAIN;
+
+    bool IsSet() const
+    {
+        return mStartTime != -DBL_MAX ||
+               mEndTime != DBL_MAX ||
+               mProcessId != CSV_INDEX_ANY_PROCESS ||
+               mSwapChainAddress != CSV_INDEX_ANY_SWAP_CHAIN;
+    }
+
+    bool Matches(double timeInSeconds, uint32_t processId, uint64_t swapChainAddress) const
+    {
+        return timeInSeconds >= mStartTime &&
+               timeInSeconds <= mEndTime &&
+               (mProcessId == CSV_INDEX_ANY_PROCESS || mProcessId == processId) &&
+               (mSwapChainAddress == CSV_INDEX_ANY_SWAP_CHAIN || mSwapChainAddress == swapChainAddress);
+    }
+};
+
+// Application, Runtime, and PresentMode are pointers into a StringTable.
 struct PresentEvent {
-    std::wstring Application;
+    std::string const* Application;
     uint32_t     ProcessID;
     uint64_t     SwapChainAddress;
-    std::wstring Runtime;
-    uint32_t     SyncInterval;
+    std::string const* Runtime;
+    int32_t      SyncInterval;
     uint32_t     PresentFlags;
     bool         Dropped;
     double       TimeInSeconds;
     double       msInPresentAPI;
     bool         AllowsTearing;
-    std::wstring PresentMode;
+    std::string const* PresentMode;
     double       msUntilRenderComplete;
     double       msUntilDisplayed;
     double       msBetweenDisplayChange;
@@ -74,53 +117,208 @@ struct SwapChainData {
 
 using SwapChains = std::unordered_map<uint32_t, std::unordered_map<uint64_t, SwapChainData> >;
 
-void WriteCsvHeader(Options const& opts)
+// String columns have very few distinct values, and usually the same value as the previous row, so
+// PresentEvents refer to a single copy of each value.
+struct StringTable {
+    std::unordered_set<std::string> mStrings;
+    std::string mKey;
+
+    std::string const* Get(CsvField const& field, std::string const* previous)
+    {
+        if (previous != nullptr && field == *previous) {
+            return previous;
+        }
+        mKey.assign(field.mData, field.mSize);
+        return &*mStrings.insert(mKey).first;
+    }
+};
+
+// The converted CSV is formatted into mBuffer, which is written to mFile whenever it gets large.
+// Outputs without an mFile just collect the CSV (see ConvertCsvSplit()).
+//
+// Like PresentMon's CsvFile, files are opened in binary mode and get a UTF-8 BOM and CRLF line
+// endings.  stdout is left in text mode, so it gets no BOM and "\n" line endings.
+struct Output {
+    enum { FLUSH_SIZE = 1024 * 1024 };
+
+    FILE* mFile = nullptr;
+    bool mIsStdout = false;
+    std::vector<char> mBuffer;
+    size_t mSize = 0;
+    bool mError = false;
+
+    void Printf(char const* format, ...)
+    {
+        for (;;) {
+            auto available = mBuffer.size() - mSize;
+
+            va_list args;
+            va_start(args, format);
+            auto n = vsnprintf(mBuffer.data() + mSize, available, format, args);
+            va_end(args);
+
+            if (n < 0) {
+                mError = true;
+                return;
+            }
+            if ((size_t) n < available) {
+                mSize += (size_t) n;
+                break;
+            }
+            mBuffer.resize(std::max(2 * mBuffer.size(), mSize + (size_t) n + 4096));
+        }
+
+        if (mFile != nullptr && mSize >= FLUSH_SIZE) {
+            Flush();
+        }
+    }
+
+    void Write(char const* data, size_t size)
+    {
+        if (mBuffer.size() - mSize < size) {
+            mBuffer.resize(std::max(2 * mBuffer.size(), mSize + size));
+        }
+        memcpy(mBuffer.data() + mSize, data, size);
+        mSize += size;
+
+        if (mFile != nullptr && mSize >= FLUSH_SIZE) {
+            Flush();
+        }
+    }
+
+    void WriteBom()
+    {
+        if (!mIsStdout) {
+            Write("\xef\xbb\xbf", 3);
+        }
+    }
+
+    void EndRow()
+    {
+        if (mIsStdout) {
+            Write("\n", 1);
+        } else {
+            Write("\r\n", 2);
+        }
+    }
+
+    void Flush()
+    {
+        if (mSize > 0 && fwrite(mBuffer.data(), 1, mSize, mFile) != mSize) {
+            mError = true;
+        }
+        mSize = 0;
+    }
+};
+
+// Progress of all the conversions, which is reported by the main thread in batch mode.
+struct Progress {
+    std::atomic<uint64_t> mBytesConverted{ 0 };
+    std::atomic<uint32_t> mFilesConverted{ 0 };
+};
+
+// The state of one conversion.  Each conversion has its own state, so that several files can be
+// converted at once.
+struct Conversion {
+    wchar_t const* mInputPath = nullptr;
+    Output* mOutput = nullptr;
+    Progress* mProgress = nullptr;
+    uint64_t mBytesReported = 0;        // Input bytes added to mProgress so far
+    Filter mFilter;
+
+    Options mOpts = {};
+    uint32_t mColumnIndex[NumColumns];
+    uint32_t mColumnCount = 0;
+    SwapChains mSwapChains;
+    StringTable mStrings;
+    PresentEvent mPrev = {};
+
+    // The time and QPCTime of the first present reported, which CPUFrameQPC is computed relative
+    // to.
+    bool mFirstReport = true;
+    double mT0 = 0.0;
+    uint64_t mQ0 = 0;
+};
+
+void PrintMessage(char const* type, wchar_t const* path, char const* format, va_list args)
+{
+    char message[512];
+    vsnprintf(message, _countof(message), format, args);
+    fprintf(stderr, "%s: %ls: %s\n", type, path, message);
+}
+
+void PrintError(wchar_t const* path, char const* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    PrintMessage("error", path, format, args);
+    va_end(args);
+}
+
+void PrintWarning(wchar_t const* path, char const* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    PrintMessage("warning", path, format, args);
+    va_end(args);
+}
+
+void ReportProgress(Conversion* conv, uint64_t bytesConverted)
 {
-    printf("Application"
-           ",ProcessID"
-           ",SwapChainAddress"
-           ",Runtime"
-           ",SyncInterval"
-           ",PresentFlags");
+    conv->mProgress->mBytesConverted += bytesConverted - conv->mBytesReported;
+    conv->mBytesReported = bytesConverted;
+}
+
+void WriteCsvHeader(Output* out, Options const& opts)
+{
+    out->WriteBom();
+    out->Printf("Application"
+                ",ProcessID"
+                ",SwapChainAddress"
+                ",Runtime"
+                ",SyncInterval"
+                ",PresentFlags");
     if (opts.mTrackDisplay) {
-        printf(",AllowsTearing"
-               ",PresentMode");
+        out->Printf(",AllowsTearing"
+                    ",PresentMode");
     }
     if (opts.mQpcTime) {
-        printf(",CPUFrameQPC");
+        out->Printf(",CPUFrameQPC");
     } else {
-        printf(",CPUFrameTime");
+        out->Printf(",CPUFrameTime");
     }
-    printf(",CPUDuration"
-           ",CPUFramePacingStall");
+    out->Printf(",CPUDuration"
+                ",CPUFramePacingStall");
     if (opts.mTrackGPU) {
-        printf(",GPULatency"
-               ",GPUDuration"
-               ",GPUBusy");
+        out->Printf(",GPULatency"
+                    ",GPUDuration"
+                    ",GPUBusy");
     }
     if (opts.mTrackGPUVideo) {
-        printf(",VideoBusy");
+        out->Printf(",VideoBusy");
     }
     if (opts.mTrackDisplay) {
-        printf(",DisplayLatency"
-               ",DisplayDuration");
+        out->Printf(",DisplayLatency"
+                    ",DisplayDuration");
     }
     if (opts.mTrackInput) {
-        printf(",InputLatency");
+        out->Printf(",InputLatency");
     }
-    printf("\n");
+    out->EndRow();
 }
 
-void ReportMetrics(Options const& opts, SwapChainData* chain, PresentEvent const& p, PresentEvent const* nextDisplayedPresent)
+void ReportMetrics(Conversion* conv, SwapChainData* chain, PresentEvent const& p, PresentEvent const* nextDisplayedPresent)
 {
-    static bool first = true;
-    static double t0 = 0.0;
-    static uint64_t q0 = 0;
-    if (first) {
-        first = false;
-        t0 = 1000.0 * p.TimeInSeconds;
-        q0 = p.QPCTime;
+    auto const& opts = conv->mOpts;
+    auto out = conv->mOutput;
+
+    if (conv->mFirstReport) {
+        conv->mFirstReport = false;
+        conv->mT0 = 1000.0 * p.TimeInSeconds;
+        conv->mQ0 = p.QPCTime;
     }
+    auto t0 = conv->mT0;
+    auto q0 = conv->mQ0;
 
     // PB = PresentStartTime
     // PE = PresentEndTime
@@ -191,225 +389,1088 @@ void ReportMetrics(Options const& opts, SwapChainData* chain, PresentEvent const
         metrics_mVideoBusy   = 0.0;
     }
 
-    printf("%ls,%d,0x%016llX,%ls,%d,%d", p.Application.c_str(),
-                                         p.ProcessID,
-                                         p.SwapChainAddress,
-                                         p.Runtime.c_str(),
-                                         p.SyncInterval,
-                                         p.PresentFlags);
+    out->Printf("%s,%d,0x%016llX,%s,%d,%d", p.Application->c_str(),
+                                            p.ProcessID,
+                                            p.SwapChainAddress,
+                                            p.Runtime->c_str(),
+                                            p.SyncInterval,
+                                            p.PresentFlags);
     if (opts.mTrackDisplay) {
-        printf(",%d,%ls", p.AllowsTearing ? 1 : 0,
-                          p.PresentMode.c_str());
+        out->Printf(",%d,%s", p.AllowsTearing ? 1 : 0,
+                              p.PresentMode->c_str());
     }
     if (chain->mNextCPUFrameTimeIsValid) {
         if (opts.mQpcTime) {
-            printf(",%llu", metrics_mCPUFrameQPC);
+            out->Printf(",%llu", metrics_mCPUFrameQPC);
         } else {
-            printf(",%.6lf", metrics_mCPUFrameTime);
+            out->Printf(",%.6lf", metrics_mCPUFrameTime);
         }
-        printf(",%.6lf", metrics_mCPUDuration);
+        out->Printf(",%.6lf", metrics_mCPUDuration);
     } else {
-        printf(",,");
+        out->Printf(",,");
     }
-    printf(",%.6lf", metrics_mCPUFramePacingStall);
+    out->Printf(",%.6lf", metrics_mCPUFramePacingStall);
     if (opts.mTrackGPU) {
         if (chain->mNextCPUFrameTimeIsValid) {
-            printf(",%.6lf", metrics_mGPULatency);
+            out->Printf(",%.6lf", metrics_mGPULatency);
         } else {
-            printf(",");
+            out->Printf(",");
         }
-        printf(",%.6lf,%.6lf", metrics_mGPUDuration,
-                               metrics_mGPUBusy);
+        out->Printf(",%.6lf,%.6lf", metrics_mGPUDuration,
+                                    metrics_mGPUBusy);
     }
     if (opts.mTrackGPUVideo) {
-        printf(",%.6lf", metrics_mVideoBusy);
+        out->Printf(",%.6lf", metrics_mVideoBusy);
     }
     if (opts.mTrackDisplay) {
         if (chain->mNextCPUFrameTimeIsValid) {
-            printf(",%.6lf", metrics_mDisplayLatency);
+            out->Printf(",%.6lf", metrics_mDisplayLatency);
         } else {
-            printf(",");
+            out->Printf(",");
         }
-        printf(",%.6lf", metrics_mDisplayDuration);
+        out->Printf(",%.6lf", metrics_mDisplayDuration);
     }
     if (opts.mTrackInput) {
         if (chain->mNextCPUFrameTimeIsValid) {
-            printf(",%.6lf", metrics_mInputLatency);
+            out->Printf(",%.6lf", metrics_mInputLatency);
         } else {
-            printf(",");
+            out->Printf(",");
         }
     }
-    printf("\n");
+    out->EndRow();
 
     chain->mNextCPUFrameTime        = p.TimeInSeconds * 1000.0 + p.msInPresentAPI;
     chain->mNextCPUFrameTimeIsValid = true;
 }
 
-void usage()
+// Columnar captures are converted into the same CSV that PresentMon would have written, using the
+// columns and time unit that were used for the capture.
+enum ColumnarTimeUnit {
+    ColumnarTimeUnit_MilliSeconds,
+    ColumnarTimeUnit_QPC,
+    ColumnarTimeUnit_QPCMilliSeconds,
+    ColumnarTimeUnit_DateTime,
+};
+
+bool HasColumn(ColumnarFileHeader const& header, ColumnarColumn column)
 {
-    fprintf(stderr,
-        "Convert a PresentMon v1.x CSV file into v2.0 CSV file.\n"
-        "usage: pm_convert_csv.exe path_to_input.csv\n");
+    return (header.mColumnMask & (1u << column)) != 0;
 }
 
+void WriteColumnarCsvHeader(Output* out, ColumnarFileHeader const& header)
+{
+    out->WriteBom();
+    out->Printf("Application"
+                ",ProcessID"
+                ",SwapChainAddress"
+                ",PresentRuntime"
+                ",SyncInterval"
+                ",PresentFlags");
+    if (HasColumn(header, COLUMNAR_PRESENT_MODE)) {
+        out->Printf(",AllowsTearing"
+                    ",PresentMode");
+    }
+    if (HasColumn(header, COLUMNAR_FRAME_TYPE)) {
+        out->Printf(",FrameType");
+    }
+    switch (header.mTimeUnit) {
+    case ColumnarTimeUnit_QPC:             out->Printf(",CPUStartQPC"); break;
+    case ColumnarTimeUnit_QPCMilliSeconds: out->Printf(",CPUStartQPCTime"); break;
+    case ColumnarTimeUnit_DateTime:        out->Printf(",CPUStartDateTime"); break;
+    default:                               out->Printf(",CPUStartTime"); break;
+    }
+    out->Printf(",FrameTime"
+                ",CPUBusy"
+                ",CPUWait");
+    if (HasColumn(header, COLUMNAR_GPU_LATENCY)) {
+        out->Printf(",GPULatency"
+                    ",GPUTime"
+                    ",GPUBusy"
+                    ",GPUWait");
+    }
+    if (HasColumn(header, COLUMNAR_VIDEO_BUSY)) {
+        out->Printf(",VideoBusy");
+    }
+    if (HasColumn(header, COLUMNAR_DISPLAYED_TIME)) {
+        out->Printf(",DisplayLatency"
+                    ",DisplayedTime");
+    }
+    if (HasColumn(header, COLUMNAR_CLICK_TO_PHOTON_LATENCY)) {
+        out->Printf(",ClickToPhotonLatency");
+    }
+    out->EndRow();
 }
 
-int wmain(
-    int argc,
-    wchar_t** argv)
+// Same as PMTraceSession::TimestampToLocalSystemTime()
+void PrintColumnarDateTime(Output* out, ColumnarFileHeader const& header, uint64_t timestamp)
 {
-    if (argc != 2) {
-        usage();
-        return 1;
+    enum { TIMESTAMP_TYPE_SYSTEM_TIME = 2 };
+    if (header.mTimestampType != TIMESTAMP_TYPE_SYSTEM_TIME) {
+        auto delta100ns = (timestamp - header.mStartTimestamp) * 10000000ull / header.mTimestampFrequency;
+        timestamp = header.mStartFileTime + delta100ns;
     }
 
-    std::wifstream file(argv[1]);
-    if (!file.is_open()) {
-        fprintf(stderr, "error: failed to open input file: %ls\n", argv[1]);
-        usage();
-        return 2;
+    FILETIME lft{};
+    SYSTEMTIME st{};
+    FileTimeToLocalFileTime((FILETIME*) &timestamp, &lft);
+    FileTimeToSystemTime(&lft, &st);
+    out->Printf(",%u-%u-%u %u:%02u:%02u.%09llu", st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond,
+                                                 (timestamp % 10000000) * 100);
+}
+
+void PrintColumnarMetric(Output* out, double value, bool available)
+{
+    if (available) {
+        out->Printf(",%.4lf", value);
+    } else {
+        out->Printf(",NA");
+    }
+}
+
+void WriteColumnarCsvRow(Output* out, ColumnarCaptureReader const& reader, ColumnarFrame const& f)
+{
+    auto const& header = reader.mHeader;
+
+    out->Printf("%s,%d,0x%llX,%s,%d,%d", reader.GetString(f.mApplication),
+                                         f.mProcessId,
+                                         f.mSwapChainAddress,
+                                         reader.GetString(f.mPresentRuntime),
+                                         f.mSyncInterval,
+                                         f.mPresentFlags);
+    if (HasColumn(header, COLUMNAR_PRESENT_MODE)) {
+        out->Printf(",%d,%s", f.mAllowsTearing,
+                              reader.GetString(f.mPresentMode));
+    }
+    if (HasColumn(header, COLUMNAR_FRAME_TYPE)) {
+        out->Printf(",%s", reader.GetString(f.mFrameType));
+    }
+    switch (header.mTimeUnit) {
+    case ColumnarTimeUnit_QPC:             out->Printf(",%llu", f.mCPUStart); break;
+    case ColumnarTimeUnit_QPCMilliSeconds: out->Printf(",%.4lf", 1000.0 * f.mCPUStart / header.mTimestampFrequency); break;
+    case ColumnarTimeUnit_DateTime:        PrintColumnarDateTime(out, header, f.mCPUStart); break;
+    default:                               out->Printf(",%.4lf", 1000.0 * (f.mCPUStart - header.mStartTimestamp) / header.mTimestampFrequency); break;
+    }
+    out->Printf(",%.4lf,%.4lf,%.4lf", f.mCPUBusy + f.mCPUWait,
+                                      f.mCPUBusy,
+                                      f.mCPUWait);
+    if (HasColumn(header, COLUMNAR_GPU_LATENCY)) {
+        out->Printf(",%.4lf,%.4lf,%.4lf,%.4lf", f.mGPULatency,
+                                                f.mGPUBusy + f.mGPUWait,
+                                                f.mGPUBusy,
+                                                f.mGPUWait);
     }
+    if (HasColumn(header, COLUMNAR_VIDEO_BUSY)) {
+        out->Printf(",%.4lf", f.mVideoBusy);
+    }
+    if (HasColumn(header, COLUMNAR_DISPLAYED_TIME)) {
+        PrintColumnarMetric(out, f.mDisplayLatency, f.mDisplayedTime != 0.0);
+        PrintColumnarMetric(out, f.mDisplayedTime,  f.mDisplayedTime != 0.0);
+    }
+    if (HasColumn(header, COLUMNAR_CLICK_TO_PHOTON_LATENCY)) {
+        PrintColumnarMetric(out, f.mClickToPhotonLatency, f.mClickToPhotonLatency != 0.0);
+    }
+    out->EndRow();
+}
+
+int ConvertColumnarCapture(Conversion* conv, ColumnarCaptureReader* reader)
+{
+    if (reader->mHeader.mTimestampFrequency == 0) {
+        PrintError(conv->mInputPath, "invalid columnar capture header.");
+        return 4;
+    }
+    if (!reader->mHasFooter) {
+        PrintWarning(conv->mInputPath, "columnar capture is incomplete, converting the %zu complete chunks.", reader->mChunks.size());
+    }
+
+    WriteColumnarCsvHeader(conv->mOutput, reader->mHeader);
 
-    SwapChains swapChains;
-
-    std::wstring line;
-    if (std::getline(file, line)) {
-        std::wstringstream ss(line);
-
-        if (line.size() >= 3 && line[0] == 0xef && line[1] == 0xbb && line[2] == 0xbf) {
-            ss.seekg(3);
-        }
-
-        uint32_t columnIndex[NumColumns];
-        for (uint32_t i = 0; i < NumColumns; ++i) {
-            columnIndex[i] = UINT32_MAX;
-        }
-
-        std::wstring word;
-        for (uint32_t i = 0; std::getline(ss, word, L','); ++i) {
-                 if (word == L"Application")           columnIndex[Application]            = i;
-            else if (word == L"ProcessID")             columnIndex[ProcessID]              = i;
-            else if (word == L"SwapChainAddress")      columnIndex[SwapChainAddress]       = i;
-            else if (word == L"Runtime")               columnIndex[Runtime]                = i;
-            else if (word == L"SyncInterval")          columnIndex[SyncInterval]           = i;
-            else if (word == L"PresentFlags")          columnIndex[PresentFlags]           = i;
-            else if (word == L"Dropped")               columnIndex[Dropped]                = i;
-            else if (word == L"TimeInSeconds")         columnIndex[TimeInSeconds]          = i;
-            else if (word == L"msInPresentAPI")        columnIndex[msInPresentAPI]         = i;
-            else if (word == L"msBetweenPresents")     columnIndex[msBetweenPresents]      = i;
-            else if (word == L"AllowsTearing")         columnIndex[AllowsTearing]          = i;
-            else if (word == L"PresentMode")           columnIndex[PresentMode]            = i;
-            else if (word == L"msUntilRenderComplete") columnIndex[msUntilRenderComplete]  = i;
-            else if (word == L"msUntilDisplayed")      columnIndex[msUntilDisplayed]       = i;
-            else if (word == L"msBetweenDisplayChange")columnIndex[msBetweenDisplayChange] = i;
-            else if (word == L"msUntilRenderStart")    columnIndex[msUntilRenderStart]     = i;
-            else if (word == L"msGPUActive")           columnIndex[msGPUActive]            = i;
-            else if (word == L"msGPUVideoActive")      columnIndex[msGPUVideoActive]       = i;
-            else if (word == L"msSinceInput")          columnIndex[msSinceInput]           = i;
-            else if (word == L"QPCTime")               columnIndex[QPCTime]                = i;
-            else if (word == L"WasBatched")            columnIndex[WasBatched]             = i;
-            else if (word == L"DwmNotified")           columnIndex[DwmNotified]            = i;
-            else {
-                fprintf(stderr, "error: unrecognised column: %ls\n", word.c_str());
-                return 3;
+    // Chunks outside of the filter's time range are skipped without being decoded.
+    auto const& header = reader->mHeader;
+    auto const& filter = conv->mFilter;
+    auto toSeconds = [&](uint64_t timestamp) {
+        return timestamp >= header.mStartTimestamp
+            ?  (double) (timestamp - header.mStartTimestamp) / header.mTimestampFrequency
+            : -(double) (header.mStartTimestamp - timestamp) / header.mTimestampFrequency;
+    };
+
+    std::vector<ColumnarFrame> frames;
+    for (size_t i = 0, n = reader->mChunks.size(); i < n; ++i) {
+        auto const& chunk = reader->mChunks[i];
+        if (toSeconds(chunk.mMaxCPUStart) < filter.mStartTime || toSeconds(chunk.mMinCPUStart) > filter.mEndTime) {
+            continue;
+        }
+        if (!reader->ReadChunk(i, &frames)) {
+            PrintError(conv->mInputPath, "failed to read chunk %zu of the columnar capture.", i);
+            return 5;
+        }
+        for (auto const& f : frames) {
+            if (filter.Matches(toSeconds(f.mCPUStart), f.mProcessId, f.mSwapChainAddress)) {
+                WriteColumnarCsvRow(conv->mOutput, *reader, f);
             }
         }
+    }
+
+    return 0;
+}
+
+int ParseCsvHeader(Conversion* conv, CsvReader* csv)
+{
+    if (!csv->ReadRow()) {
+        PrintError(conv->mInputPath, "input file is empty.");
+        return 3;
+    }
+
+    auto columnIndex = conv->mColumnIndex;
+    for (uint32_t i = 0; i < NumColumns; ++i) {
+        columnIndex[i] = UINT32_MAX;
+    }
+
+    for (uint32_t i = 0, n = (uint32_t) csv->mFields.size(); i < n; ++i) {
+        auto const& word = csv->mFields[i];
+             if (word == "Application")           columnIndex[Application]            = i;
+        else if (word == "ProcessID")             columnIndex[ProcessID]              = i;
+        else if (word == "SwapChainAddress")      columnIndex[SwapChainAddress]       = i;
+        else if (word == "Runtime")               columnIndex[Runtime]                = i;
+        else if (word == "SyncInterval")          columnIndex[SyncInterval]           = i;
+        else if (word == "PresentFlags")          columnIndex[PresentFlags]           = i;
+        else if (word == "Dropped")               columnIndex[Dropped]                = i;
+        else if (word == "TimeInSeconds")         columnIndex[TimeInSeconds]          = i;
+        else if (word == "msInPresentAPI")        columnIndex[msInPresentAPI]         = i;
+        else if (word == "msBetweenPresents")     columnIndex[msBetweenPresents]      = i;
+        else if (word == "AllowsTearing")         columnIndex[AllowsTearing]          = i;
+        else if (word == "PresentMode")           columnIndex[PresentMode]            = i;
+        else if (word == "msUntilRenderComplete") columnIndex[msUntilRenderComplete]  = i;
+        else if (word == "msUntilDisplayed")      columnIndex[msUntilDisplayed]       = i;
+        else if (word == "msBetweenDisplayChange")columnIndex[msBetweenDisplayChange] = i;
+        else if (word == "msUntilRenderStart")    columnIndex[msUntilRenderStart]     = i;
+        else if (word == "msGPUActive")           columnIndex[msGPUActive]            = i;
+        else if (word == "msGPUVideoActive")      columnIndex[msGPUVideoActive]       = i;
+        else if (word == "msSinceInput")          columnIndex[msSinceInput]           = i;
+        else if (word == "QPCTime")               columnIndex[QPCTime]                = i;
+        else if (word == "WasBatched")            columnIndex[WasBatched]             = i;
+        else if (word == "DwmNotified")           columnIndex[DwmNotified]            = i;
+        else {
+            PrintError(conv->mInputPath, "unrecognised column: %s", word.ToString().c_str());
+            return 3;
+        }
+    }
+
+    if (columnIndex[Application]       == UINT32_MAX ||
+        columnIndex[ProcessID]         == UINT32_MAX ||
+        columnIndex[SwapChainAddress]  == UINT32_MAX ||
+        columnIndex[Runtime]           == UINT32_MAX ||
+        columnIndex[SyncInterval]      == UINT32_MAX ||
+        columnIndex[PresentFlags]      == UINT32_MAX ||
+        columnIndex[Dropped]           == UINT32_MAX ||
+        columnIndex[TimeInSeconds]     == UINT32_MAX ||
+        columnIndex[msInPresentAPI]    == UINT32_MAX ||
+        columnIndex[msBetweenPresents] == UINT32_MAX) {
+        PrintError(conv->mInputPath, "missing expected column.");
+        return 4;
+    }
+
+    auto opts = &conv->mOpts;
+    opts->mTrackDisplay  = columnIndex[AllowsTearing]          != UINT32_MAX &&
+                           columnIndex[PresentMode]            != UINT32_MAX &&
+                           columnIndex[msUntilRenderComplete]  != UINT32_MAX &&
+                           columnIndex[msUntilDisplayed]       != UINT32_MAX &&
+                           columnIndex[msBetweenDisplayChange] != UINT32_MAX;
+    opts->mTrackGPU      = columnIndex[msUntilRenderStart]     != UINT32_MAX &&
+                           columnIndex[msGPUActive]            != UINT32_MAX;
+    opts->mTrackGPUVideo = columnIndex[msGPUVideoActive]       != UINT32_MAX;
+    opts->mTrackInput    = columnIndex[msSinceInput]           != UINT32_MAX;
+    opts->mQpcTime       = columnIndex[QPCTime]                != UINT32_MAX;
+
+    conv->mColumnCount = 0;
+    for (uint32_t i = 0; i < NumColumns; ++i) {
+        if (columnIndex[i] != UINT32_MAX) {
+            conv->mColumnCount = std::max(conv->mColumnCount, columnIndex[i] + 1);
+        }
+    }
+
+    return 0;
+}
+
+// Parse the current row of csv.  Returns 0, or an error status if the row is invalid.
+int ParsePresent(Conversion* conv, CsvReader const& csv, PresentEvent* present)
+{
+    auto const& row = csv.mFields;
+    if (row.size() < conv->mColumnCount) {
+        PrintError(conv->mInputPath, "line %llu: missing columns.", csv.mLine);
+        return 5;
+    }
+
+    auto const& columnIndex = conv->mColumnIndex;
+    auto const& prev = conv->mPrev;
+    auto& strings = conv->mStrings;
+    auto& opts = conv->mOpts;
+
+    PresentEvent p = {};
+    bool ok = true;
+    p.Application                 = strings.Get(row[columnIndex[Application]], prev.Application);
+    ok = ok && row[columnIndex[ProcessID]].ParseUInt32(&p.ProcessID);
+    ok = ok && row[columnIndex[SwapChainAddress]].ParseHex(&p.SwapChainAddress);
+    p.Runtime                     = strings.Get(row[columnIndex[Runtime]], prev.Runtime);
+    ok = ok && row[columnIndex[SyncInterval]].ParseInt32(&p.SyncInterval);
+    ok = ok && row[columnIndex[PresentFlags]].ParseUInt32(&p.PresentFlags);
+    p.Dropped                     = row[columnIndex[Dropped]] == "1";
+    ok = ok && row[columnIndex[TimeInSeconds]].ParseDouble(&p.TimeInSeconds);
+    ok = ok && row[columnIndex[msInPresentAPI]].ParseDouble(&p.msInPresentAPI);
+    if (opts.mTrackDisplay) {
+        p.AllowsTearing           = row[columnIndex[AllowsTearing]] == "1";
+        p.PresentMode             = strings.Get(row[columnIndex[PresentMode]], prev.PresentMode);
+        ok = ok && row[columnIndex[msUntilRenderComplete]].ParseDouble(&p.msUntilRenderComplete);
+        ok = ok && row[columnIndex[msUntilDisplayed]].ParseDouble(&p.msUntilDisplayed);
+        ok = ok && row[columnIndex[msBetweenDisplayChange]].ParseDouble(&p.msBetweenDisplayChange);
+    }
+    if (opts.mTrackGPU) {
+        ok = ok && row[columnIndex[msUntilRenderStart]].ParseDouble(&p.msUntilRenderStart);
+        ok = ok && row[columnIndex[msGPUActive]].ParseDouble(&p.msGPUActive);
+    }
+    if (opts.mTrackGPUVideo) {
+        ok = ok && row[columnIndex[msGPUVideoActive]].ParseDouble(&p.msGPUVideoActive);
+    }
+    if (opts.mTrackInput) {
+        ok = ok && row[columnIndex[msSinceInput]].ParseDouble(&p.msSinceInput);
+    }
+
+    if (opts.mQpcTime) {
+        auto const& qpcTime = row[columnIndex[QPCTime]];
+        if (memchr(qpcTime.mData, '.', qpcTime.mSize) == nullptr) {
+            ok = ok && qpcTime.ParseUInt64(&p.QPCTime);
+        } else {
+            opts.mQpcTime = false;
+        }
+    }
+
+    if (!ok) {
+        PrintError(conv->mInputPath, "line %llu: invalid value.", csv.mLine);
+        return 5;
+    }
+
+    *present = p;
+    return 0;
+}
+
+void ProcessPresent(Conversion* conv, PresentEvent const& p)
+{
+    auto chain = &conv->mSwapChains[p.ProcessID][p.SwapChainAddress];
+
+    if (p.Dropped) {
+        if (chain->mPendingPresents.empty()) {
+            ReportMetrics(conv, chain, p, nullptr);
+        } else {
+            chain->mPendingPresents.push_back(p);
+        }
+    } else {
+        for (auto const& pp : chain->mPendingPresents) {
+            ReportMetrics(conv, chain, pp, &p);
+        }
+        chain->mPendingPresents.clear();
+        chain->mPendingPresents.push_back(p);
+    }
+
+    conv->mPrev = p;
+}
+
+// Convert the current row of csv, if it matches the filter.  The output's header is written before
+// the first matching row.
+int ConvertRow(Conversion* conv, CsvReader const& csv, bool* firstRow)
+{
+    PresentEvent p;
+    auto status = ParsePresent(conv, csv, &p);
+    if (status != 0) {
+        return status;
+    }
+
+    if (conv->mFilter.Matches(p.TimeInSeconds, p.ProcessID, p.SwapChainAddress)) {
+        if (*firstRow) {
+            *firstRow = false;
+            WriteCsvHeader(conv->mOutput, conv->mOpts);
+        }
+
+        ProcessPresent(conv, p);
+    }
+
+    if ((csv.mLine & 0xffff) == 0) {
+        ReportProgress(conv, csv.mRowOffset);
+    }
+
+    return 0;
+}
+
+// If the CSV has an index (written by PresentMon --csv_index) that is up to date, find the blocks
+// of rows that may match the filter.  Returns false if there is no usable index.
+bool FindIndexedBlocks(Conversion* conv, CsvReader const& csv, CsvIndexReader* index, std::vector<uint32_t>* blocks)
+{
+    auto indexPath = std::wstring(conv->mInputPath) + L".idx";
+    if (GetFileAttributesW(indexPath.c_str()) == INVALID_FILE_ATTRIBUTES) {
+        return false;
+    }
+    if (!index->Open(indexPath.c_str()) || index->mHeader.mCsvSize != csv.mFileSize) {
+        PrintWarning(conv->mInputPath, "ignoring CSV index that doesn't match the CSV.");
+        return false;
+    }
+
+    // TimeInSeconds is rounded when it is printed, so widen the time range by a millisecond to
+    // make sure that the blocks of all the matching rows are found.
+    auto const& filter = conv->mFilter;
+    CsvIndexQuery query;
+    query.mProcessId        = filter.mProcessId;
+    query.mSwapChainAddress = filter.mSwapChainAddress;
+    if (filter.mStartTime != -DBL_MAX) {
+        query.mBeginTimestamp = index->MilliSecondsToTimestamp(1000.0 * filter.mStartTime - 1.0);
+    }
+    if (filter.mEndTime != DBL_MAX) {
+        query.mEndTimestamp = index->MilliSecondsToTimestamp(1000.0 * filter.mEndTime + 1.0);
+    }
+    index->FindBlocks(query, blocks);
+    return true;
+}
+
+int ConvertCsv(Conversion* conv, CsvReader* csv)
+{
+    auto status = ParseCsvHeader(conv, csv);
+    if (status != 0) {
+        return status;
+    }
+
+    bool firstRow = true;
 
-        if (columnIndex[Application]       == UINT32_MAX ||
-            columnIndex[ProcessID]         == UINT32_MAX ||
-            columnIndex[SwapChainAddress]  == UINT32_MAX ||
-            columnIndex[Runtime]           == UINT32_MAX ||
-            columnIndex[SyncInterval]      == UINT32_MAX ||
-            columnIndex[PresentFlags]      == UINT32_MAX ||
-            columnIndex[Dropped]           == UINT32_MAX ||
-            columnIndex[TimeInSeconds]     == UINT32_MAX ||
-            columnIndex[msInPresentAPI]    == UINT32_MAX ||
-            columnIndex[msBetweenPresents] == UINT32_MAX) {
-            fprintf(stderr, "error: missing expected column.\n");
-            return 4;
-        }
-
-        Options opts;
-        opts.mTrackDisplay  = columnIndex[AllowsTearing]          != UINT32_MAX &&
-                              columnIndex[PresentMode]            != UINT32_MAX &&
-                              columnIndex[msUntilRenderComplete]  != UINT32_MAX &&
-                              columnIndex[msUntilDisplayed]       != UINT32_MAX &&
-                              columnIndex[msBetweenDisplayChange] != UINT32_MAX;
-        opts.mTrackGPU      = columnIndex[msUntilRenderStart]     != UINT32_MAX &&
-                              columnIndex[msGPUActive]            != UINT32_MAX;
-        opts.mTrackGPUVideo = columnIndex[msGPUVideoActive]       != UINT32_MAX;
-        opts.mTrackInput    = columnIndex[msSinceInput]           != UINT32_MAX;
-        opts.mQpcTime       = columnIndex[QPCTime]                != UINT32_MAX;
-
-        std::wstring row[NumColumns];
-        bool firstRow = true;
-        while (std::getline(file, line)) {
-            ss.str(line);
-            ss.clear();
-            for (size_t i = 0; std::getline(ss, word, L','); ++i) {
-                row[i] = word;
+    CsvIndexReader index;
+    std::vector<uint32_t> blocks;
+    if (conv->mFilter.IsSet() && FindIndexedBlocks(conv, *csv, &index, &blocks)) {
+        for (auto i : blocks) {
+            auto const& block = index.mBlocks[i];
+            if (!csv->Seek(block.mOffset, block.mFirstRow + 2)) {
+                PrintError(conv->mInputPath, "CSV index doesn't match the CSV.");
+                return 5;
             }
+            for (uint32_t j = 0; j < block.mRowCount; ++j) {
+                if (!csv->ReadRow()) {
+                    PrintError(conv->mInputPath, "CSV index doesn't match the CSV.");
+                    return 5;
+                }
+                status = ConvertRow(conv, *csv, &firstRow);
+                if (status != 0) {
+                    return status;
+                }
+            }
+        }
+        return 0;
+    }
+
+    while (csv->ReadRow()) {
+        status = ConvertRow(conv, *csv, &firstRow);
+        if (status != 0) {
+            return status;
+        }
+    }
+
+    if (csv->mError) {
+        PrintError(conv->mInputPath, "failed to read line %llu of the input file.", csv->mLine + 1);
+        return 5;
+    }
+
+    return 0;
+}
+
+// With --split, a CSV is converted by several threads, each of which converts the presents of a
+// subset of the swap chains (each swap chain's presents have to be processed in order, but the
+// swap chains are independent).
+//
+// A first pass over the file finds the swap chains, the first present that will be reported (for
+// CPUFrameQPC), and the first row without a valid QPCTime.  Then each thread reads the file
+// again, a segment of rows at a time, converting the rows of its own swap chains.  The output for
+// each row is tagged with the row's index, so that the threads' output can be merged back into the
+// same order as ConvertCsv() would write it.
+enum { SPLIT_SEGMENT_ROWS = 256 * 1024 };
+
+struct SplitSwapChain {
+    uint64_t mRowCount;
+    double mFirstTimeInSeconds;
+    uint64_t mFirstQPCTime;
+    uint32_t mThread;
+};
+
+using SplitSwapChains = std::unordered_map<uint32_t, std::unordered_map<uint64_t, SplitSwapChain> >;
+
+struct SplitSegment {
+    uint64_t mRowIndex;
+    uint64_t mOffset;
+    uint64_t mLine;
+};
+
+struct SplitThread {
+    Conversion mConversion;
+    CsvReader mCsv;
+    Output mOutput;
+    std::vector<std::pair<uint64_t, size_t> > mRowOutput;   // Row index, and the end of its output
+    int mStatus = 0;
+    uint64_t mErrorLine = 0;
+};
+
+void ConvertSplitSegment(
+    SplitThread* thread,
+    uint32_t threadIndex,
+    SplitSwapChains const& swapChains,
+    SplitSegment const& segment,
+    uint64_t rowEnd,
+    uint64_t noQpcRowIndex)
+{
+    auto conv = &thread->mConversion;
+    auto csv = &thread->mCsv;
+    auto hasQpcTime = conv->mColumnIndex[QPCTime] != UINT32_MAX;
+
+    if (!csv->Seek(segment.mOffset, segment.mLine)) {
+        PrintError(conv->mInputPath, "failed to read line %llu of the input file.", segment.mLine);
+        thread->mStatus = 5;
+        thread->mErrorLine = segment.mLine;
+        return;
+    }
+
+    for (auto rowIndex = segment.mRowIndex; rowIndex < rowEnd && csv->ReadRow(); ++rowIndex) {
+        // The first pass already validated the ProcessID and SwapChainAddress.
+        uint32_t processId = 0;
+        uint64_t address = 0;
+        csv->mFields[conv->mColumnIndex[ProcessID]].ParseUInt32(&processId);
+        csv->mFields[conv->mColumnIndex[SwapChainAddress]].ParseHex(&address);
+        if (swapChains.find(processId)->second.find(address)->second.mThread != threadIndex) {
+            continue;
+        }
+
+        conv->mOpts.mQpcTime = hasQpcTime && rowIndex < noQpcRowIndex;
+
+        PresentEvent p;
+        thread->mStatus = ParsePresent(conv, *csv, &p);
+        if (thread->mStatus != 0) {
+            thread->mErrorLine = csv->mLine;
+            return;
+        }
+
+        auto outputSize = thread->mOutput.mSize;
+        ProcessPresent(conv, p);
+        if (thread->mOutput.mSize != outputSize) {
+            thread->mRowOutput.emplace_back(rowIndex, thread->mOutput.mSize);
+        }
+    }
+
+    if (csv->mError) {
+        PrintError(conv->mInputPath, "failed to read line %llu of the input file.", csv->mLine + 1);
+        thread->mStatus = 5;
+        thread->mErrorLine = csv->mLine + 1;
+    }
+}
+
+int ConvertCsvSplit(Conversion* conv, CsvReader* csv, uint32_t threadCount)
+{
+    auto status = ParseCsvHeader(conv, csv);
+    if (status != 0) {
+        return status;
+    }
+
+    auto const& columnIndex = conv->mColumnIndex;
+    auto hasQpcTime = conv->mOpts.mQpcTime;
+
+    // First pass
+    SplitSwapChains swapChains;
+    std::vector<SplitSegment> segments;
+    uint64_t rowCount = 0;
+    uint64_t noQpcRowIndex = UINT64_MAX;
+    bool foundFirstReport = false;
+    while (csv->ReadRow()) {
+        auto const& row = csv->mFields;
+        if (row.size() < conv->mColumnCount) {
+            PrintError(conv->mInputPath, "line %llu: missing columns.", csv->mLine);
+            return 5;
+        }
+
+        if (rowCount % SPLIT_SEGMENT_ROWS == 0) {
+            segments.push_back({ rowCount, csv->mRowOffset, csv->mLine });
+        }
+
+        uint32_t processId = 0;
+        uint64_t address = 0;
+        if (!row[columnIndex[ProcessID]].ParseUInt32(&processId) ||
+            !row[columnIndex[SwapChainAddress]].ParseHex(&address)) {
+            PrintError(conv->mInputPath, "line %llu: invalid value.", csv->mLine);
+            return 5;
+        }
 
-            PresentEvent p;
-            p.Application                 =             row[columnIndex[Application]];
-            p.ProcessID                   = std::stoul (row[columnIndex[ProcessID]]);
-            p.SwapChainAddress            = std::stoull(row[columnIndex[SwapChainAddress]], nullptr, 16);
-            p.Runtime                     =             row[columnIndex[Runtime]];
-            p.SyncInterval                = std::stol  (row[columnIndex[SyncInterval]]);
-            p.PresentFlags                = std::stoul (row[columnIndex[PresentFlags]]);
-            p.Dropped                     =             row[columnIndex[Dropped]] == L"1";
-            p.TimeInSeconds               = std::stod  (row[columnIndex[TimeInSeconds]]);
-            p.msInPresentAPI              = std::stod  (row[columnIndex[msInPresentAPI]]);
-            if (opts.mTrackDisplay) {
-                p.AllowsTearing           =             row[columnIndex[AllowsTearing]] == L"1";
-                p.PresentMode             =             row[columnIndex[PresentMode]];
-                p.msUntilRenderComplete   = std::stod  (row[columnIndex[msUntilRenderComplete]]);
-                p.msUntilDisplayed        = std::stod  (row[columnIndex[msUntilDisplayed]]);
-                p.msBetweenDisplayChange  = std::stod  (row[columnIndex[msBetweenDisplayChange]]);
+        if (hasQpcTime && noQpcRowIndex == UINT64_MAX) {
+            auto const& qpcTime = row[columnIndex[QPCTime]];
+            if (memchr(qpcTime.mData, '.', qpcTime.mSize) != nullptr) {
+                noQpcRowIndex = rowCount;
             }
-            if (opts.mTrackGPU) {
-                p.msUntilRenderStart      = std::stod  (row[columnIndex[msUntilRenderStart]]);
-                p.msGPUActive             = std::stod  (row[columnIndex[msGPUActive]]);
+        }
+
+        auto ii = swapChains[processId].emplace(address, SplitSwapChain{});
+        auto chain = &ii.first->second;
+        chain->mRowCount += 1;
+
+        // Each swap chain's first report is of its first present: either immediately if it was
+        // dropped, or when the swap chain's next displayed present arrives.
+        if (!foundFirstReport) {
+            auto dropped = row[columnIndex[Dropped]] == "1";
+            if (ii.second) {
+                bool ok = row[columnIndex[TimeInSeconds]].ParseDouble(&chain->mFirstTimeInSeconds);
+                if (hasQpcTime && rowCount < noQpcRowIndex) {
+                    ok = ok && row[columnIndex[QPCTime]].ParseUInt64(&chain->mFirstQPCTime);
+                }
+                if (!ok) {
+                    PrintError(conv->mInputPath, "line %llu: invalid value.", csv->mLine);
+                    return 5;
+                }
             }
-            if (opts.mTrackGPUVideo) {
-                p.msGPUVideoActive        = std::stod  (row[columnIndex[msGPUVideoActive]]);
+            if ((ii.second && dropped) || (!ii.second && !dropped)) {
+                foundFirstReport = true;
+                conv->mFirstReport = false;
+                conv->mT0 = 1000.0 * chain->mFirstTimeInSeconds;
+                conv->mQ0 = chain->mFirstQPCTime;
             }
-            if (opts.mTrackInput) {
-                p.msSinceInput            = std::stod  (row[columnIndex[msSinceInput]]);
+        }
+
+        rowCount += 1;
+    }
+
+    if (csv->mError) {
+        PrintError(conv->mInputPath, "failed to read line %llu of the input file.", csv->mLine + 1);
+        return 5;
+    }
+    if (rowCount == 0) {
+        return 0;
+    }
+
+    // Assign the swap chains to threads, largest first.
+    std::vector<SplitSwapChain*> sortedSwapChains;
+    for (auto& pr : swapChains) {
+        for (auto& pr2 : pr.second) {
+            sortedSwapChains.push_back(&pr2.second);
+        }
+    }
+    std::sort(sortedSwapChains.begin(), sortedSwapChains.end(), [](SplitSwapChain const* a, SplitSwapChain const* b) {
+        return a->mRowCount > b->mRowCount;
+    });
+
+    threadCount = std::min(threadCount, (uint32_t) sortedSwapChains.size());
+    std::vector<uint64_t> threadRowCount(threadCount, 0);
+    for (auto chain : sortedSwapChains) {
+        auto threadIndex = (uint32_t) (std::min_element(threadRowCount.begin(), threadRowCount.end()) - threadRowCount.begin());
+        chain->mThread = threadIndex;
+        threadRowCount[threadIndex] += chain->mRowCount;
+    }
+
+    std::vector<std::unique_ptr<SplitThread> > threads;
+    for (uint32_t i = 0; i < threadCount; ++i) {
+        std::unique_ptr<SplitThread> thread(new SplitThread);
+        auto threadConv = &thread->mConversion;
+        threadConv->mInputPath   = conv->mInputPath;
+        threadConv->mOutput      = &thread->mOutput;
+        thread->mOutput.mIsStdout = conv->mOutput->mIsStdout;
+        threadConv->mOpts        = conv->mOpts;
+        threadConv->mColumnCount = conv->mColumnCount;
+        threadConv->mFirstReport = conv->mFirstReport;
+        threadConv->mT0          = conv->mT0;
+        threadConv->mQ0          = conv->mQ0;
+        memcpy(threadConv->mColumnIndex, conv->mColumnIndex, sizeof(conv->mColumnIndex));
+
+        // Each thread maps its own views of the file, so keep them small.
+        thread->mCsv.mMaxViewSize = 16 * 1024 * 1024;
+        if (!thread->mCsv.Open(conv->mInputPath)) {
+            PrintError(conv->mInputPath, "failed to open input file.");
+            return 2;
+        }
+
+        threads.emplace_back(std::move(thread));
+    }
+
+    auto headerOpts = conv->mOpts;
+    headerOpts.mQpcTime = hasQpcTime && noQpcRowIndex != 0;
+    WriteCsvHeader(conv->mOutput, headerOpts);
+
+    for (size_t s = 0, n = segments.size(); s < n; ++s) {
+        auto rowEnd = s + 1 < n ? segments[s + 1].mRowIndex : rowCount;
+
+        std::vector<std::thread> workers;
+        for (uint32_t i = 1; i < threadCount; ++i) {
+            workers.emplace_back(ConvertSplitSegment, threads[i].get(), i, std::cref(swapChains), std::cref(segments[s]), rowEnd, noQpcRowIndex);
+        }
+        ConvertSplitSegment(threads[0].get(), 0, swapChains, segments[s], rowEnd, noQpcRowIndex);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        // Report the error from the earliest line (later errors may have been caused by it).
+        SplitThread const* failed = nullptr;
+        for (auto const& thread : threads) {
+            if (thread->mStatus != 0 && (failed == nullptr || thread->mErrorLine < failed->mErrorLine)) {
+                failed = thread.get();
             }
+        }
+        if (failed != nullptr) {
+            return failed->mStatus;
+        }
 
-            if (opts.mQpcTime) {
-                auto const& qpcTime = row[columnIndex[QPCTime]];
-                if (qpcTime.find('.') == std::string::npos) {
-                    p.QPCTime = std::stoull(qpcTime);
-                } else {
-                    opts.mQpcTime = false;
+        // Merge the threads' output in row order.
+        std::vector<size_t> next(threadCount, 0);
+        for (;;) {
+            SplitThread* thread = nullptr;
+            size_t* threadNext = nullptr;
+            for (uint32_t i = 0; i < threadCount; ++i) {
+                auto t = threads[i].get();
+                if (next[i] < t->mRowOutput.size() &&
+                    (thread == nullptr || t->mRowOutput[next[i]].first < thread->mRowOutput[*threadNext].first)) {
+                    thread = t;
+                    threadNext = &next[i];
                 }
             }
-
-            if (firstRow) {
-                firstRow = false;
-                WriteCsvHeader(opts);
+            if (thread == nullptr) {
+                break;
             }
 
-            auto chain = &swapChains[p.ProcessID][p.SwapChainAddress];
+            auto begin = *threadNext == 0 ? 0 : thread->mRowOutput[*threadNext - 1].second;
+            auto end = thread->mRowOutput[*threadNext].second;
+            conv->mOutput->Write(thread->mOutput.mBuffer.data() + begin, end - begin);
+            *threadNext += 1;
+        }
 
-            if (p.Dropped) {
-                if (chain->mPendingPresents.empty()) {
-                    ReportMetrics(opts, chain, p, nullptr);
-                } else {
-                    chain->mPendingPresents.push_back(p);
-                }
+        for (auto const& thread : threads) {
+            thread->mOutput.mSize = 0;
+            thread->mRowOutput.clear();
+        }
+
+        ReportProgress(conv, s + 1 < n ? segments[s + 1].mOffset : csv->mFileSize);
+    }
+
+    return 0;
+}
+
+// Convert the file at conv->mInputPath into conv->mOutput.  If splitThreadCount is more than one,
+// a CSV is converted using that many threads.
+int ConvertFile(Conversion* conv, uint32_t splitThreadCount)
+{
+    auto status = 0;
+
+    ColumnarCaptureReader reader;
+    CsvReader csv;
+    if (reader.Open(conv->mInputPath)) {
+        status = ConvertColumnarCapture(conv, &reader);
+        ReportProgress(conv, reader.mFileSize);
+    } else if (csv.Open(conv->mInputPath)) {
+        status = splitThreadCount > 1 && !conv->mFilter.IsSet() ? ConvertCsvSplit(conv, &csv, splitThreadCount)
+                                                                : ConvertCsv(conv, &csv);
+        ReportProgress(conv, csv.mFileSize);
+    } else {
+        PrintError(conv->mInputPath, "failed to open input file.");
+        return 2;
+    }
+
+    conv->mOutput->Flush();
+    if (conv->mOutput->mError) {
+        PrintError(conv->mInputPath, "failed to write the converted CSV.");
+        return status != 0 ? status : 6;
+    }
+
+    return status;
+}
+
+bool EndsWith(std::wstring const& s, wchar_t const* suffix)
+{
+    auto n = wcslen(suffix);
+    return s.size() >= n && _wcsicmp(s.c_str() + s.size() - n, suffix) == 0;
+}
+
+// Add the files specified by a command line input, which is a file, a directory (all of its .csv
+// and .pmcc files), or a wildcard pattern.  Converted files ("*_v2.csv") are skipped, so that a
+// directory can be converted again.
+bool AddInputFiles(wchar_t const* input, std::vector<std::wstring>* paths)
+{
+    auto attributes = GetFileAttributesW(input);
+    auto isPattern = wcspbrk(input, L"*?") != nullptr;
+    auto isDirectory = !isPattern && attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    if (!isPattern && !isDirectory) {
+        paths->emplace_back(input);
+        return true;
+    }
+
+    std::wstring directory(input);
+    std::wstring pattern(input);
+    if (isDirectory) {
+        if (directory.back() != L'\\' && directory.back() != L'/') {
+            directory += L'\\';
+        }
+        pattern = directory + L'*';
+    } else {
+        auto slash = directory.find_last_of(L"\\/");
+        directory.resize(slash == std::wstring::npos ? 0 : slash + 1);
+    }
+
+    WIN32_FIND_DATAW findData = {};
+    auto h = FindFirstFileW(pattern.c_str(), &findData);
+    if (h == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    std::vector<std::wstring> found;
+    do {
+        std::wstring name(findData.cFileName);
+        if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0 ||
+            (isDirectory && !EndsWith(name, L".csv") && !EndsWith(name, L".pmcc")) ||
+            EndsWith(name, L"_v2.csv")) {
+            continue;
+        }
+        found.emplace_back(directory + name);
+    } while (FindNextFileW(h, &findData));
+    FindClose(h);
+
+    std::sort(found.begin(), found.end());
+    paths->insert(paths->end(), found.begin(), found.end());
+    return true;
+}
+
+// "dir\name.csv" is converted into "outputDir\name_v2.csv", or "dir\name_v2.csv" if outputDir is
+// null.
+std::wstring GetOutputPath(std::wstring const& inputPath, wchar_t const* outputDir)
+{
+    auto slash = inputPath.find_last_of(L"\\/");
+    auto nameBegin = slash == std::wstring::npos ? 0 : slash + 1;
+    auto dot = inputPath.find_last_of(L'.');
+    auto nameEnd = dot == std::wstring::npos || dot < nameBegin ? inputPath.size() : dot;
+
+    std::wstring path;
+    if (outputDir == nullptr) {
+        path = inputPath.substr(0, nameBegin);
+    } else {
+        path = outputDir;
+        if (!path.empty() && path.back() != L'\\' && path.back() != L'/') {
+            path += L'\\';
+        }
+    }
+    path += inputPath.substr(nameBegin, nameEnd - nameBegin);
+    path += L"_v2.csv";
+    return path;
+}
+
+// Convert the files on threadCount threads, several files at once or, with --split, one file at a
+// time using all the threads.  Progress is printed until all the files have been converted.
+int ConvertFiles(std::vector<std::wstring> const& inputPaths, wchar_t const* outputDir, uint32_t threadCount, bool split, Filter const& filter)
+{
+    auto fileCount = (uint32_t) inputPaths.size();
+    std::vector<int> fileStatus(fileCount, 0);
+    std::atomic<uint32_t> nextFile(0);
+    Progress progress;
+
+    if (outputDir != nullptr) {
+        CreateDirectoryW(outputDir, nullptr);
+    }
+
+    auto convertFiles = [&]() {
+        for (;;) {
+            auto i = nextFile++;
+            if (i >= fileCount) {
+                break;
+            }
+
+            auto outputPath = GetOutputPath(inputPaths[i], outputDir);
+            Output output;
+            if (_wfopen_s(&output.mFile, outputPath.c_str(), L"wb") != 0) {
+                PrintError(outputPath.c_str(), "failed to create output file.");
+                fileStatus[i] = 2;
             } else {
-                for (auto const& pp : chain->mPendingPresents) {
-                    ReportMetrics(opts, chain, pp, &p);
+                Conversion conv;
+                conv.mInputPath = inputPaths[i].c_str();
+                conv.mOutput = &output;
+                conv.mProgress = &progress;
+                conv.mFilter = filter;
+                fileStatus[i] = ConvertFile(&conv, split ? threadCount : 1);
+                fclose(output.mFile);
+
+                // Don't leave partially converted files behind.
+                if (fileStatus[i] != 0) {
+                    DeleteFileW(outputPath.c_str());
                 }
-                chain->mPendingPresents.clear();
-                chain->mPendingPresents.push_back(p);
             }
+
+            progress.mFilesConverted += 1;
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    auto printProgress = [&]() {
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        auto mb = progress.mBytesConverted / (1024.0 * 1024.0);
+        fprintf(stderr, "%u/%u files converted (%.1lf MB, %.1lf MB/s)\n", progress.mFilesConverted.load(), fileCount,
+                mb, seconds == 0.0 ? 0.0 : mb / seconds);
+    };
+
+    uint32_t reportCount = 0;
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0, n = split ? 1 : std::min(threadCount, fileCount); i < n; ++i) {
+        threads.emplace_back(convertFiles);
+    }
+    while (progress.mFilesConverted < fileCount) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (std::chrono::steady_clock::now() - start >= std::chrono::seconds(1) * (++reportCount)) {
+            printProgress();
         }
     }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    printProgress();
 
-    file.close();
-    return 0;
+    uint32_t failedCount = 0;
+    int status = 0;
+    for (auto s : fileStatus) {
+        if (s != 0) {
+            failedCount += 1;
+            status = status == 0 ? s : status;
+        }
+    }
+    if (failedCount > 0) {
+        fprintf(stderr, "error: failed to convert %u of %u files.\n", failedCount, fileCount);
+    }
+
+    return status;
+}
+
+bool ParseValue(wchar_t const* s, double* value)
+{
+    wchar_t* end = nullptr;
+    *value = wcstod(s, &end);
+    return end != s && *end == L'\0';
+}
+
+bool ParseValue(wchar_t const* s, uint32_t* value)
+{
+    wchar_t* end = nullptr;
+    auto v = wcstoull(s, &end, 10);
+    *value = (uint32_t) v;
+    return end != s && *end == L'\0' && v <= UINT32_MAX;
+}
+
+// Swap chain addresses are hexadecimal, with or without a 0x prefix.
+bool ParseValue(wchar_t const* s, uint64_t* value)
+{
+    wchar_t* end = nullptr;
+    *value = wcstoull(s, &end, 16);
+    return end != s && *end == L'\0';
+}
+
+void usage()
+{
+    fprintf(stderr,
+        "Convert PresentMon v1.x CSV files, or columnar captures (--output_format columnar), into\n"
+        "v2.0 CSV files.\n"
+        "usage: pm_convert_csv.exe [options] path_to_input.csv\n"
+        "       pm_convert_csv.exe [options] path_to_input.pmcc\n"
+        "       pm_convert_csv.exe [options] input...\n"
+        "\n"
+        "A single input file is converted to stdout.  Otherwise, each input can be a file, a directory\n"
+        "(all of its .csv and .pmcc files), or a wildcard pattern, and each file is converted into a\n"
+        "name_v2.csv file next to it (or in --output_dir), converting several files at once.\n"
+        "\n"
+        "options:\n"
+        "    --output_dir path  Write the converted files into this directory.\n"
+        "    --threads count    The number of threads to use (default: the number of processors).\n"
+        "    --split            Convert one file at a time, dividing each CSV between the threads by\n"
+        "                       process and swap chain.\n"
+        "\n"
+        "    --start_time s     Only convert the presents from this time (TimeInSeconds, or CPUStart\n"
+        "    --end_time s       for columnar captures) onwards, or up to this time.\n"
+        "    --process_id id    Only convert the presents of this process.\n"
+        "    --swap_chain addr  Only convert the presents of this swap chain (a hexadecimal address).\n"
+        "\n"
+        "The selected presents are converted as if they were the whole file.  If a CSV has an index\n"
+        "(written by PresentMon --csv_index), only the parts of the CSV that may contain selected\n"
+        "presents are read, and --split is not used.\n");
+}
+
+}
+
+int wmain(
+    int argc,
+    wchar_t** argv)
+{
+    std::vector<wchar_t const*> inputs;
+    wchar_t const* outputDir = nullptr;
+    uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+    bool split = false;
+    Filter filter;
+    for (int i = 1; i < argc; ++i) {
+        if (wcscmp(argv[i], L"--output_dir") == 0 && i + 1 < argc) {
+            outputDir = argv[++i];
+        } else if (wcscmp(argv[i], L"--threads") == 0 && i + 1 < argc) {
+            threadCount = wcstoul(argv[++i], nullptr, 10);
+            if (threadCount == 0) {
+                usage();
+                return 1;
+            }
+        } else if (wcscmp(argv[i], L"--split") == 0) {
+            split = true;
+        } else if (wcscmp(argv[i], L"--start_time") == 0 && i + 1 < argc) {
+            if (!ParseValue(argv[++i], &filter.mStartTime)) {
+                usage();
+                return 1;
+            }
+        } else if (wcscmp(argv[i], L"--end_time") == 0 && i + 1 < argc) {
+            if (!ParseValue(argv[++i], &filter.mEndTime)) {
+                usage();
+                return 1;
+            }
+        } else if (wcscmp(argv[i], L"--process_id") == 0 && i + 1 < argc) {
+            if (!ParseValue(argv[++i], &filter.mProcessId)) {
+                usage();
+                return 1;
+            }
+        } else if (wcscmp(argv[i], L"--swap_chain") == 0 && i + 1 < argc) {
+            if (!ParseValue(argv[++i], &filter.mSwapChainAddress)) {
+                usage();
+                return 1;
+            }
+        } else if (wcsncmp(argv[i], L"--", 2) == 0) {
+            usage();
+            return 1;
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
+
+    if (inputs.empty()) {
+        usage();
+        return 1;
+    }
+
+    std::vector<std::wstring> inputPaths;
+    for (auto input : inputs) {
+        if (!AddInputFiles(input, &inputPaths)) {
+            fprintf(stderr, "error: no files found: %ls\n", input);
+            return 2;
+        }
+    }
+
+    // A single input file is converted to stdout.
+    if (outputDir == nullptr && inputs.size() == 1 && inputPaths.size() == 1 && inputPaths[0] == inputs[0]) {
+        Output output;
+        output.mFile = stdout;
+        output.mIsStdout = true;
+        Progress progress;
+        Conversion conv;
+        conv.mInputPath = inputs[0];
+        conv.mOutput = &output;
+        conv.mProgress = &progress;
+        conv.mFilter = filter;
+        auto status = ConvertFile(&conv, split ? threadCount : 1);
+        if (status == 2) {
+            usage();
+        }
+        return status;
+    }
+
+    if (inputPaths.empty()) {
+        fprintf(stderr, "error: no files found.\n");
+        return 2;
+    }
+
+    return ConvertFiles(inputPaths, outputDir, threadCount, split, filter);
 }
@@ -133,6 +133,9 @@ if %do_build% EQU 0 (
     for %%a in (%build_platforms%) do for %%b in (%build_configs%) do call :build %%a %%b "PresentMon\PresentMon.vcxproj"
     for %%a in (%build_platforms%) do for %%b in (%build_configs%) do call :build %%a %%b "Tests\PresentMonTests.vcxproj"
     for %%a in (%test_platforms%)  do for %%b in (%build_configs%) do call :build %%a %%b "Tools\etw_list\etw_list.sln"
+    rem pm_convert_csv.exe is written to build\<config>\ for any platform, and is used by the tests
+    rem of every platform.
+    for %%b in (%build_configs%) do call :build x64 %%b "Tools\pm_convert_csv\pm_convert_csv.vcxproj"
 )
 
 if %errorcount% neq %prebuild_errorcount% (